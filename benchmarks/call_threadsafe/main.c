@@ -0,0 +1,175 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+/*
+ * Measures async_call_threadsafe() throughput and latency from
+ * enqueue to dispatch with 1, 4 and 16 producer threads.
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include "async.h"
+
+#define NUMBER_OF_CALLS 1000000
+
+static int numbers_of_producers[] = {
+    1, 4, 16
+};
+
+struct run_t {
+    int number_of_producers;
+    int number_of_calls;
+    int number_of_dispatched_calls;
+    unsigned long long *latencies_p;
+    unsigned long long last_ns;
+    sem_t done;
+};
+
+static struct async_t async;
+static struct run_t run;
+
+static unsigned long long now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (1000000000ull * now.tv_sec + now.tv_nsec);
+}
+
+static int compare(const void *left_p, const void *right_p)
+{
+    unsigned long long left;
+    unsigned long long right;
+
+    left = *(const unsigned long long *)left_p;
+    right = *(const unsigned long long *)right_p;
+
+    return ((left > right) - (left < right));
+}
+
+/* Called in the async thread. The argument is the enqueue time. */
+static void on_call(void *obj_p, void *arg_p)
+{
+    (void)obj_p;
+
+    run.last_ns = now_ns();
+    run.latencies_p[run.number_of_dispatched_calls] =
+        (run.last_ns - (unsigned long long)(uintptr_t)arg_p);
+    run.number_of_dispatched_calls++;
+
+    if (run.number_of_dispatched_calls == run.number_of_calls) {
+        sem_post(&run.done);
+    }
+}
+
+static void *producer_main(void *arg_p)
+{
+    int i;
+
+    (void)arg_p;
+
+    for (i = 0; i < run.number_of_calls / run.number_of_producers; i++) {
+        async_call_threadsafe(&async,
+                              on_call,
+                              NULL,
+                              (void *)(uintptr_t)now_ns());
+    }
+
+    return (NULL);
+}
+
+static void benchmark(int number_of_producers)
+{
+    pthread_t producers[16];
+    unsigned long long start;
+    int i;
+
+    run.number_of_producers = number_of_producers;
+    run.number_of_calls = (NUMBER_OF_CALLS / number_of_producers
+                           * number_of_producers);
+    run.number_of_dispatched_calls = 0;
+    start = now_ns();
+
+    for (i = 0; i < number_of_producers; i++) {
+        pthread_create(&producers[i], NULL, producer_main, NULL);
+    }
+
+    for (i = 0; i < number_of_producers; i++) {
+        pthread_join(producers[i], NULL);
+    }
+
+    sem_wait(&run.done);
+    qsort(run.latencies_p,
+          run.number_of_calls,
+          sizeof(run.latencies_p[0]),
+          compare);
+    printf("%12d %12.0f %12llu %12llu\n",
+           number_of_producers,
+           1e9 * run.number_of_calls / (run.last_ns - start),
+           run.latencies_p[run.number_of_calls / 2],
+           run.latencies_p[run.number_of_calls / 100 * 99]);
+}
+
+static void *main_main(void *arg_p)
+{
+    size_t i;
+
+    (void)arg_p;
+
+    printf("   PRODUCERS      CALLS/s    P50/ns       P99/ns\n");
+
+    for (i = 0; i < sizeof(numbers_of_producers) / sizeof(numbers_of_producers[0]); i++) {
+        benchmark(numbers_of_producers[i]);
+    }
+
+    exit(0);
+
+    return (NULL);
+}
+
+int main()
+{
+    pthread_t pthread;
+
+    run.latencies_p = malloc(sizeof(*run.latencies_p) * NUMBER_OF_CALLS);
+
+    if (run.latencies_p == NULL) {
+        return (1);
+    }
+
+    sem_init(&run.done, 0, 0);
+    async_init(&async);
+    async_set_runtime(&async, async_runtime_create());
+    pthread_create(&pthread, NULL, main_main, NULL);
+    async_run_forever(&async);
+
+    return (1);
+}
@@ -0,0 +1,193 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+/*
+ * Measures the cost of suspending and resuming a coroutine, compared
+ * to the plain callbacks it replaces.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "async.h"
+
+#define NUMBER_OF_SUSPENSIONS                   10000000
+
+struct counter_t {
+    struct async_coroutine_t coroutine;
+    struct async_t *async_p;
+    int available;
+    int value;
+};
+
+static unsigned long long now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (1000000000ull * now.tv_sec + now.tv_nsec);
+}
+
+static void print_result(const char *name_p, unsigned long long elapsed_ns)
+{
+    printf("%-20s %8.1f\n",
+           name_p,
+           (double)elapsed_ns / NUMBER_OF_SUSPENSIONS);
+}
+
+static void on_input(struct counter_t *self_p)
+{
+    self_p->available--;
+    self_p->value++;
+}
+
+static void await_main(struct async_coroutine_t *self_p)
+{
+    struct counter_t *counter_p;
+
+    counter_p = self_p->obj_p;
+
+    ASYNC_COROUTINE_BEGIN(self_p);
+
+    while (true) {
+        ASYNC_COROUTINE_AWAIT(self_p, counter_p->available > 0);
+        counter_p->available--;
+        counter_p->value++;
+    }
+
+    ASYNC_COROUTINE_END(self_p);
+}
+
+static void yield_main(struct async_coroutine_t *self_p)
+{
+    struct counter_t *counter_p;
+
+    counter_p = self_p->obj_p;
+
+    ASYNC_COROUTINE_BEGIN(self_p);
+
+    while (counter_p->value < NUMBER_OF_SUSPENSIONS) {
+        counter_p->value++;
+        ASYNC_COROUTINE_YIELD(self_p);
+    }
+
+    ASYNC_COROUTINE_END(self_p);
+}
+
+static void on_call(struct counter_t *self_p, void *arg_p)
+{
+    (void)arg_p;
+
+    self_p->value++;
+
+    if (self_p->value < NUMBER_OF_SUSPENSIONS) {
+        async_call(self_p->async_p, (async_func_t)on_call, self_p, NULL);
+    }
+}
+
+/* Input handled by a callback and by a coroutine waiting for it. The
+   callback is called through a pointer, as runtimes do. */
+static void benchmark_input(struct async_t *async_p)
+{
+    void (*volatile on_input_p)(struct counter_t *self_p) = on_input;
+    struct counter_t counter;
+    unsigned long long start;
+    int i;
+
+    counter.available = 0;
+    counter.value = 0;
+    start = now_ns();
+
+    for (i = 0; i < NUMBER_OF_SUSPENSIONS; i++) {
+        counter.available++;
+        on_input_p(&counter);
+    }
+
+    print_result("input callback", now_ns() - start);
+
+    async_coroutine_init(&counter.coroutine, await_main, &counter, async_p);
+    async_coroutine_start(&counter.coroutine);
+    async_process(async_p);
+    counter.available = 0;
+    counter.value = 0;
+    start = now_ns();
+
+    for (i = 0; i < NUMBER_OF_SUSPENSIONS; i++) {
+        counter.available++;
+        async_coroutine_resume(&counter.coroutine);
+    }
+
+    print_result("input await", now_ns() - start);
+    async_coroutine_stop(&counter.coroutine);
+
+    if (counter.value != NUMBER_OF_SUSPENSIONS) {
+        exit(1);
+    }
+}
+
+/* Calls queued by a callback and by a coroutine yielding. */
+static void benchmark_call(struct async_t *async_p)
+{
+    struct counter_t counter;
+    unsigned long long start;
+
+    counter.async_p = async_p;
+    counter.value = 0;
+    start = now_ns();
+    async_call(async_p, (async_func_t)on_call, &counter, NULL);
+    async_process(async_p);
+    print_result("call callback", now_ns() - start);
+
+    counter.value = 0;
+    async_coroutine_init(&counter.coroutine, yield_main, &counter, async_p);
+    start = now_ns();
+    async_coroutine_start(&counter.coroutine);
+    async_process(async_p);
+    print_result("call yield", now_ns() - start);
+
+    if (!async_coroutine_is_done(&counter.coroutine)) {
+        exit(1);
+    }
+}
+
+int main()
+{
+    struct async_t async;
+
+    async_init(&async);
+    async_set_process_budget(&async, 0, 0);
+
+    printf("SUSPENSION           ns/each\n");
+
+    benchmark_input(&async);
+    benchmark_call(&async);
+
+    async_destroy(&async);
+
+    return (0);
+}
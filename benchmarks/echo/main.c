@@ -0,0 +1,309 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+/*
+ * Measures round trips per second and round trip latency of TCP
+ * clients sending small messages to an echo server, with the
+ * two-threaded, single threaded and io_uring Linux runtimes. The echo
+ * server uses plain blocking sockets, with one thread per client.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "async.h"
+#include "async/runtimes/linux.h"
+
+#define PORT 34567
+#define NUMBER_OF_ROUND_TRIPS 200000
+#define MESSAGE_SIZE 64
+
+struct client_t {
+    struct async_tcp_client_t tcp;
+    int number_of_round_trips;
+    size_t received;
+    unsigned long long sent_ns;
+};
+
+struct runtime_t {
+    const char *name_p;
+    struct async_runtime_t *(*create)(void);
+};
+
+static struct runtime_t runtimes[] = {
+    { "linux", async_runtime_linux_create },
+    { "linux_st", async_runtime_linux_st_create },
+    { "linux_uring", async_runtime_linux_uring_create }
+};
+
+static int numbers_of_clients[] = {
+    1, 16
+};
+
+static struct {
+    int number_of_clients;
+    int number_of_round_trips;
+    unsigned long long *latencies_p;
+    unsigned long long start_ns;
+    const char *runtime_name_p;
+} run;
+
+static unsigned long long now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (1000000000ull * now.tv_sec + now.tv_nsec);
+}
+
+static int compare(const void *left_p, const void *right_p)
+{
+    unsigned long long left;
+    unsigned long long right;
+
+    left = *(const unsigned long long *)left_p;
+    right = *(const unsigned long long *)right_p;
+
+    return ((left > right) - (left < right));
+}
+
+static void *server_client_main(void *arg_p)
+{
+    int sockfd;
+    char buf[MESSAGE_SIZE];
+    ssize_t size;
+
+    sockfd = (int)(uintptr_t)arg_p;
+
+    while (true) {
+        size = read(sockfd, &buf[0], sizeof(buf));
+
+        if (size <= 0) {
+            break;
+        }
+
+        if (write(sockfd, &buf[0], size) != size) {
+            break;
+        }
+    }
+
+    close(sockfd);
+
+    return (NULL);
+}
+
+static void *server_main(void *arg_p)
+{
+    int listener;
+    int sockfd;
+    pthread_t pthread;
+
+    listener = (int)(uintptr_t)arg_p;
+
+    while (true) {
+        sockfd = accept(listener, NULL, NULL);
+
+        if (sockfd == -1) {
+            break;
+        }
+
+        pthread_create(&pthread,
+                       NULL,
+                       server_client_main,
+                       (void *)(uintptr_t)sockfd);
+        pthread_detach(pthread);
+    }
+
+    return (NULL);
+}
+
+static void server_start(void)
+{
+    struct sockaddr_in addr;
+    int listener;
+    int yes;
+    pthread_t pthread;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    inet_aton("127.0.0.1", &addr.sin_addr);
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("bind");
+        exit(1);
+    }
+
+    listen(listener, 64);
+    pthread_create(&pthread, NULL, server_main, (void *)(uintptr_t)listener);
+}
+
+static void client_send(struct client_t *self_p)
+{
+    char buf[MESSAGE_SIZE];
+
+    memset(&buf[0], 'a', sizeof(buf));
+    self_p->received = 0;
+    self_p->sent_ns = now_ns();
+    async_tcp_client_write(&self_p->tcp, &buf[0], sizeof(buf));
+}
+
+static void on_connected(struct async_tcp_client_t *tcp_p, int res)
+{
+    if (res != 0) {
+        printf("Connect failed.\n");
+        exit(1);
+    }
+
+    client_send(async_container_of(tcp_p, struct client_t, tcp));
+}
+
+static void report(void)
+{
+    unsigned long long elapsed_ns;
+
+    elapsed_ns = (now_ns() - run.start_ns);
+    qsort(run.latencies_p,
+          run.number_of_round_trips,
+          sizeof(run.latencies_p[0]),
+          compare);
+    printf("%11s %12d %14.0f %12llu %12llu\n",
+           run.runtime_name_p,
+           run.number_of_clients,
+           1e9 * run.number_of_round_trips / elapsed_ns,
+           run.latencies_p[run.number_of_round_trips / 2],
+           run.latencies_p[run.number_of_round_trips / 100 * 99]);
+    exit(0);
+}
+
+static void on_input(struct async_tcp_client_t *tcp_p)
+{
+    struct client_t *self_p;
+    const uint8_t *buf_p;
+    size_t size;
+
+    self_p = async_container_of(tcp_p, struct client_t, tcp);
+
+    do {
+        size = async_tcp_client_borrow(tcp_p, &buf_p);
+        async_tcp_client_release(tcp_p, size);
+        self_p->received += size;
+    } while (size > 0);
+
+    if (self_p->received < MESSAGE_SIZE) {
+        return;
+    }
+
+    run.latencies_p[run.number_of_round_trips] = (now_ns() - self_p->sent_ns);
+    run.number_of_round_trips++;
+    self_p->number_of_round_trips--;
+
+    if (run.number_of_round_trips == NUMBER_OF_ROUND_TRIPS) {
+        report();
+    } else if (self_p->number_of_round_trips > 0) {
+        client_send(self_p);
+    }
+}
+
+static void benchmark(struct runtime_t *runtime_p, int number_of_clients)
+{
+    struct async_t async;
+    struct async_runtime_t *runtime_impl_p;
+    struct client_t *clients_p;
+    int i;
+
+    clients_p = malloc(sizeof(*clients_p) * number_of_clients);
+    run.latencies_p = malloc(sizeof(*run.latencies_p) * NUMBER_OF_ROUND_TRIPS);
+
+    if ((clients_p == NULL) || (run.latencies_p == NULL)) {
+        exit(1);
+    }
+
+    run.runtime_name_p = runtime_p->name_p;
+    run.number_of_clients = number_of_clients;
+    run.number_of_round_trips = 0;
+    async_init(&async);
+    runtime_impl_p = runtime_p->create();
+
+    if (runtime_impl_p == NULL) {
+        printf("%11s not available\n", runtime_p->name_p);
+        exit(0);
+    }
+
+    async_set_runtime(&async, runtime_impl_p);
+
+    for (i = 0; i < number_of_clients; i++) {
+        clients_p[i].number_of_round_trips =
+            (NUMBER_OF_ROUND_TRIPS / number_of_clients);
+        async_tcp_client_init(&clients_p[i].tcp,
+                              on_connected,
+                              NULL,
+                              on_input,
+                              &async);
+        async_tcp_client_connect(&clients_p[i].tcp, "127.0.0.1", PORT);
+    }
+
+    run.start_ns = now_ns();
+    async_run_forever(&async);
+}
+
+int main()
+{
+    size_t i;
+    size_t j;
+    pid_t pid;
+
+    server_start();
+    printf("    RUNTIME      CLIENTS  ROUND-TRIPS/s       P50/ns       P99/ns\n");
+    fflush(stdout);
+
+    /* Each benchmark runs in its own process, as async_run_forever()
+       never returns. */
+    for (i = 0; i < sizeof(runtimes) / sizeof(runtimes[0]); i++) {
+        for (j = 0; j < sizeof(numbers_of_clients) / sizeof(numbers_of_clients[0]); j++) {
+            pid = fork();
+
+            if (pid == 0) {
+                benchmark(&runtimes[i], numbers_of_clients[j]);
+            }
+
+            waitpid(pid, NULL, 0);
+        }
+    }
+
+    return (0);
+}
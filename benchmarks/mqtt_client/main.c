@@ -0,0 +1,317 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+/*
+ * Measures the number of received MQTT messages per second. A broker
+ * stand-in in a thread with a blocking socket sends batches of
+ * PUBLISH packets, each batch requested by the client with a PUBLISH
+ * to the broker, with two batches in flight.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "async.h"
+
+#define PORT 34568
+#define NUMBER_OF_MESSAGES 1000000
+#define BATCH_SIZE 1000
+
+static size_t message_sizes[] = {
+    16, 256
+};
+
+static struct {
+    struct async_mqtt_client_t client;
+    int index;
+    int number_of_requested;
+    int number_of_received;
+    unsigned long long start_ns;
+} run;
+
+static unsigned long long now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (1000000000ull * now.tv_sec + now.tv_nsec);
+}
+
+static void read_exactly(int sockfd, uint8_t *buf_p, size_t size)
+{
+    ssize_t res;
+
+    while (size > 0) {
+        res = read(sockfd, buf_p, size);
+
+        if (res <= 0) {
+            exit(1);
+        }
+
+        buf_p += res;
+        size -= res;
+    }
+}
+
+static void write_all(int sockfd, const uint8_t *buf_p, size_t size)
+{
+    ssize_t res;
+
+    while (size > 0) {
+        res = write(sockfd, buf_p, size);
+
+        if (res <= 0) {
+            exit(1);
+        }
+
+        buf_p += res;
+        size -= res;
+    }
+}
+
+/* Returns the packet type and reads the packet into given buffer. */
+static int read_packet(int sockfd, uint8_t *buf_p, size_t *size_p)
+{
+    uint8_t header[2];
+
+    /* Only single byte remaining lengths are sent by the client. */
+    read_exactly(sockfd, &header[0], sizeof(header));
+
+    if (header[1] & 0x80) {
+        exit(1);
+    }
+
+    read_exactly(sockfd, buf_p, header[1]);
+    *size_p = header[1];
+
+    return (header[0] >> 4);
+}
+
+static size_t create_batch(uint8_t *buf_p, size_t message_size)
+{
+    size_t offset;
+    size_t size;
+    int i;
+
+    offset = 0;
+    size = (2 + 5 + 1 + message_size);
+
+    for (i = 0; i < BATCH_SIZE; i++) {
+        buf_p[offset++] = 0x30;
+
+        if (size < 128) {
+            buf_p[offset++] = size;
+        } else {
+            buf_p[offset++] = (0x80 | (size & 0x7f));
+            buf_p[offset++] = (size >> 7);
+        }
+
+        buf_p[offset++] = 0;
+        buf_p[offset++] = 5;
+        memcpy(&buf_p[offset], "bench", 5);
+        offset += 5;
+        buf_p[offset++] = 0;
+        memset(&buf_p[offset], 0x55, message_size);
+        offset += message_size;
+    }
+
+    return (offset);
+}
+
+static void *broker_main(int *listener_p)
+{
+    static uint8_t batch[BATCH_SIZE * 300];
+    uint8_t connack[] = { 0x20, 0x03, 0x00, 0x00, 0x00 };
+    uint8_t buf[128];
+    size_t size;
+    size_t batch_size;
+    size_t message_size;
+    size_t requested_size;
+    int sockfd;
+
+    sockfd = accept(*listener_p, NULL, NULL);
+
+    if (sockfd == -1) {
+        exit(1);
+    }
+
+    batch_size = 0;
+    message_size = 0;
+
+    while (true) {
+        switch (read_packet(sockfd, &buf[0], &size)) {
+
+        case 1:
+            write_all(sockfd, &connack[0], sizeof(connack));
+            break;
+
+        case 3:
+            /* Topic "more", no properties and the message size. */
+            if (size != 9) {
+                exit(1);
+            }
+
+            requested_size = ((buf[7] << 8) | buf[8]);
+
+            if (requested_size != message_size) {
+                message_size = requested_size;
+                batch_size = create_batch(&batch[0], message_size);
+            }
+
+            write_all(sockfd, &batch[0], batch_size);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return (NULL);
+}
+
+static void request_batch(void)
+{
+    uint8_t message_size[2];
+
+    message_size[0] = (message_sizes[run.index] >> 8);
+    message_size[1] = message_sizes[run.index];
+    async_mqtt_client_publish(&run.client,
+                              "more",
+                              &message_size[0],
+                              sizeof(message_size));
+    run.number_of_requested += BATCH_SIZE;
+}
+
+static void start_run(void)
+{
+    run.number_of_requested = 0;
+    run.number_of_received = 0;
+    run.start_ns = now_ns();
+    request_batch();
+    request_batch();
+}
+
+static void on_connected(void *obj_p)
+{
+    (void)obj_p;
+
+    start_run();
+}
+
+static void on_disconnected(void *obj_p)
+{
+    (void)obj_p;
+
+    exit(1);
+}
+
+static void on_publish(void *obj_p,
+                       const char *topic_p,
+                       const uint8_t *buf_p,
+                       size_t size)
+{
+    double elapsed;
+
+    (void)obj_p;
+    (void)topic_p;
+    (void)buf_p;
+
+    if (size != message_sizes[run.index]) {
+        exit(1);
+    }
+
+    run.number_of_received++;
+
+    if (run.number_of_received == NUMBER_OF_MESSAGES) {
+        elapsed = ((double)(now_ns() - run.start_ns) / 1000000000.0);
+        printf("%8u %13.0f\n",
+               (unsigned int)size,
+               NUMBER_OF_MESSAGES / elapsed);
+        run.index++;
+
+        if (run.index == (sizeof(message_sizes) / sizeof(message_sizes[0]))) {
+            exit(0);
+        }
+
+        start_run();
+    } else if (((run.number_of_received % BATCH_SIZE) == 0)
+               && (run.number_of_requested < NUMBER_OF_MESSAGES)) {
+        request_batch();
+    }
+}
+
+int main()
+{
+    struct async_t async;
+    struct sockaddr_in addr;
+    pthread_t pthread;
+    int listener;
+    int yes;
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        return (1);
+    }
+
+    if (listen(listener, 1) != 0) {
+        return (1);
+    }
+
+    pthread_create(&pthread, NULL, (void *(*)(void *))broker_main, &listener);
+
+    printf(" PAYLOAD    MESSAGES/s\n");
+
+    async_init(&async);
+    async_set_runtime(&async, async_runtime_create());
+    async_mqtt_client_init(&run.client,
+                           "127.0.0.1",
+                           PORT,
+                           NULL,
+                           on_connected,
+                           on_disconnected,
+                           on_publish,
+                           NULL,
+                           &async);
+    run.index = 0;
+    async_mqtt_client_start(&run.client);
+    async_run_forever(&async);
+
+    return (0);
+}
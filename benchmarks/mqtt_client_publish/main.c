@@ -0,0 +1,413 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+/*
+ * Measures the number of published MQTT messages per second with
+ * QoS 0, 1 and 2. A broker stand-in in a thread with a blocking
+ * socket acknowledges QoS 1 and QoS 2 messages, and batches of QoS 0
+ * messages, so that QoS 0 messages are also flow controlled. The
+ * broker stand-in allows topic aliases, so the topic is only sent in
+ * the first message, and the number of sent bytes per message is
+ * calculated from the client statistics.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "async.h"
+
+#define PORT 34569
+#define NUMBER_OF_MESSAGES 1000000
+#define BATCH_SIZE 10000
+#define IN_FLIGHT_MAX 1000
+#define TOPIC "site/123/device/456/sensor/temp"
+
+static struct {
+    struct async_mqtt_client_t client;
+    int qos;
+    int number_of_published;
+    int number_of_completed;
+    unsigned long long start_ns;
+    uint64_t start_bytes;
+} run;
+
+static struct async_mqtt_client_in_flight_message_t in_flight[IN_FLIGHT_MAX];
+static uint8_t message[16];
+
+static unsigned long long now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (1000000000ull * now.tv_sec + now.tv_nsec);
+}
+
+static void write_all(int sockfd, const uint8_t *buf_p, size_t size)
+{
+    ssize_t res;
+
+    while (size > 0) {
+        res = write(sockfd, buf_p, size);
+
+        if (res <= 0) {
+            exit(1);
+        }
+
+        buf_p += res;
+        size -= res;
+    }
+}
+
+static size_t pack_ack(uint8_t *buf_p, int type, const uint8_t *id_p)
+{
+    buf_p[0] = (type << 4);
+
+    if (type == 6) {
+        buf_p[0] |= 0x02;
+    }
+
+    buf_p[1] = 2;
+    buf_p[2] = id_p[0];
+    buf_p[3] = id_p[1];
+
+    return (4);
+}
+
+/* Handle given packet and returns the size of the response. */
+static size_t handle_packet(int type,
+                            int flags,
+                            const uint8_t *buf_p,
+                            uint8_t *response_p,
+                            int *number_of_qos_0_p)
+{
+    uint8_t batch_ack[] = { 0x30, 0x06, 0x00, 0x03, 'a', 'c', 'k', 0x00 };
+    size_t topic_size;
+
+    switch (type) {
+
+    case 1:
+        /* Topic Alias Maximum 16. */
+        response_p[0] = 0x20;
+        response_p[1] = 0x06;
+        response_p[2] = 0x00;
+        response_p[3] = 0x00;
+        response_p[4] = 0x03;
+        response_p[5] = 0x22;
+        response_p[6] = 0x00;
+        response_p[7] = 0x10;
+
+        return (8);
+
+    case 3:
+        topic_size = ((buf_p[0] << 8) | buf_p[1]);
+
+        switch ((flags >> 1) & 3) {
+
+        case 0:
+            (*number_of_qos_0_p)++;
+
+            if (*number_of_qos_0_p == BATCH_SIZE) {
+                *number_of_qos_0_p = 0;
+                memcpy(response_p, &batch_ack[0], sizeof(batch_ack));
+
+                return (sizeof(batch_ack));
+            }
+
+            break;
+
+        case 1:
+            return (pack_ack(response_p, 4, &buf_p[2 + topic_size]));
+
+        case 2:
+            return (pack_ack(response_p, 5, &buf_p[2 + topic_size]));
+
+        default:
+            exit(1);
+        }
+
+        break;
+
+    case 6:
+        return (pack_ack(response_p, 7, buf_p));
+
+    default:
+        break;
+    }
+
+    return (0);
+}
+
+/* Reads packets and writes all responses to them at once. */
+static void *broker_main(int *listener_p)
+{
+    static uint8_t buf[65536];
+    static uint8_t responses[65536];
+    size_t size;
+    size_t offset;
+    size_t packet_size;
+    size_t responses_size;
+    ssize_t res;
+    int header_size;
+    int number_of_qos_0;
+    int sockfd;
+
+    sockfd = accept(*listener_p, NULL, NULL);
+
+    if (sockfd == -1) {
+        exit(1);
+    }
+
+    size = 0;
+    number_of_qos_0 = 0;
+
+    while (true) {
+        res = read(sockfd, &buf[size], sizeof(buf) - size);
+
+        if (res <= 0) {
+            exit(1);
+        }
+
+        size += res;
+        offset = 0;
+        responses_size = 0;
+
+        /* Only remaining lengths of one or two bytes are sent by the
+           client. */
+        while (size - offset >= 2) {
+            if (buf[offset + 1] & 0x80) {
+                if (size - offset < 3) {
+                    break;
+                }
+
+                header_size = 3;
+                packet_size = ((buf[offset + 1] & 0x7f)
+                               | (buf[offset + 2] << 7));
+            } else {
+                header_size = 2;
+                packet_size = buf[offset + 1];
+            }
+
+            if (size - offset < header_size + packet_size) {
+                break;
+            }
+
+            responses_size += handle_packet(buf[offset] >> 4,
+                                            buf[offset] & 0xf,
+                                            &buf[offset + header_size],
+                                            &responses[responses_size],
+                                            &number_of_qos_0);
+            offset += (header_size + packet_size);
+
+            if (responses_size > sizeof(responses) - 16) {
+                write_all(sockfd, &responses[0], responses_size);
+                responses_size = 0;
+            }
+        }
+
+        write_all(sockfd, &responses[0], responses_size);
+        size -= offset;
+        memmove(&buf[0], &buf[offset], size);
+    }
+
+    return (NULL);
+}
+
+static void publish_batch(void)
+{
+    int i;
+
+    for (i = 0; i < BATCH_SIZE; i++) {
+        async_mqtt_client_publish(&run.client,
+                                  TOPIC,
+                                  &message[0],
+                                  sizeof(message));
+    }
+
+    run.number_of_published += BATCH_SIZE;
+}
+
+/* Publish QoS 1 or 2 messages until the in-flight window is full. */
+static void publish_window(void)
+{
+    while (run.number_of_published < NUMBER_OF_MESSAGES) {
+        if (async_mqtt_client_publish_with_qos(&run.client,
+                                               TOPIC,
+                                               &message[0],
+                                               sizeof(message),
+                                               run.qos) < 0) {
+            break;
+        }
+
+        run.number_of_published++;
+    }
+}
+
+static uint64_t sent_bytes(void)
+{
+    struct async_mqtt_client_statistics_t statistics;
+
+    async_mqtt_client_get_statistics(&run.client, &statistics);
+
+    return (statistics.sent.bytes);
+}
+
+static void start_run(void)
+{
+    run.start_bytes = sent_bytes();
+    run.number_of_published = 0;
+    run.number_of_completed = 0;
+    run.start_ns = now_ns();
+
+    if (run.qos == 0) {
+        publish_batch();
+        publish_batch();
+    } else {
+        publish_window();
+    }
+}
+
+static void on_completed(int number_of_completed)
+{
+    double elapsed;
+
+    run.number_of_completed += number_of_completed;
+
+    if (run.number_of_completed < NUMBER_OF_MESSAGES) {
+        return;
+    }
+
+    elapsed = ((double)(now_ns() - run.start_ns) / 1000000000.0);
+    printf("%4d %13.0f %14.1f\n",
+           run.qos,
+           NUMBER_OF_MESSAGES / elapsed,
+           (double)(sent_bytes() - run.start_bytes) / NUMBER_OF_MESSAGES);
+    run.qos++;
+
+    if (run.qos == 3) {
+        exit(0);
+    }
+
+    start_run();
+}
+
+static void on_connected(void *obj_p)
+{
+    (void)obj_p;
+
+    start_run();
+}
+
+static void on_disconnected(void *obj_p)
+{
+    (void)obj_p;
+
+    exit(1);
+}
+
+/* A QoS 0 batch was received by the broker. */
+static void on_publish(void *obj_p,
+                       const char *topic_p,
+                       const uint8_t *buf_p,
+                       size_t size)
+{
+    (void)obj_p;
+    (void)topic_p;
+    (void)buf_p;
+    (void)size;
+
+    if (run.number_of_published < NUMBER_OF_MESSAGES) {
+        publish_batch();
+    }
+
+    on_completed(BATCH_SIZE);
+}
+
+static void on_publish_complete(void *obj_p, uint16_t packet_identifier)
+{
+    (void)obj_p;
+    (void)packet_identifier;
+
+    publish_window();
+    on_completed(1);
+}
+
+int main()
+{
+    struct async_t async;
+    struct sockaddr_in addr;
+    pthread_t pthread;
+    int listener;
+    int yes;
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        return (1);
+    }
+
+    if (listen(listener, 1) != 0) {
+        return (1);
+    }
+
+    pthread_create(&pthread, NULL, (void *(*)(void *))broker_main, &listener);
+
+    printf(" QOS    MESSAGES/s  BYTES/MESSAGE\n");
+
+    async_init(&async);
+    async_set_runtime(&async, async_runtime_create());
+    async_mqtt_client_init(&run.client,
+                           "127.0.0.1",
+                           PORT,
+                           NULL,
+                           on_connected,
+                           on_disconnected,
+                           on_publish,
+                           NULL,
+                           &async);
+    async_mqtt_client_set_on_publish_complete(&run.client,
+                                              on_publish_complete);
+    async_mqtt_client_set_in_flight_buffer(&run.client,
+                                           &in_flight[0],
+                                           IN_FLIGHT_MAX);
+    run.qos = 0;
+    async_mqtt_client_start(&run.client);
+    async_run_forever(&async);
+
+    return (0);
+}
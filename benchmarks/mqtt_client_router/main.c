@@ -0,0 +1,370 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+/*
+ * Measures the number of received MQTT messages per second dispatched
+ * to handlers of 10, 1000 and 10000 subscribed topic filters. A
+ * broker stand-in in a thread with a blocking socket sends batches of
+ * PUBLISH packets with topics matching the filters, each batch
+ * requested by the client with a PUBLISH to the broker, with two
+ * batches in flight.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "async.h"
+
+#define PORT 34570
+#define NUMBER_OF_MESSAGES 1000000
+#define BATCH_SIZE 1000
+#define FILTERS_MAX 10000
+#define MESSAGE_SIZE 16
+
+static int numbers_of_filters[] = {
+    10, 1000, FILTERS_MAX
+};
+
+static struct {
+    struct async_mqtt_client_t client;
+    struct async_mqtt_client_router_level_t levels[4 * FILTERS_MAX];
+    char filters[FILTERS_MAX][32];
+    int number_of_filters;
+    int index;
+    int number_of_requested;
+    int number_of_received;
+    unsigned long long start_ns;
+} run;
+
+static unsigned long long now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (1000000000ull * now.tv_sec + now.tv_nsec);
+}
+
+static void read_exactly(int sockfd, uint8_t *buf_p, size_t size)
+{
+    ssize_t res;
+
+    while (size > 0) {
+        res = read(sockfd, buf_p, size);
+
+        if (res <= 0) {
+            exit(1);
+        }
+
+        buf_p += res;
+        size -= res;
+    }
+}
+
+static void write_all(int sockfd, const uint8_t *buf_p, size_t size)
+{
+    ssize_t res;
+
+    while (size > 0) {
+        res = write(sockfd, buf_p, size);
+
+        if (res <= 0) {
+            exit(1);
+        }
+
+        buf_p += res;
+        size -= res;
+    }
+}
+
+/* Returns the packet type and reads the packet into given buffer. */
+static int read_packet(int sockfd, uint8_t *buf_p, size_t *size_p)
+{
+    uint8_t header[2];
+
+    /* Only single byte remaining lengths are sent by the client. */
+    read_exactly(sockfd, &header[0], sizeof(header));
+
+    if (header[1] & 0x80) {
+        exit(1);
+    }
+
+    read_exactly(sockfd, buf_p, header[1]);
+    *size_p = header[1];
+
+    return (header[0] >> 4);
+}
+
+static void format_topic(char *topic_p, int number)
+{
+    sprintf(topic_p, "sensors/%d/temperature", number);
+}
+
+/* Topics of consecutive messages are spread over all filters. */
+static size_t create_batch(uint8_t *buf_p, int number_of_filters)
+{
+    char topic[32];
+    size_t offset;
+    size_t topic_size;
+    int i;
+
+    offset = 0;
+
+    for (i = 0; i < BATCH_SIZE; i++) {
+        format_topic(&topic[0], (i * 7919) % number_of_filters);
+        topic_size = strlen(&topic[0]);
+        buf_p[offset++] = 0x30;
+        buf_p[offset++] = (2 + topic_size + 1 + MESSAGE_SIZE);
+        buf_p[offset++] = 0;
+        buf_p[offset++] = topic_size;
+        memcpy(&buf_p[offset], &topic[0], topic_size);
+        offset += topic_size;
+        buf_p[offset++] = 0;
+        memset(&buf_p[offset], 0x55, MESSAGE_SIZE);
+        offset += MESSAGE_SIZE;
+    }
+
+    return (offset);
+}
+
+static void *broker_main(int *listener_p)
+{
+    static uint8_t batch[BATCH_SIZE * 64];
+    uint8_t connack[] = { 0x20, 0x03, 0x00, 0x00, 0x00 };
+    uint8_t buf[128];
+    size_t size;
+    size_t batch_size;
+    int number_of_filters;
+    int requested_number_of_filters;
+    int sockfd;
+
+    sockfd = accept(*listener_p, NULL, NULL);
+
+    if (sockfd == -1) {
+        exit(1);
+    }
+
+    batch_size = 0;
+    number_of_filters = 0;
+
+    while (true) {
+        switch (read_packet(sockfd, &buf[0], &size)) {
+
+        case 1:
+            write_all(sockfd, &connack[0], sizeof(connack));
+            break;
+
+        case 3:
+            /* Topic "more", no properties and the number of filters. */
+            if (size != 9) {
+                exit(1);
+            }
+
+            requested_number_of_filters = ((buf[7] << 8) | buf[8]);
+
+            if (requested_number_of_filters != number_of_filters) {
+                number_of_filters = requested_number_of_filters;
+                batch_size = create_batch(&batch[0], number_of_filters);
+            }
+
+            write_all(sockfd, &batch[0], batch_size);
+            break;
+
+        default:
+            /* Subscriptions are not acknowledged. */
+            break;
+        }
+    }
+
+    return (NULL);
+}
+
+static void request_batch(void)
+{
+    uint8_t number_of_filters[2];
+
+    number_of_filters[0] = (run.number_of_filters >> 8);
+    number_of_filters[1] = run.number_of_filters;
+    async_mqtt_client_publish(&run.client,
+                              "more",
+                              &number_of_filters[0],
+                              sizeof(number_of_filters));
+    run.number_of_requested += BATCH_SIZE;
+}
+
+static void on_publish_filter(void *obj_p,
+                              const char *topic_p,
+                              const uint8_t *buf_p,
+                              size_t size);
+
+/* Subscribe to more filters and start the next run. */
+static void start_run(void)
+{
+    int number_of_filters;
+
+    number_of_filters = numbers_of_filters[run.index];
+
+    while (run.number_of_filters < number_of_filters) {
+        format_topic(&run.filters[run.number_of_filters][0],
+                     run.number_of_filters);
+
+        if (async_mqtt_client_subscribe_with_handler(
+                &run.client,
+                &run.filters[run.number_of_filters][0],
+                on_publish_filter,
+                NULL) < 0) {
+            exit(1);
+        }
+
+        run.number_of_filters++;
+    }
+
+    run.number_of_requested = 0;
+    run.number_of_received = 0;
+    run.start_ns = now_ns();
+    request_batch();
+    request_batch();
+}
+
+static void on_connected(void *obj_p)
+{
+    (void)obj_p;
+
+    start_run();
+}
+
+static void on_disconnected(void *obj_p)
+{
+    (void)obj_p;
+
+    exit(1);
+}
+
+static void on_publish(void *obj_p,
+                       const char *topic_p,
+                       const uint8_t *buf_p,
+                       size_t size)
+{
+    (void)obj_p;
+    (void)topic_p;
+    (void)buf_p;
+    (void)size;
+
+    /* All messages are expected to match a filter. */
+    exit(1);
+}
+
+static void on_publish_filter(void *obj_p,
+                              const char *topic_p,
+                              const uint8_t *buf_p,
+                              size_t size)
+{
+    double elapsed;
+
+    (void)obj_p;
+    (void)topic_p;
+    (void)buf_p;
+
+    if (size != MESSAGE_SIZE) {
+        exit(1);
+    }
+
+    run.number_of_received++;
+
+    if (run.number_of_received == NUMBER_OF_MESSAGES) {
+        elapsed = ((double)(now_ns() - run.start_ns) / 1000000000.0);
+        printf("%8d %13.0f\n",
+               run.number_of_filters,
+               NUMBER_OF_MESSAGES / elapsed);
+        run.index++;
+
+        if (run.index == (sizeof(numbers_of_filters)
+                          / sizeof(numbers_of_filters[0]))) {
+            exit(0);
+        }
+
+        start_run();
+    } else if (((run.number_of_received % BATCH_SIZE) == 0)
+               && (run.number_of_requested < NUMBER_OF_MESSAGES)) {
+        request_batch();
+    }
+}
+
+int main()
+{
+    struct async_t async;
+    struct sockaddr_in addr;
+    pthread_t pthread;
+    int listener;
+    int yes;
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        return (1);
+    }
+
+    if (listen(listener, 1) != 0) {
+        return (1);
+    }
+
+    pthread_create(&pthread, NULL, (void *(*)(void *))broker_main, &listener);
+
+    printf(" FILTERS    MESSAGES/s\n");
+
+    async_init(&async);
+    async_set_runtime(&async, async_runtime_create());
+    async_mqtt_client_init(&run.client,
+                           "127.0.0.1",
+                           PORT,
+                           NULL,
+                           on_connected,
+                           on_disconnected,
+                           on_publish,
+                           NULL,
+                           &async);
+    async_mqtt_client_set_router_buffer(&run.client,
+                                        &run.levels[0],
+                                        4 * FILTERS_MAX);
+    run.index = 0;
+    run.number_of_filters = 0;
+    async_mqtt_client_start(&run.client);
+    async_run_forever(&async);
+
+    return (0);
+}
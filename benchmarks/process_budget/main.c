@@ -0,0 +1,239 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+/*
+ * Measures periodic timer jitter while the async loop is flooded with
+ * callbacks that queue themselves, with different async_process()
+ * budgets.
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include "async.h"
+
+/* Timer period in milliseconds. */
+#define PERIOD_MS 10
+
+#define NUMBER_OF_EXPIRIES 200
+
+/* Number of callbacks queueing themselves. */
+#define NUMBER_OF_FLOODS 16
+
+/* Number of iterations of busy work per callback, roughly a
+   microsecond. */
+#define FLOOD_ITERATIONS 200
+
+struct budget_t {
+    int max_calls;
+    int max_time_in_us;
+};
+
+static struct budget_t budgets[] = {
+    { 16384, 0 },
+    { 1024, 0 },
+    { 64, 0 },
+    { 0, 1000 },
+    { 0, 100 }
+};
+
+struct run_t {
+    struct async_t *async_p;
+    struct async_timer_t timer;
+    bool done;
+    int number_of_expiries;
+    unsigned long long number_of_calls;
+    unsigned long long last_ns;
+    unsigned long long jitters[NUMBER_OF_EXPIRIES];
+    unsigned long long value;
+};
+
+static sem_t done;
+
+static unsigned long long now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (1000000000ull * now.tv_sec + now.tv_nsec);
+}
+
+static int compare(const void *left_p, const void *right_p)
+{
+    unsigned long long left;
+    unsigned long long right;
+
+    left = *(const unsigned long long *)left_p;
+    right = *(const unsigned long long *)right_p;
+
+    return ((left > right) - (left < right));
+}
+
+static void flood(void *obj_p, void *arg_p)
+{
+    struct run_t *run_p;
+    int i;
+
+    (void)arg_p;
+
+    run_p = obj_p;
+
+    if (run_p->done) {
+        return;
+    }
+
+    for (i = 0; i < FLOOD_ITERATIONS; i++) {
+        run_p->value ^= (run_p->value << 13);
+        run_p->value ^= (run_p->value >> 7);
+        run_p->value ^= (run_p->value << 17);
+    }
+
+    run_p->number_of_calls++;
+    async_call(run_p->async_p, flood, run_p, NULL);
+}
+
+static void on_timeout(void *obj_p)
+{
+    struct run_t *self_p;
+    unsigned long long now;
+    unsigned long long interval;
+    unsigned long long period;
+
+    self_p = obj_p;
+    now = now_ns();
+
+    if (self_p->last_ns != 0) {
+        interval = (now - self_p->last_ns);
+        period = (1000000ull * PERIOD_MS);
+
+        if (interval > period) {
+            self_p->jitters[self_p->number_of_expiries] = (interval - period);
+        } else {
+            self_p->jitters[self_p->number_of_expiries] = (period - interval);
+        }
+
+        self_p->number_of_expiries++;
+    }
+
+    self_p->last_ns = now;
+
+    if (self_p->number_of_expiries == NUMBER_OF_EXPIRIES) {
+        self_p->done = true;
+        async_timer_stop(&self_p->timer);
+        sem_post(&done);
+    }
+}
+
+static void start(void *obj_p, void *arg_p)
+{
+    struct run_t *run_p;
+    int i;
+
+    (void)arg_p;
+
+    run_p = obj_p;
+    async_timer_start(&run_p->timer);
+
+    for (i = 0; i < NUMBER_OF_FLOODS; i++) {
+        async_call(run_p->async_p, flood, run_p, NULL);
+    }
+}
+
+static void *async_main(void *arg_p)
+{
+    async_run_forever(arg_p);
+
+    return (NULL);
+}
+
+/* A new async object and runtime per run. The previous ones are left
+   idle. */
+static void benchmark(struct budget_t *budget_p)
+{
+    struct run_t *run_p;
+    pthread_t pthread;
+    unsigned long long start_ns;
+
+    run_p = calloc(1, sizeof(*run_p));
+
+    if (run_p == NULL) {
+        exit(1);
+    }
+
+    run_p->value = 1;
+    run_p->async_p = malloc(sizeof(*run_p->async_p));
+
+    if (run_p->async_p == NULL) {
+        exit(1);
+    }
+
+    async_init(run_p->async_p);
+    async_set_runtime(run_p->async_p, async_runtime_create());
+    async_set_tick_in_ms(run_p->async_p, 1);
+    async_set_process_budget(run_p->async_p,
+                             budget_p->max_calls,
+                             budget_p->max_time_in_us);
+    async_timer_init(&run_p->timer,
+                     on_timeout,
+                     run_p,
+                     PERIOD_MS,
+                     PERIOD_MS,
+                     run_p->async_p);
+    pthread_create(&pthread, NULL, async_main, run_p->async_p);
+    start_ns = now_ns();
+    async_call_threadsafe(run_p->async_p, start, run_p, NULL);
+    sem_wait(&done);
+    qsort(&run_p->jitters[0],
+          NUMBER_OF_EXPIRIES,
+          sizeof(run_p->jitters[0]),
+          compare);
+    printf("%12d %12d %12llu %12llu %12llu %12.0f\n",
+           budget_p->max_calls,
+           budget_p->max_time_in_us,
+           run_p->jitters[NUMBER_OF_EXPIRIES / 2] / 1000,
+           run_p->jitters[NUMBER_OF_EXPIRIES / 100 * 99] / 1000,
+           run_p->jitters[NUMBER_OF_EXPIRIES - 1] / 1000,
+           1e9 * run_p->number_of_calls / (now_ns() - start_ns));
+}
+
+int main()
+{
+    size_t i;
+
+    sem_init(&done, 0, 0);
+    printf("   MAX CALLS   MAX TIME/us       P50/us       P99/us       MAX/us"
+           "      CALLS/s\n");
+
+    for (i = 0; i < sizeof(budgets) / sizeof(budgets[0]); i++) {
+        benchmark(&budgets[i]);
+    }
+
+    return (0);
+}
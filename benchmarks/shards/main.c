@@ -0,0 +1,151 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+/*
+ * Measures the aggregate number of async_call_on() calls per second
+ * between shards. Tokens are passed around a ring of shards, each
+ * shard passing every received token on to the next shard.
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "async.h"
+#include "async/runtimes/linux.h"
+
+/* Number of tokens passed around, shared by all shards. Less than
+   the ring length, so rings are never full. */
+#define NUMBER_OF_TOKENS 512
+
+#define DURATION_US 1000000
+
+struct counter_t {
+    _Alignas(64) atomic_ullong value;
+};
+
+struct run_t {
+    struct async_shards_t *shards_p;
+    int number_of_shards;
+    atomic_bool done;
+    struct counter_t *counters_p;
+};
+
+static void on_token(void *obj_p, void *arg_p)
+{
+    struct run_t *run_p;
+    int index;
+
+    run_p = obj_p;
+    index = (int)(intptr_t)arg_p;
+    atomic_fetch_add_explicit(&run_p->counters_p[index].value,
+                              1,
+                              memory_order_relaxed);
+
+    if (atomic_load_explicit(&run_p->done, memory_order_relaxed)) {
+        return;
+    }
+
+    index = ((index + 1) % run_p->number_of_shards);
+    async_call_on(async_shards_get(run_p->shards_p, index),
+                  on_token,
+                  run_p,
+                  (void *)(intptr_t)index);
+}
+
+static void *shards_main(void *arg_p)
+{
+    async_shards_run_forever(arg_p);
+
+    return (NULL);
+}
+
+/* New shards per run. The previous ones are left idle. */
+static void benchmark(int number_of_shards)
+{
+    struct run_t *run_p;
+    pthread_t pthread;
+    unsigned long long total;
+    int index;
+    int i;
+
+    run_p = malloc(sizeof(*run_p));
+
+    if (run_p == NULL) {
+        exit(1);
+    }
+
+    run_p->shards_p = async_shards_create(number_of_shards);
+    run_p->counters_p = calloc(number_of_shards, sizeof(*run_p->counters_p));
+
+    if ((run_p->shards_p == NULL) || (run_p->counters_p == NULL)) {
+        exit(1);
+    }
+
+    run_p->number_of_shards = number_of_shards;
+    atomic_init(&run_p->done, false);
+
+    for (i = 0; i < NUMBER_OF_TOKENS; i++) {
+        index = (i % number_of_shards);
+        async_call_on(async_shards_get(run_p->shards_p, index),
+                      on_token,
+                      run_p,
+                      (void *)(intptr_t)index);
+    }
+
+    pthread_create(&pthread, NULL, shards_main, run_p->shards_p);
+    usleep(DURATION_US);
+    atomic_store(&run_p->done, true);
+    total = 0;
+
+    for (i = 0; i < number_of_shards; i++) {
+        total += atomic_load(&run_p->counters_p[i].value);
+    }
+
+    printf("%12d %12.0f %12.0f\n",
+           number_of_shards,
+           1e6 * total / DURATION_US,
+           1e6 * total / DURATION_US / number_of_shards);
+}
+
+int main()
+{
+    int number_of_cpus;
+    int number_of_shards;
+
+    number_of_cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    printf("      SHARDS      CALLS/s    PER SHARD\n");
+
+    for (number_of_shards = 1;
+         (number_of_shards <= number_of_cpus) || (number_of_shards <= 2);
+         number_of_shards *= 2) {
+        benchmark(number_of_shards);
+    }
+
+    return (0);
+}
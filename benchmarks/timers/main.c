@@ -0,0 +1,128 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+/*
+ * Measures the cost of starting (inserting) and stopping (cancelling)
+ * timers with given number of timers running.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "async.h"
+
+static int numbers_of_timers[] = {
+    10, 1000, 100000, 1000000
+};
+
+static void on_timeout()
+{
+}
+
+static unsigned long long now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (1000000000ull * now.tv_sec + now.tv_nsec);
+}
+
+static void benchmark(int number_of_timers)
+{
+    struct async_t async;
+    struct async_timer_t *timers_p;
+    unsigned long long start;
+    unsigned long long insert_ns;
+    unsigned long long cancel_ns;
+    unsigned long long restart_ns;
+    int i;
+
+    timers_p = malloc(sizeof(*timers_p) * number_of_timers);
+
+    if (timers_p == NULL) {
+        exit(1);
+    }
+
+    async_init(&async);
+    async_set_tick_in_ms(&async, 1);
+
+    for (i = 0; i < number_of_timers; i++) {
+        async_timer_init(&timers_p[i],
+                         on_timeout,
+                         NULL,
+                         (unsigned int)rand() % 600000,
+                         0,
+                         &async);
+    }
+
+    start = now_ns();
+
+    for (i = 0; i < number_of_timers; i++) {
+        async_timer_start(&timers_p[i]);
+    }
+
+    insert_ns = (now_ns() - start);
+
+    /* Restart timers in random order, as keep-alive timers are. */
+    start = now_ns();
+
+    for (i = 0; i < number_of_timers; i++) {
+        async_timer_start(&timers_p[(unsigned int)rand() % number_of_timers]);
+    }
+
+    restart_ns = (now_ns() - start);
+    start = now_ns();
+
+    for (i = 0; i < number_of_timers; i++) {
+        async_timer_stop(&timers_p[i]);
+    }
+
+    cancel_ns = (now_ns() - start);
+
+    printf("%9d %12.1f %12.1f %12.1f\n",
+           number_of_timers,
+           (double)insert_ns / number_of_timers,
+           (double)restart_ns / number_of_timers,
+           (double)cancel_ns / number_of_timers);
+
+    async_destroy(&async);
+    free(timers_p);
+}
+
+int main()
+{
+    size_t i;
+
+    printf("   TIMERS    INSERT/ns   RESTART/ns    CANCEL/ns\n");
+
+    for (i = 0; i < sizeof(numbers_of_timers) / sizeof(numbers_of_timers[0]); i++) {
+        benchmark(numbers_of_timers[i]);
+    }
+
+    return (0);
+}
@@ -0,0 +1,227 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+/*
+ * Measures async_call_worker_pool() jobs per second and latency from
+ * submission to completion with 1 to 64 workers. Jobs are submitted
+ * until the worker queues are full, and one more each time a job
+ * completes.
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include "async.h"
+
+#define NUMBER_OF_JOBS 200000
+
+/* Number of iterations of busy work per job, roughly a few
+   microseconds. */
+#define JOB_ITERATIONS 2000
+
+static int numbers_of_workers[] = {
+    1, 2, 4, 8, 16, 32, 64
+};
+
+struct job_t {
+    unsigned long long submitted_ns;
+    unsigned long long value;
+};
+
+struct run_t {
+    struct async_t *async_p;
+    int number_of_submitted_jobs;
+    int number_of_completed_jobs;
+    int number_of_queue_full;
+    struct job_t *jobs_p;
+    unsigned long long *latencies_p;
+    unsigned long long start_ns;
+    unsigned long long last_ns;
+    sem_t done;
+};
+
+static struct run_t run;
+
+static unsigned long long now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (1000000000ull * now.tv_sec + now.tv_nsec);
+}
+
+static int compare(const void *left_p, const void *right_p)
+{
+    unsigned long long left;
+    unsigned long long right;
+
+    left = *(const unsigned long long *)left_p;
+    right = *(const unsigned long long *)right_p;
+
+    return ((left > right) - (left < right));
+}
+
+/* Called in a worker. */
+static void job_entry(void *obj_p, void *arg_p)
+{
+    struct job_t *job_p;
+    unsigned long long value;
+    int i;
+
+    (void)arg_p;
+
+    job_p = obj_p;
+    value = (job_p->submitted_ns | 1);
+
+    for (i = 0; i < JOB_ITERATIONS; i++) {
+        value ^= (value << 13);
+        value ^= (value >> 7);
+        value ^= (value << 17);
+    }
+
+    job_p->value = value;
+}
+
+static void submit(void);
+
+/* Called in the async thread. */
+static void on_job_complete(void *obj_p, void *arg_p)
+{
+    struct job_t *job_p;
+
+    (void)arg_p;
+
+    job_p = obj_p;
+    run.last_ns = now_ns();
+    run.latencies_p[run.number_of_completed_jobs] =
+        (run.last_ns - job_p->submitted_ns);
+    run.number_of_completed_jobs++;
+
+    if (run.number_of_completed_jobs == NUMBER_OF_JOBS) {
+        sem_post(&run.done);
+    } else {
+        submit();
+    }
+}
+
+/* Submit jobs until all are submitted or the worker queues are
+   full. */
+static void submit(void)
+{
+    struct job_t *job_p;
+
+    while (run.number_of_submitted_jobs < NUMBER_OF_JOBS) {
+        job_p = &run.jobs_p[run.number_of_submitted_jobs];
+        job_p->submitted_ns = now_ns();
+
+        if (async_call_worker_pool(run.async_p,
+                                   job_entry,
+                                   job_p,
+                                   NULL,
+                                   on_job_complete) != 0) {
+            run.number_of_queue_full++;
+            break;
+        }
+
+        run.number_of_submitted_jobs++;
+    }
+}
+
+static void start(void *obj_p, void *arg_p)
+{
+    (void)obj_p;
+    (void)arg_p;
+
+    run.start_ns = now_ns();
+    submit();
+}
+
+static void *async_main(void *arg_p)
+{
+    async_run_forever(arg_p);
+
+    return (NULL);
+}
+
+/* A new async object and runtime per run, as the worker pool size
+   is fixed once started. The previous ones are left idle. */
+static void benchmark(int number_of_workers)
+{
+    pthread_t pthread;
+
+    run.number_of_submitted_jobs = 0;
+    run.number_of_completed_jobs = 0;
+    run.number_of_queue_full = 0;
+    run.async_p = malloc(sizeof(*run.async_p));
+
+    if (run.async_p == NULL) {
+        exit(1);
+    }
+
+    async_init(run.async_p);
+    async_set_runtime(run.async_p, async_runtime_create());
+    async_set_worker_pool_size(run.async_p, number_of_workers, 64);
+    pthread_create(&pthread, NULL, async_main, run.async_p);
+    async_call_threadsafe(run.async_p, start, NULL, NULL);
+    sem_wait(&run.done);
+    qsort(run.latencies_p,
+          NUMBER_OF_JOBS,
+          sizeof(run.latencies_p[0]),
+          compare);
+    printf("%12d %12.0f %12llu %12llu %12llu %12d\n",
+           number_of_workers,
+           1e9 * NUMBER_OF_JOBS / (run.last_ns - run.start_ns),
+           run.latencies_p[NUMBER_OF_JOBS / 2],
+           run.latencies_p[NUMBER_OF_JOBS / 100 * 99],
+           run.latencies_p[NUMBER_OF_JOBS / 1000 * 999],
+           run.number_of_queue_full);
+}
+
+int main()
+{
+    size_t i;
+
+    run.jobs_p = malloc(sizeof(*run.jobs_p) * NUMBER_OF_JOBS);
+    run.latencies_p = malloc(sizeof(*run.latencies_p) * NUMBER_OF_JOBS);
+
+    if ((run.jobs_p == NULL) || (run.latencies_p == NULL)) {
+        return (1);
+    }
+
+    sem_init(&run.done, 0, 0);
+    printf("     WORKERS       JOBS/s       P50/ns       P99/ns     P99.9/ns"
+           "   QUEUE FULL\n");
+
+    for (i = 0; i < sizeof(numbers_of_workers) / sizeof(numbers_of_workers[0]); i++) {
+        benchmark(numbers_of_workers[i]);
+    }
+
+    return (0);
+}
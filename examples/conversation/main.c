@@ -39,6 +39,7 @@ int main()
     int epoll_fd;
     struct epoll_event event;
     int nfds;
+    int timeout;
     struct bob_t bob;
     struct async_channel_t channel;
 
@@ -50,7 +51,13 @@ int main()
     async_utils_linux_init_stdin(epoll_fd);
 
     while (true) {
-        nfds = epoll_wait(epoll_fd, &event, 1, -1);
+        if (async_has_pending_calls(&async)) {
+            timeout = 0;
+        } else {
+            timeout = -1;
+        }
+
+        nfds = epoll_wait(epoll_fd, &event, 1, timeout);
 
         if (nfds == 1) {
             if (event.data.fd == timer_fd) {
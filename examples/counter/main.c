@@ -65,6 +65,7 @@ int main()
     int timer_fd;
     int epoll_fd;
     int nfds;
+    int timeout;
     struct async_t async;
     struct counter_t counter;
     struct epoll_event event;
@@ -79,7 +80,13 @@ int main()
     printf("Press + and - to increment and decrement the counter.\n");
 
     while (true) {
-        nfds = epoll_wait(epoll_fd, &event, 1, -1);
+        if (async_has_pending_calls(&async)) {
+            timeout = 0;
+        } else {
+            timeout = -1;
+        }
+
+        nfds = epoll_wait(epoll_fd, &event, 1, timeout);
 
         if (nfds == 1) {
             if (event.data.fd == timer_fd) {
@@ -64,14 +64,17 @@ static void on_disconnected(struct async_tcp_client_t *tcp_p)
 
 static void on_input(struct async_tcp_client_t *tcp_p)
 {
-    char buf[64];
-    ssize_t size;
+    const uint8_t *buf_p;
+    size_t size;
     struct http_get_t *self_p;
 
     self_p = async_container_of(tcp_p, typeof(*self_p), tcp);
-    size = async_tcp_client_read(&self_p->tcp, &buf[0], sizeof(buf));
+    size = async_tcp_client_borrow(&self_p->tcp, &buf_p);
 
-    fwrite(&buf[0], 1, size, stdout);
+    if (size > 0) {
+        fwrite(buf_p, 1, size, stdout);
+        async_tcp_client_release(&self_p->tcp, size);
+    }
 }
 
 void http_get_init(struct http_get_t *self_p, struct async_t *async_p)
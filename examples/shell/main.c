@@ -38,6 +38,7 @@ int main()
     int epoll_fd;
     int timer_fd;
     int nfds;
+    int timeout;
     struct async_t async;
     struct my_shell_t my_shell;
     struct epoll_event event;
@@ -52,7 +53,13 @@ int main()
     async_utils_linux_make_stdin_unbuffered();
 
     while (true) {
-        nfds = epoll_wait(epoll_fd, &event, 1, -1);
+        if (async_has_pending_calls(&async)) {
+            timeout = 0;
+        } else {
+            timeout = -1;
+        }
+
+        nfds = epoll_wait(epoll_fd, &event, 1, timeout);
 
         if (nfds == 1) {
             if (event.data.fd == timer_fd) {
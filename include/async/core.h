@@ -33,6 +33,7 @@
 
 #include "async/core/core.h"
 #include "async/core/channel.h"
+#include "async/core/coroutine.h"
 #include "async/core/tcp_client.h"
 #include "async/core/tcp_server.h"
 #include "async/core/runtime.h"
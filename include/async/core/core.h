@@ -36,6 +36,8 @@
 /* Error codes. */
 #define ASYNC_ERROR_NOT_IMPLMENETED              1
 #define ASYNC_ERROR_QUEUE_FULL                   2
+#define ASYNC_ERROR_TIMEOUT                      3
+#define ASYNC_ERROR_INVALID_ARGUMENT             4
 
 /* Log levels. */
 #define ASYNC_LOG_EMERGENCY   0
@@ -47,7 +49,80 @@
 #define ASYNC_LOG_INFO        6
 #define ASYNC_LOG_DEBUG       7
 
-#define ASYNC_FUNC_QUEUE_MAX                     (32 + 1)
+/* Call priorities. */
+#define ASYNC_PRIORITY_HIGH   0
+#define ASYNC_PRIORITY_NORMAL 1
+#define ASYNC_PRIORITY_IDLE   2
+
+#define ASYNC_PRIORITY_MAX    3
+
+/* Function call queue configuration. Calls are queued in segments
+   allocated on the heap, and drained segments are kept in a pool for
+   reuse. Define ASYNC_FUNC_QUEUE_FIXED to instead queue up to
+   ASYNC_FUNC_QUEUE_MAX - 1 normal priority calls in a ring in the
+   async object. */
+#ifndef ASYNC_FUNC_QUEUE_MAX
+#    define ASYNC_FUNC_QUEUE_MAX                 (32 + 1)
+#endif
+
+#ifndef ASYNC_FUNC_QUEUE_HIGH_MAX
+#    define ASYNC_FUNC_QUEUE_HIGH_MAX            (8 + 1)
+#endif
+
+#ifndef ASYNC_FUNC_QUEUE_IDLE_MAX
+#    define ASYNC_FUNC_QUEUE_IDLE_MAX            (8 + 1)
+#endif
+
+/* Ten calls and a next pointer fills four 64 bytes cache lines,
+   including the allocator header, on 64 bits targets. */
+#ifndef ASYNC_FUNC_QUEUE_SEGMENT_LENGTH
+#    define ASYNC_FUNC_QUEUE_SEGMENT_LENGTH      10
+#endif
+
+#ifndef ASYNC_FUNC_QUEUE_SOFT_MAX
+#    define ASYNC_FUNC_QUEUE_SOFT_MAX            1024
+#endif
+
+/* Maximum number of normal priority calls between checks for high
+   priority calls. */
+#ifndef ASYNC_FUNC_QUEUE_NORMAL_BATCH
+#    define ASYNC_FUNC_QUEUE_NORMAL_BATCH        8
+#endif
+
+/* Default maximum number of calls made by async_process(), or zero
+   for no limit. */
+#ifndef ASYNC_PROCESS_MAX_CALLS
+#    define ASYNC_PROCESS_MAX_CALLS              1024
+#endif
+
+/* Default maximum time in microseconds spent in async_process(), or
+   zero for no limit. */
+#ifndef ASYNC_PROCESS_MAX_TIME_IN_US
+#    define ASYNC_PROCESS_MAX_TIME_IN_US         0
+#endif
+
+/* Worker pool configuration. Zero workers means one per online
+   CPU. The queue length is per worker. */
+#ifndef ASYNC_WORKER_POOL_NUMBER_OF_WORKERS
+#    define ASYNC_WORKER_POOL_NUMBER_OF_WORKERS  0
+#endif
+
+#ifndef ASYNC_WORKER_POOL_QUEUE_LENGTH
+#    define ASYNC_WORKER_POOL_QUEUE_LENGTH       64
+#endif
+
+/* Timer wheel configuration. Each level has 2 ^ bits slots, and
+   enough levels are used to cover 32 bits of ticks. Fewer bits per
+   level uses less memory, but timers are cascaded more often. */
+#ifndef ASYNC_TIMER_WHEEL_LEVEL_BITS
+#    define ASYNC_TIMER_WHEEL_LEVEL_BITS         6
+#endif
+
+#define ASYNC_TIMER_WHEEL_SLOTS                  \
+    (1 << ASYNC_TIMER_WHEEL_LEVEL_BITS)
+
+#define ASYNC_TIMER_WHEEL_LEVELS                                        \
+    ((32 + ASYNC_TIMER_WHEEL_LEVEL_BITS - 1) / ASYNC_TIMER_WHEEL_LEVEL_BITS)
 
 #define async_offsetof(type, member) ((size_t) &((type *)0)->member)
 
@@ -66,6 +141,14 @@ struct async_timer_t;
 
 typedef void (*async_timer_timeout_t)(void *obj_p);
 
+/**
+ * A buffer of a scatter-gather write.
+ */
+struct async_iovec_t {
+    const void *buf_p;
+    size_t size;
+};
+
 /**
  * Check if given log level is enabled in given log object. If so,
  * format a log entry and print it.
@@ -88,16 +171,23 @@ struct async_timer_t {
     unsigned int repeat;
     unsigned int initial_ticks;
     unsigned int repeat_ticks;
-    unsigned int delta;
+    unsigned int expires;
     async_timer_timeout_t on_timeout;
     int number_of_outstanding_timeouts;
     int number_of_timeouts_to_ignore;
     struct async_timer_t *next_p;
+    /* The link pointing to this timer, or NULL if not running. */
+    struct async_timer_t **prev_next_pp;
 };
 
+/**
+ * Running timers in a hierarchical timing wheel. Level zero has one
+ * slot per tick, and each following level has one slot per full
+ * revolution of the level below it.
+ */
 struct async_timer_list_t {
-    struct async_timer_t *head_p;
-    struct async_timer_t tail;
+    unsigned int tick;
+    struct async_timer_t *slots[ASYNC_TIMER_WHEEL_LEVELS][ASYNC_TIMER_WHEEL_SLOTS];
 };
 
 struct async_func_queue_elem_t {
@@ -106,22 +196,77 @@ struct async_func_queue_elem_t {
     void *arg_p;
 };
 
+struct async_call_queue_statistics_t {
+    /* Number of queued calls. */
+    int length;
+    /* Highest number of queued calls. */
+    int max_length;
+    /* Number of calls queued above the soft max. */
+    unsigned int number_of_overflows;
+    /* Number of calls not queued. */
+    unsigned int number_of_drops;
+};
+
+#if defined(ASYNC_FUNC_QUEUE_FIXED)
+
 struct async_func_queue_t {
     int rdpos;
     int wrpos;
     int length;
     struct async_func_queue_elem_t *list_p;
+    int soft_max;
+    struct async_call_queue_statistics_t statistics;
+};
+
+#else
+
+struct async_func_queue_segment_t {
+    struct async_func_queue_segment_t *next_p;
+    struct async_func_queue_elem_t elems[ASYNC_FUNC_QUEUE_SEGMENT_LENGTH];
+};
+
+struct async_func_queue_t {
+    struct {
+        struct async_func_queue_segment_t *segment_p;
+        int pos;
+    } read;
+    struct {
+        struct async_func_queue_segment_t *segment_p;
+        int pos;
+    } write;
+    struct {
+        struct async_func_queue_segment_t *head_p;
+        int length;
+    } pool;
+    int soft_max;
+    struct async_call_queue_statistics_t statistics;
 };
 
+#endif
+
 struct async_t {
     int tick_in_ms;
     struct async_timer_list_t running_timers;
-    struct async_func_queue_t funcs;
-    struct async_func_queue_elem_t elems[ASYNC_FUNC_QUEUE_MAX];
+    struct async_func_queue_t funcs[ASYNC_PRIORITY_MAX];
+#if defined(ASYNC_FUNC_QUEUE_FIXED)
+    struct {
+        struct async_func_queue_elem_t high[ASYNC_FUNC_QUEUE_HIGH_MAX];
+        struct async_func_queue_elem_t normal[ASYNC_FUNC_QUEUE_MAX];
+        struct async_func_queue_elem_t idle[ASYNC_FUNC_QUEUE_IDLE_MAX];
+    } elems;
+#endif
     struct {
         async_log_object_print_t print;
         async_log_object_is_enabled_for_t is_enabled_for;
     } log_object;
+    struct {
+        int max_calls;
+        int max_time_in_us;
+    } process;
+    struct {
+        int number_of_workers;
+        int queue_length;
+    } worker_pool;
     struct async_runtime_t *runtime_p;
 };
 
@@ -144,6 +289,41 @@ void async_set_log_object_callbacks(
  */
 void async_set_tick_in_ms(struct async_t *self_p, int tick_in_ms);
 
+/**
+ * Set the call queue soft max. More calls than that are still
+ * queued, but counted as overflows, and queue memory above it is
+ * freed once drained instead of kept for reuse.
+ */
+void async_set_call_queue_soft_max(struct async_t *self_p, int length);
+
+/**
+ * Set the maximum number of calls made and the maximum time in
+ * microseconds spent by one async_process(), zero for no limit. The
+ * time is checked after each call, so a single long call may exceed
+ * it.
+ */
+void async_set_process_budget(struct async_t *self_p,
+                              int max_calls,
+                              int max_time_in_us);
+
+/**
+ * Set the number of worker pool threads, zero for one per online CPU,
+ * and the maximum number of queued jobs per worker. The worker pool
+ * is started by the first call to async_call_worker_pool(), and is
+ * not resized after that.
+ */
+void async_set_worker_pool_size(struct async_t *self_p,
+                                int number_of_workers,
+                                int queue_length);
+
+/**
+ * Get call queue statistics, summed over all priorities. The highest
+ * number of queued calls is the highest of any priority.
+ */
+void async_get_call_queue_statistics(
+    struct async_t *self_p,
+    struct async_call_queue_statistics_t *statistics_p);
+
 /**
  * Set the runtime for given async object. The default runtime exits
  * the program if used.
@@ -162,18 +342,66 @@ void async_destroy(struct async_t *self_p);
 void async_tick(struct async_t *self_p);
 
 /**
- * Returns once all async functions have been called.
+ * Advance the async time given number of ticks. Same as calling
+ * async_tick() given number of times, but ticks without expiring
+ * timers are skipped. Used by tickless runtimes.
+ */
+void async_advance(struct async_t *self_p, unsigned int ticks);
+
+/**
+ * Returns the time in milliseconds from the start of the current tick
+ * until async_tick() or async_advance() has to be called next, or -1
+ * if no timer is running. Used by tickless runtimes to sleep until
+ * the next timer expires instead of waking up every tick.
+ */
+int async_next_timeout(struct async_t *self_p);
+
+/**
+ * Call queued async functions until all high and normal priority
+ * calls are made, or the process budget is used up. All high priority
+ * calls are made before every batch of at most
+ * ASYNC_FUNC_QUEUE_NORMAL_BATCH normal priority calls. Idle priority
+ * calls queued before both queues became empty are made one at a time
+ * once they are, while idle calls queued after that are left for the
+ * next call to this function.
+ *
+ * Handle pending I/O and timers, without blocking, and call this
+ * function again while async_has_pending_calls() returns true.
  */
 void async_process(struct async_t *self_p);
 
 /**
- * Call given function with given argument later.
+ * Returns true if any async function has been called but not yet
+ * processed. Runtimes must not block waiting for events if so, as
+ * calls may be left after async_process().
+ */
+bool async_has_pending_calls(struct async_t *self_p);
+
+/**
+ * Call given function with given argument later, with normal
+ * priority. Returns zero or -ASYNC_ERROR_QUEUE_FULL if out of memory,
+ * or if the fixed size queue is full.
  */
 int async_call(struct async_t *self_p,
                async_func_t func,
                void *obj_p,
                void *arg_p);
 
+/**
+ * Same as async_call(), but with given priority, one of
+ * ASYNC_PRIORITY_HIGH, ASYNC_PRIORITY_NORMAL and
+ * ASYNC_PRIORITY_IDLE. Use high priority for short latency critical
+ * calls, like keep alive pings, and idle priority for background
+ * work that may wait until there is nothing else to do. Returns
+ * -ASYNC_ERROR_INVALID_ARGUMENT if given priority is not one of
+ * them.
+ */
+int async_call_with_priority(struct async_t *self_p,
+                             int priority,
+                             async_func_t func,
+                             void *obj_p,
+                             void *arg_p);
+
 /**
  * Call given function with given data later. This function may be
  * called from any thread except given async thread.
@@ -193,6 +421,9 @@ void async_call_threadsafe(struct async_t *self_p,
  * It is not allowed to call any async-functions from a function
  * called in the worker pool, as it is not executed in the async
  * thread!
+ *
+ * Returns zero or -ASYNC_ERROR_QUEUE_FULL if all worker queues are
+ * full. Never blocks.
  */
 int async_call_worker_pool(struct async_t *self_p,
                            async_func_t entry,
@@ -207,7 +438,8 @@ void async_run_forever(struct async_t *self_p);
 
 /**
  * Initialize given timer with given initial and repeat timeouts in
- * milliseconds. Calls on_timeout() on expiry.
+ * milliseconds. Calls on_timeout() on expiry. The timer must not be
+ * running.
  */
 void async_timer_init(struct async_timer_t *self_p,
                       async_timer_timeout_t on_timeout,
@@ -239,7 +471,8 @@ void async_timer_set_repeat(struct async_timer_t *self_p,
 unsigned int async_timer_get_repeat(struct async_timer_t *self_p);
 
 /**
- * (Re)start given timer.
+ * (Re)start given timer. Both starting and stopping are constant
+ * time operations.
  */
 void async_timer_start(struct async_timer_t *self_p);
 
@@ -249,4 +482,11 @@ void async_timer_start(struct async_timer_t *self_p);
  */
 void async_timer_stop(struct async_timer_t *self_p);
 
+/**
+ * Returns true if given timer is running, that is, it has been
+ * started and has not yet expired or been stopped. Periodic timers
+ * run until stopped.
+ */
+bool async_timer_is_running(struct async_timer_t *self_p);
+
 #endif
@@ -0,0 +1,254 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+/*
+ * Stackless coroutines, or protothreads, built on async calls and
+ * timers. A coroutine is a function that returns when it has to wait,
+ * and continues after the wait it returned from when resumed.
+ *
+ * The coroutine frame is allocated by the user, and waiting does not
+ * allocate any memory. Local variables are not preserved across
+ * waits, so keep state in the object containing the frame. At most
+ * one wait per source line, and switch statements must not span a
+ * wait.
+ *
+ * A coroutine may be resumed when the condition it waits for has not
+ * yet become true, for example by an on_input() callback while it
+ * waits for a timer. Waits check their condition or completion when
+ * resumed, and keep waiting if not fulfilled.
+ *
+ * Example:
+ *
+ *   static void echo_main(struct async_coroutine_t *self_p)
+ *   {
+ *       struct echo_t *echo_p;
+ *
+ *       echo_p = async_container_of(self_p, struct echo_t, coroutine);
+ *
+ *       ASYNC_COROUTINE_BEGIN(self_p);
+ *
+ *       while (true) {
+ *           ASYNC_COROUTINE_AWAIT_TIMEOUT(
+ *               self_p,
+ *               (echo_p->size = async_tcp_client_read(&echo_p->client,
+ *                                                     &echo_p->buf[0],
+ *                                                     sizeof(echo_p->buf))) > 0,
+ *               1000);
+ *
+ *           if (self_p->res != 0) {
+ *               break;
+ *           }
+ *
+ *           async_tcp_client_write(&echo_p->client,
+ *                                  &echo_p->buf[0],
+ *                                  echo_p->size);
+ *       }
+ *
+ *       ASYNC_COROUTINE_END(self_p);
+ *   }
+ *
+ * with on_input() calling async_coroutine_resume(&echo_p->coroutine).
+ */
+
+#ifndef ASYNC_CORE_COROUTINE_H
+#define ASYNC_CORE_COROUTINE_H
+
+#include "async/core/core.h"
+
+/* Line of a completed coroutine. */
+#define ASYNC_COROUTINE_DONE                     -1
+
+/* Resuming jumps to a case label right after the suspending
+   statement. */
+#if defined(__GNUC__) && (__GNUC__ >= 7)
+#    define ASYNC_COROUTINE_FALLTHROUGH          __attribute__((fallthrough))
+#else
+#    define ASYNC_COROUTINE_FALLTHROUGH
+#endif
+
+struct async_coroutine_t;
+
+typedef void (*async_coroutine_entry_t)(struct async_coroutine_t *self_p);
+
+struct async_coroutine_t {
+    struct async_t *async_p;
+    async_coroutine_entry_t entry;
+    /* Line of the wait to continue after, zero to start from the
+       beginning. */
+    int line;
+    /* Result of the last wait with a timeout or for a worker pool
+       job. Zero or a negative error code. */
+    int res;
+    /* A timer or worker pool job has not yet completed. */
+    bool waiting;
+    struct async_timer_t timer;
+    void *obj_p;
+};
+
+/**
+ * Start of the coroutine body.
+ */
+#define ASYNC_COROUTINE_BEGIN(self_p)                   \
+    switch ((self_p)->line) {                           \
+    case 0:
+
+/**
+ * End of the coroutine body. The coroutine is done once reached.
+ */
+#define ASYNC_COROUTINE_END(self_p)                     \
+    }                                                   \
+    (self_p)->line = ASYNC_COROUTINE_DONE;              \
+    return
+
+/**
+ * Wait until given condition is true. The condition is evaluated
+ * immediately, and then every time the coroutine is resumed.
+ */
+#define ASYNC_COROUTINE_AWAIT(self_p, cond)             \
+    do {                                                \
+        (self_p)->line = __LINE__;                      \
+        ASYNC_COROUTINE_FALLTHROUGH;                    \
+    case __LINE__:                                      \
+        if (!(cond)) {                                  \
+            return;                                     \
+        }                                               \
+    } while (0)
+
+/**
+ * Same as ASYNC_COROUTINE_AWAIT(), but wait at most given number of
+ * milliseconds. Sets res to zero if the condition became true, and
+ * to -ASYNC_ERROR_TIMEOUT otherwise.
+ */
+#define ASYNC_COROUTINE_AWAIT_TIMEOUT(self_p, cond, timeout)            \
+    do {                                                                \
+        async_coroutine_timer_start(self_p, timeout);                   \
+        (self_p)->line = __LINE__;                                      \
+        ASYNC_COROUTINE_FALLTHROUGH;                                    \
+    case __LINE__:                                                      \
+        if (!async_coroutine_timer_check(self_p, cond)) {               \
+            return;                                                     \
+        }                                                               \
+    } while (0)
+
+/**
+ * Wait given number of milliseconds.
+ */
+#define ASYNC_COROUTINE_SLEEP(self_p, timeout)                  \
+    ASYNC_COROUTINE_AWAIT_TIMEOUT(self_p, false, timeout)
+
+/**
+ * Call given function in the worker pool and wait for it to
+ * return. The function is called with the coroutine and given
+ * argument. Sets res to zero, or to -ASYNC_ERROR_QUEUE_FULL without
+ * waiting if the job could not be queued.
+ */
+#define ASYNC_COROUTINE_AWAIT_WORKER_POOL(self_p, entry, arg_p)         \
+    do {                                                                \
+        async_coroutine_call_worker_pool(self_p, entry, arg_p);         \
+        (self_p)->line = __LINE__;                                      \
+        ASYNC_COROUTINE_FALLTHROUGH;                                    \
+    case __LINE__:                                                      \
+        if ((self_p)->waiting) {                                        \
+            return;                                                     \
+        }                                                               \
+    } while (0)
+
+/**
+ * Let queued calls run before continuing. Continues immediately if
+ * the call queue is full.
+ */
+#define ASYNC_COROUTINE_YIELD(self_p)                   \
+    do {                                                \
+        (self_p)->line = __LINE__;                      \
+        if (async_coroutine_call(self_p) == 0) {        \
+            return;                                     \
+        }                                               \
+        ASYNC_COROUTINE_FALLTHROUGH;                    \
+    case __LINE__:;                                     \
+    } while (0)
+
+/**
+ * Initialize given coroutine. The entry function is called when the
+ * coroutine is started and resumed.
+ */
+void async_coroutine_init(struct async_coroutine_t *self_p,
+                          async_coroutine_entry_t entry,
+                          void *obj_p,
+                          struct async_t *async_p);
+
+/**
+ * Start given coroutine from the beginning in a later async
+ * call. Must not be called while waiting for a worker pool
+ * job. Returns zero or -ASYNC_ERROR_QUEUE_FULL.
+ */
+int async_coroutine_start(struct async_coroutine_t *self_p);
+
+/**
+ * Stop given coroutine. It is not resumed again until restarted.
+ */
+void async_coroutine_stop(struct async_coroutine_t *self_p);
+
+/**
+ * Resume given coroutine, typically when the condition it waits for
+ * may have become true. Does nothing if the coroutine is done.
+ */
+void async_coroutine_resume(struct async_coroutine_t *self_p);
+
+/**
+ * Returns true if given coroutine has reached its end or is stopped.
+ */
+bool async_coroutine_is_done(struct async_coroutine_t *self_p);
+
+/**
+ * Resume given coroutine in a later async call. Used by
+ * ASYNC_COROUTINE_YIELD().
+ */
+int async_coroutine_call(struct async_coroutine_t *self_p);
+
+/**
+ * Start the timeout timer. Used by ASYNC_COROUTINE_AWAIT_TIMEOUT().
+ */
+void async_coroutine_timer_start(struct async_coroutine_t *self_p,
+                                 unsigned int timeout);
+
+/**
+ * Returns true if the wait with a timeout is over. Used by
+ * ASYNC_COROUTINE_AWAIT_TIMEOUT().
+ */
+bool async_coroutine_timer_check(struct async_coroutine_t *self_p,
+                                 bool ready);
+
+/**
+ * Queue a worker pool job. Used by
+ * ASYNC_COROUTINE_AWAIT_WORKER_POOL().
+ */
+void async_coroutine_call_worker_pool(struct async_coroutine_t *self_p,
+                                      async_func_t entry,
+                                      void *arg_p);
+
+#endif
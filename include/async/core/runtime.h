@@ -67,11 +67,27 @@ typedef void (*async_runtime_tcp_client_write_t)(
     const void *buf_p,
     size_t size);
 
+typedef void (*async_runtime_tcp_client_writev_t)(
+    struct async_tcp_client_t *self_p,
+    const struct async_iovec_t *iov_p,
+    int length);
+
+typedef bool (*async_runtime_tcp_client_is_writable_t)(
+    struct async_tcp_client_t *self_p);
+
 typedef size_t (*async_runtime_tcp_client_read_t)(
     struct async_tcp_client_t *self_p,
     void *buf_p,
     size_t size);
 
+typedef size_t (*async_runtime_tcp_client_borrow_t)(
+    struct async_tcp_client_t *self_p,
+    const uint8_t **buf_pp);
+
+typedef void (*async_runtime_tcp_client_release_t)(
+    struct async_tcp_client_t *self_p,
+    size_t size);
+
 typedef void (*async_runtime_tcp_server_init_t)(
     struct async_tcp_server_t *self_p,
     const char *host_p,
@@ -100,6 +116,14 @@ typedef size_t (*async_runtime_tcp_server_client_read_t)(
     void *buf_p,
     size_t size);
 
+typedef size_t (*async_runtime_tcp_server_client_borrow_t)(
+    struct async_tcp_server_client_t *self_p,
+    const uint8_t **buf_pp);
+
+typedef void (*async_runtime_tcp_server_client_release_t)(
+    struct async_tcp_server_client_t *self_p,
+    size_t size);
+
 typedef void (*async_runtime_tcp_server_client_disconnect_t)(
     struct async_tcp_server_client_t *self_p);
 
@@ -113,7 +137,11 @@ struct async_runtime_t {
         async_runtime_tcp_client_connect_t connect;
         async_runtime_tcp_client_disconnect_t disconnect;
         async_runtime_tcp_client_write_t write;
+        async_runtime_tcp_client_writev_t writev;
+        async_runtime_tcp_client_is_writable_t is_writable;
         async_runtime_tcp_client_read_t read;
+        async_runtime_tcp_client_borrow_t borrow;
+        async_runtime_tcp_client_release_t release;
     } tcp_client;
     struct {
         async_runtime_tcp_server_init_t init;
@@ -123,6 +151,8 @@ struct async_runtime_t {
         struct {
             async_runtime_tcp_server_client_write_t write;
             async_runtime_tcp_server_client_read_t read;
+            async_runtime_tcp_server_client_borrow_t borrow;
+            async_runtime_tcp_server_client_release_t release;
             async_runtime_tcp_server_client_disconnect_t disconnect;
         } client;
     } tcp_server;
@@ -31,8 +31,32 @@
 
 #include "async/core/core.h"
 
+/* Default connect timeout in milliseconds, or zero for no timeout. */
+#ifndef ASYNC_TCP_CLIENT_CONNECT_TIMEOUT
+#    define ASYNC_TCP_CLIENT_CONNECT_TIMEOUT     10000
+#endif
+
+/* Default output queue watermarks in bytes. */
+#ifndef ASYNC_TCP_CLIENT_OUTPUT_LOW_WATERMARK
+#    define ASYNC_TCP_CLIENT_OUTPUT_LOW_WATERMARK       16384
+#endif
+
+#ifndef ASYNC_TCP_CLIENT_OUTPUT_HIGH_WATERMARK
+#    define ASYNC_TCP_CLIENT_OUTPUT_HIGH_WATERMARK      65536
+#endif
+
+struct async_tcp_client_t;
+
+typedef void (*async_tcp_client_writable_t)(struct async_tcp_client_t *self_p);
+
 struct async_tcp_client_t {
     struct async_t *async_p;
+    unsigned int connect_timeout;
+    struct {
+        size_t low_watermark;
+        size_t high_watermark;
+        async_tcp_client_writable_t on_writable;
+    } output;
     void *obj_p;
 };
 
@@ -52,6 +76,30 @@ void async_tcp_client_init(struct async_tcp_client_t *self_p,
                            async_tcp_client_input_t on_input,
                            struct async_t *async_p);
 
+/**
+ * Set the connect timeout in milliseconds, or zero for no timeout. A
+ * connect that has not completed in time fails.
+ */
+void async_tcp_client_set_connect_timeout(struct async_tcp_client_t *self_p,
+                                          unsigned int timeout);
+
+/**
+ * Set the output queue watermarks in bytes. Data that cannot be
+ * written immediately is queued and sent once the socket is
+ * writable. The client is not writable once more than high bytes are
+ * queued, until the queue has drained to low bytes.
+ */
+void async_tcp_client_set_output_watermarks(struct async_tcp_client_t *self_p,
+                                            size_t low,
+                                            size_t high);
+
+/**
+ * Set the function called when the client is writable again after
+ * the output queue exceeded the high watermark, or NULL.
+ */
+void async_tcp_client_set_on_writable(struct async_tcp_client_t *self_p,
+                                      async_tcp_client_writable_t on_writable);
+
 /**
  * Opens a TCP connection to a remote host. on_connect_complete is
  * called once completed.
@@ -72,6 +120,21 @@ void async_tcp_client_write(struct async_tcp_client_t *self_p,
                             const void *buf_p,
                             size_t size);
 
+/**
+ * Write given buffers, in order, to the remote host. Data is handed
+ * to the runtime without first being copied into a single buffer.
+ */
+void async_tcp_client_writev(struct async_tcp_client_t *self_p,
+                             const struct async_iovec_t *iov_p,
+                             int length);
+
+/**
+ * Returns true if the output queue has not exceeded the high
+ * watermark. Written data is always queued, but producers should
+ * wait for on_writable once this returns false.
+ */
+bool async_tcp_client_is_writable(struct async_tcp_client_t *self_p);
+
 /**
  * Read up to size bytes from the remote host. Returns the number of
  * read bytes (0..size).
@@ -80,4 +143,22 @@ size_t async_tcp_client_read(struct async_tcp_client_t *self_p,
                              void *buf_p,
                              size_t size);
 
+/**
+ * Borrow received data from the runtime without copying it. Returns
+ * the number of bytes at *buf_pp, or zero if no data is available.
+ * The data is valid until the next borrow, release or read, or until
+ * on_input returns. Data is read from the socket at most once per
+ * input event.
+ */
+size_t async_tcp_client_borrow(struct async_tcp_client_t *self_p,
+                               const uint8_t **buf_pp);
+
+/**
+ * Release given number of borrowed bytes, which may be fewer than
+ * borrowed. Data not released is borrowed again, followed by any
+ * data received later. A consumer that needs more data than borrowed
+ * to make progress must copy it.
+ */
+void async_tcp_client_release(struct async_tcp_client_t *self_p, size_t size);
+
 #endif
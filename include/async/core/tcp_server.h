@@ -31,6 +31,11 @@
 
 #include "async/core/core.h"
 
+/* Default maximum number of pending connections. */
+#ifndef ASYNC_TCP_SERVER_BACKLOG
+#    define ASYNC_TCP_SERVER_BACKLOG                    1024
+#endif
+
 struct async_tcp_server_client_t;
 
 typedef void (*async_tcp_server_client_connected_t)(
@@ -44,6 +49,8 @@ typedef void (*async_tcp_server_client_input_t)(
 
 struct async_tcp_server_t {
     struct async_t *async_p;
+    int backlog;
+    bool reuse_port;
     struct {
         struct async_tcp_server_client_t *used_p;
         struct async_tcp_server_client_t *free_p;
@@ -70,7 +77,25 @@ void async_tcp_server_init(struct async_tcp_server_t *self_p,
                            struct async_t *async_p);
 
 /**
- * Add given client to given server.
+ * Set the maximum number of pending connections. Must be called
+ * before async_tcp_server_start().
+ */
+void async_tcp_server_set_backlog(struct async_tcp_server_t *self_p,
+                                  int backlog);
+
+/**
+ * Let multiple servers listen on the same address and port, for
+ * example one per thread, with incoming connections distributed
+ * among them by the kernel. Must be called before
+ * async_tcp_server_start().
+ */
+void async_tcp_server_set_reuse_port(struct async_tcp_server_t *self_p,
+                                     bool reuse_port);
+
+/**
+ * Add given client to given server. Accepted connections are
+ * assigned to added clients that are not connected, and closed if
+ * there is none.
  */
 void async_tcp_server_add_client(struct async_tcp_server_t *self_p,
                                  struct async_tcp_server_client_t *client_p);
@@ -100,6 +125,19 @@ size_t async_tcp_server_client_read(struct async_tcp_server_client_t *self_p,
                                     void *buf_p,
                                     size_t size);
 
+/**
+ * Borrow received data without copying it. Same as
+ * async_tcp_client_borrow(), but for a server client.
+ */
+size_t async_tcp_server_client_borrow(struct async_tcp_server_client_t *self_p,
+                                      const uint8_t **buf_pp);
+
+/**
+ * Release given number of borrowed bytes.
+ */
+void async_tcp_server_client_release(struct async_tcp_server_client_t *self_p,
+                                     size_t size);
+
 /**
  * Disconnect given client.
  */
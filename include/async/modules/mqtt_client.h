@@ -40,16 +40,200 @@ typedef void (*async_mqtt_client_on_publish_t)(void *obj_p,
                                                const uint8_t *buf_p,
                                                size_t size);
 
+typedef void (*async_mqtt_client_on_publish_chunk_t)(void *obj_p,
+                                                     const char *topic_p,
+                                                     const uint8_t *buf_p,
+                                                     size_t size,
+                                                     size_t offset,
+                                                     size_t total_size);
+
 typedef void (*async_mqtt_client_on_subscribe_complete_t)(void *obj_p,
                                                           uint16_t transaction_id);
 
-struct async_mqtt_client_packet_t {
-    uint8_t buf[256];
-    int size;
-    int state;
-    int offset;
-    int type;
-    int flags;
+typedef void (*async_mqtt_client_on_publish_complete_t)(void *obj_p,
+                                                        uint16_t packet_identifier);
+
+/* Default receive buffer size. Received packets are decoded in
+   place. Larger packets are passed in chunks or discarded. */
+#ifndef ASYNC_MQTT_CLIENT_INPUT_BUFFER_SIZE
+#    define ASYNC_MQTT_CLIENT_INPUT_BUFFER_SIZE         1024
+#endif
+
+/* Largest packet size allowed by the protocol. */
+#define ASYNC_MQTT_CLIENT_MAXIMUM_PACKET_SIZE           268435455
+
+struct async_mqtt_client_input_t {
+    uint8_t default_buf[ASYNC_MQTT_CLIENT_INPUT_BUFFER_SIZE];
+    uint8_t *buf_p;
+    size_t buf_size;
+    /* Bytes at the start of the buffer reserved for the topic of a
+       message passed in chunks. Received data is stored after it. */
+    size_t start;
+    /* End of received data not yet decoded. */
+    size_t end;
+    /* Number of bytes left to discard of a too large packet. */
+    size_t discard;
+    struct {
+        bool active;
+        size_t offset;
+        size_t size;
+        /* Acknowledged once all chunks are passed. */
+        int qos;
+        uint16_t packet_identifier;
+    } chunk;
+    bool closed;
+};
+
+/* Packets written while received packets are decoded, for example
+   acknowledgements and publishes in callbacks, are buffered and
+   written at once afterwards. */
+#ifndef ASYNC_MQTT_CLIENT_OUTPUT_BUFFER_SIZE
+#    define ASYNC_MQTT_CLIENT_OUTPUT_BUFFER_SIZE        512
+#endif
+
+struct async_mqtt_client_output_t {
+    uint8_t buf[ASYNC_MQTT_CLIENT_OUTPUT_BUFFER_SIZE];
+    size_t size;
+    bool corked;
+};
+
+/* Default maximum number of published QoS 1 and QoS 2 messages not
+   yet acknowledged by the broker. At most as many as the broker's
+   Receive Maximum are sent at a time. */
+#ifndef ASYNC_MQTT_CLIENT_IN_FLIGHT_MAX
+#    define ASYNC_MQTT_CLIENT_IN_FLIGHT_MAX             32
+#endif
+
+struct async_mqtt_client_in_flight_message_t {
+    const char *topic_p;
+    const void *buf_p;
+    size_t size;
+    uint16_t packet_identifier;
+    uint8_t qos;
+    uint8_t state;
+    bool sent;
+    bool dup;
+    int next;
+    int prev;
+};
+
+struct async_mqtt_client_in_flight_t {
+    struct async_mqtt_client_in_flight_message_t
+    default_messages[ASYNC_MQTT_CLIENT_IN_FLIGHT_MAX];
+    struct async_mqtt_client_in_flight_message_t *messages_p;
+    int max;
+    /* Free messages, linked by next. */
+    int free;
+    /* Used messages in publish order. */
+    int head;
+    int tail;
+    /* First used message not yet sent. */
+    int unsent;
+    int length;
+    int number_of_sent;
+    int receive_maximum;
+};
+
+/* Maximum number of received QoS 1 and QoS 2 messages not yet
+   acknowledged, sent to the broker as Receive Maximum. */
+#ifndef ASYNC_MQTT_CLIENT_RECEIVE_MAX
+#    define ASYNC_MQTT_CLIENT_RECEIVE_MAX               16
+#endif
+
+/* Packet identifiers of received QoS 2 messages are kept until
+   released by the broker, so that resent messages are passed to the
+   application only once. */
+struct async_mqtt_client_received_t {
+    uint16_t packet_identifiers[ASYNC_MQTT_CLIENT_RECEIVE_MAX];
+    int length;
+};
+
+/* Number of topic aliases in each direction. Outgoing topics are
+   replaced by aliases, up to the broker's Topic Alias Maximum, with
+   the least recently used alias reassigned when all are used. */
+#ifndef ASYNC_MQTT_CLIENT_TOPIC_ALIAS_MAX
+#    define ASYNC_MQTT_CLIENT_TOPIC_ALIAS_MAX           16
+#endif
+
+/* Topics with aliases are stored in the client, so only outgoing
+   topics shorter than this are given aliases. The default storage of
+   received topics is this many bytes per alias. */
+#ifndef ASYNC_MQTT_CLIENT_TOPIC_ALIAS_TOPIC_SIZE
+#    define ASYNC_MQTT_CLIENT_TOPIC_ALIAS_TOPIC_SIZE    64
+#endif
+
+struct async_mqtt_client_topic_alias_t {
+    char topic[ASYNC_MQTT_CLIENT_TOPIC_ALIAS_TOPIC_SIZE];
+    /* Zero if not used. */
+    size_t size;
+    unsigned int last_used;
+};
+
+struct async_mqtt_client_topic_aliases_t {
+    /* Alias n is stored at index n - 1. */
+    struct async_mqtt_client_topic_alias_t
+    outgoing[ASYNC_MQTT_CLIENT_TOPIC_ALIAS_MAX];
+    struct {
+        char default_buf[ASYNC_MQTT_CLIENT_TOPIC_ALIAS_MAX
+                         * ASYNC_MQTT_CLIENT_TOPIC_ALIAS_TOPIC_SIZE];
+        /* The topic of alias n is stored at (n - 1) * topic_size. */
+        char *buf_p;
+        size_t size;
+        /* Bytes per alias, set when connecting. */
+        size_t topic_size;
+        /* Zero if not used. */
+        size_t sizes[ASYNC_MQTT_CLIENT_TOPIC_ALIAS_MAX];
+        /* Topic Alias Maximum sent to the broker. */
+        int maximum;
+    } incoming;
+    /* Broker's Topic Alias Maximum. */
+    int maximum;
+    unsigned int clock;
+};
+
+struct async_mqtt_client_statistics_t {
+    struct {
+        /* Number of bytes. */
+        uint64_t bytes;
+        /* Number of topic bytes replaced by topic aliases. */
+        uint64_t topic_alias_bytes;
+    } sent;
+    struct {
+        uint64_t bytes;
+        uint64_t topic_alias_bytes;
+    } received;
+};
+
+/* Default maximum number of topic levels of filters subscribed to
+   with handlers. Filters with common leading levels share them. */
+#ifndef ASYNC_MQTT_CLIENT_ROUTER_LEVELS_MAX
+#    define ASYNC_MQTT_CLIENT_ROUTER_LEVELS_MAX         32
+#endif
+
+struct async_mqtt_client_router_level_t {
+    /* Points into the filter, or NULL if not used. */
+    const char *level_p;
+    uint32_t hash;
+    uint16_t level_size;
+    int parent;
+    /* Child '+' and '#' levels, or -1. */
+    int single_level;
+    int multi_level;
+    /* Handler of the filter ending with this level, or NULL. */
+    async_mqtt_client_on_publish_t on_publish;
+    void *obj_p;
+};
+
+/* Topic level trie of filters subscribed to with handlers. Children
+   are looked up by parent and level in a hash table with open
+   addressing. */
+struct async_mqtt_client_router_t {
+    struct async_mqtt_client_router_level_t
+    default_levels[ASYNC_MQTT_CLIENT_ROUTER_LEVELS_MAX];
+    struct async_mqtt_client_router_level_t *levels_p;
+    int max;
+    int length;
+    struct async_mqtt_client_router_level_t root;
 };
 
 struct async_mqtt_client_will_t {
@@ -66,17 +250,27 @@ struct async_mqtt_client_t {
     async_mqtt_client_on_connected_t on_connected;
     async_mqtt_client_on_disconnected_t on_disconnected;
     async_mqtt_client_on_publish_t on_publish;
+    async_mqtt_client_on_publish_chunk_t on_publish_chunk;
     async_mqtt_client_on_subscribe_complete_t on_subscribe_complete;
+    async_mqtt_client_on_publish_complete_t on_publish_complete;
     void *obj_p;
     void *log_object_p;
     struct async_t *async_p;
     char client_id[64];
     int keep_alive_s;
     struct async_mqtt_client_will_t will;
+    size_t maximum_packet_size;
+    uint32_t session_expiry_interval;
     bool connected;
     uint16_t next_packet_identifier;
     struct async_stcp_client_t stcp;
-    struct async_mqtt_client_packet_t packet;
+    struct async_mqtt_client_input_t input;
+    struct async_mqtt_client_output_t output;
+    struct async_mqtt_client_in_flight_t in_flight;
+    struct async_mqtt_client_received_t received;
+    struct async_mqtt_client_router_t router;
+    struct async_mqtt_client_topic_aliases_t topic_aliases;
+    struct async_mqtt_client_statistics_t statistics;
     struct async_timer_t keep_alive_timer;
     struct async_timer_t reconnect_timer;
 };
@@ -118,6 +312,109 @@ void async_mqtt_client_set_on_subscribe_complete(
     struct async_mqtt_client_t *self_p,
     async_mqtt_client_on_subscribe_complete_t on_subscribe_complete);
 
+/**
+ * Set the on publish complete callback. Must be called after
+ * async_mqtt_client_init() and before async_mqtt_client_start().
+ */
+void async_mqtt_client_set_on_publish_complete(
+    struct async_mqtt_client_t *self_p,
+    async_mqtt_client_on_publish_complete_t on_publish_complete);
+
+/**
+ * Keep up to given number of published QoS 1 and QoS 2 messages in
+ * flight, stored in given array, instead of up to
+ * ASYNC_MQTT_CLIENT_IN_FLIGHT_MAX. A larger window gives higher
+ * throughput. Returns zero, or -ASYNC_ERROR_INVALID_ARGUMENT if
+ * length is not 1 to 32768. Must be called after
+ * async_mqtt_client_init() and before async_mqtt_client_start().
+ */
+int async_mqtt_client_set_in_flight_buffer(
+    struct async_mqtt_client_t *self_p,
+    struct async_mqtt_client_in_flight_message_t *messages_p,
+    int length);
+
+/**
+ * Store topic levels of filters subscribed to with handlers in given
+ * array instead of in an array of ASYNC_MQTT_CLIENT_ROUTER_LEVELS_MAX
+ * levels. Up to three quarters of length levels are used, to keep
+ * lookups fast. Must be called after async_mqtt_client_init() and
+ * before async_mqtt_client_start().
+ */
+void async_mqtt_client_set_router_buffer(
+    struct async_mqtt_client_t *self_p,
+    struct async_mqtt_client_router_level_t *levels_p,
+    int length);
+
+/**
+ * Keep the session for given number of seconds after the connection
+ * is closed, instead of starting a new session when connecting. QoS 1
+ * and QoS 2 messages are then delivered exactly as requested across
+ * reconnects, as long as the session is kept by the broker. Must be
+ * called after async_mqtt_client_init() and before
+ * async_mqtt_client_start().
+ */
+void async_mqtt_client_set_session_expiry_interval(
+    struct async_mqtt_client_t *self_p,
+    uint32_t interval_s);
+
+/**
+ * Receive packets into given buffer, for example allocated from an
+ * arena or a pool owned by the caller, instead of into the default
+ * buffer of ASYNC_MQTT_CLIENT_INPUT_BUFFER_SIZE bytes. The buffer must
+ * be valid as long as the client is started. Must be called after
+ * async_mqtt_client_init() and before async_mqtt_client_start().
+ */
+void async_mqtt_client_set_input_buffer(struct async_mqtt_client_t *self_p,
+                                        void *buf_p,
+                                        size_t size);
+
+/**
+ * Store topics of received topic aliases in given buffer instead of
+ * in the default buffer of ASYNC_MQTT_CLIENT_TOPIC_ALIAS_MAX *
+ * ASYNC_MQTT_CLIENT_TOPIC_ALIAS_TOPIC_SIZE bytes. Each alias takes
+ * as many bytes as the smallest of the receive buffer size and the
+ * maximum packet size, so any received topic can be stored, and the
+ * broker is allowed to send as many aliases as fits, at most
+ * ASYNC_MQTT_CLIENT_TOPIC_ALIAS_MAX. With the default buffers that is
+ * one alias. Must be called after async_mqtt_client_init() and before
+ * async_mqtt_client_start().
+ */
+void async_mqtt_client_set_topic_alias_buffer(
+    struct async_mqtt_client_t *self_p,
+    void *buf_p,
+    size_t size);
+
+/**
+ * Set the maximum packet size the client accepts, sent to the broker
+ * when connecting. The client disconnects from the broker if a larger
+ * packet is received. Defaults to
+ * ASYNC_MQTT_CLIENT_MAXIMUM_PACKET_SIZE. Must be called after
+ * async_mqtt_client_init() and before async_mqtt_client_start().
+ */
+void async_mqtt_client_set_maximum_packet_size(
+    struct async_mqtt_client_t *self_p,
+    size_t size);
+
+/**
+ * Set the on publish chunk callback, called with received messages
+ * that do not fit in the receive buffer, one chunk at a time as they
+ * arrive. offset is the offset of the chunk in the message of
+ * total_size bytes. Such messages are discarded if not set. Must be
+ * called after async_mqtt_client_init() and before
+ * async_mqtt_client_start().
+ */
+void async_mqtt_client_set_on_publish_chunk(
+    struct async_mqtt_client_t *self_p,
+    async_mqtt_client_on_publish_chunk_t on_publish_chunk);
+
+/**
+ * Get statistics of given client, including the number of topic bytes
+ * not sent or received thanks to topic aliases.
+ */
+void async_mqtt_client_get_statistics(
+    struct async_mqtt_client_t *self_p,
+    struct async_mqtt_client_statistics_t *statistics_p);
+
 /**
  * Start given client. A startd client will try to connect to the
  * broker until successful. `on_connected()` passed to
@@ -137,6 +434,37 @@ void async_mqtt_client_stop(struct async_mqtt_client_t *self_p);
 uint16_t async_mqtt_client_subscribe(struct async_mqtt_client_t *self_p,
                                      const char *topic_p);
 
+/**
+ * Subscribe to given topic with given maximum quality of service, 0,
+ * 1 or 2, of received messages. Received QoS 1 messages are
+ * acknowledged once passed to the application, and QoS 2 messages
+ * are passed once even if resent by the broker. Returns the
+ * transaction id, as `async_mqtt_client_subscribe()`, or
+ * -ASYNC_ERROR_INVALID_ARGUMENT if qos is not 0, 1 or 2.
+ */
+int async_mqtt_client_subscribe_with_qos(struct async_mqtt_client_t *self_p,
+                                         const char *topic_p,
+                                         int qos);
+
+/**
+ * Subscribe to given topic filter, optionally with '+' and '#'
+ * wildcards, and call given handler with received messages matching
+ * it. Messages matching no filter with a handler are passed to
+ * `on_publish()` passed to `async_mqtt_client_init()`. A handler of
+ * an already subscribed filter is replaced. Dispatching a message
+ * takes time proportional to the number of levels of its topic, not
+ * the number of filters. The filter must be valid as long as the
+ * client is initialized. Returns the transaction id, as
+ * `async_mqtt_client_subscribe()`, -ASYNC_ERROR_INVALID_ARGUMENT if
+ * the filter is malformed, or -ASYNC_ERROR_QUEUE_FULL if there is no
+ * room for its levels.
+ */
+int async_mqtt_client_subscribe_with_handler(
+    struct async_mqtt_client_t *self_p,
+    const char *filter_p,
+    async_mqtt_client_on_publish_t on_publish,
+    void *obj_p);
+
 /**
  * Publish to given message on given topic, with quality of service
  * zero (QoS 0).
@@ -146,4 +474,21 @@ void async_mqtt_client_publish(struct async_mqtt_client_t *self_p,
                                const void *buf_p,
                                size_t size);
 
+/**
+ * Publish given message on given topic with given quality of service,
+ * 0, 1 or 2. QoS 1 and QoS 2 messages are sent when connected, up to
+ * the in-flight limit, and sent again after reconnecting until
+ * acknowledged by the broker. Topic and message must be valid until
+ * then. Returns the packet identifier, passed to
+ * `on_publish_complete()`, if set, once acknowledged, zero for QoS 0,
+ * -ASYNC_ERROR_INVALID_ARGUMENT if qos is not 0, 1 or 2, or
+ * -ASYNC_ERROR_QUEUE_FULL if the maximum number of messages are
+ * already in flight.
+ */
+int async_mqtt_client_publish_with_qos(struct async_mqtt_client_t *self_p,
+                                       const char *topic_p,
+                                       const void *buf_p,
+                                       size_t size,
+                                       int qos);
+
 #endif
@@ -167,6 +167,15 @@ void async_ssl_connection_write(struct async_ssl_connection_t *self_p,
                                 const void *buf_p,
                                 size_t size);
 
+/**
+ * Write given buffers to given SSL connection. Small buffers are
+ * gathered into one record, while large buffers are encrypted in
+ * place.
+ */
+void async_ssl_connection_writev(struct async_ssl_connection_t *self_p,
+                                 const struct async_iovec_t *iov_p,
+                                 int length);
+
 /**
  * Called when transport input is available.
  */
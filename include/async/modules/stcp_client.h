@@ -98,6 +98,13 @@ void async_stcp_client_write(struct async_stcp_client_t *self_p,
                              const void *buf_p,
                              size_t size);
 
+/**
+ * Write given buffers, in order, to the remote host.
+ */
+void async_stcp_client_writev(struct async_stcp_client_t *self_p,
+                              const struct async_iovec_t *iov_p,
+                              int length);
+
 /**
  * Read up to size bytes from the remote host. Returns the number of
  * read bytes (0..size).
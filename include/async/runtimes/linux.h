@@ -31,6 +31,96 @@
 
 #include "async/core/runtime.h"
 
+struct async_runtime_linux_statistics_t {
+    /* Messages passed between the io and async threads, allocated
+       from slabs owned by the runtime. */
+    struct {
+        /* Number of allocated messages. */
+        size_t allocations;
+        /* Number of allocations that had to allocate a new slab. */
+        size_t misses;
+        /* Number of messages in all slabs. */
+        size_t capacity;
+        /* Number of messages currently in use. */
+        size_t used;
+    } messages;
+};
+
 struct async_runtime_t *async_runtime_linux_create(void);
 
+/**
+ * Get statistics of given runtime created by
+ * async_runtime_linux_create(). May be called from any thread, but
+ * is only approximate while the runtime is running.
+ */
+void async_runtime_linux_get_statistics(
+    struct async_runtime_t *runtime_p,
+    struct async_runtime_linux_statistics_t *statistics_p);
+
+/**
+ * Create a single threaded Linux runtime. I/O, timers and callbacks
+ * are all handled in the thread calling async_run_forever(), without
+ * passing messages between threads. Callbacks must not block, as
+ * that blocks I/O as well.
+ */
+struct async_runtime_t *async_runtime_linux_st_create(void);
+
+/**
+ * Create a single threaded Linux runtime built on io_uring, with
+ * batched submission and multishot accept and receive. Requires Linux
+ * 6.1 or later. Returns NULL if io_uring is not available.
+ */
+struct async_runtime_t *async_runtime_linux_uring_create(void);
+
+struct async_shards_t;
+
+/**
+ * Create given number of shards, zero for one per CPU the process may
+ * run on. Each shard is an async object with its own single threaded
+ * runtime, that is, its own timers, call queues and epoll
+ * instance. Returns NULL on failure.
+ */
+struct async_shards_t *async_shards_create(int number_of_shards);
+
+int async_shards_get_number_of_shards(struct async_shards_t *self_p);
+
+/**
+ * Get the async object of shard given index, from zero to the number
+ * of shards minus one.
+ */
+struct async_t *async_shards_get(struct async_shards_t *self_p, int index);
+
+/**
+ * Get the async object of the shard for given key, for example a
+ * client identifier. The same key always gives the same shard. TCP
+ * clients are handled by the shard of the async object they are
+ * initialized with.
+ */
+struct async_t *async_shards_get_for_key(struct async_shards_t *self_p,
+                                         const void *key_p,
+                                         size_t size);
+
+/**
+ * Run all shards forever, each in its own thread pinned to a CPU. The
+ * first shard runs in the calling thread. Never returns.
+ *
+ * Start one TCP server per shard on the same port, with reuse port
+ * set, to let the kernel distribute accepted connections among the
+ * shards, preferably to the shard on the CPU handling the connection.
+ */
+void async_shards_run_forever(struct async_shards_t *self_p);
+
+/**
+ * Call given function later in given shard async object. Calls from
+ * another shard are passed in a lock-free ring per pair of shards,
+ * calls from the same shard are the same as async_call(), and calls
+ * from any other thread are the same as
+ * async_call_threadsafe(). Returns zero or -ASYNC_ERROR_QUEUE_FULL if
+ * the ring is full or out of memory.
+ */
+int async_call_on(struct async_t *shard_p,
+                  async_func_t func,
+                  void *obj_p,
+                  void *arg_p);
+
 #endif
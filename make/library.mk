@@ -5,6 +5,7 @@ INC += $(ASYNC_ROOT)/include
 SRC += $(ASYNC_ROOT)/src/core/async_core.c
 SRC += $(ASYNC_ROOT)/src/core/async_timer.c
 SRC += $(ASYNC_ROOT)/src/core/async_channel.c
+SRC += $(ASYNC_ROOT)/src/core/async_coroutine.c
 SRC += $(ASYNC_ROOT)/src/core/async_tcp_client.c
 SRC += $(ASYNC_ROOT)/src/core/async_tcp_server.c
 SRC += $(ASYNC_ROOT)/src/core/async_runtime_null.c
@@ -15,6 +16,18 @@ SRC += $(ASYNC_ROOT)/src/modules/async_shell.c
 SRC += $(ASYNC_ROOT)/src/modules/async_mqtt_client.c
 SRC += $(ASYNC_ROOT)/src/runtimes/async_runtime.c
 SRC += $(ASYNC_ROOT)/src/runtimes/async_runtime_linux.c
+SRC += $(ASYNC_ROOT)/src/runtimes/async_runtime_linux_st.c
+SRC += $(ASYNC_ROOT)/src/runtimes/async_runtime_linux_uring.c
+SRC += $(ASYNC_ROOT)/src/runtimes/async_mpsc_ring.c
+SRC += $(ASYNC_ROOT)/src/runtimes/async_spsc_ring.c
+SRC += $(ASYNC_ROOT)/src/runtimes/async_shards.c
+SRC += $(ASYNC_ROOT)/src/runtimes/async_runtime_timer.c
+SRC += $(ASYNC_ROOT)/src/runtimes/async_resolver.c
+SRC += $(ASYNC_ROOT)/src/runtimes/async_input.c
+SRC += $(ASYNC_ROOT)/src/runtimes/async_slab.c
+SRC += $(ASYNC_ROOT)/src/runtimes/async_output.c
+SRC += $(ASYNC_ROOT)/src/runtimes/async_worker_pool.c
+SRC += $(ASYNC_ROOT)/src/runtimes/async_calls.c
 SRC += $(ASYNC_ROOT)/src/utils/async_utils_linux.c
 
 OBJ = $(patsubst %,$(BUILD)%,$(abspath $(SRC:%.c=%.o)))
@@ -26,9 +26,30 @@
  * This file is part of the Async project.
  */
 
+#include <limits.h>
+#include <string.h>
+#include <time.h>
 #include "async/core.h"
 #include "internal.h"
 
+static void statistics_update_put(struct async_func_queue_t *self_p)
+{
+    struct async_call_queue_statistics_t *statistics_p;
+
+    statistics_p = &self_p->statistics;
+    statistics_p->length++;
+
+    if (statistics_p->length > statistics_p->max_length) {
+        statistics_p->max_length = statistics_p->length;
+    }
+
+    if (statistics_p->length > self_p->soft_max) {
+        statistics_p->number_of_overflows++;
+    }
+}
+
+#if defined(ASYNC_FUNC_QUEUE_FIXED)
+
 static bool is_empty(struct async_func_queue_t *self_p)
 {
     return (self_p->rdpos == self_p->wrpos);
@@ -40,13 +61,13 @@ static bool is_full(struct async_func_queue_t *self_p)
 }
 
 static void async_func_queue_init(struct async_func_queue_t *self_p,
-                                  struct async_func_queue_elem_t *elems_p,
+                                  struct async_func_queue_elem_t *list_p,
                                   int length)
 {
     self_p->rdpos = 0;
     self_p->wrpos = 0;
     self_p->length = length;
-    self_p->list_p = elems_p;
+    self_p->list_p = list_p;
 }
 
 static void async_func_queue_destroy(struct async_func_queue_t *self_p)
@@ -69,6 +90,7 @@ static async_func_t async_func_queue_get(struct async_func_queue_t *self_p,
     *arg_pp = self_p->list_p[self_p->rdpos].arg_p;
     self_p->rdpos++;
     self_p->rdpos %= self_p->length;
+    self_p->statistics.length--;
 
     return (func);
 }
@@ -79,6 +101,8 @@ static int async_func_queue_put(struct async_func_queue_t *self_p,
                                 void *arg_p)
 {
     if (is_full(self_p)) {
+        self_p->statistics.number_of_drops++;
+
         return (-ASYNC_ERROR_QUEUE_FULL);
     }
 
@@ -87,10 +111,265 @@ static int async_func_queue_put(struct async_func_queue_t *self_p,
     self_p->list_p[self_p->wrpos].arg_p = arg_p;
     self_p->wrpos++;
     self_p->wrpos %= self_p->length;
+    statistics_update_put(self_p);
 
     return (0);
 }
 
+#else
+
+static struct async_func_queue_segment_t *segment_alloc(
+    struct async_func_queue_t *self_p)
+{
+    struct async_func_queue_segment_t *segment_p;
+
+    segment_p = self_p->pool.head_p;
+
+    if (segment_p != NULL) {
+        self_p->pool.head_p = segment_p->next_p;
+        self_p->pool.length--;
+    } else {
+        segment_p = malloc(sizeof(*segment_p));
+
+        if (segment_p == NULL) {
+            return (NULL);
+        }
+    }
+
+    segment_p->next_p = NULL;
+
+    return (segment_p);
+}
+
+/**
+ * Keep given drained segment for reuse, unless the pool already
+ * holds soft max calls.
+ */
+static void segment_free(struct async_func_queue_t *self_p,
+                         struct async_func_queue_segment_t *segment_p)
+{
+    if ((self_p->pool.length * ASYNC_FUNC_QUEUE_SEGMENT_LENGTH)
+        >= self_p->soft_max) {
+        free(segment_p);
+    } else {
+        segment_p->next_p = self_p->pool.head_p;
+        self_p->pool.head_p = segment_p;
+        self_p->pool.length++;
+    }
+}
+
+static void segment_list_free(struct async_func_queue_segment_t *segment_p)
+{
+    struct async_func_queue_segment_t *next_p;
+
+    while (segment_p != NULL) {
+        next_p = segment_p->next_p;
+        free(segment_p);
+        segment_p = next_p;
+    }
+}
+
+static void async_func_queue_init(struct async_func_queue_t *self_p)
+{
+    self_p->read.segment_p = NULL;
+    self_p->read.pos = 0;
+    self_p->write.segment_p = NULL;
+    self_p->write.pos = 0;
+    self_p->pool.head_p = NULL;
+    self_p->pool.length = 0;
+}
+
+static void async_func_queue_destroy(struct async_func_queue_t *self_p)
+{
+    segment_list_free(self_p->read.segment_p);
+    segment_list_free(self_p->pool.head_p);
+    async_func_queue_init(self_p);
+}
+
+static async_func_t async_func_queue_get(struct async_func_queue_t *self_p,
+                                         void **obj_pp,
+                                         void **arg_pp)
+{
+    struct async_func_queue_segment_t *segment_p;
+    struct async_func_queue_elem_t *elem_p;
+    async_func_t func;
+
+    if (self_p->statistics.length == 0) {
+        return (NULL);
+    }
+
+    segment_p = self_p->read.segment_p;
+    elem_p = &segment_p->elems[self_p->read.pos];
+    func = elem_p->func;
+    *obj_pp = elem_p->obj_p;
+    *arg_pp = elem_p->arg_p;
+    self_p->read.pos++;
+    self_p->statistics.length--;
+
+    if (self_p->statistics.length == 0) {
+        /* Reuse the last segment from the start. */
+        self_p->read.pos = 0;
+        self_p->write.pos = 0;
+    } else if (self_p->read.pos == ASYNC_FUNC_QUEUE_SEGMENT_LENGTH) {
+        self_p->read.segment_p = segment_p->next_p;
+        self_p->read.pos = 0;
+        segment_free(self_p, segment_p);
+    }
+
+    return (func);
+}
+
+static int async_func_queue_put(struct async_func_queue_t *self_p,
+                                async_func_t func,
+                                void *obj_p,
+                                void *arg_p)
+{
+    struct async_func_queue_segment_t *segment_p;
+    struct async_func_queue_elem_t *elem_p;
+
+    if (self_p->write.segment_p == NULL) {
+        segment_p = segment_alloc(self_p);
+
+        if (segment_p == NULL) {
+            self_p->statistics.number_of_drops++;
+
+            return (-ASYNC_ERROR_QUEUE_FULL);
+        }
+
+        self_p->read.segment_p = segment_p;
+        self_p->write.segment_p = segment_p;
+    } else if (self_p->write.pos == ASYNC_FUNC_QUEUE_SEGMENT_LENGTH) {
+        segment_p = segment_alloc(self_p);
+
+        if (segment_p == NULL) {
+            self_p->statistics.number_of_drops++;
+
+            return (-ASYNC_ERROR_QUEUE_FULL);
+        }
+
+        self_p->write.segment_p->next_p = segment_p;
+        self_p->write.segment_p = segment_p;
+        self_p->write.pos = 0;
+    }
+
+    elem_p = &self_p->write.segment_p->elems[self_p->write.pos];
+    elem_p->func = func;
+    elem_p->obj_p = obj_p;
+    elem_p->arg_p = arg_p;
+    self_p->write.pos++;
+    statistics_update_put(self_p);
+
+    return (0);
+}
+
+#endif
+
+static void funcs_init(struct async_t *self_p)
+{
+    int i;
+
+    for (i = 0; i < ASYNC_PRIORITY_MAX; i++) {
+        memset(&self_p->funcs[i].statistics,
+               0,
+               sizeof(self_p->funcs[i].statistics));
+        self_p->funcs[i].soft_max = ASYNC_FUNC_QUEUE_SOFT_MAX;
+    }
+
+#if defined(ASYNC_FUNC_QUEUE_FIXED)
+    async_func_queue_init(&self_p->funcs[ASYNC_PRIORITY_HIGH],
+                          &self_p->elems.high[0],
+                          ASYNC_FUNC_QUEUE_HIGH_MAX);
+    async_func_queue_init(&self_p->funcs[ASYNC_PRIORITY_NORMAL],
+                          &self_p->elems.normal[0],
+                          ASYNC_FUNC_QUEUE_MAX);
+    async_func_queue_init(&self_p->funcs[ASYNC_PRIORITY_IDLE],
+                          &self_p->elems.idle[0],
+                          ASYNC_FUNC_QUEUE_IDLE_MAX);
+#else
+    for (i = 0; i < ASYNC_PRIORITY_MAX; i++) {
+        async_func_queue_init(&self_p->funcs[i]);
+    }
+#endif
+}
+
+struct process_budget_t {
+    int calls_left;
+    bool timed;
+    struct timespec deadline;
+    bool exhausted;
+};
+
+static void process_budget_init(struct process_budget_t *self_p,
+                                struct async_t *async_p)
+{
+    long nsec;
+
+    if (async_p->process.max_calls > 0) {
+        self_p->calls_left = async_p->process.max_calls;
+    } else {
+        self_p->calls_left = INT_MAX;
+    }
+
+    self_p->timed = (async_p->process.max_time_in_us > 0);
+
+    if (self_p->timed) {
+        clock_gettime(CLOCK_MONOTONIC, &self_p->deadline);
+        nsec = (self_p->deadline.tv_nsec
+                + 1000L * (async_p->process.max_time_in_us % 1000000));
+        self_p->deadline.tv_sec += (async_p->process.max_time_in_us / 1000000
+                                    + nsec / 1000000000L);
+        self_p->deadline.tv_nsec = (nsec % 1000000000L);
+    }
+
+    self_p->exhausted = false;
+}
+
+static void process_budget_spend(struct process_budget_t *self_p)
+{
+    struct timespec now;
+
+    self_p->calls_left--;
+
+    if (self_p->calls_left == 0) {
+        self_p->exhausted = true;
+    } else if (self_p->timed) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        if ((now.tv_sec > self_p->deadline.tv_sec)
+            || ((now.tv_sec == self_p->deadline.tv_sec)
+                && (now.tv_nsec >= self_p->deadline.tv_nsec))) {
+            self_p->exhausted = true;
+        }
+    }
+}
+
+/**
+ * Make up to given number of calls from given queue, within given
+ * budget. Returns the number of made calls.
+ */
+static int call_queued(struct async_func_queue_t *self_p,
+                       int max,
+                       struct process_budget_t *budget_p)
+{
+    async_func_t func;
+    void *obj_p;
+    void *arg_p;
+    int count;
+
+    for (count = 0; (count < max) && !budget_p->exhausted; count++) {
+        func = async_func_queue_get(self_p, &obj_p, &arg_p);
+
+        if (func == NULL) {
+            break;
+        }
+
+        func(obj_p, arg_p);
+        process_budget_spend(budget_p);
+    }
+
+    return (count);
+}
+
 static void log_object_print_null(void *log_object_p,
                                   int level,
                                   const char *fmt_p,
@@ -114,11 +393,13 @@ void async_init(struct async_t *self_p)
 {
     self_p->tick_in_ms = 100;
     async_timer_list_init(&self_p->running_timers);
-    async_func_queue_init(&self_p->funcs,
-                          &self_p->elems[0],
-                          ASYNC_FUNC_QUEUE_MAX);
+    funcs_init(self_p);
     self_p->log_object.print = log_object_print_null;
     self_p->log_object.is_enabled_for = log_object_is_enabled_for_null;
+    self_p->process.max_calls = ASYNC_PROCESS_MAX_CALLS;
+    self_p->process.max_time_in_us = ASYNC_PROCESS_MAX_TIME_IN_US;
+    self_p->worker_pool.number_of_workers = ASYNC_WORKER_POOL_NUMBER_OF_WORKERS;
+    self_p->worker_pool.queue_length = ASYNC_WORKER_POOL_QUEUE_LENGTH;
     self_p->runtime_p = async_runtime_null_create();
 }
 
@@ -145,6 +426,53 @@ void async_set_tick_in_ms(struct async_t *self_p,
     self_p->tick_in_ms = tick_in_ms;
 }
 
+void async_set_call_queue_soft_max(struct async_t *self_p, int length)
+{
+    int i;
+
+    for (i = 0; i < ASYNC_PRIORITY_MAX; i++) {
+        self_p->funcs[i].soft_max = length;
+    }
+}
+
+void async_set_process_budget(struct async_t *self_p,
+                              int max_calls,
+                              int max_time_in_us)
+{
+    self_p->process.max_calls = max_calls;
+    self_p->process.max_time_in_us = max_time_in_us;
+}
+
+void async_set_worker_pool_size(struct async_t *self_p,
+                                int number_of_workers,
+                                int queue_length)
+{
+    self_p->worker_pool.number_of_workers = number_of_workers;
+    self_p->worker_pool.queue_length = queue_length;
+}
+
+void async_get_call_queue_statistics(
+    struct async_t *self_p,
+    struct async_call_queue_statistics_t *statistics_p)
+{
+    struct async_call_queue_statistics_t *lane_p;
+    int i;
+
+    memset(statistics_p, 0, sizeof(*statistics_p));
+
+    for (i = 0; i < ASYNC_PRIORITY_MAX; i++) {
+        lane_p = &self_p->funcs[i].statistics;
+        statistics_p->length += lane_p->length;
+
+        if (lane_p->max_length > statistics_p->max_length) {
+            statistics_p->max_length = lane_p->max_length;
+        }
+
+        statistics_p->number_of_overflows += lane_p->number_of_overflows;
+        statistics_p->number_of_drops += lane_p->number_of_drops;
+    }
+}
+
 void async_set_runtime(struct async_t *self_p,
                        struct async_runtime_t *runtime_p)
 {
@@ -158,7 +486,11 @@ void async_set_runtime(struct async_t *self_p,
 
 void async_destroy(struct async_t *self_p)
 {
-    async_func_queue_destroy(&self_p->funcs);
+    int i;
+
+    for (i = 0; i < ASYNC_PRIORITY_MAX; i++) {
+        async_func_queue_destroy(&self_p->funcs[i]);
+    }
 }
 
 void async_tick(struct async_t *self_p)
@@ -166,26 +498,103 @@ void async_tick(struct async_t *self_p)
     async_timer_list_tick(&self_p->running_timers);
 }
 
+void async_advance(struct async_t *self_p, unsigned int ticks)
+{
+    async_timer_list_advance(&self_p->running_timers, ticks);
+}
+
+int async_next_timeout(struct async_t *self_p)
+{
+    int ticks;
+
+    ticks = async_timer_list_next_timeout(&self_p->running_timers);
+
+    if (ticks == -1) {
+        return (-1);
+    } else if (ticks > (INT_MAX / self_p->tick_in_ms)) {
+        return (INT_MAX);
+    }
+
+    return (ticks * self_p->tick_in_ms);
+}
+
 void async_process(struct async_t *self_p)
 {
-    async_func_t func;
-    void *obj_p;
-    void *arg_p;
+    struct async_func_queue_t *idle_p;
+    struct process_budget_t budget;
+    int idle_budget;
+
+    process_budget_init(&budget, self_p);
+    idle_p = &self_p->funcs[ASYNC_PRIORITY_IDLE];
+    idle_budget = -1;
 
     while (true) {
-        func = async_func_queue_get(&self_p->funcs, &obj_p, &arg_p);
+        call_queued(&self_p->funcs[ASYNC_PRIORITY_HIGH], INT_MAX, &budget);
 
-        if (func == NULL) {
+        if (call_queued(&self_p->funcs[ASYNC_PRIORITY_NORMAL],
+                        ASYNC_FUNC_QUEUE_NORMAL_BATCH,
+                        &budget) > 0) {
+            continue;
+        }
+
+        if (budget.exhausted) {
             break;
         }
 
-        func(obj_p, arg_p);
+        /* Only idle calls queued when there first was nothing else
+           to do, or idle calls queueing themselves would never
+           return. */
+        if (idle_budget == -1) {
+            idle_budget = idle_p->statistics.length;
+        }
+
+        if (idle_budget == 0) {
+            break;
+        }
+
+        if (call_queued(idle_p, 1, &budget) == 0) {
+            break;
+        }
+
+        idle_budget--;
+    }
+}
+
+bool async_has_pending_calls(struct async_t *self_p)
+{
+    int i;
+
+    for (i = 0; i < ASYNC_PRIORITY_MAX; i++) {
+        if (self_p->funcs[i].statistics.length > 0) {
+            return (true);
+        }
     }
+
+    return (false);
 }
 
 int async_call(struct async_t *self_p, async_func_t func, void *obj_p, void *arg_p)
 {
-    return (async_func_queue_put(&self_p->funcs, func, obj_p, arg_p));
+    return (async_func_queue_put(&self_p->funcs[ASYNC_PRIORITY_NORMAL],
+                                 func,
+                                 obj_p,
+                                 arg_p));
+}
+
+int async_call_with_priority(struct async_t *self_p,
+                             int priority,
+                             async_func_t func,
+                             void *obj_p,
+                             void *arg_p)
+{
+    if ((priority < ASYNC_PRIORITY_HIGH) || (priority > ASYNC_PRIORITY_IDLE)) {
+        return (-ASYNC_ERROR_INVALID_ARGUMENT);
+    }
+
+    return (async_func_queue_put(&self_p->funcs[priority],
+                                 func,
+                                 obj_p,
+                                 arg_p));
 }
 
 void async_call_threadsafe(struct async_t *self_p,
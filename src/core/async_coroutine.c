@@ -0,0 +1,144 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+#include "async/core.h"
+
+static void on_call(struct async_coroutine_t *self_p, void *arg_p)
+{
+    (void)arg_p;
+
+    async_coroutine_resume(self_p);
+}
+
+static void on_timeout(struct async_coroutine_t *self_p)
+{
+    if (!self_p->waiting) {
+        return;
+    }
+
+    self_p->waiting = false;
+    self_p->res = -ASYNC_ERROR_TIMEOUT;
+    async_coroutine_resume(self_p);
+}
+
+static void on_worker_pool_complete(struct async_coroutine_t *self_p,
+                                    void *arg_p)
+{
+    (void)arg_p;
+
+    self_p->waiting = false;
+    async_coroutine_resume(self_p);
+}
+
+void async_coroutine_init(struct async_coroutine_t *self_p,
+                          async_coroutine_entry_t entry,
+                          void *obj_p,
+                          struct async_t *async_p)
+{
+    self_p->async_p = async_p;
+    self_p->entry = entry;
+    self_p->line = ASYNC_COROUTINE_DONE;
+    self_p->res = 0;
+    self_p->waiting = false;
+    async_timer_init(&self_p->timer,
+                     (async_timer_timeout_t)on_timeout,
+                     self_p,
+                     0,
+                     0,
+                     async_p);
+    self_p->obj_p = obj_p;
+}
+
+int async_coroutine_start(struct async_coroutine_t *self_p)
+{
+    async_coroutine_stop(self_p);
+    self_p->line = 0;
+    self_p->res = 0;
+
+    return (async_coroutine_call(self_p));
+}
+
+void async_coroutine_stop(struct async_coroutine_t *self_p)
+{
+    async_timer_stop(&self_p->timer);
+    self_p->waiting = false;
+    self_p->line = ASYNC_COROUTINE_DONE;
+}
+
+void async_coroutine_resume(struct async_coroutine_t *self_p)
+{
+    if (self_p->line != ASYNC_COROUTINE_DONE) {
+        self_p->entry(self_p);
+    }
+}
+
+bool async_coroutine_is_done(struct async_coroutine_t *self_p)
+{
+    return (self_p->line == ASYNC_COROUTINE_DONE);
+}
+
+int async_coroutine_call(struct async_coroutine_t *self_p)
+{
+    return (async_call(self_p->async_p, (async_func_t)on_call, self_p, NULL));
+}
+
+void async_coroutine_timer_start(struct async_coroutine_t *self_p,
+                                 unsigned int timeout)
+{
+    self_p->waiting = true;
+    self_p->res = 0;
+    async_timer_set_initial(&self_p->timer, timeout);
+    async_timer_start(&self_p->timer);
+}
+
+bool async_coroutine_timer_check(struct async_coroutine_t *self_p,
+                                 bool ready)
+{
+    if (ready) {
+        if (self_p->waiting) {
+            async_timer_stop(&self_p->timer);
+            self_p->waiting = false;
+        }
+
+        self_p->res = 0;
+    }
+
+    return (!self_p->waiting);
+}
+
+void async_coroutine_call_worker_pool(struct async_coroutine_t *self_p,
+                                      async_func_t entry,
+                                      void *arg_p)
+{
+    self_p->res = async_call_worker_pool(self_p->async_p,
+                                         entry,
+                                         self_p,
+                                         arg_p,
+                                         (async_func_t)on_worker_pool_complete);
+    self_p->waiting = (self_p->res == 0);
+}
@@ -77,6 +77,20 @@ static void tcp_client_write()
     exit(1);
 }
 
+static void tcp_client_writev()
+{
+    fprintf(stderr, "async_tcp_client_writev() not implemented.\n");
+    exit(1);
+}
+
+static bool tcp_client_is_writable()
+{
+    fprintf(stderr, "async_tcp_client_is_writable() not implemented.\n");
+    exit(1);
+
+    return (false);
+}
+
 static size_t tcp_client_read()
 {
     fprintf(stderr, "async_tcp_client_read() not implemented.\n");
@@ -85,6 +99,20 @@ static size_t tcp_client_read()
     return (0);
 }
 
+static size_t tcp_client_borrow()
+{
+    fprintf(stderr, "async_tcp_client_borrow() not implemented.\n");
+    exit(1);
+
+    return (0);
+}
+
+static void tcp_client_release()
+{
+    fprintf(stderr, "async_tcp_client_release() not implemented.\n");
+    exit(1);
+}
+
 static void tcp_server_init()
 {
     fprintf(stderr, "async_tcp_server_init() not implemented.\n");
@@ -125,6 +153,20 @@ static size_t tcp_server_client_read()
     return (0);
 }
 
+static size_t tcp_server_client_borrow()
+{
+    fprintf(stderr, "async_tcp_server_client_borrow() not implemented.\n");
+    exit(1);
+
+    return (0);
+}
+
+static void tcp_server_client_release()
+{
+    fprintf(stderr, "async_tcp_server_client_release() not implemented.\n");
+    exit(1);
+}
+
 static void tcp_server_client_disconnect()
 {
     fprintf(stderr, "async_tcp_server_client_disconnect() not implemented.\n");
@@ -141,7 +183,11 @@ static struct async_runtime_t runtime = {
         .connect = tcp_client_connect,
         .disconnect = tcp_client_disconnect,
         .write = tcp_client_write,
-        .read = tcp_client_read
+        .writev = tcp_client_writev,
+        .is_writable = tcp_client_is_writable,
+        .read = tcp_client_read,
+        .borrow = tcp_client_borrow,
+        .release = tcp_client_release
     },
     .tcp_server = {
         .init = tcp_server_init,
@@ -151,6 +197,8 @@ static struct async_runtime_t runtime = {
         .client = {
             .write = tcp_server_client_write,
             .read = tcp_server_client_read,
+            .borrow = tcp_server_client_borrow,
+            .release = tcp_server_client_release,
             .disconnect = tcp_server_client_disconnect
         }
     }
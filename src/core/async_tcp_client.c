@@ -42,13 +42,22 @@ static void on_disconnected_default(struct async_tcp_client_t *self_p)
     (void)self_p;
 }
 
+static void on_writable_default(struct async_tcp_client_t *self_p)
+{
+    (void)self_p;
+}
+
 static void on_input_default(struct async_tcp_client_t *self_p)
 {
-    char buf[32];
+    const uint8_t *buf_p;
     size_t size;
 
     do {
-        size = async_tcp_client_read(self_p, &buf[0], sizeof(buf));
+        size = async_tcp_client_borrow(self_p, &buf_p);
+
+        if (size > 0) {
+            async_tcp_client_release(self_p, size);
+        }
     } while (size > 0);
 }
 
@@ -71,12 +80,40 @@ void async_tcp_client_init(struct async_tcp_client_t *self_p,
     }
 
     self_p->async_p = async_p;
+    self_p->connect_timeout = ASYNC_TCP_CLIENT_CONNECT_TIMEOUT;
+    self_p->output.low_watermark = ASYNC_TCP_CLIENT_OUTPUT_LOW_WATERMARK;
+    self_p->output.high_watermark = ASYNC_TCP_CLIENT_OUTPUT_HIGH_WATERMARK;
+    self_p->output.on_writable = on_writable_default;
     async_p->runtime_p->tcp_client.init(self_p,
                                         on_connected,
                                         on_disconnected,
                                         on_input);
 }
 
+void async_tcp_client_set_connect_timeout(struct async_tcp_client_t *self_p,
+                                          unsigned int timeout)
+{
+    self_p->connect_timeout = timeout;
+}
+
+void async_tcp_client_set_output_watermarks(struct async_tcp_client_t *self_p,
+                                            size_t low,
+                                            size_t high)
+{
+    self_p->output.low_watermark = low;
+    self_p->output.high_watermark = high;
+}
+
+void async_tcp_client_set_on_writable(struct async_tcp_client_t *self_p,
+                                      async_tcp_client_writable_t on_writable)
+{
+    if (on_writable == NULL) {
+        on_writable = on_writable_default;
+    }
+
+    self_p->output.on_writable = on_writable;
+}
+
 void async_tcp_client_connect(struct async_tcp_client_t *self_p,
                               const char *host_p,
                               int port)
@@ -96,9 +133,32 @@ void async_tcp_client_write(struct async_tcp_client_t *self_p,
     self_p->async_p->runtime_p->tcp_client.write(self_p, buf_p, size);
 }
 
+void async_tcp_client_writev(struct async_tcp_client_t *self_p,
+                             const struct async_iovec_t *iov_p,
+                             int length)
+{
+    self_p->async_p->runtime_p->tcp_client.writev(self_p, iov_p, length);
+}
+
+bool async_tcp_client_is_writable(struct async_tcp_client_t *self_p)
+{
+    return (self_p->async_p->runtime_p->tcp_client.is_writable(self_p));
+}
+
 size_t async_tcp_client_read(struct async_tcp_client_t *self_p,
                              void *buf_p,
                              size_t size)
 {
     return (self_p->async_p->runtime_p->tcp_client.read(self_p, buf_p, size));
 }
+
+size_t async_tcp_client_borrow(struct async_tcp_client_t *self_p,
+                               const uint8_t **buf_pp)
+{
+    return (self_p->async_p->runtime_p->tcp_client.borrow(self_p, buf_pp));
+}
+
+void async_tcp_client_release(struct async_tcp_client_t *self_p, size_t size)
+{
+    self_p->async_p->runtime_p->tcp_client.release(self_p, size);
+}
@@ -41,11 +41,15 @@ static void on_disconnected_default()
 
 static void on_input_default(struct async_tcp_server_client_t *self_p)
 {
-    char buf[32];
+    const uint8_t *buf_p;
     size_t size;
 
     do {
-        size = async_tcp_server_client_read(self_p, &buf[0], sizeof(buf));
+        size = async_tcp_server_client_borrow(self_p, &buf_p);
+
+        if (size > 0) {
+            async_tcp_server_client_release(self_p, size);
+        }
     } while (size > 0);
 }
 
@@ -70,6 +74,8 @@ void async_tcp_server_init(struct async_tcp_server_t *self_p,
     }
 
     self_p->async_p = async_p;
+    self_p->backlog = ASYNC_TCP_SERVER_BACKLOG;
+    self_p->reuse_port = false;
     async_p->runtime_p->tcp_server.init(self_p,
                                         host_p,
                                         port,
@@ -78,6 +84,18 @@ void async_tcp_server_init(struct async_tcp_server_t *self_p,
                                         on_input);
 }
 
+void async_tcp_server_set_backlog(struct async_tcp_server_t *self_p,
+                                  int backlog)
+{
+    self_p->backlog = backlog;
+}
+
+void async_tcp_server_set_reuse_port(struct async_tcp_server_t *self_p,
+                                     bool reuse_port)
+{
+    self_p->reuse_port = reuse_port;
+}
+
 void async_tcp_server_add_client(struct async_tcp_server_t *self_p,
                                  struct async_tcp_server_client_t *client_p)
 {
@@ -113,6 +131,21 @@ size_t async_tcp_server_client_read(struct async_tcp_server_client_t *self_p,
                                                                          size));
 }
 
+size_t async_tcp_server_client_borrow(struct async_tcp_server_client_t *self_p,
+                                      const uint8_t **buf_pp)
+{
+    return (self_p->server_p->async_p->runtime_p->tcp_server.client.borrow(
+                self_p,
+                buf_pp));
+}
+
+void async_tcp_server_client_release(struct async_tcp_server_client_t *self_p,
+                                     size_t size)
+{
+    self_p->server_p->async_p->runtime_p->tcp_server.client.release(self_p,
+                                                                    size);
+}
+
 void async_tcp_server_client_disconnect(struct async_tcp_server_client_t *self_p)
 {
     self_p->server_p->async_p->runtime_p->tcp_server.client.disconnect(self_p);
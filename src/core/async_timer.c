@@ -27,18 +27,16 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <limits.h>
 #include "async/core.h"
 #include "internal.h"
 
-static bool is_any_timer_running(struct async_timer_list_t *self_p)
-{
-    return (self_p->head_p != &self_p->tail);
-}
+#define LEVEL_MASK (ASYNC_TIMER_WHEEL_SLOTS - 1)
 
-static bool is_tail_timer(struct async_timer_list_t *self_p,
-                          struct async_timer_t *timer_p)
+static unsigned int level_shift(int level)
 {
-    return (timer_p == &self_p->tail);
+    return (ASYNC_TIMER_WHEEL_LEVEL_BITS * level);
 }
 
 static void on_timeout(struct async_timer_t *self_p, void *arg_p)
@@ -56,72 +54,82 @@ static void on_timeout(struct async_timer_t *self_p, void *arg_p)
     self_p->on_timeout(self_p->obj_p);
 }
 
+static void slot_push(struct async_timer_t **slot_pp,
+                      struct async_timer_t *timer_p)
+{
+    timer_p->next_p = *slot_pp;
+    timer_p->prev_next_pp = slot_pp;
+
+    if (timer_p->next_p != NULL) {
+        timer_p->next_p->prev_next_pp = &timer_p->next_p;
+    }
+
+    *slot_pp = timer_p;
+}
+
+/**
+ * Insert given timer into the slot its expiry tick belongs to. Timers
+ * expiring within one revolution of level zero are put in level
+ * zero, timers expiring within one revolution of level one are put
+ * in level one, and so on.
+ */
 static void timer_list_insert(struct async_timer_list_t *self_p,
                               struct async_timer_t *timer_p)
 {
-    struct async_timer_t *elem_p;
-    struct async_timer_t *prev_p;
+    unsigned int delta;
+    int level;
+    int index;
 
-    /* Find element preceeding this timer. */
-    elem_p = self_p->head_p;
-    prev_p = NULL;
+    delta = (timer_p->expires - self_p->tick);
 
-    /* Find the element to insert this timer before. Delta is
-       initially the timeout. */
-    while (elem_p->delta < timer_p->delta) {
-        timer_p->delta -= elem_p->delta;
-        prev_p = elem_p;
-        elem_p = elem_p->next_p;
+    for (level = 0; level < ASYNC_TIMER_WHEEL_LEVELS - 1; level++) {
+        if (delta < (1u << level_shift(level + 1))) {
+            break;
+        }
     }
 
-    /* Adjust the next timer for this timers delta. Do not adjust the
-       tail timer. */
-    if (!is_tail_timer(self_p, elem_p)) {
-        elem_p->delta -= timer_p->delta;
-    }
+    index = ((timer_p->expires >> level_shift(level)) & LEVEL_MASK);
+    slot_push(&self_p->slots[level][index], timer_p);
+}
 
-    /* Insert the new timer into list. */
-    timer_p->next_p = elem_p;
+/**
+ * Remove given running timer from the slot it is in.
+ */
+static void timer_list_remove(struct async_timer_t *timer_p)
+{
+    *timer_p->prev_next_pp = timer_p->next_p;
 
-    if (prev_p == NULL) {
-        self_p->head_p = timer_p;
-    } else {
-        prev_p->next_p = timer_p;
+    if (timer_p->next_p != NULL) {
+        timer_p->next_p->prev_next_pp = timer_p->prev_next_pp;
     }
+
+    timer_p->next_p = NULL;
+    timer_p->prev_next_pp = NULL;
 }
 
 /**
- * Remove given timer from given list of active timers.
+ * Move all timers in the current slot of each level to lower levels,
+ * as the current tick has reached the start of the slot.
  */
-static void timer_list_remove(struct async_timer_list_t *self_p,
-                              struct async_timer_t *timer_p)
+static void timer_list_cascade(struct async_timer_list_t *self_p)
 {
-    struct async_timer_t *elem_p;
-    struct async_timer_t *prev_p;
-
-    /* Find element preceeding this timer.*/
-    elem_p = self_p->head_p;
-    prev_p = NULL;
+    struct async_timer_t *timer_p;
+    struct async_timer_t **slot_pp;
+    int level;
 
-    while (elem_p != NULL) {
-        if (elem_p == timer_p) {
-            /* Remove the timer from the list. */
-            if (prev_p != NULL) {
-                prev_p->next_p = elem_p->next_p;
-            } else {
-                self_p->head_p = elem_p->next_p;
-            }
+    for (level = 1; level < ASYNC_TIMER_WHEEL_LEVELS; level++) {
+        if (((self_p->tick >> level_shift(level - 1)) & LEVEL_MASK) != 0) {
+            break;
+        }
 
-            /* Add the delta timeout to the next timer. */
-            if (!is_tail_timer(self_p, elem_p->next_p)) {
-                elem_p->next_p->delta += elem_p->delta;
-            }
+        slot_pp = &self_p->slots[level][(self_p->tick >> level_shift(level))
+                                        & LEVEL_MASK];
 
-            return;
+        while (*slot_pp != NULL) {
+            timer_p = *slot_pp;
+            timer_list_remove(timer_p);
+            timer_list_insert(self_p, timer_p);
         }
-
-        prev_p = elem_p;
-        elem_p = elem_p->next_p;
     }
 }
 
@@ -139,6 +147,8 @@ void async_timer_init(struct async_timer_t *self_p,
     async_timer_set_repeat(self_p, repeat);
     self_p->number_of_outstanding_timeouts = 0;
     self_p->number_of_timeouts_to_ignore = 0;
+    self_p->next_p = NULL;
+    self_p->prev_next_pp = NULL;
 }
 
 void async_timer_set_initial(struct async_timer_t *self_p,
@@ -168,45 +178,153 @@ unsigned int async_timer_get_repeat(struct async_timer_t *self_p)
 
 void async_timer_start(struct async_timer_t *self_p)
 {
-    async_timer_stop(self_p);
-    self_p->delta = self_p->initial_ticks;
-    timer_list_insert(&self_p->async_p->running_timers, self_p);
+    struct async_timer_list_t *list_p;
+    unsigned int expires;
+
+    list_p = &self_p->async_p->running_timers;
+    expires = (list_p->tick + self_p->initial_ticks);
+    self_p->number_of_timeouts_to_ignore = self_p->number_of_outstanding_timeouts;
+
+    if (async_timer_is_running(self_p)) {
+        /* Restarted within the same tick, often by frequent traffic
+           on a connection. The timer is already in a valid slot. */
+        if (self_p->expires == expires) {
+            return;
+        }
+
+        timer_list_remove(self_p);
+    }
+
+    self_p->expires = expires;
+    timer_list_insert(list_p, self_p);
 }
 
 void async_timer_stop(struct async_timer_t *self_p)
 {
     self_p->number_of_timeouts_to_ignore = self_p->number_of_outstanding_timeouts;
-    timer_list_remove(&self_p->async_p->running_timers, self_p);
+
+    if (async_timer_is_running(self_p)) {
+        timer_list_remove(self_p);
+    }
+}
+
+bool async_timer_is_running(struct async_timer_t *self_p)
+{
+    return (self_p->prev_next_pp != NULL);
 }
 
 void async_timer_list_init(struct async_timer_list_t *self_p)
 {
-    self_p->head_p = &self_p->tail;
-    self_p->tail.next_p = NULL;
-    self_p->tail.delta = -1;
+    memset(self_p, 0, sizeof(*self_p));
 }
 
 void async_timer_list_tick(struct async_timer_list_t *self_p)
 {
     struct async_timer_t *timer_p;
+    struct async_timer_t **slot_pp;
+    int res;
 
-    if (!is_any_timer_running(self_p)) {
-        return;
+    self_p->tick++;
+
+    if ((self_p->tick & LEVEL_MASK) == 0) {
+        timer_list_cascade(self_p);
     }
 
-    /* Fire all expired timers.*/
-    self_p->head_p->delta--;
+    /* Fire all expired timers. */
+    slot_pp = &self_p->slots[0][self_p->tick & LEVEL_MASK];
 
-    while (self_p->head_p->delta == 0) {
-        timer_p = self_p->head_p;
-        self_p->head_p = timer_p->next_p;
-        timer_p->number_of_outstanding_timeouts++;
-        async_call(timer_p->async_p, (async_func_t)on_timeout, timer_p, NULL);
+    while (*slot_pp != NULL) {
+        timer_p = *slot_pp;
+        timer_list_remove(timer_p);
+        res = async_call(timer_p->async_p,
+                         (async_func_t)on_timeout,
+                         timer_p,
+                         NULL);
+
+        if (res == 0) {
+            timer_p->number_of_outstanding_timeouts++;
+        }
 
         /* Re-set periodic timers. */
         if (timer_p->repeat_ticks > 0) {
-            timer_p->delta = timer_p->repeat_ticks;
+            timer_p->expires = (self_p->tick + timer_p->repeat_ticks);
             timer_list_insert(self_p, timer_p);
         }
     }
 }
+
+/**
+ * Returns the number of ticks until the next tick that fires a timer
+ * or cascades a non-empty slot, or -1 if no timer is running. Level
+ * zero is exact, while higher levels give the time their next
+ * non-empty slot is cascaded, which is never later than the expiry
+ * of any timer in it.
+ */
+int async_timer_list_next_timeout(struct async_timer_list_t *self_p)
+{
+    unsigned long long ticks;
+    unsigned long long best;
+    unsigned int shift;
+    unsigned int offset;
+    unsigned int base;
+    unsigned int index;
+    int level;
+
+    best = ULLONG_MAX;
+
+    for (level = 0; level < ASYNC_TIMER_WHEEL_LEVELS; level++) {
+        shift = level_shift(level);
+        base = (self_p->tick & ((1u << shift) - 1));
+
+        /* No slot in this or higher levels can be processed earlier. */
+        if (best <= ((1ull << shift) - base)) {
+            break;
+        }
+
+        for (offset = 1; offset <= ASYNC_TIMER_WHEEL_SLOTS; offset++) {
+            index = ((((self_p->tick >> shift) + offset) << shift) >> shift);
+            index &= LEVEL_MASK;
+
+            if (self_p->slots[level][index] != NULL) {
+                ticks = (((unsigned long long)offset << shift) - base);
+
+                if (ticks < best) {
+                    best = ticks;
+                }
+
+                break;
+            }
+        }
+    }
+
+    if (best == ULLONG_MAX) {
+        return (-1);
+    } else if (best > INT_MAX) {
+        return (INT_MAX);
+    }
+
+    return ((int)best);
+}
+
+void async_timer_list_advance(struct async_timer_list_t *self_p,
+                              unsigned int ticks)
+{
+    int timeout;
+
+    while (ticks > 0) {
+        timeout = async_timer_list_next_timeout(self_p);
+
+        /* Skip ticks with nothing to do. */
+        if (timeout == -1) {
+            self_p->tick += ticks;
+            break;
+        } else if ((unsigned int)timeout > ticks) {
+            self_p->tick += ticks;
+            break;
+        }
+
+        self_p->tick += (timeout - 1);
+        ticks -= timeout;
+        async_timer_list_tick(self_p);
+    }
+}
@@ -41,4 +41,7 @@ void async_timer_list_process(struct async_timer_list_t *self_p);
 
 int async_timer_list_next_timeout(struct async_timer_list_t *self_p);
 
+void async_timer_list_advance(struct async_timer_list_t *self_p,
+                              unsigned int ticks);
+
 #endif
@@ -48,11 +48,19 @@
 #define PASSWORD_FLAG   0x40
 #define USER_NAME_FLAG  0x80
 
-enum packet_state_t {
-    packet_state_read_type_t = 0,
-    packet_state_read_size_t,
-    packet_state_read_data_t
-};
+/* Publish flags. */
+#define PUBLISH_QOS_SHIFT  1
+#define PUBLISH_QOS_MASK   0x06
+#define PUBLISH_DUP        0x08
+
+/* Packet identifiers of QoS 1 and QoS 2 publishes, derived from the
+   in-flight message index. Other packets use lower identifiers. */
+#define PUBLISH_PACKET_IDENTIFIER_BEGIN 0x8000
+
+#if (ASYNC_MQTT_CLIENT_IN_FLIGHT_MAX < 1)             \
+    || (ASYNC_MQTT_CLIENT_IN_FLIGHT_MAX > 0x8000)
+#    error "ASYNC_MQTT_CLIENT_IN_FLIGHT_MAX must be 1 to 32768."
+#endif
 
 /* Control packet types. */
 enum control_packet_type_t {
@@ -160,6 +168,19 @@ enum unsuback_reason_code_t {
     unsubsck_reason_code_packet_identifier_in_use_t = 145
 };
 
+enum puback_reason_code_t {
+    puback_reason_code_success_t = 0,
+    puback_reason_code_unspecified_error_t = 128,
+    puback_reason_code_packet_identifier_not_found_t = 146
+};
+
+enum in_flight_state_t {
+    in_flight_state_free_t = 0,
+    in_flight_state_puback_t,
+    in_flight_state_pubrec_t,
+    in_flight_state_pubcomp_t
+};
+
 enum property_ids_t {
     property_ids_payload_format_indicator_t = 1,
     property_ids_message_expiry_interval_t = 2,
@@ -230,6 +251,13 @@ static void writer_write_u16(struct writer_t *self_p, uint16_t value)
     }
 }
 
+static void writer_write_u32(struct writer_t *self_p, uint32_t value)
+{
+    if (writer_available(self_p, 4)) {
+        bitstream_writer_write_u32(&self_p->writer, value);
+    }
+}
+
 static void writer_write_bytes(struct writer_t *self_p,
                                const uint8_t *buf_p,
                                int size)
@@ -271,7 +299,7 @@ static void reader_init(struct reader_t *self_p,
     self_p->size = size;
 }
 
-static uint16_t reader_offset(struct reader_t *self_p)
+static int reader_offset(struct reader_t *self_p)
 {
     return (bitstream_reader_tell(&self_p->reader) / 8);
 }
@@ -342,16 +370,62 @@ static void reader_get_string(struct reader_t *self_p,
     }
 }
 
-static void reader_null_terminate_string(char *string_p, size_t size)
+static uint8_t *reader_pointer(struct reader_t *self_p)
+{
+    return (&self_p->buf_p[reader_offset(self_p)]);
+}
+
+/**
+ * Unpack a variable byte integer from the start of given
+ * buffer. Returns its size, zero if more data is needed, or -1 if
+ * malformed.
+ */
+static int unpack_variable_integer(const uint8_t *buf_p,
+                                   size_t size,
+                                   size_t *value_p)
 {
-    if (string_p != NULL) {
-        string_p[size] = '\0';
+    size_t i;
+    size_t value;
+
+    value = 0;
+
+    for (i = 0; i < 4; i++) {
+        if (i >= size) {
+            return (0);
+        }
+
+        value |= ((size_t)(buf_p[i] & 0x7f) << (7 * i));
+
+        if ((buf_p[i] & 0x80) == 0) {
+            *value_p = value;
+
+            return (i + 1);
+        }
     }
+
+    return (-1);
 }
 
-static uint8_t *reader_pointer(struct reader_t *self_p)
+static size_t reader_read_variable_integer(struct reader_t *self_p)
 {
-    return (&self_p->buf_p[reader_offset(self_p)]);
+    size_t value;
+    int size;
+
+    value = 0;
+
+    if (reader_ok(self_p)) {
+        size = unpack_variable_integer(reader_pointer(self_p),
+                                       self_p->size - reader_offset(self_p),
+                                       &value);
+
+        if (size > 0) {
+            reader_seek(self_p, size);
+        } else {
+            self_p->size = -1;
+        }
+    }
+
+    return (value);
 }
 
 static void on_subscribe_complete_null(void *obj_p,
@@ -361,6 +435,13 @@ static void on_subscribe_complete_null(void *obj_p,
     (void)transaction_id;
 }
 
+static void on_publish_complete_null(void *obj_p,
+                                     uint16_t packet_identifier)
+{
+    (void)obj_p;
+    (void)packet_identifier;
+}
+
 static void pack_variable_integer(struct writer_t *writer_p, int value)
 {
     uint8_t encoded_byte;
@@ -384,7 +465,7 @@ static void pack_variable_integer(struct writer_t *writer_p, int value)
 static void pack_fixed_header(struct writer_t *writer_p,
                               uint8_t message_type,
                               uint8_t flags,
-                              uint16_t size)
+                              int size)
 {
     writer_write_u8(writer_p, (message_type << 4) | flags);
     pack_variable_integer(writer_p, size);
@@ -393,12 +474,32 @@ static void pack_fixed_header(struct writer_t *writer_p,
 static size_t pack_connect(struct writer_t *writer_p,
                            const char *client_id_p,
                            struct async_mqtt_client_will_t *will_p,
-                           int keep_alive_s)
+                           int keep_alive_s,
+                           size_t maximum_packet_size,
+                           uint32_t session_expiry_interval,
+                           int topic_alias_maximum)
 {
     uint8_t flags;
     int payload_length;
+    int properties_length;
+
+    flags = 0;
+    properties_length = 3;
+
+    if (session_expiry_interval > 0) {
+        properties_length += 5;
+    } else {
+        flags |= CLEAN_START;
+    }
+
+    if (maximum_packet_size < MAXIMUM_PACKET_SIZE) {
+        properties_length += 5;
+    }
+
+    if (topic_alias_maximum > 0) {
+        properties_length += 3;
+    }
 
-    flags = CLEAN_START;
     payload_length = strlen(client_id_p) + 2;
 
     if (will_p->topic_p != NULL) {
@@ -411,12 +512,31 @@ static size_t pack_connect(struct writer_t *writer_p,
     pack_fixed_header(writer_p,
                       control_packet_type_connect_t,
                       0,
-                      10 + payload_length + 1);
+                      10 + payload_length + 1 + properties_length);
     writer_write_string(writer_p, "MQTT");
     writer_write_u8(writer_p, PROTOCOL_VERSION);
     writer_write_u8(writer_p, flags);
     writer_write_u16(writer_p, keep_alive_s);
-    pack_variable_integer(writer_p, 0);
+    pack_variable_integer(writer_p, properties_length);
+
+    if (session_expiry_interval > 0) {
+        writer_write_u8(writer_p, property_ids_session_expiry_interval_t);
+        writer_write_u32(writer_p, session_expiry_interval);
+    }
+
+    if (maximum_packet_size < MAXIMUM_PACKET_SIZE) {
+        writer_write_u8(writer_p, property_ids_maximum_packet_size_t);
+        writer_write_u32(writer_p, maximum_packet_size);
+    }
+
+    writer_write_u8(writer_p, property_ids_receive_maximum_t);
+    writer_write_u16(writer_p, ASYNC_MQTT_CLIENT_RECEIVE_MAX);
+
+    if (topic_alias_maximum > 0) {
+        writer_write_u8(writer_p, property_ids_topic_alias_maximum_t);
+        writer_write_u16(writer_p, topic_alias_maximum);
+    }
+
     writer_write_string(writer_p, client_id_p);
 
     if (flags & WILL_FLAG) {
@@ -430,14 +550,103 @@ static size_t pack_connect(struct writer_t *writer_p,
     return (writer_written(writer_p));
 }
 
-static bool unpack_connack(struct async_mqtt_client_t *self_p,
-                           bool *success_p)
+static void reader_skip_property(struct reader_t *self_p, int id)
+{
+    switch (id) {
+
+    case property_ids_payload_format_indicator_t:
+    case property_ids_request_problem_information_t:
+    case property_ids_request_response_information_t:
+    case property_ids_maximum_qos_t:
+    case property_ids_retain_available_t:
+    case property_ids_wildcard_subscription_available_t:
+    case property_ids_subscription_identifier_available_t:
+    case property_ids_shared_subscription_available_t:
+        reader_seek(self_p, 1);
+        break;
+
+    case property_ids_server_keep_alive_t:
+    case property_ids_receive_maximum_t:
+    case property_ids_topic_alias_maximum_t:
+    case property_ids_topic_alias_t:
+        reader_seek(self_p, 2);
+        break;
+
+    case property_ids_message_expiry_interval_t:
+    case property_ids_session_expiry_interval_t:
+    case property_ids_will_delay_interval_t:
+    case property_ids_maximum_packet_size_t:
+        reader_seek(self_p, 4);
+        break;
+
+    case property_ids_subscription_identifier_t:
+        reader_read_variable_integer(self_p);
+        break;
+
+    case property_ids_user_property_t:
+        reader_seek(self_p, reader_read_u16(self_p));
+        reader_seek(self_p, reader_read_u16(self_p));
+        break;
+
+    case property_ids_content_type_t:
+    case property_ids_response_topic_t:
+    case property_ids_correlation_data_t:
+    case property_ids_assigned_client_identifier_t:
+    case property_ids_authentication_method_t:
+    case property_ids_authentication_data_t:
+    case property_ids_response_information_t:
+    case property_ids_server_reference_t:
+    case property_ids_reason_string_t:
+        reader_seek(self_p, reader_read_u16(self_p));
+        break;
+
+    default:
+        self_p->size = -1;
+        break;
+    }
+}
+
+/**
+ * Unpack a CONNACK packet. Properties are optional, the Receive
+ * Maximum is 65535 and the Topic Alias Maximum is zero if not given.
+ */
+static bool unpack_connack(uint8_t *buf_p,
+                           size_t size,
+                           bool *success_p,
+                           bool *session_present_p,
+                           int *receive_maximum_p,
+                           int *topic_alias_maximum_p)
 {
     struct reader_t reader;
+    int end;
+    int id;
 
-    reader_init(&reader, &self_p->packet.buf[0], self_p->packet.size);
-    reader_read_u8(&reader);
+    reader_init(&reader, buf_p, size);
+    *session_present_p = (reader_read_u8(&reader) & 0x01);
     *success_p = (reader_read_u8(&reader) == connect_reason_code_success_t);
+    *receive_maximum_p = 65535;
+    *topic_alias_maximum_p = 0;
+
+    if (reader_ok(&reader) && (reader_offset(&reader) < reader.size)) {
+        end = reader_read_variable_integer(&reader);
+        end += reader_offset(&reader);
+
+        while (reader_ok(&reader) && (reader_offset(&reader) < end)) {
+            id = reader_read_u8(&reader);
+
+            if (id == property_ids_receive_maximum_t) {
+                *receive_maximum_p = reader_read_u16(&reader);
+            } else if (id == property_ids_topic_alias_maximum_t) {
+                *topic_alias_maximum_p = reader_read_u16(&reader);
+            } else {
+                reader_skip_property(&reader, id);
+            }
+        }
+
+        if (*receive_maximum_p == 0) {
+            reader.size = -1;
+        }
+    }
 
     return (reader_ok(&reader));
 }
@@ -454,7 +663,8 @@ static size_t pack_disconnect(struct writer_t *writer_p,
 
 static size_t pack_subscribe(struct writer_t *writer_p,
                              const char *topic_p,
-                             uint16_t packet_identifier)
+                             uint16_t packet_identifier,
+                             int qos)
 {
     pack_fixed_header(writer_p,
                       control_packet_type_subscribe_t,
@@ -463,56 +673,195 @@ static size_t pack_subscribe(struct writer_t *writer_p,
     writer_write_u16(writer_p, packet_identifier);
     writer_write_u8(writer_p, 0);
     writer_write_string(writer_p, topic_p);
-    writer_write_u8(writer_p, 0);
+    writer_write_u8(writer_p, qos);
 
     return (writer_written(writer_p));
 }
 
-static bool unpack_suback(struct async_mqtt_client_t *self_p,
+static bool unpack_suback(uint8_t *buf_p,
+                          size_t size,
                           uint16_t *packet_identifier_p)
 {
     struct reader_t reader;
 
-    reader_init(&reader, &self_p->packet.buf[0], self_p->packet.size);
+    reader_init(&reader, buf_p, size);
     *packet_identifier_p = reader_read_u16(&reader);
 
     return (reader_ok(&reader));
 }
 
-static size_t pack_publish(struct writer_t *writer_p,
-                           const char *topic_p,
-                           const void *buf_p,
-                           size_t size)
+/**
+ * Pack the fixed header and the topic length of a publish
+ * packet. The topic, packet identifier, properties and payload are
+ * written separately.
+ */
+static size_t pack_publish_header(struct writer_t *writer_p,
+                                  uint8_t flags,
+                                  size_t topic_size,
+                                  size_t size)
 {
-    pack_fixed_header(writer_p,
-                      control_packet_type_publish_t,
-                      0,
-                      size + strlen(topic_p) + 3);
-    writer_write_string(writer_p, topic_p);
-    pack_variable_integer(writer_p, 0);
-    writer_write_bytes(writer_p, buf_p, size);
+    size += (topic_size + 3);
+
+    if (flags & PUBLISH_QOS_MASK) {
+        size += 2;
+    }
+
+    pack_fixed_header(writer_p, control_packet_type_publish_t, flags, size);
+    writer_write_u16(writer_p, topic_size);
 
     return (writer_written(writer_p));
 }
 
-static bool unpack_publish(struct async_mqtt_client_t *self_p,
-                           char **topic_pp,
-                           uint8_t **buf_pp,
-                           size_t *size_p)
+/**
+ * Pack a PUBACK, PUBREC, PUBREL or PUBCOMP packet.
+ */
+static size_t pack_ack(struct writer_t *writer_p,
+                       uint8_t type,
+                       uint8_t flags,
+                       uint16_t packet_identifier,
+                       uint8_t reason)
+{
+    if (reason == puback_reason_code_success_t) {
+        pack_fixed_header(writer_p, type, flags, 2);
+        writer_write_u16(writer_p, packet_identifier);
+    } else {
+        pack_fixed_header(writer_p, type, flags, 3);
+        writer_write_u16(writer_p, packet_identifier);
+        writer_write_u8(writer_p, reason);
+    }
+
+    return (writer_written(writer_p));
+}
+
+/**
+ * Unpack a PUBACK, PUBREC, PUBREL or PUBCOMP packet. The reason code
+ * is success if not given.
+ */
+static bool unpack_ack(uint8_t *buf_p,
+                       size_t size,
+                       uint16_t *packet_identifier_p,
+                       uint8_t *reason_p)
 {
     struct reader_t reader;
-    size_t topic_size;
 
-    reader_init(&reader, &self_p->packet.buf[0], self_p->packet.size);
-    reader_get_string(&reader, topic_pp, &topic_size);
-    reader_seek(&reader, 1);
-    reader_null_terminate_string(*topic_pp, topic_size);
-    *buf_pp = reader_pointer(&reader);
-    *size_p = (self_p->packet.size - reader_offset(&reader));
+    reader_init(&reader, buf_p, size);
+    *packet_identifier_p = reader_read_u16(&reader);
+
+    if (size > 2) {
+        *reason_p = reader_read_u8(&reader);
+    } else {
+        *reason_p = puback_reason_code_success_t;
+    }
 
     return (reader_ok(&reader));
 }
 
+/**
+ * Unpack the topic, packet identifier, only present if QoS is above
+ * zero, and topic alias, zero if not given, of a publish packet, and
+ * skip other properties. Returns the number of bytes before the
+ * message, or zero if more data is needed.
+ */
+static size_t unpack_publish_topic(uint8_t *buf_p,
+                                   size_t size,
+                                   int qos,
+                                   char **topic_pp,
+                                   size_t *topic_size_p,
+                                   uint16_t *packet_identifier_p,
+                                   int *topic_alias_p)
+{
+    struct reader_t reader;
+    int end;
+    int id;
+
+    reader_init(&reader, buf_p, size);
+    reader_get_string(&reader, topic_pp, topic_size_p);
+    *packet_identifier_p = 0;
+
+    if (qos > 0) {
+        *packet_identifier_p = reader_read_u16(&reader);
+    }
+
+    *topic_alias_p = 0;
+    end = reader_read_variable_integer(&reader);
+    end += reader_offset(&reader);
+
+    while (reader_ok(&reader) && (reader_offset(&reader) < end)) {
+        id = reader_read_u8(&reader);
+
+        if (id == property_ids_topic_alias_t) {
+            *topic_alias_p = reader_read_u16(&reader);
+        } else {
+            reader_skip_property(&reader, id);
+        }
+    }
+
+    if (!reader_ok(&reader)) {
+        return (0);
+    }
+
+    return (reader_offset(&reader));
+}
+
+static bool unpack_publish(uint8_t *buf_p,
+                           size_t size,
+                           int qos,
+                           char **topic_pp,
+                           size_t *topic_size_p,
+                           uint16_t *packet_identifier_p,
+                           int *topic_alias_p,
+                           uint8_t **message_buf_pp,
+                           size_t *message_size_p)
+{
+    size_t offset;
+
+    offset = unpack_publish_topic(buf_p,
+                                  size,
+                                  qos,
+                                  topic_pp,
+                                  topic_size_p,
+                                  packet_identifier_p,
+                                  topic_alias_p);
+
+    if (offset == 0) {
+        return (false);
+    }
+
+    (*topic_pp)[*topic_size_p] = '\0';
+    *message_buf_pp = &buf_p[offset];
+    *message_size_p = (size - offset);
+
+    return (true);
+}
+
+/**
+ * Unpack a fixed header from the start of given buffer. Returns the
+ * header size, zero if more data is needed, or -1 if malformed.
+ */
+static int unpack_fixed_header(const uint8_t *buf_p,
+                               size_t size,
+                               int *type_p,
+                               int *flags_p,
+                               size_t *packet_size_p)
+{
+    int res;
+
+    if (size == 0) {
+        return (0);
+    }
+
+    res = unpack_variable_integer(&buf_p[1], size - 1, packet_size_p);
+
+    if (res <= 0) {
+        return (res);
+    }
+
+    *type_p = (buf_p[0] >> 4);
+    *flags_p = (buf_p[0] & 0x0f);
+
+    return (res + 1);
+}
+
 static void on_reconnect_timeout(struct async_mqtt_client_t *self_p)
 {
     DEBUG("Connecting to %s:%d.", self_p->host_p, self_p->port);
@@ -529,234 +878,1327 @@ static void stop_reconnect_timer(struct async_mqtt_client_t *self_p)
     async_timer_stop(&self_p->reconnect_timer);
 }
 
-static void on_stcp_connected(struct async_stcp_client_t *stcp_p, int res)
+static void input_open(struct async_mqtt_client_t *self_p)
 {
-    struct writer_t writer;
-    uint8_t buf[256];
-    struct async_mqtt_client_t *self_p;
-
-    self_p = async_container_of(stcp_p, typeof(*self_p), stcp);
+    self_p->input.start = 0;
+    self_p->input.end = 0;
+    self_p->input.discard = 0;
+    self_p->input.chunk.active = false;
+    self_p->input.closed = false;
+}
 
-    DEBUG("Transport connected with result %d.", res);
+/**
+ * Drop any received data and stop decoding it. Handlers may close
+ * the input while received packets are decoded.
+ */
+static void input_close(struct async_mqtt_client_t *self_p)
+{
+    self_p->input.start = 0;
+    self_p->input.end = 0;
+    self_p->input.discard = 0;
+    self_p->input.chunk.active = false;
+    self_p->input.closed = true;
+}
 
-    if (res == 0) {
-        writer_init(&writer, &buf[0], sizeof(buf));
+static void output_flush(struct async_mqtt_client_t *self_p)
+{
+    if (self_p->output.size > 0) {
         async_stcp_client_write(&self_p->stcp,
-                                &buf[0],
-                                pack_connect(&writer,
-                                             &self_p->client_id[0],
-                                             &self_p->will,
-                                             30));
-        self_p->packet.state = packet_state_read_type_t;
-        stop_reconnect_timer(self_p);
-    } else {
-        start_reconnect_timer(self_p);
+                                &self_p->output.buf[0],
+                                self_p->output.size);
+        self_p->output.size = 0;
     }
 }
 
-static void on_stcp_disconnected(struct async_stcp_client_t *stcp_p)
+/**
+ * Write given packet, or buffer it if corked.
+ */
+static void output_writev(struct async_mqtt_client_t *self_p,
+                          const struct async_iovec_t *iov_p,
+                          int length)
 {
-    struct async_mqtt_client_t *self_p;
+    struct async_mqtt_client_output_t *output_p;
+    size_t size;
+    int i;
 
-    self_p = async_container_of(stcp_p, typeof(*self_p), stcp);
+    output_p = &self_p->output;
+    size = 0;
 
-    DEBUG("Transport disconnected.");
+    for (i = 0; i < length; i++) {
+        size += iov_p[i].size;
+    }
 
-    if (self_p->connected) {
-        self_p->connected = false;
-        async_timer_stop(&self_p->keep_alive_timer);
-        self_p->on_disconnected(self_p->obj_p);
+    self_p->statistics.sent.bytes += size;
+
+    if (output_p->corked) {
+        if (size > sizeof(output_p->buf) - output_p->size) {
+            output_flush(self_p);
+        }
+
+        if (size <= sizeof(output_p->buf)) {
+            for (i = 0; i < length; i++) {
+                memcpy(&output_p->buf[output_p->size],
+                       iov_p[i].buf_p,
+                       iov_p[i].size);
+                output_p->size += iov_p[i].size;
+            }
+
+            return;
+        }
     }
 
-    start_reconnect_timer(self_p);
+    if (length == 1) {
+        async_stcp_client_write(&self_p->stcp, iov_p[0].buf_p, iov_p[0].size);
+    } else {
+        async_stcp_client_writev(&self_p->stcp, iov_p, length);
+    }
 }
 
-static bool read_packet_type(struct async_mqtt_client_t *self_p)
+static void output_write(struct async_mqtt_client_t *self_p,
+                         const void *buf_p,
+                         size_t size)
 {
-    uint8_t ch;
-    size_t size;
+    struct async_iovec_t iov;
 
-    size = async_stcp_client_read(&self_p->stcp, &ch, 1);
+    iov.buf_p = buf_p;
+    iov.size = size;
+    output_writev(self_p, &iov, 1);
+}
 
-    if (size == 1) {
-        self_p->packet.type = (ch >> 4);
-        self_p->packet.flags = (ch & 0xf);
-        self_p->packet.offset = 0;
-        self_p->packet.state = packet_state_read_size_t;
-    }
+/**
+ * Buffer written packets until uncorked.
+ */
+static void output_cork(struct async_mqtt_client_t *self_p)
+{
+    self_p->output.corked = true;
+}
 
-    return (false);
+static void output_uncork(struct async_mqtt_client_t *self_p)
+{
+    output_flush(self_p);
+    self_p->output.corked = false;
 }
 
-static bool read_packet_size(struct async_mqtt_client_t *self_p)
+/**
+ * Write any buffered packets before disconnecting.
+ */
+static void disconnect_transport(struct async_mqtt_client_t *self_p)
 {
-    size_t size;
-    bool complete;
+    output_flush(self_p);
+    async_stcp_client_disconnect(&self_p->stcp);
+}
 
-    size = async_stcp_client_read(&self_p->stcp,
-                                  &self_p->packet.buf[self_p->packet.offset],
-                                  1);
+/**
+ * Topic aliases only apply to one connection.
+ */
+static void topic_aliases_reset(
+    struct async_mqtt_client_topic_aliases_t *self_p)
+{
+    int i;
 
-    if (size == 0) {
-        return (false);
+    for (i = 0; i < ASYNC_MQTT_CLIENT_TOPIC_ALIAS_MAX; i++) {
+        self_p->outgoing[i].size = 0;
+        self_p->outgoing[i].last_used = 0;
+        self_p->incoming.sizes[i] = 0;
     }
 
-    complete = false;
-    self_p->packet.offset++;
+    self_p->maximum = 0;
+    self_p->clock = 0;
+}
 
-    switch (self_p->packet.offset) {
+/**
+ * Returns the alias of given outgoing topic, or zero if it is sent
+ * without one. known_p is set to true if the broker already knows the
+ * alias, and to false if the least recently used alias, or an unused
+ * one, is assigned to the topic now.
+ */
+static int topic_alias_outgoing(struct async_mqtt_client_t *self_p,
+                                const char *topic_p,
+                                size_t size,
+                                bool *known_p)
+{
+    struct async_mqtt_client_topic_aliases_t *aliases_p;
+    struct async_mqtt_client_topic_alias_t *alias_p;
+    int least_recently_used;
+    int i;
 
-    case 1:
-        if ((self_p->packet.buf[0] & 0x80) == 0) {
-            self_p->packet.size = self_p->packet.buf[0];
-            complete = true;
-        }
+    aliases_p = &self_p->topic_aliases;
 
-        break;
+    if ((aliases_p->maximum == 0)
+        || (size == 0)
+        || (size >= ASYNC_MQTT_CLIENT_TOPIC_ALIAS_TOPIC_SIZE)) {
+        return (0);
+    }
 
-    case 2:
-        if ((self_p->packet.buf[1] & 0x80) == 0) {
-            self_p->packet.size = self_p->packet.buf[1];
-            self_p->packet.size *= 128;
-            self_p->packet.size += (self_p->packet.buf[0] & 0x7f);
-            complete = true;
-        }
+    aliases_p->clock++;
+    least_recently_used = 0;
 
-        break;
+    for (i = 0; i < aliases_p->maximum; i++) {
+        alias_p = &aliases_p->outgoing[i];
 
-    default:
-        self_p->packet.state = packet_state_read_type_t;
-        break;
-    }
+        if ((alias_p->size == size)
+            && (memcmp(&alias_p->topic[0], topic_p, size) == 0)) {
+            alias_p->last_used = aliases_p->clock;
+            *known_p = true;
 
-    if (complete) {
-        if (self_p->packet.size > 0) {
-            self_p->packet.state = packet_state_read_data_t;
-        } else {
-            self_p->packet.state = packet_state_read_type_t;
+            return (i + 1);
         }
 
-        self_p->packet.offset = 0;
-        complete = (self_p->packet.size == 0);
+        if (alias_p->last_used
+            < aliases_p->outgoing[least_recently_used].last_used) {
+            least_recently_used = i;
+        }
     }
 
-    return (complete);
+    alias_p = &aliases_p->outgoing[least_recently_used];
+    memcpy(&alias_p->topic[0], topic_p, size);
+    alias_p->size = size;
+    alias_p->last_used = aliases_p->clock;
+    *known_p = false;
+
+    return (least_recently_used + 1);
 }
 
-static bool read_packet_data(struct async_mqtt_client_t *self_p)
+/**
+ * Split the storage of received topic aliases into one slot per
+ * alias, each large enough for any topic that can be received, that
+ * is, any topic of a packet fitting in the receive buffer and within
+ * the maximum packet size. The number of slots is the Topic Alias
+ * Maximum sent to the broker.
+ */
+static void topic_alias_incoming_init(struct async_mqtt_client_t *self_p)
 {
-    size_t size;
+    struct async_mqtt_client_topic_aliases_t *aliases_p;
+    size_t topic_size;
+    size_t maximum;
 
-    if (self_p->packet.offset == sizeof(self_p->packet.buf)) {
-        self_p->packet.state = packet_state_read_type_t;
+    aliases_p = &self_p->topic_aliases;
+    topic_size = self_p->input.buf_size;
 
-        return (false);
+    if (self_p->maximum_packet_size < topic_size) {
+        topic_size = self_p->maximum_packet_size;
     }
 
-    size = async_stcp_client_read(&self_p->stcp,
-                                  &self_p->packet.buf[self_p->packet.offset],
-                                  self_p->packet.size - self_p->packet.offset);
-    self_p->packet.offset += size;
-
-    if (self_p->packet.offset != self_p->packet.size) {
-        return (false);
+    if (topic_size == 0) {
+        maximum = 0;
+    } else {
+        maximum = (aliases_p->incoming.size / topic_size);
     }
 
-    self_p->packet.state = packet_state_read_type_t;
+    if (maximum > ASYNC_MQTT_CLIENT_TOPIC_ALIAS_MAX) {
+        maximum = ASYNC_MQTT_CLIENT_TOPIC_ALIAS_MAX;
+    }
 
-    return (true);
+    aliases_p->incoming.topic_size = topic_size;
+    aliases_p->incoming.maximum = maximum;
 }
 
-static bool read_packet(struct async_mqtt_client_t *self_p)
+/**
+ * Store the topic of given received topic alias, or replace an empty
+ * topic with the stored topic of the alias. Returns false if the
+ * alias is invalid or unknown.
+ */
+static bool topic_alias_incoming(struct async_mqtt_client_t *self_p,
+                                 char **topic_pp,
+                                 size_t *topic_size_p,
+                                 int topic_alias)
 {
-    bool complete;
+    struct async_mqtt_client_topic_aliases_t *aliases_p;
+    char *topic_p;
+    size_t *size_p;
 
-    switch (self_p->packet.state) {
+    if (topic_alias == 0) {
+        return (true);
+    }
 
-    case packet_state_read_type_t:
-        complete = read_packet_type(self_p);
-        break;
+    aliases_p = &self_p->topic_aliases;
 
-    case packet_state_read_size_t:
-        complete = read_packet_size(self_p);
-        break;
+    if (topic_alias > aliases_p->incoming.maximum) {
+        return (false);
+    }
 
-    case packet_state_read_data_t:
-        complete = read_packet_data(self_p);
-        break;
+    topic_p = &aliases_p->incoming.buf_p[
+        (topic_alias - 1) * aliases_p->incoming.topic_size];
+    size_p = &aliases_p->incoming.sizes[topic_alias - 1];
 
-    default:
-        complete = false;
-        break;
+    if (*topic_size_p == 0) {
+        if (*size_p == 0) {
+            return (false);
+        }
+
+        *topic_pp = topic_p;
+        *topic_size_p = *size_p;
+        self_p->statistics.received.topic_alias_bytes += *size_p;
+    } else {
+        if (*topic_size_p >= aliases_p->incoming.topic_size) {
+            return (false);
+        }
+
+        memcpy(topic_p, *topic_pp, *topic_size_p);
+        topic_p[*topic_size_p] = '\0';
+        *size_p = *topic_size_p;
     }
 
-    return (complete);
+    return (true);
 }
 
-static void handle_connack(struct async_mqtt_client_t *self_p)
+static void on_stcp_connected(struct async_stcp_client_t *stcp_p, int res)
 {
-    bool ok;
-    bool success;
+    struct writer_t writer;
+    uint8_t buf[256];
+    struct async_mqtt_client_t *self_p;
 
-    ok = unpack_connack(self_p, &success);
+    self_p = async_container_of(stcp_p, typeof(*self_p), stcp);
 
-    if (ok && success) {
-        self_p->connected = true;
-        async_timer_start(&self_p->keep_alive_timer);
-        self_p->on_connected(self_p->obj_p);
+    DEBUG("Transport connected with result %d.", res);
+
+    if (res == 0) {
+        topic_aliases_reset(&self_p->topic_aliases);
+        topic_alias_incoming_init(self_p);
+        writer_init(&writer, &buf[0], sizeof(buf));
+        output_write(self_p,
+                     &buf[0],
+                     pack_connect(&writer,
+                                  &self_p->client_id[0],
+                                  &self_p->will,
+                                  30,
+                                  self_p->maximum_packet_size,
+                                  self_p->session_expiry_interval,
+                                  self_p->topic_aliases.incoming.maximum));
+        input_open(self_p);
+        stop_reconnect_timer(self_p);
     } else {
-        async_stcp_client_disconnect(&self_p->stcp);
         start_reconnect_timer(self_p);
     }
 }
 
-static void handle_suback(struct async_mqtt_client_t *self_p)
+static void on_stcp_disconnected(struct async_stcp_client_t *stcp_p)
 {
+    struct async_mqtt_client_t *self_p;
+
+    self_p = async_container_of(stcp_p, typeof(*self_p), stcp);
+
+    DEBUG("Transport disconnected.");
+    input_close(self_p);
+
+    if (self_p->connected) {
+        self_p->connected = false;
+        async_timer_stop(&self_p->keep_alive_timer);
+        self_p->on_disconnected(self_p->obj_p);
+    }
+
+    start_reconnect_timer(self_p);
+}
+
+static void write_disconnect(struct async_mqtt_client_t *self_p,
+                             enum disconnect_reason_code_t reason)
+{
+    struct writer_t writer;
+    uint8_t buf[8];
+
+    writer_init(&writer, &buf[0], sizeof(buf));
+    output_write(self_p, &buf[0], pack_disconnect(&writer, reason));
+}
+
+static void write_ack(struct async_mqtt_client_t *self_p,
+                      uint8_t type,
+                      uint8_t flags,
+                      uint16_t packet_identifier,
+                      uint8_t reason)
+{
+    struct writer_t writer;
+    uint8_t buf[8];
+
+    writer_init(&writer, &buf[0], sizeof(buf));
+    output_write(self_p,
+                 &buf[0],
+                 pack_ack(&writer, type, flags, packet_identifier, reason));
+}
+
+static void write_publish(struct async_mqtt_client_t *self_p,
+                          const char *topic_p,
+                          const void *buf_p,
+                          size_t size,
+                          uint8_t flags,
+                          uint16_t packet_identifier)
+{
+    struct writer_t writer;
+    uint8_t header[8];
+    uint8_t trailer[6];
+    struct async_iovec_t iov[4];
+    size_t properties_size;
+    int topic_alias;
+    bool known;
+
+    iov[1].buf_p = topic_p;
+    iov[1].size = strlen(topic_p);
+    topic_alias = topic_alias_outgoing(self_p, topic_p, iov[1].size, &known);
+
+    if (topic_alias == 0) {
+        properties_size = 0;
+    } else {
+        properties_size = 3;
+
+        if (known) {
+            self_p->statistics.sent.topic_alias_bytes += iov[1].size;
+            iov[1].size = 0;
+        }
+    }
+
+    writer_init(&writer, &header[0], sizeof(header));
+    iov[0].buf_p = &header[0];
+    iov[0].size = pack_publish_header(&writer,
+                                      flags,
+                                      iov[1].size,
+                                      properties_size + size);
+    writer_init(&writer, &trailer[0], sizeof(trailer));
+
+    if (flags & PUBLISH_QOS_MASK) {
+        writer_write_u16(&writer, packet_identifier);
+    }
+
+    pack_variable_integer(&writer, properties_size);
+
+    if (topic_alias != 0) {
+        writer_write_u8(&writer, property_ids_topic_alias_t);
+        writer_write_u16(&writer, topic_alias);
+    }
+
+    iov[2].buf_p = &trailer[0];
+    iov[2].size = writer_written(&writer);
+    iov[3].buf_p = buf_p;
+    iov[3].size = size;
+    output_writev(self_p, &iov[0], 4);
+}
+
+static void in_flight_init(
+    struct async_mqtt_client_in_flight_t *self_p,
+    struct async_mqtt_client_in_flight_message_t *messages_p,
+    int max)
+{
+    int i;
+
+    for (i = 0; i < max; i++) {
+        messages_p[i].packet_identifier = (PUBLISH_PACKET_IDENTIFIER_BEGIN + i);
+        messages_p[i].state = in_flight_state_free_t;
+        messages_p[i].next = (i + 1);
+    }
+
+    messages_p[max - 1].next = -1;
+    self_p->messages_p = messages_p;
+    self_p->max = max;
+    self_p->free = 0;
+    self_p->head = -1;
+    self_p->tail = -1;
+    self_p->unsent = -1;
+    self_p->length = 0;
+    self_p->number_of_sent = 0;
+    self_p->receive_maximum = 65535;
+}
+
+/**
+ * Returns the in-flight message with given packet identifier, or
+ * NULL if missing. The identifier gives the message index.
+ */
+static struct async_mqtt_client_in_flight_message_t *in_flight_get(
+    struct async_mqtt_client_in_flight_t *self_p,
+    uint16_t packet_identifier)
+{
+    struct async_mqtt_client_in_flight_message_t *message_p;
+
+    if (packet_identifier < PUBLISH_PACKET_IDENTIFIER_BEGIN) {
+        return (NULL);
+    }
+
+    message_p = &self_p->messages_p[
+        (packet_identifier - PUBLISH_PACKET_IDENTIFIER_BEGIN) % self_p->max];
+
+    if ((message_p->state == in_flight_state_free_t)
+        || (message_p->packet_identifier != packet_identifier)) {
+        return (NULL);
+    }
+
+    return (message_p);
+}
+
+/**
+ * Allocate a message and append it to the in-flight list. Returns
+ * NULL if all messages are in flight.
+ */
+static struct async_mqtt_client_in_flight_message_t *in_flight_alloc(
+    struct async_mqtt_client_in_flight_t *self_p)
+{
+    struct async_mqtt_client_in_flight_message_t *message_p;
+    int index;
+
+    index = self_p->free;
+
+    if (index == -1) {
+        return (NULL);
+    }
+
+    message_p = &self_p->messages_p[index];
+    self_p->free = message_p->next;
+    message_p->next = -1;
+    message_p->prev = self_p->tail;
+    message_p->sent = false;
+    message_p->dup = false;
+
+    if (self_p->tail == -1) {
+        self_p->head = index;
+    } else {
+        self_p->messages_p[self_p->tail].next = index;
+    }
+
+    self_p->tail = index;
+
+    if (self_p->unsent == -1) {
+        self_p->unsent = index;
+    }
+
+    self_p->length++;
+
+    return (message_p);
+}
+
+/**
+ * Remove given message from the in-flight list and give it the next
+ * packet identifier for its index.
+ */
+static void in_flight_free(
+    struct async_mqtt_client_in_flight_t *self_p,
+    struct async_mqtt_client_in_flight_message_t *message_p)
+{
+    int index;
+    int packet_identifier;
+
+    index = (message_p - self_p->messages_p);
+
+    if (message_p->prev == -1) {
+        self_p->head = message_p->next;
+    } else {
+        self_p->messages_p[message_p->prev].next = message_p->next;
+    }
+
+    if (message_p->next == -1) {
+        self_p->tail = message_p->prev;
+    } else {
+        self_p->messages_p[message_p->next].prev = message_p->prev;
+    }
+
+    if (self_p->unsent == index) {
+        self_p->unsent = message_p->next;
+    }
+
+    if (message_p->sent) {
+        self_p->number_of_sent--;
+    }
+
+    self_p->length--;
+    packet_identifier = (message_p->packet_identifier + self_p->max);
+
+    if (packet_identifier > 0xffff) {
+        packet_identifier = (PUBLISH_PACKET_IDENTIFIER_BEGIN + index);
+    }
+
+    message_p->packet_identifier = packet_identifier;
+    message_p->state = in_flight_state_free_t;
+    message_p->next = self_p->free;
+    self_p->free = index;
+}
+
+static void in_flight_send(
+    struct async_mqtt_client_t *self_p,
+    struct async_mqtt_client_in_flight_message_t *message_p)
+{
+    uint8_t flags;
+
+    if (message_p->state == in_flight_state_pubcomp_t) {
+        write_ack(self_p,
+                  control_packet_type_pubrel_t,
+                  0x02,
+                  message_p->packet_identifier,
+                  puback_reason_code_success_t);
+    } else {
+        flags = (message_p->qos << PUBLISH_QOS_SHIFT);
+
+        if (message_p->dup) {
+            flags |= PUBLISH_DUP;
+        }
+
+        write_publish(self_p,
+                      message_p->topic_p,
+                      message_p->buf_p,
+                      message_p->size,
+                      flags,
+                      message_p->packet_identifier);
+        message_p->dup = true;
+    }
+
+    message_p->sent = true;
+}
+
+/**
+ * Send unsent in-flight messages in publish order, as long as the
+ * broker's Receive Maximum allows it. Unsent messages are always at
+ * the end of the list.
+ */
+static void in_flight_send_pending(struct async_mqtt_client_t *self_p)
+{
+    struct async_mqtt_client_in_flight_t *in_flight_p;
+    struct async_mqtt_client_in_flight_message_t *message_p;
+
+    if (!self_p->connected) {
+        return;
+    }
+
+    in_flight_p = &self_p->in_flight;
+
+    while ((in_flight_p->unsent != -1)
+           && (in_flight_p->number_of_sent < in_flight_p->receive_maximum)) {
+        message_p = &in_flight_p->messages_p[in_flight_p->unsent];
+        in_flight_p->unsent = message_p->next;
+        in_flight_p->number_of_sent++;
+        in_flight_send(self_p, message_p);
+    }
+}
+
+/**
+ * Send all in-flight messages again after connecting. They are new
+ * messages if the broker did not keep the session.
+ */
+static void in_flight_resend(struct async_mqtt_client_t *self_p,
+                             bool session_present)
+{
+    struct async_mqtt_client_in_flight_t *in_flight_p;
+    struct async_mqtt_client_in_flight_message_t *message_p;
+    int index;
+
+    in_flight_p = &self_p->in_flight;
+    index = in_flight_p->head;
+
+    while (index != -1) {
+        message_p = &in_flight_p->messages_p[index];
+        message_p->sent = false;
+
+        if (!session_present) {
+            message_p->dup = false;
+
+            if (message_p->state == in_flight_state_pubcomp_t) {
+                message_p->state = in_flight_state_pubrec_t;
+            }
+        }
+
+        index = message_p->next;
+    }
+
+    in_flight_p->unsent = in_flight_p->head;
+    in_flight_p->number_of_sent = 0;
+    in_flight_send_pending(self_p);
+}
+
+static void in_flight_complete(
+    struct async_mqtt_client_t *self_p,
+    struct async_mqtt_client_in_flight_message_t *message_p)
+{
+    uint16_t packet_identifier;
+
+    packet_identifier = message_p->packet_identifier;
+    in_flight_free(&self_p->in_flight, message_p);
+    in_flight_send_pending(self_p);
+    self_p->on_publish_complete(self_p->obj_p, packet_identifier);
+}
+
+static void router_level_init(struct async_mqtt_client_router_level_t *level_p)
+{
+    level_p->level_p = NULL;
+    level_p->single_level = -1;
+    level_p->multi_level = -1;
+    level_p->on_publish = NULL;
+}
+
+static void router_init(struct async_mqtt_client_router_t *self_p,
+                        struct async_mqtt_client_router_level_t *levels_p,
+                        int max)
+{
+    int i;
+
+    for (i = 0; i < max; i++) {
+        router_level_init(&levels_p[i]);
+    }
+
+    router_level_init(&self_p->root);
+    self_p->levels_p = levels_p;
+    self_p->max = max;
+    self_p->length = 0;
+}
+
+/**
+ * Returns given level, where -1 is the root.
+ */
+static struct async_mqtt_client_router_level_t *router_level(
+    struct async_mqtt_client_router_t *self_p,
+    int index)
+{
+    if (index == -1) {
+        return (&self_p->root);
+    } else {
+        return (&self_p->levels_p[index]);
+    }
+}
+
+static uint32_t router_hash(int parent, const char *level_p, size_t size)
+{
+    uint32_t hash;
+    size_t i;
+
+    hash = (2166136261u ^ (uint32_t)parent);
+
+    for (i = 0; i < size; i++) {
+        hash ^= (uint8_t)level_p[i];
+        hash *= 16777619u;
+    }
+
+    return (hash);
+}
+
+/**
+ * Returns the index of the child with given level of given parent,
+ * or the index of the unused slot to add it in.
+ */
+static int router_find(struct async_mqtt_client_router_t *self_p,
+                       int parent,
+                       const char *level_p,
+                       size_t size,
+                       uint32_t hash)
+{
+    struct async_mqtt_client_router_level_t *child_p;
+    int index;
+
+    index = (int)(hash % (uint32_t)self_p->max);
+
+    while (true) {
+        child_p = &self_p->levels_p[index];
+
+        if (child_p->level_p == NULL) {
+            break;
+        }
+
+        if ((child_p->hash == hash)
+            && (child_p->parent == parent)
+            && (child_p->level_size == size)
+            && (memcmp(child_p->level_p, level_p, size) == 0)) {
+            break;
+        }
+
+        index++;
+
+        if (index == self_p->max) {
+            index = 0;
+        }
+    }
+
+    return (index);
+}
+
+/**
+ * Returns the number of levels of given filter, or zero if malformed.
+ */
+static int router_count_levels(const char *filter_p)
+{
+    const char *level_p;
+    size_t size;
+    int number_of_levels;
+
+    level_p = filter_p;
+    number_of_levels = 0;
+
+    while (true) {
+        size = strcspn(level_p, "/");
+
+        if (size > 0xffff) {
+            return (0);
+        }
+
+        if ((memchr(level_p, '+', size) != NULL)
+            || (memchr(level_p, '#', size) != NULL)) {
+            if (size != 1) {
+                return (0);
+            }
+
+            if ((level_p[0] == '#') && (level_p[1] != '\0')) {
+                return (0);
+            }
+        }
+
+        number_of_levels++;
+
+        if (level_p[size] == '\0') {
+            break;
+        }
+
+        level_p += (size + 1);
+    }
+
+    return (number_of_levels);
+}
+
+static int router_add(struct async_mqtt_client_router_t *self_p,
+                      const char *filter_p,
+                      async_mqtt_client_on_publish_t on_publish,
+                      void *obj_p)
+{
+    struct async_mqtt_client_router_level_t *level_p;
+    struct async_mqtt_client_router_level_t *parent_p;
+    int number_of_levels;
+    int parent;
+    int index;
+    size_t size;
+    uint32_t hash;
+
+    number_of_levels = router_count_levels(filter_p);
+
+    if ((number_of_levels == 0) || (filter_p[0] == '\0')) {
+        return (-ASYNC_ERROR_INVALID_ARGUMENT);
+    }
+
+    if ((self_p->length + number_of_levels) > (self_p->max - self_p->max / 4)) {
+        return (-ASYNC_ERROR_QUEUE_FULL);
+    }
+
+    parent = -1;
+
+    while (true) {
+        size = strcspn(filter_p, "/");
+        hash = router_hash(parent, filter_p, size);
+        index = router_find(self_p, parent, filter_p, size, hash);
+        level_p = &self_p->levels_p[index];
+
+        if (level_p->level_p == NULL) {
+            level_p->level_p = filter_p;
+            level_p->hash = hash;
+            level_p->level_size = (uint16_t)size;
+            level_p->parent = parent;
+            self_p->length++;
+
+            if (size == 1) {
+                parent_p = router_level(self_p, parent);
+
+                if (filter_p[0] == '+') {
+                    parent_p->single_level = index;
+                } else if (filter_p[0] == '#') {
+                    parent_p->multi_level = index;
+                }
+            }
+        }
+
+        parent = index;
+
+        if (filter_p[size] == '\0') {
+            break;
+        }
+
+        filter_p += (size + 1);
+    }
+
+    level_p->on_publish = on_publish;
+    level_p->obj_p = obj_p;
+
+    return (0);
+}
+
+static int router_call(struct async_mqtt_client_router_level_t *level_p,
+                       const char *topic_p,
+                       const uint8_t *buf_p,
+                       size_t size)
+{
+    if (level_p->on_publish == NULL) {
+        return (0);
+    }
+
+    level_p->on_publish(level_p->obj_p, topic_p, buf_p, size);
+
+    return (1);
+}
+
+/**
+ * Call handlers of filters matching given topic, with given parent
+ * matching its levels before given level. level_p is NULL if all
+ * levels are matched. Returns the number of called handlers.
+ */
+static int router_match(struct async_mqtt_client_router_t *self_p,
+                        int parent,
+                        const char *level_p,
+                        bool wildcards,
+                        const char *topic_p,
+                        const uint8_t *buf_p,
+                        size_t size)
+{
+    struct async_mqtt_client_router_level_t *parent_p;
+    const char *next_p;
+    size_t level_size;
+    int index;
+    int number_of_calls;
+
+    parent_p = router_level(self_p, parent);
+    number_of_calls = 0;
+
+    /* '#' also matches the parent level. */
+    if (wildcards && (parent_p->multi_level != -1)) {
+        number_of_calls += router_call(&self_p->levels_p[parent_p->multi_level],
+                                       topic_p,
+                                       buf_p,
+                                       size);
+    }
+
+    if (level_p == NULL) {
+        return (number_of_calls + router_call(parent_p, topic_p, buf_p, size));
+    }
+
+    level_size = strcspn(level_p, "/");
+
+    if (level_p[level_size] == '\0') {
+        next_p = NULL;
+    } else {
+        next_p = &level_p[level_size + 1];
+    }
+
+    index = router_find(self_p,
+                        parent,
+                        level_p,
+                        level_size,
+                        router_hash(parent, level_p, level_size));
+
+    if (self_p->levels_p[index].level_p != NULL) {
+        number_of_calls += router_match(self_p,
+                                        index,
+                                        next_p,
+                                        true,
+                                        topic_p,
+                                        buf_p,
+                                        size);
+    }
+
+    if (wildcards && (parent_p->single_level != -1)) {
+        number_of_calls += router_match(self_p,
+                                        parent_p->single_level,
+                                        next_p,
+                                        true,
+                                        topic_p,
+                                        buf_p,
+                                        size);
+    }
+
+    return (number_of_calls);
+}
+
+/**
+ * Pass given received message to the handlers of matching filters,
+ * or to on_publish() if there are none. Wildcards do not match
+ * topics starting with '$'.
+ */
+static void dispatch_publish(struct async_mqtt_client_t *self_p,
+                             const char *topic_p,
+                             const uint8_t *buf_p,
+                             size_t size)
+{
+    int number_of_calls;
+
+    if (self_p->router.length == 0) {
+        number_of_calls = 0;
+    } else {
+        number_of_calls = router_match(&self_p->router,
+                                       -1,
+                                       topic_p,
+                                       topic_p[0] != '$',
+                                       topic_p,
+                                       buf_p,
+                                       size);
+    }
+
+    if (number_of_calls == 0) {
+        self_p->on_publish(self_p->obj_p, topic_p, buf_p, size);
+    }
+}
+
+/**
+ * Disconnect from the broker and try again later.
+ */
+static void reconnect(struct async_mqtt_client_t *self_p)
+{
+    input_close(self_p);
+    disconnect_transport(self_p);
+
+    if (self_p->connected) {
+        self_p->connected = false;
+        async_timer_stop(&self_p->keep_alive_timer);
+        self_p->on_disconnected(self_p->obj_p);
+    }
+
+    start_reconnect_timer(self_p);
+}
+
+/**
+ * Returns the index of given packet identifier of a received QoS 2
+ * message not yet released, or -1 if missing.
+ */
+static int received_find(struct async_mqtt_client_received_t *self_p,
+                         uint16_t packet_identifier)
+{
+    int i;
+
+    for (i = 0; i < self_p->length; i++) {
+        if (self_p->packet_identifiers[i] == packet_identifier) {
+            return (i);
+        }
+    }
+
+    return (-1);
+}
+
+static void received_add(struct async_mqtt_client_received_t *self_p,
+                         uint16_t packet_identifier)
+{
+    self_p->packet_identifiers[self_p->length] = packet_identifier;
+    self_p->length++;
+}
+
+/**
+ * Forget given released packet identifier. Returns false if missing.
+ */
+static bool received_remove(struct async_mqtt_client_received_t *self_p,
+                            uint16_t packet_identifier)
+{
+    int index;
+
+    index = received_find(self_p, packet_identifier);
+
+    if (index == -1) {
+        return (false);
+    }
+
+    self_p->length--;
+    self_p->packet_identifiers[index] =
+        self_p->packet_identifiers[self_p->length];
+
+    return (true);
+}
+
+/**
+ * Check a received message before passing it to the application.
+ * Returns 1 if it should be passed, 0 if it is a resent QoS 2 message
+ * already passed, which is acknowledged again, or -1 if the broker
+ * exceeded the Receive Maximum.
+ */
+static int publish_check(struct async_mqtt_client_t *self_p,
+                         int qos,
+                         uint16_t packet_identifier)
+{
+    if (qos != 2) {
+        return (1);
+    }
+
+    if (received_find(&self_p->received, packet_identifier) != -1) {
+        write_ack(self_p,
+                  control_packet_type_pubrec_t,
+                  0,
+                  packet_identifier,
+                  puback_reason_code_success_t);
+
+        return (0);
+    }
+
+    if (self_p->received.length == ASYNC_MQTT_CLIENT_RECEIVE_MAX) {
+        return (-1);
+    }
+
+    return (1);
+}
+
+/**
+ * Acknowledge a received message passed to the application, unless
+ * the input was closed meanwhile.
+ */
+static void publish_acknowledge(struct async_mqtt_client_t *self_p,
+                                int qos,
+                                uint16_t packet_identifier)
+{
+    if (self_p->input.closed) {
+        return;
+    }
+
+    if (qos == 1) {
+        write_ack(self_p,
+                  control_packet_type_puback_t,
+                  0,
+                  packet_identifier,
+                  puback_reason_code_success_t);
+    } else if (qos == 2) {
+        write_ack(self_p,
+                  control_packet_type_pubrec_t,
+                  0,
+                  packet_identifier,
+                  puback_reason_code_success_t);
+    }
+}
+
+static void handle_connack(struct async_mqtt_client_t *self_p,
+                           uint8_t *buf_p,
+                           size_t size)
+{
+    bool ok;
+    bool success;
+    bool session_present;
+    int receive_maximum;
+    int topic_alias_maximum;
+
+    ok = unpack_connack(buf_p,
+                        size,
+                        &success,
+                        &session_present,
+                        &receive_maximum,
+                        &topic_alias_maximum);
+
+    if (ok && success) {
+        self_p->connected = true;
+        self_p->in_flight.receive_maximum = receive_maximum;
+
+        if (topic_alias_maximum > ASYNC_MQTT_CLIENT_TOPIC_ALIAS_MAX) {
+            topic_alias_maximum = ASYNC_MQTT_CLIENT_TOPIC_ALIAS_MAX;
+        }
+
+        self_p->topic_aliases.maximum = topic_alias_maximum;
+
+        if (!session_present) {
+            self_p->received.length = 0;
+        }
+
+        async_timer_start(&self_p->keep_alive_timer);
+        in_flight_resend(self_p, session_present);
+        self_p->on_connected(self_p->obj_p);
+    } else {
+        reconnect(self_p);
+    }
+}
+
+static void handle_suback(struct async_mqtt_client_t *self_p,
+                          uint8_t *buf_p,
+                          size_t size)
+{
+    uint16_t packet_identifier;
+
+    if (unpack_suback(buf_p, size, &packet_identifier)) {
+        self_p->on_subscribe_complete(self_p->obj_p, packet_identifier);
+    }
+}
+
+static void handle_publish(struct async_mqtt_client_t *self_p,
+                           int flags,
+                           uint8_t *buf_p,
+                           size_t size)
+{
+    char *topic_p;
+    size_t topic_size;
     uint16_t packet_identifier;
+    int topic_alias;
+    uint8_t *message_buf_p;
+    size_t message_size;
+    int qos;
+    int res;
 
-    if (unpack_suback(self_p, &packet_identifier)) {
-        self_p->on_subscribe_complete(self_p->obj_p, packet_identifier);
+    qos = ((flags & PUBLISH_QOS_MASK) >> PUBLISH_QOS_SHIFT);
+
+    if (qos == 3) {
+        DEBUG("Malformed packet.");
+        reconnect(self_p);
+
+        return;
+    }
+
+    if (!unpack_publish(buf_p,
+                        size,
+                        qos,
+                        &topic_p,
+                        &topic_size,
+                        &packet_identifier,
+                        &topic_alias,
+                        &message_buf_p,
+                        &message_size)) {
+        return;
+    }
+
+    if (!topic_alias_incoming(self_p, &topic_p, &topic_size, topic_alias)) {
+        DEBUG("Invalid topic alias %d.", topic_alias);
+        write_disconnect(self_p, disconnect_reason_code_topic_alias_invalid_t);
+        reconnect(self_p);
+
+        return;
     }
+
+    res = publish_check(self_p, qos, packet_identifier);
+
+    if (res == 0) {
+        return;
+    } else if (res < 0) {
+        DEBUG("Receive Maximum exceeded.");
+        write_disconnect(self_p,
+                         disconnect_reason_code_receive_maximum_exceeded_t);
+        reconnect(self_p);
+
+        return;
+    }
+
+    if (qos == 2) {
+        received_add(&self_p->received, packet_identifier);
+    }
+
+    dispatch_publish(self_p, topic_p, message_buf_p, message_size);
+    publish_acknowledge(self_p, qos, packet_identifier);
 }
 
-static void handle_publish(struct async_mqtt_client_t *self_p)
+static void handle_puback(struct async_mqtt_client_t *self_p,
+                          uint8_t *buf_p,
+                          size_t size)
 {
-    char *topic_p;
-    uint8_t *buf_p;
-    size_t size;
+    struct async_mqtt_client_in_flight_message_t *message_p;
+    uint16_t packet_identifier;
+    uint8_t reason;
 
-    if (unpack_publish(self_p, &topic_p, &buf_p, &size)) {
-        self_p->on_publish(self_p->obj_p, topic_p, buf_p, size);
+    if (!unpack_ack(buf_p, size, &packet_identifier, &reason)) {
+        return;
+    }
+
+    message_p = in_flight_get(&self_p->in_flight, packet_identifier);
+
+    if ((message_p != NULL)
+        && (message_p->state == in_flight_state_puback_t)) {
+        in_flight_complete(self_p, message_p);
     }
 }
 
-static void handle_pingresp(struct async_mqtt_client_t *self_p)
+/**
+ * Release a received message, or complete it if rejected by the
+ * broker.
+ */
+static void handle_pubrec(struct async_mqtt_client_t *self_p,
+                          uint8_t *buf_p,
+                          size_t size)
 {
-    async_timer_start(&self_p->keep_alive_timer);
+    struct async_mqtt_client_in_flight_message_t *message_p;
+    uint16_t packet_identifier;
+    uint8_t reason;
+
+    if (!unpack_ack(buf_p, size, &packet_identifier, &reason)) {
+        return;
+    }
+
+    message_p = in_flight_get(&self_p->in_flight, packet_identifier);
+
+    if (message_p == NULL) {
+        reason = puback_reason_code_packet_identifier_not_found_t;
+    } else if (message_p->state == in_flight_state_puback_t) {
+        return;
+    } else if (reason >= puback_reason_code_unspecified_error_t) {
+        in_flight_complete(self_p, message_p);
+
+        return;
+    } else {
+        message_p->state = in_flight_state_pubcomp_t;
+    }
+
+    write_ack(self_p,
+              control_packet_type_pubrel_t,
+              0x02,
+              packet_identifier,
+              reason);
 }
 
-static void on_stcp_input(struct async_stcp_client_t *stcp_p)
+static void handle_pubcomp(struct async_mqtt_client_t *self_p,
+                           uint8_t *buf_p,
+                           size_t size)
 {
-    struct async_mqtt_client_t *self_p;
+    struct async_mqtt_client_in_flight_message_t *message_p;
+    uint16_t packet_identifier;
+    uint8_t reason;
 
-    self_p = async_container_of(stcp_p, typeof(*self_p), stcp);
+    if (!unpack_ack(buf_p, size, &packet_identifier, &reason)) {
+        return;
+    }
+
+    message_p = in_flight_get(&self_p->in_flight, packet_identifier);
+
+    if ((message_p != NULL)
+        && (message_p->state == in_flight_state_pubcomp_t)) {
+        in_flight_complete(self_p, message_p);
+    }
+}
+
+/**
+ * Forget a released received QoS 2 message.
+ */
+static void handle_pubrel(struct async_mqtt_client_t *self_p,
+                          uint8_t *buf_p,
+                          size_t size)
+{
+    uint16_t packet_identifier;
+    uint8_t reason;
 
-    if (!read_packet(self_p)) {
+    if (!unpack_ack(buf_p, size, &packet_identifier, &reason)) {
         return;
     }
 
-    switch (self_p->packet.type) {
+    if (received_remove(&self_p->received, packet_identifier)) {
+        reason = puback_reason_code_success_t;
+    } else {
+        reason = puback_reason_code_packet_identifier_not_found_t;
+    }
+
+    write_ack(self_p,
+              control_packet_type_pubcomp_t,
+              0,
+              packet_identifier,
+              reason);
+}
+
+static void handle_pingresp(struct async_mqtt_client_t *self_p)
+{
+    async_timer_start(&self_p->keep_alive_timer);
+}
+
+static void handle_packet(struct async_mqtt_client_t *self_p,
+                          int type,
+                          int flags,
+                          uint8_t *buf_p,
+                          size_t size)
+{
+    switch (type) {
 
     case control_packet_type_connack_t:
-        handle_connack(self_p);
+        handle_connack(self_p, buf_p, size);
         break;
 
     case control_packet_type_suback_t:
-        handle_suback(self_p);
+        handle_suback(self_p, buf_p, size);
         break;
 
     case control_packet_type_publish_t:
-        handle_publish(self_p);
+        handle_publish(self_p, flags, buf_p, size);
+        break;
+
+    case control_packet_type_puback_t:
+        handle_puback(self_p, buf_p, size);
+        break;
+
+    case control_packet_type_pubrec_t:
+        handle_pubrec(self_p, buf_p, size);
+        break;
+
+    case control_packet_type_pubrel_t:
+        handle_pubrel(self_p, buf_p, size);
+        break;
+
+    case control_packet_type_pubcomp_t:
+        handle_pubcomp(self_p, buf_p, size);
         break;
 
     case control_packet_type_pingresp_t:
@@ -768,6 +2210,316 @@ static void on_stcp_input(struct async_stcp_client_t *stcp_p)
     }
 }
 
+/**
+ * Pass received message bytes of a publish packet that does not fit
+ * in the receive buffer to the on publish chunk callback, and
+ * acknowledge the message after the last chunk. Returns the number
+ * of used bytes.
+ */
+static size_t decode_chunk(struct async_mqtt_client_t *self_p,
+                           uint8_t *buf_p,
+                           size_t size)
+{
+    struct async_mqtt_client_input_t *input_p;
+    size_t offset;
+    bool last;
+
+    input_p = &self_p->input;
+    offset = input_p->chunk.offset;
+
+    if (size > input_p->chunk.size - offset) {
+        size = (input_p->chunk.size - offset);
+    }
+
+    input_p->chunk.offset += size;
+    last = (input_p->chunk.offset == input_p->chunk.size);
+
+    if (last) {
+        input_p->chunk.active = false;
+        input_p->start = 0;
+
+        if (input_p->chunk.qos == 2) {
+            received_add(&self_p->received, input_p->chunk.packet_identifier);
+        }
+    }
+
+    self_p->on_publish_chunk(self_p->obj_p,
+                             (char *)&input_p->buf_p[0],
+                             buf_p,
+                             size,
+                             offset,
+                             input_p->chunk.size);
+
+    if (last) {
+        publish_acknowledge(self_p,
+                            input_p->chunk.qos,
+                            input_p->chunk.packet_identifier);
+    }
+
+    return (size);
+}
+
+/**
+ * Start passing the message of a publish packet that does not fit in
+ * the receive buffer in chunks, and keep its topic at the start of
+ * the buffer meanwhile. Resent QoS 2 messages already passed, and all
+ * messages if there is no chunk handler, are discarded, but their
+ * topic aliases are still stored. Returns the number of used bytes,
+ * zero if more data is needed, or -1 if malformed.
+ */
+static int decode_chunk_start(struct async_mqtt_client_t *self_p,
+                              uint8_t *buf_p,
+                              size_t size,
+                              int header_size,
+                              size_t packet_size)
+{
+    struct async_mqtt_client_input_t *input_p;
+    char *topic_p;
+    size_t topic_size;
+    uint16_t packet_identifier;
+    size_t offset;
+    int topic_alias;
+    int qos;
+    int res;
+
+    input_p = &self_p->input;
+    qos = ((buf_p[0] & PUBLISH_QOS_MASK) >> PUBLISH_QOS_SHIFT);
+
+    if (qos == 3) {
+        return (-1);
+    }
+
+    offset = unpack_publish_topic(&buf_p[header_size],
+                                  size - header_size,
+                                  qos,
+                                  &topic_p,
+                                  &topic_size,
+                                  &packet_identifier,
+                                  &topic_alias);
+
+    if (offset == 0) {
+        return (0);
+    } else if (offset > packet_size) {
+        return (-1);
+    }
+
+    if (!topic_alias_incoming(self_p, &topic_p, &topic_size, topic_alias)) {
+        DEBUG("Invalid topic alias %d.", topic_alias);
+        write_disconnect(self_p, disconnect_reason_code_topic_alias_invalid_t);
+
+        return (-1);
+    }
+
+    if (self_p->on_publish_chunk == NULL) {
+        DEBUG("Discarding %lu bytes packet.",
+              (unsigned long)(header_size + packet_size));
+        input_p->discard = (packet_size - offset);
+
+        return (header_size + offset);
+    }
+
+    res = publish_check(self_p, qos, packet_identifier);
+
+    if (res == 0) {
+        input_p->discard = (packet_size - offset);
+
+        return (header_size + offset);
+    } else if (res < 0) {
+        DEBUG("Receive Maximum exceeded.");
+        write_disconnect(self_p,
+                         disconnect_reason_code_receive_maximum_exceeded_t);
+
+        return (-1);
+    }
+
+    memmove(&input_p->buf_p[0], topic_p, topic_size);
+    input_p->buf_p[topic_size] = '\0';
+
+    if (offset == packet_size) {
+        if (qos == 2) {
+            received_add(&self_p->received, packet_identifier);
+        }
+
+        dispatch_publish(self_p,
+                         (char *)&input_p->buf_p[0],
+                         &input_p->buf_p[topic_size],
+                         0);
+        publish_acknowledge(self_p, qos, packet_identifier);
+    } else {
+        input_p->start = (topic_size + 1);
+        input_p->chunk.active = true;
+        input_p->chunk.offset = 0;
+        input_p->chunk.size = (packet_size - offset);
+        input_p->chunk.qos = qos;
+        input_p->chunk.packet_identifier = packet_identifier;
+    }
+
+    return (header_size + offset);
+}
+
+/**
+ * Decode and handle all complete packets in the receive buffer, and
+ * move any partial packet to the start of it. Publish packets that
+ * do not fit in the buffer are passed in chunks, if possible, and
+ * other such packets are discarded.
+ */
+static void decode_input(struct async_mqtt_client_t *self_p)
+{
+    struct async_mqtt_client_input_t *input_p;
+    uint8_t *buf_p;
+    size_t offset;
+    size_t left;
+    size_t packet_size;
+    size_t total_size;
+    int header_size;
+    int type;
+    int flags;
+    int res;
+
+    input_p = &self_p->input;
+    offset = input_p->start;
+
+    while (offset < input_p->end) {
+        buf_p = &input_p->buf_p[offset];
+        left = (input_p->end - offset);
+
+        if (input_p->discard > 0) {
+            if (left > input_p->discard) {
+                left = input_p->discard;
+            }
+
+            input_p->discard -= left;
+            offset += left;
+
+            continue;
+        }
+
+        if (input_p->chunk.active) {
+            offset += decode_chunk(self_p, buf_p, left);
+
+            if (input_p->closed) {
+                return;
+            }
+
+            continue;
+        }
+
+        header_size = unpack_fixed_header(buf_p,
+                                          left,
+                                          &type,
+                                          &flags,
+                                          &packet_size);
+
+        if (header_size == 0) {
+            break;
+        } else if (header_size < 0) {
+            DEBUG("Malformed packet.");
+            reconnect(self_p);
+
+            return;
+        }
+
+        total_size = (header_size + packet_size);
+
+        if (total_size > self_p->maximum_packet_size) {
+            DEBUG("Too large packet of %lu bytes.", (unsigned long)total_size);
+            write_disconnect(self_p, disconnect_reason_code_packet_too_large_t);
+            reconnect(self_p);
+
+            return;
+        }
+
+        if (total_size > input_p->buf_size) {
+            if (type == control_packet_type_publish_t) {
+                res = decode_chunk_start(self_p,
+                                         buf_p,
+                                         left,
+                                         header_size,
+                                         packet_size);
+
+                if (res > 0) {
+                    offset += res;
+
+                    if (input_p->closed) {
+                        return;
+                    }
+
+                    continue;
+                } else if (res < 0) {
+                    DEBUG("Malformed packet.");
+                    reconnect(self_p);
+
+                    return;
+                } else if (left < input_p->buf_size) {
+                    break;
+                }
+            }
+
+            DEBUG("Discarding %lu bytes packet.", (unsigned long)total_size);
+            input_p->discard = total_size;
+
+            continue;
+        }
+
+        if (total_size > left) {
+            break;
+        }
+
+        offset += total_size;
+        handle_packet(self_p,
+                      type,
+                      flags,
+                      &buf_p[header_size],
+                      packet_size);
+
+        if (input_p->closed) {
+            return;
+        }
+    }
+
+    left = (input_p->end - offset);
+
+    if ((left > 0) && (offset > input_p->start)) {
+        memmove(&input_p->buf_p[input_p->start], &input_p->buf_p[offset], left);
+    }
+
+    input_p->end = (input_p->start + left);
+}
+
+/**
+ * Read everything readable into the receive buffer, and decode all
+ * complete packets in it, instead of reading one packet field per
+ * input event. Packets written meanwhile are written at once after
+ * each read.
+ */
+static void on_stcp_input(struct async_stcp_client_t *stcp_p)
+{
+    struct async_mqtt_client_t *self_p;
+    struct async_mqtt_client_input_t *input_p;
+    size_t size;
+
+    self_p = async_container_of(stcp_p, typeof(*self_p), stcp);
+    input_p = &self_p->input;
+    output_cork(self_p);
+
+    while (!input_p->closed) {
+        size = async_stcp_client_read(&self_p->stcp,
+                                      &input_p->buf_p[input_p->end],
+                                      input_p->buf_size - input_p->end);
+
+        if ((size == 0) || input_p->closed) {
+            break;
+        }
+
+        input_p->end += size;
+        self_p->statistics.received.bytes += size;
+        decode_input(self_p);
+        output_flush(self_p);
+    }
+
+    output_uncork(self_p);
+}
+
 static uint16_t next_packet_identifier(struct async_mqtt_client_t *self_p)
 {
     uint16_t packet_identifier;
@@ -775,7 +2527,7 @@ static uint16_t next_packet_identifier(struct async_mqtt_client_t *self_p)
     packet_identifier = self_p->next_packet_identifier;
     self_p->next_packet_identifier++;
 
-    if (self_p->next_packet_identifier == 0) {
+    if (self_p->next_packet_identifier == PUBLISH_PACKET_IDENTIFIER_BEGIN) {
         self_p->next_packet_identifier = 1;
     }
 
@@ -795,7 +2547,7 @@ static void on_keep_alive_timeout(struct async_mqtt_client_t *self_p)
     uint8_t buf[8];
 
     writer_init(&writer, &buf[0], sizeof(buf));
-    async_stcp_client_write(&self_p->stcp, &buf[0], pack_pingreq(&writer));
+    output_write(self_p, &buf[0], pack_pingreq(&writer));
 }
 
 void async_mqtt_client_init(struct async_mqtt_client_t *self_p,
@@ -813,15 +2565,39 @@ void async_mqtt_client_init(struct async_mqtt_client_t *self_p,
     self_p->on_connected = on_connected;
     self_p->on_disconnected = on_disconnected;
     self_p->on_publish = on_publish;
+    self_p->on_publish_chunk = NULL;
     self_p->on_subscribe_complete = on_subscribe_complete_null;
+    self_p->on_publish_complete = on_publish_complete_null;
     self_p->obj_p = obj_p;
     self_p->log_object_p = NULL;
     self_p->async_p = async_p;
     sprintf(&self_p->client_id[0], "async-12345");
     self_p->keep_alive_s = 10;
     self_p->will.topic_p = NULL;
+    self_p->maximum_packet_size = MAXIMUM_PACKET_SIZE;
+    self_p->session_expiry_interval = 0;
     self_p->connected = false;
     self_p->next_packet_identifier = 1;
+    self_p->input.buf_p = &self_p->input.default_buf[0];
+    self_p->input.buf_size = sizeof(self_p->input.default_buf);
+    input_close(self_p);
+    self_p->output.size = 0;
+    self_p->output.corked = false;
+    in_flight_init(&self_p->in_flight,
+                   &self_p->in_flight.default_messages[0],
+                   ASYNC_MQTT_CLIENT_IN_FLIGHT_MAX);
+    self_p->received.length = 0;
+    router_init(&self_p->router,
+                &self_p->router.default_levels[0],
+                ASYNC_MQTT_CLIENT_ROUTER_LEVELS_MAX);
+    self_p->topic_aliases.incoming.buf_p =
+        &self_p->topic_aliases.incoming.default_buf[0];
+    self_p->topic_aliases.incoming.size =
+        sizeof(self_p->topic_aliases.incoming.default_buf);
+    self_p->topic_aliases.incoming.topic_size = 0;
+    self_p->topic_aliases.incoming.maximum = 0;
+    topic_aliases_reset(&self_p->topic_aliases);
+    memset(&self_p->statistics, 0, sizeof(self_p->statistics));
     async_stcp_client_init(&self_p->stcp,
                            ssl_context_p,
                            on_stcp_connected,
@@ -865,6 +2641,80 @@ void async_mqtt_client_set_on_subscribe_complete(
     self_p->on_subscribe_complete = on_subscribe_complete;
 }
 
+void async_mqtt_client_set_on_publish_complete(
+    struct async_mqtt_client_t *self_p,
+    async_mqtt_client_on_publish_complete_t on_publish_complete)
+{
+    self_p->on_publish_complete = on_publish_complete;
+}
+
+int async_mqtt_client_set_in_flight_buffer(
+    struct async_mqtt_client_t *self_p,
+    struct async_mqtt_client_in_flight_message_t *messages_p,
+    int length)
+{
+    if ((length < 1) || (length > 32768)) {
+        return (-ASYNC_ERROR_INVALID_ARGUMENT);
+    }
+
+    in_flight_init(&self_p->in_flight, messages_p, length);
+
+    return (0);
+}
+
+void async_mqtt_client_set_router_buffer(
+    struct async_mqtt_client_t *self_p,
+    struct async_mqtt_client_router_level_t *levels_p,
+    int length)
+{
+    router_init(&self_p->router, levels_p, length);
+}
+
+void async_mqtt_client_set_session_expiry_interval(
+    struct async_mqtt_client_t *self_p,
+    uint32_t interval_s)
+{
+    self_p->session_expiry_interval = interval_s;
+}
+
+void async_mqtt_client_set_input_buffer(struct async_mqtt_client_t *self_p,
+                                        void *buf_p,
+                                        size_t size)
+{
+    self_p->input.buf_p = buf_p;
+    self_p->input.buf_size = size;
+}
+
+void async_mqtt_client_set_topic_alias_buffer(
+    struct async_mqtt_client_t *self_p,
+    void *buf_p,
+    size_t size)
+{
+    self_p->topic_aliases.incoming.buf_p = buf_p;
+    self_p->topic_aliases.incoming.size = size;
+}
+
+void async_mqtt_client_set_maximum_packet_size(
+    struct async_mqtt_client_t *self_p,
+    size_t size)
+{
+    self_p->maximum_packet_size = size;
+}
+
+void async_mqtt_client_set_on_publish_chunk(
+    struct async_mqtt_client_t *self_p,
+    async_mqtt_client_on_publish_chunk_t on_publish_chunk)
+{
+    self_p->on_publish_chunk = on_publish_chunk;
+}
+
+void async_mqtt_client_get_statistics(
+    struct async_mqtt_client_t *self_p,
+    struct async_mqtt_client_statistics_t *statistics_p)
+{
+    *statistics_p = self_p->statistics;
+}
+
 void async_mqtt_client_start(struct async_mqtt_client_t *self_p)
 {
     async_stcp_client_connect(&self_p->stcp, self_p->host_p, self_p->port);
@@ -872,48 +2722,99 @@ void async_mqtt_client_start(struct async_mqtt_client_t *self_p)
 
 void async_mqtt_client_stop(struct async_mqtt_client_t *self_p)
 {
-    struct writer_t writer;
-    uint8_t buf[8];
-
-    writer_init(&writer, &buf[0], sizeof(buf));
-    async_stcp_client_write(
-        &self_p->stcp,
-        &buf[0],
-        pack_disconnect(&writer,
-                        disconnect_reason_code_normal_disconnection_t));
-    async_stcp_client_disconnect(&self_p->stcp);
+    write_disconnect(self_p, disconnect_reason_code_normal_disconnection_t);
+    disconnect_transport(self_p);
     self_p->connected = false;
     async_timer_stop(&self_p->keep_alive_timer);
+    input_close(self_p);
 }
 
 uint16_t async_mqtt_client_subscribe(struct async_mqtt_client_t *self_p,
                                      const char *topic_p)
+{
+    return (async_mqtt_client_subscribe_with_qos(self_p, topic_p, 0));
+}
+
+int async_mqtt_client_subscribe_with_qos(struct async_mqtt_client_t *self_p,
+                                         const char *topic_p,
+                                         int qos)
 {
     struct writer_t writer;
     uint8_t buf[512];
     uint16_t packet_identifier;
 
+    if ((qos < 0) || (qos > 2)) {
+        return (-ASYNC_ERROR_INVALID_ARGUMENT);
+    }
+
     writer_init(&writer, &buf[0], sizeof(buf));
     packet_identifier = next_packet_identifier(self_p);
-    async_stcp_client_write(&self_p->stcp,
-                            &buf[0],
-                            pack_subscribe(&writer,
-                                           topic_p,
-                                           packet_identifier));
+    output_write(self_p,
+                 &buf[0],
+                 pack_subscribe(&writer, topic_p, packet_identifier, qos));
 
     return (packet_identifier);
 }
 
+int async_mqtt_client_subscribe_with_handler(
+    struct async_mqtt_client_t *self_p,
+    const char *filter_p,
+    async_mqtt_client_on_publish_t on_publish,
+    void *obj_p)
+{
+    int res;
+
+    res = router_add(&self_p->router, filter_p, on_publish, obj_p);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    return (async_mqtt_client_subscribe(self_p, filter_p));
+}
+
 void async_mqtt_client_publish(struct async_mqtt_client_t *self_p,
                                const char *topic_p,
                                const void *buf_p,
                                size_t size)
 {
-    struct writer_t writer;
-    uint8_t buf[512];
+    write_publish(self_p, topic_p, buf_p, size, 0, 0);
+}
 
-    writer_init(&writer, &buf[0], sizeof(buf));
-    async_stcp_client_write(&self_p->stcp,
-                            &buf[0],
-                            pack_publish(&writer, topic_p, buf_p, size));
+int async_mqtt_client_publish_with_qos(struct async_mqtt_client_t *self_p,
+                                       const char *topic_p,
+                                       const void *buf_p,
+                                       size_t size,
+                                       int qos)
+{
+    struct async_mqtt_client_in_flight_message_t *message_p;
+
+    if ((qos < 0) || (qos > 2)) {
+        return (-ASYNC_ERROR_INVALID_ARGUMENT);
+    } else if (qos == 0) {
+        async_mqtt_client_publish(self_p, topic_p, buf_p, size);
+
+        return (0);
+    }
+
+    message_p = in_flight_alloc(&self_p->in_flight);
+
+    if (message_p == NULL) {
+        return (-ASYNC_ERROR_QUEUE_FULL);
+    }
+
+    message_p->topic_p = topic_p;
+    message_p->buf_p = buf_p;
+    message_p->size = size;
+    message_p->qos = qos;
+
+    if (qos == 1) {
+        message_p->state = in_flight_state_puback_t;
+    } else {
+        message_p->state = in_flight_state_pubrec_t;
+    }
+
+    in_flight_send_pending(self_p);
+
+    return (message_p->packet_identifier);
 }
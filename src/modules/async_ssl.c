@@ -43,6 +43,9 @@
 #include "mbedtls/debug.h"
 #include "mbedtls/timing.h"
 
+/* Written buffers smaller than this are gathered into one record. */
+#define WRITEV_BUFFER_SIZE                              512
+
 struct module_t {
     bool initialized;
     mbedtls_entropy_context entropy;
@@ -326,22 +329,73 @@ size_t async_ssl_connection_read(struct async_ssl_connection_t *self_p,
 
     if (!self_p->input_call_outstanding) {
         if (mbedtls_ssl_get_bytes_avail(&self_p->ssl) > 0) {
-            self_p->input_call_outstanding = true;
-            async_call(self_p->async_p,
-                       (async_func_t)on_input_wrapper,
-                       self_p,
-                       NULL);
+            if (async_call(self_p->async_p,
+                           (async_func_t)on_input_wrapper,
+                           self_p,
+                           NULL) == 0) {
+                self_p->input_call_outstanding = true;
+            }
         }
     }
 
     return (res);
 }
 
+/**
+ * Each mbedtls_ssl_write() call writes at most one record.
+ */
+static void write_all(struct async_ssl_connection_t *self_p,
+                      const uint8_t *buf_p,
+                      size_t size)
+{
+    int res;
+
+    while (size > 0) {
+        res = mbedtls_ssl_write(&self_p->ssl, buf_p, size);
+
+        if (res <= 0) {
+            break;
+        }
+
+        buf_p += res;
+        size -= res;
+    }
+}
+
 void async_ssl_connection_write(struct async_ssl_connection_t *self_p,
                                 const void *buf_p,
                                 size_t size)
 {
-    mbedtls_ssl_write(&self_p->ssl, buf_p, size);
+    write_all(self_p, buf_p, size);
+}
+
+void async_ssl_connection_writev(struct async_ssl_connection_t *self_p,
+                                 const struct async_iovec_t *iov_p,
+                                 int length)
+{
+    uint8_t buf[WRITEV_BUFFER_SIZE];
+    size_t size;
+    int i;
+
+    size = 0;
+
+    for (i = 0; i < length; i++) {
+        if (iov_p[i].size > sizeof(buf) - size) {
+            write_all(self_p, &buf[0], size);
+            size = 0;
+
+            if (iov_p[i].size >= sizeof(buf)) {
+                write_all(self_p, iov_p[i].buf_p, iov_p[i].size);
+
+                continue;
+            }
+        }
+
+        memcpy(&buf[size], iov_p[i].buf_p, iov_p[i].size);
+        size += iov_p[i].size;
+    }
+
+    write_all(self_p, &buf[0], size);
 }
 
 void async_ssl_connection_on_transport_input(struct async_ssl_connection_t *self_p)
@@ -157,6 +157,17 @@ void async_stcp_client_write(struct async_stcp_client_t *self_p,
     }
 }
 
+void async_stcp_client_writev(struct async_stcp_client_t *self_p,
+                              const struct async_iovec_t *iov_p,
+                              int length)
+{
+    if (self_p->ssl.context_p == NULL) {
+        async_tcp_client_writev(&self_p->tcp, iov_p, length);
+    } else {
+        async_ssl_connection_writev(&self_p->ssl.connection, iov_p, length);
+    }
+}
+
 size_t async_stcp_client_read(struct async_stcp_client_t *self_p,
                               void *buf_p,
                               size_t size)
@@ -0,0 +1,152 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+#include <sched.h>
+#include "internal.h"
+
+struct job_t {
+    async_func_t entry;
+    void *obj_p;
+    void *arg_p;
+    async_func_t on_complete;
+    struct async_calls_t *calls_p;
+};
+
+static void job_complete(struct job_t *self_p, void *arg_p)
+{
+    (void)arg_p;
+
+    self_p->on_complete(self_p->obj_p, self_p->arg_p);
+    async_slab_free(&self_p->calls_p->jobs, self_p);
+}
+
+static void job(struct job_t *self_p)
+{
+    self_p->entry(self_p->obj_p, self_p->arg_p);
+    async_calls_call_threadsafe(self_p->calls_p,
+                                (async_func_t)job_complete,
+                                self_p,
+                                NULL);
+}
+
+int async_calls_init(struct async_calls_t *self_p,
+                     size_t length,
+                     async_calls_wakeup_t wakeup,
+                     void *obj_p)
+{
+    if (async_mpsc_ring_init(&self_p->ring, length) != 0) {
+        return (-1);
+    }
+
+    async_worker_pool_init(&self_p->worker_pool);
+    async_slab_init(&self_p->jobs, sizeof(struct job_t));
+    self_p->wakeup = wakeup;
+    self_p->obj_p = obj_p;
+
+    return (0);
+}
+
+void async_calls_destroy(struct async_calls_t *self_p)
+{
+    async_mpsc_ring_destroy(&self_p->ring);
+}
+
+void async_calls_call_threadsafe(struct async_calls_t *self_p,
+                                 async_func_t func,
+                                 void *obj_p,
+                                 void *arg_p)
+{
+    int res;
+
+    while (true) {
+        res = async_mpsc_ring_put(&self_p->ring, func, obj_p, arg_p);
+
+        if (res != -ASYNC_ERROR_QUEUE_FULL) {
+            break;
+        }
+
+        /* Let the async thread make room. */
+        sched_yield();
+    }
+
+    if (res == 1) {
+        self_p->wakeup(self_p->obj_p);
+    }
+}
+
+int async_calls_call_worker_pool(struct async_calls_t *self_p,
+                                 struct async_t *async_p,
+                                 async_func_t entry,
+                                 void *obj_p,
+                                 void *arg_p,
+                                 async_func_t on_complete)
+{
+    struct job_t *job_p;
+    int res;
+
+    if (async_worker_pool_start(&self_p->worker_pool,
+                                async_p->worker_pool.number_of_workers,
+                                async_p->worker_pool.queue_length) != 0) {
+        return (-1);
+    }
+
+    job_p = async_slab_alloc(&self_p->jobs);
+    job_p->entry = entry;
+    job_p->obj_p = obj_p;
+    job_p->arg_p = arg_p;
+    job_p->on_complete = on_complete;
+    job_p->calls_p = self_p;
+    res = async_worker_pool_spawn(&self_p->worker_pool,
+                                  (async_worker_pool_entry_t)job,
+                                  job_p);
+
+    if (res != 0) {
+        async_slab_free(&self_p->jobs, job_p);
+    }
+
+    return (res);
+}
+
+void async_calls_process(struct async_calls_t *self_p)
+{
+    async_func_t func;
+    void *obj_p;
+    void *arg_p;
+
+    async_mpsc_ring_woken_up(&self_p->ring);
+
+    while (true) {
+        func = async_mpsc_ring_get(&self_p->ring, &obj_p, &arg_p);
+
+        if (func == NULL) {
+            break;
+        }
+
+        func(obj_p, arg_p);
+    }
+}
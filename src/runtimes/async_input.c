@@ -0,0 +1,229 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include "async/utils/linux.h"
+#include "internal.h"
+
+static struct async_input_buffer_t *buffer_alloc(struct async_input_pool_t *self_p)
+{
+    struct async_input_buffer_t *buffer_p;
+
+    buffer_p = self_p->free_p;
+
+    if (buffer_p != NULL) {
+        self_p->free_p = buffer_p->next_p;
+    } else {
+        buffer_p = malloc(sizeof(*buffer_p));
+
+        if (buffer_p == NULL) {
+            async_utils_linux_fatal_perror("input malloc");
+        }
+    }
+
+    return (buffer_p);
+}
+
+static void buffer_free(struct async_input_pool_t *self_p,
+                        struct async_input_buffer_t *buffer_p)
+{
+    buffer_p->next_p = self_p->free_p;
+    self_p->free_p = buffer_p;
+}
+
+static void give_back_if_empty(struct async_input_t *self_p)
+{
+    if ((self_p->size == 0) && (self_p->buffer_p != NULL)) {
+        buffer_free(self_p->pool_p, self_p->buffer_p);
+        self_p->buffer_p = NULL;
+        self_p->offset = 0;
+    }
+}
+
+static void update_readable(struct async_input_t *self_p,
+                            ssize_t res,
+                            size_t size)
+{
+    if (res == 0) {
+        self_p->end = true;
+    }
+
+    /* A short read means that the socket is drained. */
+    if ((res <= 0) || ((size_t)res < size)) {
+        self_p->readable = false;
+    }
+}
+
+/**
+ * Read once from the socket into the free space after any received
+ * data, which is first moved to the start of the buffer.
+ */
+static ssize_t fill(struct async_input_t *self_p, int sockfd)
+{
+    ssize_t res;
+    size_t left;
+
+    if (!self_p->readable) {
+        errno = EAGAIN;
+
+        return (-1);
+    }
+
+    if (self_p->buffer_p == NULL) {
+        self_p->buffer_p = buffer_alloc(self_p->pool_p);
+        self_p->offset = 0;
+    } else if (self_p->offset > 0) {
+        memmove(&self_p->buffer_p->buf[0],
+                &self_p->buffer_p->buf[self_p->offset],
+                self_p->size);
+        self_p->offset = 0;
+    }
+
+    left = (sizeof(self_p->buffer_p->buf) - self_p->size);
+
+    if (left == 0) {
+        errno = EAGAIN;
+
+        return (-1);
+    }
+
+    res = read(sockfd, &self_p->buffer_p->buf[self_p->size], left);
+    update_readable(self_p, res, left);
+
+    if (res > 0) {
+        self_p->size += res;
+    }
+
+    give_back_if_empty(self_p);
+
+    return (res);
+}
+
+void async_input_pool_init(struct async_input_pool_t *self_p)
+{
+    self_p->free_p = NULL;
+}
+
+void async_input_init(struct async_input_t *self_p,
+                      struct async_input_pool_t *pool_p)
+{
+    self_p->pool_p = pool_p;
+    self_p->buffer_p = NULL;
+    self_p->offset = 0;
+    self_p->size = 0;
+    self_p->readable = false;
+    self_p->end = false;
+    self_p->consumed = 0;
+}
+
+void async_input_clear(struct async_input_t *self_p)
+{
+    self_p->size = 0;
+    give_back_if_empty(self_p);
+    self_p->readable = false;
+    self_p->end = false;
+}
+
+void async_input_set_readable(struct async_input_t *self_p)
+{
+    self_p->readable = true;
+}
+
+ssize_t async_input_read(struct async_input_t *self_p,
+                         int sockfd,
+                         void *buf_p,
+                         size_t size)
+{
+    const uint8_t *data_p;
+    ssize_t res;
+
+    if ((self_p->size == 0)
+        && (size >= ASYNC_INPUT_BUFFER_SIZE)
+        && self_p->readable) {
+        res = read(sockfd, buf_p, size);
+        update_readable(self_p, res, size);
+
+        if (res > 0) {
+            self_p->consumed += res;
+        }
+
+        return (res);
+    }
+
+    res = async_input_borrow(self_p, sockfd, &data_p);
+
+    if (res <= 0) {
+        return (res);
+    }
+
+    if (size > (size_t)res) {
+        size = res;
+    }
+
+    memcpy(buf_p, data_p, size);
+    async_input_release(self_p, size);
+
+    return (size);
+}
+
+ssize_t async_input_borrow(struct async_input_t *self_p,
+                           int sockfd,
+                           const uint8_t **buf_pp)
+{
+    ssize_t res;
+
+    res = fill(self_p, sockfd);
+
+    if (self_p->size > 0) {
+        *buf_pp = &self_p->buffer_p->buf[self_p->offset];
+        res = self_p->size;
+    } else if (self_p->end) {
+        res = 0;
+    }
+
+    return (res);
+}
+
+void async_input_release(struct async_input_t *self_p, size_t size)
+{
+    if (size > self_p->size) {
+        size = self_p->size;
+    }
+
+    self_p->offset += size;
+    self_p->size -= size;
+    self_p->consumed += size;
+    give_back_if_empty(self_p);
+}
+
+bool async_input_is_progressing(struct async_input_t *self_p, size_t consumed)
+{
+    return ((self_p->size > 0) && (self_p->consumed != consumed));
+}
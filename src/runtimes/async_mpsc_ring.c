@@ -0,0 +1,140 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+#include "internal.h"
+
+int async_mpsc_ring_init(struct async_mpsc_ring_t *self_p, size_t length)
+{
+    size_t i;
+
+    if ((length == 0) || ((length & (length - 1)) != 0)) {
+        return (-1);
+    }
+
+    self_p->elems_p = malloc(sizeof(*self_p->elems_p) * length);
+
+    if (self_p->elems_p == NULL) {
+        return (-1);
+    }
+
+    for (i = 0; i < length; i++) {
+        atomic_init(&self_p->elems_p[i].sequence, i);
+    }
+
+    self_p->mask = (length - 1);
+    atomic_init(&self_p->write_pos, 0);
+    atomic_init(&self_p->wakeup_pending, false);
+    self_p->read_pos = 0;
+
+    return (0);
+}
+
+void async_mpsc_ring_destroy(struct async_mpsc_ring_t *self_p)
+{
+    free(self_p->elems_p);
+}
+
+int async_mpsc_ring_put(struct async_mpsc_ring_t *self_p,
+                        async_func_t func,
+                        void *obj_p,
+                        void *arg_p)
+{
+    struct async_mpsc_ring_elem_t *elem_p;
+    size_t pos;
+    size_t sequence;
+    intptr_t diff;
+
+    pos = atomic_load_explicit(&self_p->write_pos, memory_order_relaxed);
+
+    while (true) {
+        elem_p = &self_p->elems_p[pos & self_p->mask];
+        sequence = atomic_load_explicit(&elem_p->sequence,
+                                        memory_order_acquire);
+        diff = ((intptr_t)sequence - (intptr_t)pos);
+
+        if (diff == 0) {
+            /* Free. Claim it unless another producer did first. */
+            if (atomic_compare_exchange_weak_explicit(&self_p->write_pos,
+                                                      &pos,
+                                                      pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return (-ASYNC_ERROR_QUEUE_FULL);
+        } else {
+            pos = atomic_load_explicit(&self_p->write_pos,
+                                       memory_order_relaxed);
+        }
+    }
+
+    elem_p->func = func;
+    elem_p->obj_p = obj_p;
+    elem_p->arg_p = arg_p;
+    atomic_store_explicit(&elem_p->sequence, pos + 1, memory_order_release);
+
+    /* Only the first call in a batch wakes up the consumer. */
+    if (atomic_exchange(&self_p->wakeup_pending, true)) {
+        return (0);
+    }
+
+    return (1);
+}
+
+async_func_t async_mpsc_ring_get(struct async_mpsc_ring_t *self_p,
+                                 void **obj_pp,
+                                 void **arg_pp)
+{
+    struct async_mpsc_ring_elem_t *elem_p;
+    size_t sequence;
+    async_func_t func;
+
+    elem_p = &self_p->elems_p[self_p->read_pos & self_p->mask];
+    sequence = atomic_load_explicit(&elem_p->sequence, memory_order_acquire);
+
+    /* Empty, or the producer has not yet written the call. */
+    if (sequence != (self_p->read_pos + 1)) {
+        return (NULL);
+    }
+
+    func = elem_p->func;
+    *obj_pp = elem_p->obj_p;
+    *arg_pp = elem_p->arg_p;
+    atomic_store_explicit(&elem_p->sequence,
+                          self_p->read_pos + self_p->mask + 1,
+                          memory_order_release);
+    self_p->read_pos++;
+
+    return (func);
+}
+
+void async_mpsc_ring_woken_up(struct async_mpsc_ring_t *self_p)
+{
+    atomic_exchange(&self_p->wakeup_pending, false);
+}
@@ -0,0 +1,306 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
+#include "async/utils/linux.h"
+#include "internal.h"
+
+/* Maximum number of chunks written per system call. */
+#define IOVECS_MAX                                      16
+
+static struct async_output_chunk_t *chunk_alloc(struct async_output_t *self_p,
+                                                size_t size)
+{
+    struct async_output_chunk_t *chunk_p;
+
+    if ((size <= ASYNC_OUTPUT_CHUNK_SIZE) && (self_p->free_p != NULL)) {
+        chunk_p = self_p->free_p;
+        self_p->free_p = NULL;
+    } else {
+        if (size < ASYNC_OUTPUT_CHUNK_SIZE) {
+            size = ASYNC_OUTPUT_CHUNK_SIZE;
+        }
+
+        chunk_p = malloc(sizeof(*chunk_p) + size);
+
+        if (chunk_p == NULL) {
+            async_utils_linux_fatal_perror("output malloc");
+        }
+
+        chunk_p->capacity = size;
+    }
+
+    chunk_p->next_p = NULL;
+    chunk_p->offset = 0;
+    chunk_p->size = 0;
+
+    return (chunk_p);
+}
+
+static void chunk_free(struct async_output_t *self_p,
+                       struct async_output_chunk_t *chunk_p)
+{
+    if ((chunk_p->capacity == ASYNC_OUTPUT_CHUNK_SIZE)
+        && (self_p->free_p == NULL)) {
+        self_p->free_p = chunk_p;
+    } else {
+        free(chunk_p);
+    }
+}
+
+static void append(struct async_output_t *self_p,
+                   const uint8_t *buf_p,
+                   size_t size)
+{
+    struct async_output_chunk_t *chunk_p;
+    size_t left;
+
+    self_p->size += size;
+    chunk_p = self_p->tail_p;
+
+    if (chunk_p != NULL) {
+        left = (chunk_p->capacity - chunk_p->size);
+
+        if (left > size) {
+            left = size;
+        }
+
+        memcpy(&chunk_p->buf[chunk_p->size], buf_p, left);
+        chunk_p->size += left;
+        buf_p += left;
+        size -= left;
+    }
+
+    if (size == 0) {
+        return;
+    }
+
+    chunk_p = chunk_alloc(self_p, size);
+    memcpy(&chunk_p->buf[0], buf_p, size);
+    chunk_p->size = size;
+
+    if (self_p->tail_p == NULL) {
+        self_p->head_p = chunk_p;
+    } else {
+        self_p->tail_p->next_p = chunk_p;
+    }
+
+    self_p->tail_p = chunk_p;
+}
+
+/**
+ * Append given buffers, except the first offset bytes.
+ */
+static void append_iov(struct async_output_t *self_p,
+                       const struct async_iovec_t *iov_p,
+                       int length,
+                       size_t offset)
+{
+    int i;
+
+    for (i = 0; i < length; i++) {
+        if (offset >= iov_p[i].size) {
+            offset -= iov_p[i].size;
+        } else {
+            append(self_p,
+                   (const uint8_t *)iov_p[i].buf_p + offset,
+                   iov_p[i].size - offset);
+            offset = 0;
+        }
+    }
+}
+
+/**
+ * Remove given number of written bytes from the head of the queue.
+ */
+static void consume(struct async_output_t *self_p, size_t size)
+{
+    struct async_output_chunk_t *chunk_p;
+    size_t left;
+
+    self_p->size -= size;
+
+    while (size > 0) {
+        chunk_p = self_p->head_p;
+        left = (chunk_p->size - chunk_p->offset);
+
+        if (size < left) {
+            chunk_p->offset += size;
+
+            break;
+        }
+
+        size -= left;
+        self_p->head_p = chunk_p->next_p;
+
+        if (self_p->head_p == NULL) {
+            self_p->tail_p = NULL;
+        }
+
+        chunk_free(self_p, chunk_p);
+    }
+}
+
+void async_output_init(struct async_output_t *self_p)
+{
+    self_p->head_p = NULL;
+    self_p->tail_p = NULL;
+    self_p->free_p = NULL;
+    self_p->size = 0;
+    self_p->blocked = false;
+}
+
+void async_output_clear(struct async_output_t *self_p)
+{
+    consume(self_p, self_p->size);
+    self_p->blocked = false;
+}
+
+int async_output_writev(struct async_output_t *self_p,
+                        int sockfd,
+                        const struct async_iovec_t *iov_p,
+                        int length)
+{
+    struct iovec iov[IOVECS_MAX];
+    struct msghdr msg;
+    size_t size;
+    ssize_t res;
+    int count;
+    int i;
+
+    if (self_p->size > 0) {
+        append_iov(self_p, iov_p, length, 0);
+
+        return (0);
+    }
+
+    while (length > 0) {
+        count = (length < IOVECS_MAX ? length : IOVECS_MAX);
+        size = 0;
+
+        for (i = 0; i < count; i++) {
+            iov[i].iov_base = (void *)iov_p[i].buf_p;
+            iov[i].iov_len = iov_p[i].size;
+            size += iov_p[i].size;
+        }
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov[0];
+        msg.msg_iovlen = count;
+        res = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+
+        if (res == -1) {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                return (-1);
+            }
+
+            res = 0;
+        }
+
+        if ((size_t)res < size) {
+            append_iov(self_p, iov_p, length, (size_t)res);
+
+            break;
+        }
+
+        iov_p += count;
+        length -= count;
+    }
+
+    return (0);
+}
+
+int async_output_flush(struct async_output_t *self_p, int sockfd)
+{
+    struct iovec iov[IOVECS_MAX];
+    struct msghdr msg;
+    struct async_output_chunk_t *chunk_p;
+    size_t size;
+    ssize_t res;
+    int length;
+
+    while (self_p->head_p != NULL) {
+        length = 0;
+        size = 0;
+        chunk_p = self_p->head_p;
+
+        while ((chunk_p != NULL) && (length < IOVECS_MAX)) {
+            iov[length].iov_base = &chunk_p->buf[chunk_p->offset];
+            iov[length].iov_len = (chunk_p->size - chunk_p->offset);
+            size += iov[length].iov_len;
+            length++;
+            chunk_p = chunk_p->next_p;
+        }
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov[0];
+        msg.msg_iovlen = length;
+        res = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+
+        if (res == -1) {
+            if (errno == EINTR) {
+                continue;
+            } else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                break;
+            } else {
+                return (-1);
+            }
+        }
+
+        consume(self_p, (size_t)res);
+
+        /* The socket buffer is full. */
+        if ((size_t)res < size) {
+            break;
+        }
+    }
+
+    return (0);
+}
+
+bool async_output_is_empty(struct async_output_t *self_p)
+{
+    return (self_p->size == 0);
+}
+
+bool async_output_update(struct async_output_t *self_p,
+                         size_t low_watermark,
+                         size_t high_watermark)
+{
+    if (self_p->size > high_watermark) {
+        self_p->blocked = true;
+    } else if (self_p->blocked && (self_p->size <= low_watermark)) {
+        self_p->blocked = false;
+
+        return (true);
+    }
+
+    return (false);
+}
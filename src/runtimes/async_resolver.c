@@ -0,0 +1,301 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include "internal.h"
+
+struct job_t {
+    struct async_resolver_t *resolver_p;
+    char host[ASYNC_RESOLVER_HOST_MAX];
+    int port;
+    int res;
+    struct async_resolver_result_t result;
+    async_resolver_complete_t on_complete;
+    void *obj_p;
+    void *arg_p;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec);
+}
+
+static void set_port(struct async_resolver_result_t *result_p, int port)
+{
+    struct async_resolver_address_t *address_p;
+    int i;
+
+    for (i = 0; i < result_p->length; i++) {
+        address_p = &result_p->addresses[i];
+
+        if (address_p->addr.ss_family == AF_INET) {
+            ((struct sockaddr_in *)&address_p->addr)->sin_port = htons(port);
+        } else {
+            ((struct sockaddr_in6 *)&address_p->addr)->sin6_port = htons(port);
+        }
+    }
+}
+
+static bool parse_numeric(const char *host_p,
+                          struct async_resolver_result_t *result_p)
+{
+    struct sockaddr_in *addr_p;
+    struct sockaddr_in6 *addr6_p;
+
+    memset(&result_p->addresses[0], 0, sizeof(result_p->addresses[0]));
+    addr_p = (struct sockaddr_in *)&result_p->addresses[0].addr;
+    addr6_p = (struct sockaddr_in6 *)&result_p->addresses[0].addr;
+
+    if (inet_pton(AF_INET, host_p, &addr_p->sin_addr) == 1) {
+        addr_p->sin_family = AF_INET;
+        result_p->addresses[0].size = sizeof(*addr_p);
+    } else if (inet_pton(AF_INET6, host_p, &addr6_p->sin6_addr) == 1) {
+        addr6_p->sin6_family = AF_INET6;
+        result_p->addresses[0].size = sizeof(*addr6_p);
+    } else {
+        return (false);
+    }
+
+    result_p->length = 1;
+
+    return (true);
+}
+
+static struct async_resolver_cache_entry_t *find(struct async_resolver_t *self_p,
+                                                 const char *host_p)
+{
+    int i;
+
+    for (i = 0; i < self_p->length; i++) {
+        if (strcmp(&self_p->entries[i].host[0], host_p) == 0) {
+            return (&self_p->entries[i]);
+        }
+    }
+
+    return (NULL);
+}
+
+void async_resolver_init(struct async_resolver_t *self_p)
+{
+    self_p->resolve = async_resolver_resolve;
+    self_p->ttl_ms = ASYNC_RESOLVER_TTL_MS;
+    self_p->counter = 0;
+    self_p->length = 0;
+}
+
+void async_resolver_set_resolve(struct async_resolver_t *self_p,
+                                async_resolver_resolve_t resolve)
+{
+    self_p->resolve = resolve;
+}
+
+int async_resolver_resolve(const char *host_p,
+                           struct async_resolver_result_t *result_p)
+{
+    struct addrinfo hints;
+    struct addrinfo *infos_p;
+    struct addrinfo *info_p;
+    struct async_resolver_address_t *address_p;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_ADDRCONFIG;
+
+    if (getaddrinfo(host_p, NULL, &hints, &infos_p) != 0) {
+        return (-1);
+    }
+
+    result_p->length = 0;
+
+    for (info_p = infos_p; info_p != NULL; info_p = info_p->ai_next) {
+        if (result_p->length == ASYNC_RESOLVER_ADDRESSES_MAX) {
+            break;
+        }
+
+        if ((info_p->ai_family != AF_INET) && (info_p->ai_family != AF_INET6)) {
+            continue;
+        }
+
+        address_p = &result_p->addresses[result_p->length];
+        memset(&address_p->addr, 0, sizeof(address_p->addr));
+        memcpy(&address_p->addr, info_p->ai_addr, info_p->ai_addrlen);
+        address_p->size = info_p->ai_addrlen;
+        result_p->length++;
+    }
+
+    freeaddrinfo(infos_p);
+
+    return (result_p->length > 0 ? 0 : -1);
+}
+
+bool async_resolver_lookup(struct async_resolver_t *self_p,
+                           const char *host_p,
+                           int port,
+                           struct async_resolver_result_t *result_p)
+{
+    struct async_resolver_cache_entry_t *entry_p;
+
+    if (!parse_numeric(host_p, result_p)) {
+        entry_p = find(self_p, host_p);
+
+        if ((entry_p == NULL) || (now_ns() >= entry_p->expiry_ns)) {
+            return (false);
+        }
+
+        self_p->counter++;
+        entry_p->last_used = self_p->counter;
+        *result_p = entry_p->result;
+    }
+
+    set_port(result_p, port);
+
+    return (true);
+}
+
+void async_resolver_insert(struct async_resolver_t *self_p,
+                           const char *host_p,
+                           const struct async_resolver_result_t *result_p)
+{
+    struct async_resolver_cache_entry_t *entry_p;
+    uint64_t now;
+    int i;
+
+    if (strlen(host_p) >= ASYNC_RESOLVER_HOST_MAX) {
+        return;
+    }
+
+    now = now_ns();
+    entry_p = find(self_p, host_p);
+
+    if (entry_p == NULL) {
+        if (self_p->length < ASYNC_RESOLVER_CACHE_LENGTH) {
+            entry_p = &self_p->entries[self_p->length];
+            self_p->length++;
+        } else {
+            entry_p = &self_p->entries[0];
+
+            for (i = 0; i < self_p->length; i++) {
+                if (self_p->entries[i].expiry_ns <= now) {
+                    entry_p = &self_p->entries[i];
+                    break;
+                }
+
+                if (self_p->entries[i].last_used < entry_p->last_used) {
+                    entry_p = &self_p->entries[i];
+                }
+            }
+        }
+
+        strcpy(&entry_p->host[0], host_p);
+    }
+
+    self_p->counter++;
+    entry_p->last_used = self_p->counter;
+    entry_p->expiry_ns = (now + (uint64_t)self_p->ttl_ms * 1000000);
+    entry_p->result = *result_p;
+}
+
+static void job_entry(struct job_t *self_p, void *arg_p)
+{
+    (void)arg_p;
+
+    self_p->res = self_p->resolver_p->resolve(&self_p->host[0],
+                                              &self_p->result);
+}
+
+static void job_complete(struct job_t *self_p, void *arg_p)
+{
+    (void)arg_p;
+
+    if (self_p->res == 0) {
+        async_resolver_insert(self_p->resolver_p,
+                              &self_p->host[0],
+                              &self_p->result);
+        set_port(&self_p->result, self_p->port);
+        self_p->on_complete(self_p->obj_p, self_p->arg_p, &self_p->result);
+    } else {
+        self_p->on_complete(self_p->obj_p, self_p->arg_p, NULL);
+    }
+
+    free(self_p);
+}
+
+void async_resolver_get(struct async_resolver_t *self_p,
+                        struct async_t *async_p,
+                        const char *host_p,
+                        int port,
+                        async_resolver_complete_t on_complete,
+                        void *obj_p,
+                        void *arg_p)
+{
+    struct async_resolver_result_t result;
+    struct job_t *job_p;
+
+    if (async_resolver_lookup(self_p, host_p, port, &result)) {
+        on_complete(obj_p, arg_p, &result);
+
+        return;
+    }
+
+    job_p = NULL;
+
+    if (strlen(host_p) < ASYNC_RESOLVER_HOST_MAX) {
+        job_p = malloc(sizeof(*job_p));
+    }
+
+    if (job_p == NULL) {
+        on_complete(obj_p, arg_p, NULL);
+
+        return;
+    }
+
+    job_p->resolver_p = self_p;
+    strcpy(&job_p->host[0], host_p);
+    job_p->port = port;
+    job_p->on_complete = on_complete;
+    job_p->obj_p = obj_p;
+    job_p->arg_p = arg_p;
+
+    if (async_call_worker_pool(async_p,
+                               (async_func_t)job_entry,
+                               job_p,
+                               NULL,
+                               (async_func_t)job_complete) != 0) {
+        free(job_p);
+        on_complete(obj_p, arg_p, NULL);
+    }
+}
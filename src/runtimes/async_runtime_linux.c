@@ -31,132 +31,251 @@
 #include <arpa/inet.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
+#include <sched.h>
 #include <stdio.h>
 #include <sys/types.h>
+#include <sys/socket.h>
 #include "async.h"
+#include "async/runtimes/linux.h"
 #include "async/utils/linux.h"
-#include "ml/ml.h"
-
-static ML_UID(uid_timeout);
-static ML_UID(uid_tcp_client_connect);
-static ML_UID(uid_tcp_client_connect_complete);
-static ML_UID(uid_tcp_client_disconnect);
-static ML_UID(uid_tcp_client_write_error);
-static ML_UID(uid_tcp_client_data);
-static ML_UID(uid_tcp_client_data_complete);
-static ML_UID(uid_tcp_client_disconnected);
-static ML_UID(uid_worker_job);
-static ML_UID(uid_call_threadsafe);
-
-struct call_threadsafe_t {
-    async_func_t func;
-    void *obj_p;
-    void *arg_p;
+#include "internal.h"
+
+/* Maximum number of queued threadsafe calls. A power of two. */
+#define CALL_THREADSAFE_RING_LENGTH                     1024
+
+/* Maximum number of events handled per epoll_wait() call. */
+#define IO_EPOLL_EVENTS_MAX                             64
+
+/* Maximum number of accepted sockets per message. */
+#define IO_ACCEPT_MAX                                   64
+
+/* Message types. */
+#define MESSAGE_TCP_CLIENT_CONNECT                      0
+#define MESSAGE_TCP_CLIENT_CONNECT_COMPLETE             1
+#define MESSAGE_TCP_CLIENT_CONNECT_ABORT                2
+#define MESSAGE_TCP_SERVER_START                        3
+#define MESSAGE_TCP_SERVER_STOP                         4
+#define MESSAGE_TCP_SERVER_ACCEPTED                     5
+#define MESSAGE_CONNECTION_START                        6
+#define MESSAGE_CONNECTION_DISCONNECT                   7
+#define MESSAGE_CONNECTION_WRITE_ERROR                  8
+#define MESSAGE_CONNECTION_DATA                         9
+#define MESSAGE_CONNECTION_DATA_COMPLETE                10
+#define MESSAGE_CONNECTION_WRITE_WAIT                   11
+#define MESSAGE_CONNECTION_WRITABLE                     12
+#define MESSAGE_CONNECTION_DISCONNECTED                 13
+
+struct connection_t;
+
+/**
+ * Connections to call on_input() for, or to re-arm after on_input()
+ * has been called. One message per batch of events.
+ */
+struct message_data_t {
+    int length;
+    struct connection_t *connections_pp[IO_EPOLL_EVENTS_MAX];
 };
 
-struct worker_job_t {
-    async_func_t entry;
-    void *obj_p;
+struct async_runtime_linux_t;
+
+typedef void (*io_epoll_func_t)(struct async_runtime_linux_t *self_p,
+                                int epoll_fd,
+                                void *arg_p,
+                                uint32_t events);
+
+struct io_epoll_data_t {
+    io_epoll_func_t func;
     void *arg_p;
-    async_func_t on_complete;
-    struct ml_queue_t *async_queue_p;
 };
 
+/* Messages are allocated from slabs of the sending thread, one per
+   message payload type, and freed by the receiving thread. */
 struct async_runtime_linux_t {
     struct async_runtime_t runtime;
     struct {
         int fd;
         int epoll_fd;
-        struct ml_queue_t queue;
+        struct async_message_queue_t queue;
         pthread_t pthread;
+        /* Connections with input found by the current epoll_wait()
+           call. */
+        struct message_data_t *data_p;
+        struct io_epoll_data_t async_epoll_data;
+        struct io_epoll_data_t timer_epoll_data;
+        struct {
+            struct async_slab_t connect_complete;
+            struct async_slab_t accepted;
+            struct async_slab_t socket;
+            struct async_slab_t data;
+        } slabs;
     } io;
     struct {
-        struct ml_timer_t timer;
-        struct ml_queue_t queue;
+        int fd;
+        struct async_message_queue_t queue;
         pthread_t pthread;
+        struct async_calls_t calls;
+        struct async_input_pool_t input_pool;
+        struct {
+            struct async_slab_t connect;
+            struct async_slab_t connect_abort;
+            struct async_slab_t listener;
+            struct async_slab_t socket;
+            struct async_slab_t data;
+        } slabs;
     } async;
-    struct ml_timer_handler_t timer_handler;
-    struct ml_worker_pool_t worker_pool;
+    struct async_runtime_timer_t timer;
+    struct async_resolver_t resolver;
     struct async_t *async_p;
 };
 
-typedef void (*io_epoll_func_t)(struct async_runtime_linux_t *self_p,
-                                int epoll_fd,
-                                void *arg_p);
+typedef void (*connection_input_t)(void *owner_p);
 
-struct io_epoll_data_t {
-    io_epoll_func_t func;
-    void *arg_p;
+typedef void (*connection_func_t)(struct connection_t *self_p);
+
+/**
+ * A connected socket of a TCP client or a TCP server client.
+ */
+struct connection_t {
+    struct async_runtime_linux_t *runtime_p;
+    void *owner_p;
+    int sockfd;
+    bool closed;
+    struct io_epoll_data_t epoll_data;
+    /* Written data waiting for the socket to become writable. */
+    struct async_output_t output;
+    const size_t *low_watermark_p;
+    const size_t *high_watermark_p;
+    /* Received data not yet consumed by on_input(). */
+    struct async_input_t input;
+    connection_input_t on_input;
+    /* Called when closed by the remote end or by an error. */
+    connection_func_t on_closed;
+    /* Called when the output queue has drained to the low
+       watermark. */
+    connection_func_t on_writable;
+    /* Only used by the io thread. */
+    struct {
+        /* The connected socket and its armed one-shot events. */
+        int sockfd;
+        uint32_t events;
+    } io;
 };
 
+/* Connect messages are identified by a per client counter, so that a
+   late completion of an aborted connect can be ignored. */
 struct message_connect_t {
     struct async_tcp_client_t *tcp_p;
-    char *host_p;
-    int port;
+    unsigned int connect_id;
+    struct async_resolver_address_t address;
 };
 
 struct message_connect_complete_t {
     struct async_tcp_client_t *tcp_p;
+    unsigned int connect_id;
     int sockfd;
 };
 
-struct message_disconnect_t {
-    int sockfd;
-};
-
-struct message_write_error_t {
+struct message_connect_abort_t {
     struct async_tcp_client_t *tcp_p;
-    int sockfd;
+    unsigned int connect_id;
 };
 
-struct message_disconnected_t {
-    struct async_tcp_client_t *tcp_p;
+/* A request or an indication for given socket of given connection. */
+struct message_socket_t {
+    struct connection_t *connection_p;
+    int sockfd;
 };
 
-struct message_data_t {
-    struct async_tcp_client_t *tcp_p;
+struct message_listener_t {
+    struct async_tcp_server_t *server_p;
+    int listener;
 };
 
-struct message_data_complete_t {
-    struct async_tcp_client_t *tcp_p;
+/* Sockets accepted by given listener. */
+struct message_accepted_t {
+    struct async_tcp_server_t *server_p;
+    int listener;
+    int length;
+    int sockfds[IO_ACCEPT_MAX];
 };
 
 struct tcp_client_t {
+    struct connection_t connection;
     async_tcp_client_connected_t on_connected;
     async_tcp_client_disconnected_t on_disconnected;
-    async_tcp_client_input_t on_input;
-    int sockfd;
-    bool closed;
-    struct io_epoll_data_t *epoll_data_p;
+    bool connecting;
+    unsigned int connect_id;
+    struct async_timer_t connect_timer;
+    /* Addresses of the host, connected to in order until one
+       succeeds. */
+    struct async_resolver_result_t result;
+    int address_index;
+    /* Only used by the io thread. */
+    struct {
+        /* The socket of an ongoing connect. */
+        int sockfd;
+        unsigned int connect_id;
+    } io;
 };
 
 struct tcp_server_t {
+    struct sockaddr_in addr;
     int listener;
-    const char *host_p;
-    int port;
     async_tcp_server_client_connected_t on_connected;
     async_tcp_server_client_disconnected_t on_disconnected;
     async_tcp_server_client_input_t on_input;
-    struct io_epoll_data_t *epoll_data_p;
+    struct io_epoll_data_t epoll_data;
+    /* Only used by the io thread. */
+    struct {
+        int listener;
+    } io;
+};
+
+struct tcp_server_client_t {
+    struct connection_t connection;
 };
 
-static struct io_epoll_data_t *io_epoll_data_create(io_epoll_func_t func,
-                                                    void *arg_p)
+/* Server clients have no configurable output watermarks. */
+static const size_t server_client_low_watermark =
+    ASYNC_TCP_CLIENT_OUTPUT_LOW_WATERMARK;
+static const size_t server_client_high_watermark =
+    ASYNC_TCP_CLIENT_OUTPUT_HIGH_WATERMARK;
+
+static void io_epoll_data_init(struct io_epoll_data_t *self_p,
+                               io_epoll_func_t func,
+                               void *arg_p)
 {
-    struct io_epoll_data_t *data_p;
+    self_p->func = func;
+    self_p->arg_p = arg_p;
+}
 
-    data_p = malloc(sizeof(*data_p));
+static void on_put_signal_event(int fd)
+{
+    uint64_t value;
+    ssize_t size;
 
-    if (data_p == NULL) {
-        async_utils_linux_fatal_perror("malloc");
-    }
+    value = 1;
+    size = write(fd, &value, sizeof(value));
+    (void)size;
+}
 
-    data_p->func = func;
-    data_p->arg_p = arg_p;
+static void send_to_io_thread(struct async_runtime_linux_t *self_p,
+                              void *message_p)
+{
+    if (async_message_queue_put(&self_p->io.queue, message_p)) {
+        on_put_signal_event(self_p->io.fd);
+    }
+}
 
-    return (data_p);
+static void send_to_async_thread(struct async_runtime_linux_t *self_p,
+                                 void *message_p)
+{
+    if (async_message_queue_put(&self_p->async.queue, message_p)) {
+        on_put_signal_event(self_p->async.fd);
+    }
 }
 
 static struct tcp_client_t *tcp_client(struct async_tcp_client_t *self_p)
@@ -164,66 +283,319 @@ static struct tcp_client_t *tcp_client(struct async_tcp_client_t *self_p)
     return ((struct tcp_client_t *)(self_p->obj_p));
 }
 
+static struct connection_t *tcp_client_connection(
+    struct async_tcp_client_t *self_p)
+{
+    return (&tcp_client(self_p)->connection);
+}
+
 static struct async_runtime_linux_t *tcp_client_runtime(
     struct async_tcp_client_t *self_p)
 {
     return ((struct async_runtime_linux_t *)(self_p->async_p->runtime_p->obj_p));
 }
 
-static void async_tcp_client_set_sockfd(struct async_tcp_client_t *self_p,
-                                        int sockfd)
+static struct tcp_server_t *tcp_server(struct async_tcp_server_t *self_p)
 {
-    tcp_client(self_p)->sockfd = sockfd;
+    return ((struct tcp_server_t *)(self_p->obj_p));
 }
 
-static void io_handle_tcp_client(struct async_runtime_linux_t *self_p,
-                                 int epoll_fd,
-                                 struct async_tcp_client_t *tcp_p)
+static struct connection_t *tcp_server_client(
+    struct async_tcp_server_client_t *self_p)
+{
+    return ((struct connection_t *)(self_p->obj_p));
+}
+
+static struct async_runtime_linux_t *tcp_server_runtime(
+    struct async_tcp_server_t *self_p)
+{
+    return ((struct async_runtime_linux_t *)(self_p->async_p->runtime_p->obj_p));
+}
+
+static void server_client_list_remove(
+    struct async_tcp_server_client_t **list_pp,
+    struct async_tcp_server_client_t *client_p)
+{
+    if (client_p->prev_p != NULL) {
+        client_p->prev_p->next_p = client_p->next_p;
+    } else {
+        *list_pp = client_p->next_p;
+    }
+
+    if (client_p->next_p != NULL) {
+        client_p->next_p->prev_p = client_p->prev_p;
+    }
+
+    client_p->next_p = NULL;
+    client_p->prev_p = NULL;
+}
+
+static void server_client_list_push(struct async_tcp_server_client_t **list_pp,
+                                    struct async_tcp_server_client_t *client_p)
+{
+    client_p->prev_p = NULL;
+    client_p->next_p = *list_pp;
+
+    if (*list_pp != NULL) {
+        (*list_pp)->prev_p = client_p;
+    }
+
+    *list_pp = client_p;
+}
+
+static void connection_set_sockfd(struct connection_t *self_p, int sockfd)
+{
+    self_p->sockfd = sockfd;
+    self_p->closed = false;
+    async_output_clear(&self_p->output);
+    async_input_clear(&self_p->input);
+}
+
+/**
+ * Re-arm the connected socket with its remaining one-shot events, if
+ * any.
+ */
+static void io_connection_rearm(int epoll_fd, struct connection_t *self_p)
 {
     struct epoll_event event;
+
+    if (self_p->io.events == 0) {
+        return;
+    }
+
+    event.events = (self_p->io.events | EPOLLONESHOT);
+    event.data.ptr = &self_p->epoll_data;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, self_p->io.sockfd, &event);
+}
+
+static void io_connection_closed(struct connection_t *self_p, int sockfd)
+{
+    if (self_p->io.sockfd == sockfd) {
+        self_p->io.sockfd = -1;
+        self_p->io.events = 0;
+    }
+}
+
+static void io_connection_close(int epoll_fd,
+                                struct connection_t *self_p,
+                                int sockfd)
+{
+    io_connection_closed(self_p, sockfd);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, sockfd, NULL);
+    close(sockfd);
+}
+
+static void io_connection_disconnected_write(struct async_runtime_linux_t *self_p,
+                                             struct connection_t *connection_p,
+                                             int sockfd)
+{
+    struct message_socket_t *message_p;
+
+    message_p = async_message_alloc(&self_p->io.slabs.socket,
+                                    MESSAGE_CONNECTION_DISCONNECTED);
+    message_p->connection_p = connection_p;
+    message_p->sockfd = sockfd;
+    send_to_async_thread(self_p, message_p);
+}
+
+/**
+ * Connected sockets are one-shot. Input is re-armed once the async
+ * thread has called on_input(), and output when the async thread
+ * waits for the socket to become writable.
+ */
+static void io_handle_connection(struct async_runtime_linux_t *self_p,
+                                 int epoll_fd,
+                                 struct connection_t *connection_p,
+                                 uint32_t events)
+{
     struct message_data_t *message_p;
+    struct message_socket_t *writable_p;
+
+    if ((connection_p->io.events & EPOLLIN) && (events & ~EPOLLOUT)) {
+        message_p = self_p->io.data_p;
+
+        if (message_p == NULL) {
+            message_p = async_message_alloc(&self_p->io.slabs.data,
+                                            MESSAGE_CONNECTION_DATA);
+            message_p->length = 0;
+            self_p->io.data_p = message_p;
+        }
+
+        message_p->connections_pp[message_p->length] = connection_p;
+        message_p->length++;
+        connection_p->io.events &= ~EPOLLIN;
+    }
+
+    if ((connection_p->io.events & EPOLLOUT)
+        && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        writable_p = async_message_alloc(&self_p->io.slabs.socket,
+                                         MESSAGE_CONNECTION_WRITABLE);
+        writable_p->connection_p = connection_p;
+        writable_p->sockfd = connection_p->io.sockfd;
+        send_to_async_thread(self_p, writable_p);
+        connection_p->io.events &= ~EPOLLOUT;
+    }
+
+    io_connection_rearm(epoll_fd, connection_p);
+}
+
+/**
+ * Start receiving on a connected socket. Returns zero or -1 on failure.
+ */
+static int io_connection_start(int epoll_fd,
+                               struct connection_t *self_p,
+                               int sockfd,
+                               int op)
+{
+    struct epoll_event event;
+
+    self_p->epoll_data.func = (io_epoll_func_t)io_handle_connection;
+    self_p->io.sockfd = sockfd;
+    self_p->io.events = EPOLLIN;
+    event.events = (EPOLLIN | EPOLLONESHOT);
+    event.data.ptr = &self_p->epoll_data;
+
+    return (epoll_ctl(epoll_fd, op, sockfd, &event));
+}
+
+static void io_tcp_client_connect_complete_write(
+    struct async_runtime_linux_t *self_p,
+    struct async_tcp_client_t *tcp_p,
+    unsigned int connect_id,
+    int sockfd)
+{
+    struct message_connect_complete_t *rsp_p;
+
+    rsp_p = async_message_alloc(&self_p->io.slabs.connect_complete,
+                                MESSAGE_TCP_CLIENT_CONNECT_COMPLETE);
+    rsp_p->tcp_p = tcp_p;
+    rsp_p->connect_id = connect_id;
+    rsp_p->sockfd = sockfd;
+    send_to_async_thread(self_p, rsp_p);
+}
+
+/**
+ * Close the socket of an ongoing connect, if any.
+ */
+static void io_tcp_client_connect_close(int epoll_fd,
+                                        struct tcp_client_t *rself_p)
+{
+    if (rself_p->io.sockfd == -1) {
+        return;
+    }
 
-    event.events = 0;
-    event.data.ptr = tcp_client(tcp_p)->epoll_data_p;
-    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, tcp_client(tcp_p)->sockfd, &event);
-    message_p = ml_message_alloc(&uid_tcp_client_data, sizeof(*message_p));
-    message_p->tcp_p = tcp_p;
-    ml_queue_put(&self_p->async.queue, message_p);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, rself_p->io.sockfd, NULL);
+    close(rself_p->io.sockfd);
+    rself_p->io.sockfd = -1;
 }
 
+/**
+ * The socket of an ongoing connect is writable once connected, or
+ * once the connect failed. Shares epoll data with the connection.
+ */
+static void io_handle_tcp_client_connecting(
+    struct async_runtime_linux_t *self_p,
+    int epoll_fd,
+    struct connection_t *connection_p,
+    uint32_t events)
+{
+    (void)events;
+
+    struct async_tcp_client_t *tcp_p;
+    struct tcp_client_t *rself_p;
+    int sockfd;
+    int error;
+    socklen_t size;
+    struct sockaddr addr;
+    socklen_t addr_size;
+
+    tcp_p = connection_p->owner_p;
+    rself_p = tcp_client(tcp_p);
+    sockfd = rself_p->io.sockfd;
+
+    /* Aborted by an earlier event in the same batch. */
+    if (sockfd == -1) {
+        return;
+    }
+
+    size = sizeof(error);
+
+    if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &error, &size) == -1) {
+        error = errno;
+    }
+
+    if (error == 0) {
+        /* The event may be for a closed socket of an earlier connect
+           in the same batch. */
+        addr_size = sizeof(addr);
+
+        if ((getpeername(sockfd, &addr, &addr_size) == -1)
+            && (errno == ENOTCONN)) {
+            return;
+        }
+
+        if (io_connection_start(epoll_fd,
+                                &rself_p->connection,
+                                sockfd,
+                                EPOLL_CTL_MOD) == -1) {
+            error = errno;
+        }
+    }
+
+    if (error == 0) {
+        rself_p->io.sockfd = -1;
+    } else {
+        io_tcp_client_connect_close(epoll_fd, rself_p);
+        sockfd = -1;
+    }
+
+    io_tcp_client_connect_complete_write(self_p,
+                                         tcp_p,
+                                         rself_p->io.connect_id,
+                                         sockfd);
+}
+
+/**
+ * Connect without blocking the io thread. Completion is signalled by
+ * the socket becoming writable.
+ */
 static void io_handle_tcp_client_connect(struct async_runtime_linux_t *self_p,
                                          int epoll_fd,
                                          struct message_connect_t *req_p)
 {
-    struct sockaddr_in addr;
+    struct tcp_client_t *rself_p;
+    struct async_resolver_address_t *address_p;
     int sockfd;
-    struct message_connect_complete_t *rsp_p;
     int res;
     struct epoll_event event;
 
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(req_p->port);
-    inet_aton(req_p->host_p, (struct in_addr *)&addr.sin_addr.s_addr);
-    free(req_p->host_p);
-
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    rself_p = tcp_client(req_p->tcp_p);
+    io_tcp_client_connect_close(epoll_fd, rself_p);
+    address_p = &req_p->address;
+    sockfd = socket(address_p->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
 
     if (sockfd != -1) {
-        res = connect(sockfd, (struct sockaddr *)&addr, sizeof(addr));
-
-        if (res != -1) {
-            res = fcntl(sockfd,
-                        F_SETFL,
-                        fcntl(sockfd, F_GETFL, 0) | O_NONBLOCK);
-
-            if (res != -1) {
-                tcp_client(req_p->tcp_p)->epoll_data_p = io_epoll_data_create(
-                    (io_epoll_func_t)io_handle_tcp_client,
-                    req_p->tcp_p);
-                event.events = EPOLLIN;
-                event.data.ptr = tcp_client(req_p->tcp_p)->epoll_data_p;
-                res = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sockfd, &event);
+        res = connect(sockfd,
+                      (struct sockaddr *)&address_p->addr,
+                      address_p->size);
+
+        if (res == 0) {
+            res = io_connection_start(epoll_fd,
+                                      &rself_p->connection,
+                                      sockfd,
+                                      EPOLL_CTL_ADD);
+        } else if (errno == EINPROGRESS) {
+            rself_p->connection.epoll_data.func =
+                (io_epoll_func_t)io_handle_tcp_client_connecting;
+            event.events = (EPOLLOUT | EPOLLONESHOT);
+            event.data.ptr = &rself_p->connection.epoll_data;
+            res = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sockfd, &event);
+
+            if (res == 0) {
+                rself_p->io.sockfd = sockfd;
+                rself_p->io.connect_id = req_p->connect_id;
+
+                return;
             }
         }
 
@@ -233,246 +605,644 @@ static void io_handle_tcp_client_connect(struct async_runtime_linux_t *self_p,
         }
     }
 
-    rsp_p = ml_message_alloc(&uid_tcp_client_connect_complete, sizeof(*rsp_p));
-    rsp_p->tcp_p = req_p->tcp_p;
-    rsp_p->sockfd = sockfd;
-    ml_queue_put(&self_p->async.queue, rsp_p);
+    io_tcp_client_connect_complete_write(self_p,
+                                         req_p->tcp_p,
+                                         req_p->connect_id,
+                                         sockfd);
 }
 
-static void io_handle_tcp_client_disconnect(int epoll_fd,
-                                            struct message_disconnect_t *ind_p)
+static void io_handle_tcp_client_connect_abort(
+    int epoll_fd,
+    struct message_connect_abort_t *ind_p)
 {
-    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, ind_p->sockfd, NULL);
-    close(ind_p->sockfd);
+    struct tcp_client_t *rself_p;
+
+    rself_p = tcp_client(ind_p->tcp_p);
+
+    if (rself_p->io.connect_id == ind_p->connect_id) {
+        io_tcp_client_connect_close(epoll_fd, rself_p);
+    }
 }
 
-static void io_handle_tcp_client_write_error(struct async_runtime_linux_t *self_p,
-                                             int epoll_fd,
-                                             struct message_write_error_t *ind_p)
+/**
+ * Accept until the backlog is drained. Accepted sockets are handed
+ * to the async thread in batches, which assigns them to free
+ * clients.
+ */
+static void io_handle_tcp_server_listener(struct async_runtime_linux_t *self_p,
+                                          int epoll_fd,
+                                          struct async_tcp_server_t *server_p,
+                                          uint32_t events)
 {
-    struct message_disconnected_t *message_p;
+    (void)epoll_fd;
+    (void)events;
+
+    struct tcp_server_t *rself_p;
+    struct message_accepted_t *message_p;
+    int sockfd;
 
-    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, ind_p->sockfd, NULL);
-    close(ind_p->sockfd);
-    message_p = ml_message_alloc(&uid_tcp_client_disconnected,
-                                 sizeof(*message_p));
-    message_p->tcp_p = ind_p->tcp_p;
-    ml_queue_put(&self_p->async.queue, message_p);
+    rself_p = tcp_server(server_p);
+    message_p = NULL;
+
+    while (rself_p->io.listener != -1) {
+        sockfd = accept4(rself_p->io.listener,
+                         NULL,
+                         NULL,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (sockfd == -1) {
+            if ((errno == ECONNABORTED) || (errno == EINTR)) {
+                continue;
+            }
+
+            break;
+        }
+
+        if (message_p == NULL) {
+            message_p = async_message_alloc(&self_p->io.slabs.accepted,
+                                            MESSAGE_TCP_SERVER_ACCEPTED);
+            message_p->server_p = server_p;
+            message_p->listener = rself_p->io.listener;
+            message_p->length = 0;
+        }
+
+        message_p->sockfds[message_p->length] = sockfd;
+        message_p->length++;
+
+        if (message_p->length == IO_ACCEPT_MAX) {
+            send_to_async_thread(self_p, message_p);
+            message_p = NULL;
+        }
+    }
+
+    if (message_p != NULL) {
+        send_to_async_thread(self_p, message_p);
+    }
 }
 
-static void io_handle_tcp_client_data_complete(struct async_runtime_linux_t *self_p,
-                                               int epoll_fd,
-                                               struct message_data_complete_t *ind_p)
+static void io_handle_tcp_server_start(int epoll_fd,
+                                       struct message_listener_t *req_p)
 {
-    int sockfd;
+    struct tcp_server_t *rself_p;
     struct epoll_event event;
-    struct message_disconnected_t *message_p;
 
-    sockfd = tcp_client(ind_p->tcp_p)->sockfd;
+    rself_p = tcp_server(req_p->server_p);
+    event.events = EPOLLIN;
+    event.data.ptr = &rself_p->epoll_data;
 
-    if (tcp_client(ind_p->tcp_p)->closed) {
-        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, sockfd, NULL);
-        close(sockfd);
-        message_p = ml_message_alloc(&uid_tcp_client_disconnected,
-                                     sizeof(*message_p));
-        message_p->tcp_p = ind_p->tcp_p;
-        ml_queue_put(&self_p->async.queue, message_p);
-    } else {
-        event.events = EPOLLIN;
-        event.data.ptr = tcp_client(ind_p->tcp_p)->epoll_data_p;
-        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, sockfd, &event);
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, req_p->listener, &event) == 0) {
+        rself_p->io.listener = req_p->listener;
     }
 }
 
-static struct tcp_server_t *tcp_server(struct async_tcp_server_t *self_p)
+static void io_handle_tcp_server_stop(int epoll_fd,
+                                      struct message_listener_t *req_p)
 {
-    return ((struct tcp_server_t *)(self_p->obj_p));
+    struct tcp_server_t *rself_p;
+
+    rself_p = tcp_server(req_p->server_p);
+
+    if (rself_p->io.listener == req_p->listener) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, req_p->listener, NULL);
+        rself_p->io.listener = -1;
+    }
+
+    close(req_p->listener);
 }
 
-static void io_handle_tcp_server_listener(struct async_runtime_linux_t *self_p,
-                                          int epoll_fd,
-                                          struct async_tcp_server_t *tcp_p)
+static void io_handle_connection_start(int epoll_fd,
+                                       struct message_socket_t *req_p)
 {
-    (void)self_p;
-    (void)epoll_fd;
+    if (io_connection_start(epoll_fd,
+                            req_p->connection_p,
+                            req_p->sockfd,
+                            EPOLL_CTL_ADD) == -1) {
+        async_utils_linux_fatal_perror("epoll_ctl");
+    }
+}
+
+static void io_handle_connection_disconnect(int epoll_fd,
+                                            struct message_socket_t *ind_p)
+{
+    io_connection_close(epoll_fd, ind_p->connection_p, ind_p->sockfd);
+}
+
+static void io_handle_connection_write_error(struct async_runtime_linux_t *self_p,
+                                             int epoll_fd,
+                                             struct message_socket_t *ind_p)
+{
+    io_connection_close(epoll_fd, ind_p->connection_p, ind_p->sockfd);
+    io_connection_disconnected_write(self_p,
+                                     ind_p->connection_p,
+                                     ind_p->sockfd);
+}
+
+static void io_handle_connection_data_complete(struct async_runtime_linux_t *self_p,
+                                               int epoll_fd,
+                                               struct message_data_t *ind_p)
+{
+    struct connection_t *connection_p;
+    int sockfd;
+    int i;
+
+    for (i = 0; i < ind_p->length; i++) {
+        connection_p = ind_p->connections_pp[i];
+        sockfd = connection_p->io.sockfd;
+
+        /* Already closed on a write error or a disconnect. */
+        if (sockfd == -1) {
+            continue;
+        }
+
+        if (connection_p->closed) {
+            io_connection_close(epoll_fd, connection_p, sockfd);
+            io_connection_disconnected_write(self_p, connection_p, sockfd);
+        } else {
+            connection_p->io.events |= EPOLLIN;
+            io_connection_rearm(epoll_fd, connection_p);
+        }
+    }
+}
 
-    int client_fd;
+static void io_handle_connection_write_wait(int epoll_fd,
+                                            struct message_socket_t *req_p)
+{
+    struct connection_t *connection_p;
 
-    client_fd = accept(tcp_server(tcp_p)->listener, NULL, 0);
+    connection_p = req_p->connection_p;
 
-    (void)client_fd;
+    if (connection_p->io.sockfd != req_p->sockfd) {
+        return;
+    }
 
-    exit(5);
+    connection_p->io.events |= EPOLLOUT;
+    io_connection_rearm(epoll_fd, connection_p);
 }
 
+/**
+ * Handle all messages put in the io queue since the last wakeup.
+ */
 static void io_handle_async(struct async_runtime_linux_t *self_p,
                             int epoll_fd,
-                            void *arg_p)
+                            void *arg_p,
+                            uint32_t events)
 {
     (void)arg_p;
+    (void)events;
 
-    struct ml_uid_t *uid_p;
     void *message_p;
-    uint64_t event;
+    uint64_t count;
     ssize_t res;
+    int type;
 
-    res = read(self_p->io.fd, &event, sizeof(event));
+    res = read(self_p->io.fd, &count, sizeof(count));
 
-    if (res != (ssize_t)sizeof(event)) {
+    if (res != (ssize_t)sizeof(count)) {
         async_utils_linux_fatal_perror("event read");
     }
 
-    uid_p = ml_queue_get(&self_p->io.queue, &message_p);
+    while (true) {
+        message_p = async_message_queue_get(&self_p->io.queue, &type);
+
+        if (message_p == NULL) {
+            break;
+        }
 
-    if (uid_p == &uid_tcp_client_connect) {
-        io_handle_tcp_client_connect(self_p, epoll_fd, message_p);
-    } else if (uid_p == &uid_tcp_client_disconnect) {
-        io_handle_tcp_client_disconnect(epoll_fd, message_p);
-    } else if (uid_p == &uid_tcp_client_write_error) {
-        io_handle_tcp_client_write_error(self_p, epoll_fd, message_p);
-    } else if (uid_p == &uid_tcp_client_data_complete) {
-        io_handle_tcp_client_data_complete(self_p, epoll_fd, message_p);
+        if (type == MESSAGE_TCP_CLIENT_CONNECT) {
+            io_handle_tcp_client_connect(self_p, epoll_fd, message_p);
+        } else if (type == MESSAGE_TCP_CLIENT_CONNECT_ABORT) {
+            io_handle_tcp_client_connect_abort(epoll_fd, message_p);
+        } else if (type == MESSAGE_TCP_SERVER_START) {
+            io_handle_tcp_server_start(epoll_fd, message_p);
+        } else if (type == MESSAGE_TCP_SERVER_STOP) {
+            io_handle_tcp_server_stop(epoll_fd, message_p);
+        } else if (type == MESSAGE_CONNECTION_START) {
+            io_handle_connection_start(epoll_fd, message_p);
+        } else if (type == MESSAGE_CONNECTION_DISCONNECT) {
+            io_handle_connection_disconnect(epoll_fd, message_p);
+        } else if (type == MESSAGE_CONNECTION_WRITE_ERROR) {
+            io_handle_connection_write_error(self_p, epoll_fd, message_p);
+        } else if (type == MESSAGE_CONNECTION_DATA_COMPLETE) {
+            io_handle_connection_data_complete(self_p, epoll_fd, message_p);
+        } else if (type == MESSAGE_CONNECTION_WRITE_WAIT) {
+            io_handle_connection_write_wait(epoll_fd, message_p);
+        }
+
+        async_message_free(message_p);
     }
+}
 
-    ml_message_free(message_p);
+static void io_handle_timeout(struct async_runtime_linux_t *self_p,
+                              int epoll_fd,
+                              void *arg_p,
+                              uint32_t events)
+{
+    (void)epoll_fd;
+    (void)arg_p;
+    (void)events;
+
+    if (async_runtime_timer_read(&self_p->timer)) {
+        on_put_signal_event(self_p->async.fd);
+    }
 }
 
 static void *io_main(struct async_runtime_linux_t *self_p)
 {
-    ssize_t res;
-    int nfds;
-    struct epoll_event event;
-    struct io_epoll_data_t *data_p;
+    ssize_t res;
+    int nfds;
+    int i;
+    struct epoll_event event;
+    struct epoll_event events[IO_EPOLL_EVENTS_MAX];
+    struct io_epoll_data_t *data_p;
+
+    pthread_setname_np(pthread_self(), "async_io");
+
+    event.events = EPOLLIN;
+    io_epoll_data_init(&self_p->io.async_epoll_data,
+                       (io_epoll_func_t)io_handle_async,
+                       NULL);
+    event.data.ptr = &self_p->io.async_epoll_data;
+    res = epoll_ctl(self_p->io.epoll_fd, EPOLL_CTL_ADD, self_p->io.fd, &event);
+
+    if (res == -1) {
+        return (NULL);
+    }
+
+    event.events = EPOLLIN;
+    io_epoll_data_init(&self_p->io.timer_epoll_data,
+                       (io_epoll_func_t)io_handle_timeout,
+                       NULL);
+    event.data.ptr = &self_p->io.timer_epoll_data;
+    res = epoll_ctl(self_p->io.epoll_fd,
+                    EPOLL_CTL_ADD,
+                    self_p->timer.fd,
+                    &event);
+
+    if (res == -1) {
+        return (NULL);
+    }
+
+    while (true) {
+        nfds = epoll_wait(self_p->io.epoll_fd,
+                          &events[0],
+                          IO_EPOLL_EVENTS_MAX,
+                          -1);
+
+        for (i = 0; i < nfds; i++) {
+            data_p = (struct io_epoll_data_t *)events[i].data.ptr;
+            data_p->func(self_p,
+                         self_p->io.epoll_fd,
+                         data_p->arg_p,
+                         events[i].events);
+        }
+
+        /* Forward all connections with input in one message. */
+        if (self_p->io.data_p != NULL) {
+            send_to_async_thread(self_p, self_p->io.data_p);
+            self_p->io.data_p = NULL;
+        }
+    }
+
+    return (NULL);
+}
+
+static void async_connection_socket_write(int type,
+                                          struct connection_t *self_p)
+{
+    struct message_socket_t *message_p;
+
+    message_p = async_message_alloc(&self_p->runtime_p->async.slabs.socket,
+                                    type);
+    message_p->connection_p = self_p;
+    message_p->sockfd = self_p->sockfd;
+    send_to_io_thread(self_p->runtime_p, message_p);
+}
+
+static void async_connection_start(struct connection_t *self_p, int sockfd)
+{
+    connection_set_sockfd(self_p, sockfd);
+    async_connection_socket_write(MESSAGE_CONNECTION_START, self_p);
+}
+
+static void async_connection_disconnect(struct connection_t *self_p)
+{
+    if (self_p->sockfd == -1) {
+        return;
+    }
+
+    async_connection_socket_write(MESSAGE_CONNECTION_DISCONNECT, self_p);
+    connection_set_sockfd(self_p, -1);
+}
+
+static void async_connection_write_error(struct connection_t *self_p)
+{
+    self_p->closed = true;
+    async_connection_socket_write(MESSAGE_CONNECTION_WRITE_ERROR, self_p);
+}
+
+static void async_connection_write_wait(struct connection_t *self_p)
+{
+    async_connection_socket_write(MESSAGE_CONNECTION_WRITE_WAIT, self_p);
+}
+
+static void async_tcp_client_disconnect_write(struct async_tcp_client_t *self_p,
+                                              int sockfd)
+{
+    struct message_socket_t *data_p;
+
+    data_p = async_message_alloc(&tcp_client_runtime(self_p)->async.slabs.socket,
+                                 MESSAGE_CONNECTION_DISCONNECT);
+    data_p->connection_p = tcp_client_connection(self_p);
+    data_p->sockfd = sockfd;
+    send_to_io_thread(tcp_client_runtime(self_p), data_p);
+}
+
+static void async_tcp_client_connect_write(
+    struct async_tcp_client_t *self_p,
+    const struct async_resolver_address_t *address_p)
+{
+    struct message_connect_t *data_p;
+
+    data_p = async_message_alloc(&tcp_client_runtime(self_p)->async.slabs.connect,
+                                 MESSAGE_TCP_CLIENT_CONNECT);
+    data_p->tcp_p = self_p;
+    data_p->connect_id = tcp_client(self_p)->connect_id;
+    data_p->address = *address_p;
+    send_to_io_thread(tcp_client_runtime(self_p), data_p);
+}
+
+/**
+ * Connect to the next address of the host, if any, with a new connect
+ * id, so that a late completion of the previous connect is ignored.
+ */
+static bool async_tcp_client_connect_next(struct async_tcp_client_t *self_p)
+{
+    struct tcp_client_t *rself_p;
+
+    rself_p = tcp_client(self_p);
+
+    if (rself_p->address_index + 1 >= rself_p->result.length) {
+        return (false);
+    }
+
+    rself_p->address_index++;
+    rself_p->connect_id++;
+
+    if (self_p->connect_timeout > 0) {
+        async_timer_start(&rself_p->connect_timer);
+    }
+
+    async_tcp_client_connect_write(
+        self_p,
+        &rself_p->result.addresses[rself_p->address_index]);
+
+    return (true);
+}
+
+static void async_handle_tcp_client_connected(
+    struct message_connect_complete_t *message_p)
+{
+    struct tcp_client_t *rself_p;
+    int res;
+
+    rself_p = tcp_client(message_p->tcp_p);
+
+    /* Timed out or disconnected while connecting. */
+    if (!rself_p->connecting
+        || (message_p->connect_id != rself_p->connect_id)) {
+        if (message_p->sockfd != -1) {
+            async_tcp_client_disconnect_write(message_p->tcp_p,
+                                              message_p->sockfd);
+        }
+
+        return;
+    }
+
+    if ((message_p->sockfd == -1)
+        && async_tcp_client_connect_next(message_p->tcp_p)) {
+        return;
+    }
+
+    rself_p->connecting = false;
+    async_timer_stop(&rself_p->connect_timer);
+    connection_set_sockfd(&rself_p->connection, message_p->sockfd);
+    res = (message_p->sockfd == -1 ? -1 : 0);
+    rself_p->on_connected(message_p->tcp_p, res);
+}
+
+/**
+ * Assign accepted sockets to free clients. Sockets are closed if
+ * there is no free client, or if the server has been stopped.
+ */
+static void async_handle_tcp_server_accepted(struct message_accepted_t *ind_p)
+{
+    struct async_tcp_server_t *server_p;
+    struct tcp_server_t *rself_p;
+    struct async_tcp_server_client_t *client_p;
+    int i;
+
+    server_p = ind_p->server_p;
+    rself_p = tcp_server(server_p);
+
+    for (i = 0; i < ind_p->length; i++) {
+        client_p = server_p->clients.free_p;
+
+        if ((ind_p->listener != rself_p->listener) || (client_p == NULL)) {
+            close(ind_p->sockfds[i]);
+
+            continue;
+        }
+
+        server_client_list_remove(&server_p->clients.free_p, client_p);
+        server_client_list_push(&server_p->clients.used_p, client_p);
+        async_connection_start(tcp_server_client(client_p),
+                               ind_p->sockfds[i]);
+        rself_p->on_connected(client_p);
+    }
+}
+
+static void async_connection_data_complete_write(
+    struct async_runtime_linux_t *self_p,
+    struct message_data_t *req_p)
+{
+    struct message_data_t *ind_p;
+
+    ind_p = async_message_alloc(&self_p->async.slabs.data,
+                                MESSAGE_CONNECTION_DATA_COMPLETE);
+    memcpy(ind_p->connections_pp,
+           req_p->connections_pp,
+           sizeof(req_p->connections_pp[0]) * req_p->length);
+    ind_p->length = req_p->length;
+    send_to_io_thread(self_p, ind_p);
+}
+
+static void async_handle_connection_data(struct async_runtime_linux_t *self_p,
+                                         struct message_data_t *req_p)
+{
+    struct connection_t *connection_p;
+    size_t consumed;
+    int i;
+
+    for (i = 0; i < req_p->length; i++) {
+        connection_p = req_p->connections_pp[i];
+
+        /* Disconnected since the input event. */
+        if (connection_p->sockfd == -1) {
+            continue;
+        }
+
+        async_input_set_readable(&connection_p->input);
+
+        /* Call again while received data is consumed, as the socket
+           may be drained. */
+        do {
+            consumed = connection_p->input.consumed;
+            connection_p->on_input(connection_p->owner_p);
+        } while (async_input_is_progressing(&connection_p->input, consumed));
+    }
+
+    async_connection_data_complete_write(self_p, req_p);
+}
+
+/**
+ * Write queued data once the socket is writable, and wait again if
+ * not all of it could be written.
+ */
+static void async_handle_connection_writable(struct message_socket_t *ind_p)
+{
+    struct connection_t *connection_p;
 
-    pthread_setname_np(pthread_self(), "async_io");
+    connection_p = ind_p->connection_p;
 
-    event.events = EPOLLIN;
-    event.data.ptr = io_epoll_data_create((io_epoll_func_t)io_handle_async, NULL);
-    res = epoll_ctl(self_p->io.epoll_fd, EPOLL_CTL_ADD, self_p->io.fd, &event);
+    if ((ind_p->sockfd != connection_p->sockfd)
+        || connection_p->closed
+        || async_output_is_empty(&connection_p->output)) {
+        return;
+    }
 
-    if (res == -1) {
-        return (NULL);
+    if (async_output_flush(&connection_p->output, connection_p->sockfd) != 0) {
+        async_connection_write_error(connection_p);
+
+        return;
     }
 
-    while (true) {
-        nfds = epoll_wait(self_p->io.epoll_fd, &event, 1, -1);
+    if (!async_output_is_empty(&connection_p->output)) {
+        async_connection_write_wait(connection_p);
+    }
 
-        if (nfds == 1) {
-            data_p = (struct io_epoll_data_t *)event.data.ptr;
-            data_p->func(self_p, self_p->io.epoll_fd, data_p->arg_p);
+    if (async_output_update(&connection_p->output,
+                            *connection_p->low_watermark_p,
+                            *connection_p->high_watermark_p)) {
+        if (connection_p->on_writable != NULL) {
+            connection_p->on_writable(connection_p);
         }
     }
-
-    return (NULL);
 }
 
-static void async_handle_tcp_client_connected(
-    struct message_connect_complete_t *message_p)
+static void async_handle_connection_disconnected(struct message_socket_t *ind_p)
 {
-    int res;
-
-    async_tcp_client_set_sockfd(message_p->tcp_p, message_p->sockfd);
-    res = (message_p->sockfd == -1 ? -1 : 0);
-    tcp_client(message_p->tcp_p)->on_connected(message_p->tcp_p, res);
-}
+    struct connection_t *connection_p;
 
-static void async_tcp_client_data_complete_write(struct async_tcp_client_t *self_p)
-{
-    struct message_data_complete_t *ind_p;
+    connection_p = ind_p->connection_p;
 
-    ind_p = ml_message_alloc(&uid_tcp_client_data_complete, sizeof(*ind_p));
-    ind_p->tcp_p = self_p;
-    ml_queue_put(&tcp_client_runtime(self_p)->io.queue, ind_p);
-}
+    /* Disconnected, and possibly connected again, by the user. */
+    if (ind_p->sockfd != connection_p->sockfd) {
+        return;
+    }
 
-static void async_handle_tcp_client_data(struct message_data_t *req_p)
-{
-    tcp_client(req_p->tcp_p)->on_input(req_p->tcp_p);
-    async_tcp_client_data_complete_write(req_p->tcp_p);
+    connection_set_sockfd(connection_p, -1);
+    connection_p->on_closed(connection_p);
 }
 
-static void async_handle_timeout(struct async_runtime_linux_t *self_p)
+/**
+ * Call all functions in the threadsafe calls ring. One wakeup message
+ * is sent per batch of calls.
+ */
+static void async_handle_call_threadsafe(struct async_runtime_linux_t *self_p)
 {
-    async_tick(self_p->async_p);
+    async_calls_process(&self_p->async.calls);
 }
 
-static void async_handle_tcp_client_disconnected(
-    struct message_disconnected_t *ind_p)
+/**
+ * Wait until woken up by a message, a threadsafe call or an expired
+ * timer.
+ */
+static void async_wait(struct async_runtime_linux_t *self_p)
 {
-    async_tcp_client_set_sockfd(ind_p->tcp_p, -1);
-    tcp_client(ind_p->tcp_p)->on_disconnected(ind_p->tcp_p);
-}
+    uint64_t count;
+    ssize_t res;
 
-static void async_handle_worker_job(struct worker_job_t *job_p)
-{
-    job_p->on_complete(job_p->obj_p, job_p->arg_p);
-}
+    res = read(self_p->async.fd, &count, sizeof(count));
 
-static void async_handle_call_threadsafe(struct call_threadsafe_t *message_p)
-{
-    message_p->func(message_p->obj_p, message_p->arg_p);
+    if (res != (ssize_t)sizeof(count)) {
+        async_utils_linux_fatal_perror("event read");
+    }
 }
 
 static void *async_main(struct async_runtime_linux_t *self_p)
 {
-    struct ml_uid_t *uid_p;
     void *message_p;
+    int type;
 
     pthread_setname_np(pthread_self(), "async_async");
 
-    ml_timer_handler_timer_start(&self_p->async.timer,
-                                 0,
-                                 self_p->async_p->tick_in_ms);
+    async_process(self_p->async_p);
+    async_runtime_timer_start(&self_p->timer, self_p->async_p);
 
     while (true) {
-        uid_p = ml_queue_get(&self_p->async.queue, &message_p);
-
-        if (uid_p == &uid_timeout) {
-            async_handle_timeout(self_p);
-        } else if (uid_p == &uid_tcp_client_connect_complete) {
-            async_handle_tcp_client_connected(message_p);
-        } else if (uid_p == &uid_tcp_client_data) {
-            async_handle_tcp_client_data(message_p);
-        } else if (uid_p == &uid_tcp_client_disconnected) {
-            async_handle_tcp_client_disconnected(message_p);
-        } else if (uid_p == &uid_worker_job) {
-            async_handle_worker_job(message_p);
-        } else if (uid_p == &uid_call_threadsafe) {
-            async_handle_call_threadsafe(message_p);
+        if (!async_has_pending_calls(self_p->async_p)) {
+            async_wait(self_p);
         }
 
-        ml_message_free(message_p);
+        async_runtime_timer_advance(&self_p->timer, self_p->async_p);
+        async_handle_call_threadsafe(self_p);
         async_process(self_p->async_p);
+
+        while (true) {
+            message_p = async_message_queue_get(&self_p->async.queue, &type);
+
+            if (message_p == NULL) {
+                break;
+            }
+
+            if (type == MESSAGE_TCP_CLIENT_CONNECT_COMPLETE) {
+                async_handle_tcp_client_connected(message_p);
+            } else if (type == MESSAGE_TCP_SERVER_ACCEPTED) {
+                async_handle_tcp_server_accepted(message_p);
+            } else if (type == MESSAGE_CONNECTION_DATA) {
+                async_handle_connection_data(self_p, message_p);
+            } else if (type == MESSAGE_CONNECTION_WRITABLE) {
+                async_handle_connection_writable(message_p);
+            } else if (type == MESSAGE_CONNECTION_DISCONNECTED) {
+                async_handle_connection_disconnected(message_p);
+            }
+
+            async_message_free(message_p);
+            async_process(self_p->async_p);
+        }
+
+        async_runtime_timer_update(&self_p->timer, self_p->async_p);
     }
 
     return (NULL);
 }
-
 static void set_async(struct async_runtime_linux_t *self_p,
                       struct async_t *async_p)
 {
     self_p->async_p = async_p;
 }
 
+static void call_wakeup(struct async_runtime_linux_t *self_p)
+{
+    on_put_signal_event(self_p->async.fd);
+}
+
 static void call_threadsafe(struct async_runtime_linux_t *self_p,
                             async_func_t func,
                             void *obj_p,
                             void *arg_p)
 {
-    struct call_threadsafe_t *message_p;
-
-    message_p = ml_message_alloc(&uid_call_threadsafe, sizeof(*message_p));
-    message_p->func = func;
-    message_p->obj_p = obj_p;
-    message_p->arg_p = arg_p;
-    ml_queue_put(&self_p->async.queue, message_p);
-
-}
-
-static void job(struct worker_job_t *job_p)
-{
-    job_p->entry(job_p->obj_p, job_p->arg_p);
-    ml_queue_put(job_p->async_queue_p, job_p);
+    async_calls_call_threadsafe(&self_p->async.calls, func, obj_p, arg_p);
 }
 
 static int call_worker_pool(struct async_runtime_linux_t *self_p,
@@ -481,19 +1251,12 @@ static int call_worker_pool(struct async_runtime_linux_t *self_p,
                             void *arg_p,
                             async_func_t on_complete)
 {
-    struct worker_job_t *job_p;
-
-    job_p = ml_message_alloc(&uid_worker_job, sizeof(*job_p));
-    job_p->entry = entry;
-    job_p->obj_p = obj_p;
-    job_p->arg_p = arg_p;
-    job_p->on_complete = on_complete;
-    job_p->async_queue_p = &self_p->async.queue;
-    ml_worker_pool_spawn(&self_p->worker_pool,
-                         (ml_worker_pool_job_entry_t)job,
-                         job_p);
-
-    return (0);
+    return (async_calls_call_worker_pool(&self_p->async.calls,
+                                         self_p->async_p,
+                                         entry,
+                                         obj_p,
+                                         arg_p,
+                                         on_complete));
 }
 
 static void run_forever(struct async_runtime_linux_t *self_p)
@@ -510,36 +1273,136 @@ static void run_forever(struct async_runtime_linux_t *self_p)
     pthread_join(self_p->async.pthread, NULL);
 }
 
-static void async_tcp_client_connect_write(struct async_tcp_client_t *self_p,
-                                           const char *host_p,
-                                           int port)
+static void async_tcp_client_connect_abort_write(
+    struct async_tcp_client_t *self_p)
 {
-    struct message_connect_t *data_p;
+    struct message_connect_abort_t *data_p;
 
-    data_p = ml_message_alloc(&uid_tcp_client_connect, sizeof(*data_p));
+    data_p = async_message_alloc(
+        &tcp_client_runtime(self_p)->async.slabs.connect_abort,
+        MESSAGE_TCP_CLIENT_CONNECT_ABORT);
     data_p->tcp_p = self_p;
-    data_p->host_p = strdup(host_p);
-    data_p->port = port;
-    ml_queue_put(&tcp_client_runtime(self_p)->io.queue, data_p);
+    data_p->connect_id = tcp_client(self_p)->connect_id;
+    send_to_io_thread(tcp_client_runtime(self_p), data_p);
+}
+
+/**
+ * Abort an ongoing connect. Returns true if there was one.
+ */
+static bool async_tcp_client_connect_abort(struct async_tcp_client_t *self_p)
+{
+    struct tcp_client_t *rself_p;
+
+    rself_p = tcp_client(self_p);
+
+    if (!rself_p->connecting) {
+        return (false);
+    }
+
+    rself_p->connecting = false;
+    async_timer_stop(&rself_p->connect_timer);
+    async_tcp_client_connect_abort_write(self_p);
+
+    return (true);
 }
 
-static void async_tcp_client_disconnect_write(struct async_tcp_client_t *self_p)
+/**
+ * Try the next address, if any, before giving up.
+ */
+static void on_tcp_client_connect_timeout(struct async_tcp_client_t *self_p)
 {
-    struct message_disconnect_t *data_p;
+    if (tcp_client(self_p)->connecting
+        && async_tcp_client_connect_next(self_p)) {
+        return;
+    }
 
-    data_p = ml_message_alloc(&uid_tcp_client_disconnect, sizeof(*data_p));
-    data_p->sockfd = tcp_client(self_p)->sockfd;
-    ml_queue_put(&tcp_client_runtime(self_p)->io.queue, data_p);
+    if (async_tcp_client_connect_abort(self_p)) {
+        tcp_client(self_p)->on_connected(self_p, -1);
+    }
 }
 
-static void async_tcp_client_write_error_write(struct async_tcp_client_t *self_p)
+static void on_tcp_client_connect_failed(struct async_tcp_client_t *self_p,
+                                         void *arg_p)
 {
-    struct message_write_error_t *data_p;
+    (void)arg_p;
 
-    data_p = ml_message_alloc(&uid_tcp_client_write_error, sizeof(*data_p));
-    data_p->tcp_p = self_p;
-    data_p->sockfd = tcp_client(self_p)->sockfd;
-    ml_queue_put(&tcp_client_runtime(self_p)->io.queue, data_p);
+    tcp_client(self_p)->on_connected(self_p, -1);
+}
+
+/**
+ * Connect to the first address once resolved, unless aborted while
+ * resolving. The other addresses are tried in order if connecting
+ * fails.
+ */
+static void on_tcp_client_resolved(
+    struct async_tcp_client_t *self_p,
+    void *arg_p,
+    const struct async_resolver_result_t *result_p)
+{
+    struct tcp_client_t *rself_p;
+
+    rself_p = tcp_client(self_p);
+
+    if (!rself_p->connecting
+        || ((unsigned int)(uintptr_t)arg_p != rself_p->connect_id)) {
+        return;
+    }
+
+    if (result_p == NULL) {
+        rself_p->connecting = false;
+        async_timer_stop(&rself_p->connect_timer);
+        async_call(self_p->async_p,
+                   (async_func_t)on_tcp_client_connect_failed,
+                   self_p,
+                   NULL);
+    } else {
+        rself_p->result = *result_p;
+        rself_p->address_index = 0;
+        async_tcp_client_connect_write(self_p, &result_p->addresses[0]);
+    }
+}
+
+static void tcp_client_on_closed(struct connection_t *self_p)
+{
+    struct async_tcp_client_t *tcp_p;
+
+    tcp_p = self_p->owner_p;
+    tcp_client(tcp_p)->on_disconnected(tcp_p);
+}
+
+static void tcp_client_on_writable(struct connection_t *self_p)
+{
+    struct async_tcp_client_t *tcp_p;
+
+    tcp_p = self_p->owner_p;
+    tcp_p->output.on_writable(tcp_p);
+}
+
+static void connection_init(struct connection_t *self_p,
+                            struct async_runtime_linux_t *runtime_p,
+                            void *owner_p,
+                            connection_input_t on_input,
+                            connection_func_t on_closed,
+                            connection_func_t on_writable,
+                            const size_t *low_watermark_p,
+                            const size_t *high_watermark_p)
+{
+    self_p->runtime_p = runtime_p;
+    self_p->owner_p = owner_p;
+    self_p->sockfd = -1;
+    self_p->closed = false;
+    io_epoll_data_init(&self_p->epoll_data,
+                       (io_epoll_func_t)io_handle_connection,
+                       self_p);
+    async_output_init(&self_p->output);
+    self_p->low_watermark_p = low_watermark_p;
+    self_p->high_watermark_p = high_watermark_p;
+    async_input_init(&self_p->input, &runtime_p->async.input_pool);
+    self_p->on_input = on_input;
+    self_p->on_closed = on_closed;
+    self_p->on_writable = on_writable;
+    self_p->io.sockfd = -1;
+    self_p->io.events = 0;
 }
 
 static void tcp_client_init(struct async_tcp_client_t *self_p,
@@ -555,11 +1418,28 @@ static void tcp_client_init(struct async_tcp_client_t *self_p,
         async_utils_linux_fatal_perror("tcp client malloc");
     }
 
+    connection_init(&rself_p->connection,
+                    tcp_client_runtime(self_p),
+                    self_p,
+                    (connection_input_t)on_input,
+                    tcp_client_on_closed,
+                    tcp_client_on_writable,
+                    &self_p->output.low_watermark,
+                    &self_p->output.high_watermark);
     rself_p->on_connected = on_connected;
     rself_p->on_disconnected = on_disconnected;
-    rself_p->on_input = on_input;
-    rself_p->sockfd = -1;
-    rself_p->closed = false;
+    rself_p->connecting = false;
+    rself_p->connect_id = 0;
+    rself_p->result.length = 0;
+    rself_p->address_index = 0;
+    async_timer_init(&rself_p->connect_timer,
+                     (async_timer_timeout_t)on_tcp_client_connect_timeout,
+                     self_p,
+                     0,
+                     0,
+                     self_p->async_p);
+    rself_p->io.sockfd = -1;
+    rself_p->io.connect_id = 0;
     self_p->obj_p = rself_p;
 }
 
@@ -567,48 +1447,90 @@ static void tcp_client_connect(struct async_tcp_client_t *self_p,
                                const char *host_p,
                                int port)
 {
-    tcp_client(self_p)->sockfd = -1;
-    tcp_client(self_p)->closed = false;
-    async_tcp_client_connect_write(self_p, host_p, port);
+    struct tcp_client_t *rself_p;
+
+    rself_p = tcp_client(self_p);
+    async_tcp_client_connect_abort(self_p);
+    connection_set_sockfd(&rself_p->connection, -1);
+    rself_p->connecting = true;
+    rself_p->connect_id++;
+    rself_p->result.length = 0;
+    rself_p->address_index = 0;
+
+    if (self_p->connect_timeout > 0) {
+        async_timer_set_initial(&rself_p->connect_timer,
+                                self_p->connect_timeout);
+        async_timer_start(&rself_p->connect_timer);
+    }
+
+    async_resolver_get(&tcp_client_runtime(self_p)->resolver,
+                       self_p->async_p,
+                       host_p,
+                       port,
+                       (async_resolver_complete_t)on_tcp_client_resolved,
+                       self_p,
+                       (void *)(uintptr_t)rself_p->connect_id);
 }
 
 static void tcp_client_disconnect(struct async_tcp_client_t *self_p)
 {
-    async_tcp_client_disconnect_write(self_p);
+    if (async_tcp_client_connect_abort(self_p)) {
+        return;
+    }
+
+    async_connection_disconnect(tcp_client_connection(self_p));
 }
 
-static void tcp_client_write(struct async_tcp_client_t *self_p,
-                             const void *buf_p,
-                             size_t size)
+/**
+ * Data that cannot be written immediately is queued and written by
+ * the async thread once the io thread finds the socket writable.
+ */
+static void connection_writev(struct connection_t *self_p,
+                              const struct async_iovec_t *iov_p,
+                              int length)
 {
-    ssize_t res;
+    bool was_empty;
 
-    if (tcp_client(self_p)->closed) {
+    if (self_p->closed || (self_p->sockfd == -1)) {
         return;
     }
 
-    res = write(tcp_client(self_p)->sockfd, buf_p, size);
+    was_empty = async_output_is_empty(&self_p->output);
+
+    if (async_output_writev(&self_p->output,
+                            self_p->sockfd,
+                            iov_p,
+                            length) != 0) {
+        async_connection_write_error(self_p);
+
+        return;
+    }
 
-    if (res != (ssize_t)size) {
-        tcp_client(self_p)->closed = true;
-        async_tcp_client_write_error_write(self_p);
+    if (was_empty && !async_output_is_empty(&self_p->output)) {
+        async_connection_write_wait(self_p);
     }
+
+    async_output_update(&self_p->output,
+                        *self_p->low_watermark_p,
+                        *self_p->high_watermark_p);
 }
 
-static size_t tcp_client_read(struct async_tcp_client_t *self_p,
-                              void *buf_p,
-                              size_t size)
+static void connection_write(struct connection_t *self_p,
+                             const void *buf_p,
+                             size_t size)
 {
-    ssize_t res;
-
-    if (tcp_client(self_p)->closed) {
-        return (0);
-    }
+    struct async_iovec_t iov;
 
-    res = read(tcp_client(self_p)->sockfd, buf_p, size);
+    iov.buf_p = buf_p;
+    iov.size = size;
+    connection_writev(self_p, &iov, 1);
+}
 
+static size_t connection_input_result(struct connection_t *self_p,
+                                      ssize_t res)
+{
     if (res == 0) {
-        tcp_client(self_p)->closed = true;
+        self_p->closed = true;
     } else if (res == -1) {
         res = 0;
     }
@@ -616,10 +1538,81 @@ static size_t tcp_client_read(struct async_tcp_client_t *self_p,
     return (res);
 }
 
-static struct async_runtime_linux_t *tcp_server_runtime(
-    struct async_tcp_server_t *self_p)
+static size_t connection_read(struct connection_t *self_p,
+                              void *buf_p,
+                              size_t size)
 {
-    return ((struct async_runtime_linux_t *)(self_p->async_p->runtime_p->obj_p));
+    if (self_p->closed) {
+        return (0);
+    }
+
+    return (connection_input_result(self_p,
+                                    async_input_read(&self_p->input,
+                                                     self_p->sockfd,
+                                                     buf_p,
+                                                     size)));
+}
+
+static size_t connection_borrow(struct connection_t *self_p,
+                                const uint8_t **buf_pp)
+{
+    if (self_p->closed) {
+        return (0);
+    }
+
+    return (connection_input_result(self_p,
+                                    async_input_borrow(&self_p->input,
+                                                       self_p->sockfd,
+                                                       buf_pp)));
+}
+
+static void tcp_client_writev(struct async_tcp_client_t *self_p,
+                              const struct async_iovec_t *iov_p,
+                              int length)
+{
+    connection_writev(tcp_client_connection(self_p), iov_p, length);
+}
+
+static void tcp_client_write(struct async_tcp_client_t *self_p,
+                             const void *buf_p,
+                             size_t size)
+{
+    connection_write(tcp_client_connection(self_p), buf_p, size);
+}
+
+static bool tcp_client_is_writable(struct async_tcp_client_t *self_p)
+{
+    return (!tcp_client_connection(self_p)->output.blocked);
+}
+
+static size_t tcp_client_read(struct async_tcp_client_t *self_p,
+                              void *buf_p,
+                              size_t size)
+{
+    return (connection_read(tcp_client_connection(self_p), buf_p, size));
+}
+
+static size_t tcp_client_borrow(struct async_tcp_client_t *self_p,
+                                const uint8_t **buf_pp)
+{
+    return (connection_borrow(tcp_client_connection(self_p), buf_pp));
+}
+
+static void tcp_client_release(struct async_tcp_client_t *self_p, size_t size)
+{
+    async_input_release(&tcp_client_connection(self_p)->input, size);
+}
+
+static void tcp_server_client_on_closed(struct connection_t *self_p)
+{
+    struct async_tcp_server_client_t *client_p;
+    struct async_tcp_server_t *server_p;
+
+    client_p = self_p->owner_p;
+    server_p = client_p->server_p;
+    server_client_list_remove(&server_p->clients.used_p, client_p);
+    server_client_list_push(&server_p->clients.free_p, client_p);
+    tcp_server(server_p)->on_disconnected(client_p);
 }
 
 static void tcp_server_init(struct async_tcp_server_t *self_p,
@@ -637,118 +1630,175 @@ static void tcp_server_init(struct async_tcp_server_t *self_p,
         async_utils_linux_fatal_perror("tcp server malloc");
     }
 
+    memset(&rself_p->addr, 0, sizeof(rself_p->addr));
+    rself_p->addr.sin_family = AF_INET;
+    rself_p->addr.sin_port = htons(port);
+
+    if (inet_aton(host_p, &rself_p->addr.sin_addr) == 0) {
+        rself_p->addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    }
+
     rself_p->listener = -1;
-    rself_p->host_p = strdup(host_p);
-    rself_p->port = port;
     rself_p->on_connected = on_connected;
     rself_p->on_disconnected = on_disconnected;
     rself_p->on_input = on_input;
+    io_epoll_data_init(&rself_p->epoll_data,
+                       (io_epoll_func_t)io_handle_tcp_server_listener,
+                       self_p);
+    rself_p->io.listener = -1;
+    self_p->clients.used_p = NULL;
+    self_p->clients.free_p = NULL;
     self_p->obj_p = rself_p;
 }
 
+/**
+ * Clients are allocated once when added, and then reused for all
+ * accepted connections.
+ */
 static void tcp_server_add_client(struct async_tcp_server_t *self_p,
                                   struct async_tcp_server_client_t *client_p)
 {
-    (void)self_p;
-    (void)client_p;
+    struct tcp_server_client_t *rclient_p;
+
+    rclient_p = malloc(sizeof(*rclient_p));
+
+    if (rclient_p == NULL) {
+        async_utils_linux_fatal_perror("tcp server client malloc");
+    }
+
+    connection_init(&rclient_p->connection,
+                    tcp_server_runtime(self_p),
+                    client_p,
+                    (connection_input_t)tcp_server(self_p)->on_input,
+                    tcp_server_client_on_closed,
+                    NULL,
+                    &server_client_low_watermark,
+                    &server_client_high_watermark);
+    client_p->obj_p = rclient_p;
+    server_client_list_push(&self_p->clients.free_p, client_p);
+}
+
+static void async_tcp_server_listener_write(int type,
+                                            struct async_tcp_server_t *self_p,
+                                            int listener)
+{
+    struct message_listener_t *message_p;
+
+    message_p = async_message_alloc(
+        &tcp_server_runtime(self_p)->async.slabs.listener,
+        type);
+    message_p->server_p = self_p;
+    message_p->listener = listener;
+    send_to_io_thread(tcp_server_runtime(self_p), message_p);
 }
 
+/**
+ * Listen in the async thread and accept in the io thread.
+ */
 static int tcp_server_start(struct async_tcp_server_t *self_p)
 {
-    struct sockaddr_in addr;
-    int sockfd;
-    int res;
-    struct epoll_event event;
     struct tcp_server_t *rself_p;
+    int listener;
+    int yes;
 
-    res = -1;
     rself_p = tcp_server(self_p);
 
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(rself_p->port);
-    inet_aton(rself_p->host_p, (struct in_addr *)&addr.sin_addr.s_addr);
+    if (rself_p->listener != -1) {
+        return (-1);
+    }
 
-    sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
 
-    if (sockfd != -1) {
-        res = bind(sockfd, (struct sockaddr *)&addr, sizeof(addr));
-
-        if (res != -1) {
-            res = listen(sockfd, 5);
-
-            if (res != -1) {
-                rself_p->epoll_data_p = io_epoll_data_create(
-                    (io_epoll_func_t)io_handle_tcp_server_listener,
-                    self_p);
-                event.events = EPOLLIN;
-                event.data.ptr = rself_p->epoll_data_p;
-                res = epoll_ctl(tcp_server_runtime(self_p)->io.epoll_fd,
-                                EPOLL_CTL_ADD,
-                                sockfd,
-                                &event);
-            }
-        }
+    if (listener == -1) {
+        return (-1);
+    }
 
-        if (res == -1) {
-            close(sockfd);
-            sockfd = -1;
-        }
+    yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    if ((self_p->reuse_port
+         && (setsockopt(listener,
+                        SOL_SOCKET,
+                        SO_REUSEPORT,
+                        &yes,
+                        sizeof(yes)) != 0))
+        || (bind(listener,
+                 (struct sockaddr *)&rself_p->addr,
+                 sizeof(rself_p->addr)) != 0)
+        || (listen(listener, self_p->backlog) != 0)) {
+        close(listener);
+
+        return (-1);
     }
 
-    rself_p->listener = sockfd;
+    rself_p->listener = listener;
+    async_tcp_server_listener_write(MESSAGE_TCP_SERVER_START, self_p, listener);
 
-    return (res);
+    return (0);
+}
+
+static void tcp_server_client_disconnect(struct async_tcp_server_client_t *self_p)
+{
+    struct async_tcp_server_t *server_p;
+    struct connection_t *connection_p;
+
+    connection_p = tcp_server_client(self_p);
+
+    if (connection_p->sockfd == -1) {
+        return;
+    }
+
+    server_p = self_p->server_p;
+    server_client_list_remove(&server_p->clients.used_p, self_p);
+    server_client_list_push(&server_p->clients.free_p, self_p);
+    async_connection_disconnect(connection_p);
 }
 
 static void tcp_server_stop(struct async_tcp_server_t *self_p)
 {
-    (void)self_p;
+    struct tcp_server_t *rself_p;
+
+    rself_p = tcp_server(self_p);
 
-    exit(3);
+    if (rself_p->listener == -1) {
+        return;
+    }
+
+    async_tcp_server_listener_write(MESSAGE_TCP_SERVER_STOP,
+                                    self_p,
+                                    rself_p->listener);
+    rself_p->listener = -1;
+
+    while (self_p->clients.used_p != NULL) {
+        tcp_server_client_disconnect(self_p->clients.used_p);
+    }
 }
 
 static void tcp_server_client_write(struct async_tcp_server_client_t *self_p,
                                     const void *buf_p,
                                     size_t size)
 {
-    (void)self_p;
-    (void)buf_p;
-    (void)size;
-
-    exit(4);
+    connection_write(tcp_server_client(self_p), buf_p, size);
 }
 
 static size_t tcp_server_client_read(struct async_tcp_server_client_t *self_p,
                                      void *buf_p,
                                      size_t size)
 {
-    (void)self_p;
-    (void)buf_p;
-    (void)size;
-
-    exit(5);
-
-    return (0);
+    return (connection_read(tcp_server_client(self_p), buf_p, size));
 }
 
-static void tcp_server_client_disconnect(struct async_tcp_server_client_t *self_p)
+static size_t tcp_server_client_borrow(struct async_tcp_server_client_t *self_p,
+                                       const uint8_t **buf_pp)
 {
-    (void)self_p;
-
-    exit(6);
+    return (connection_borrow(tcp_server_client(self_p), buf_pp));
 }
 
-static void on_put_signal_event(int *fd_p)
+static void tcp_server_client_release(struct async_tcp_server_client_t *self_p,
+                                      size_t size)
 {
-    uint64_t value;
-    ssize_t size;
-
-    value = 1;
-    size = write(*fd_p, &value, sizeof(value));
-    (void)size;
+    async_input_release(&tcp_server_client(self_p)->input, size);
 }
-
 static int init(struct async_runtime_linux_t *self_p)
 {
     struct async_runtime_t *runtime_p;
@@ -762,43 +1812,105 @@ static int init(struct async_runtime_linux_t *self_p)
     runtime_p->tcp_client.connect = tcp_client_connect;
     runtime_p->tcp_client.disconnect = tcp_client_disconnect;
     runtime_p->tcp_client.write = tcp_client_write;
+    runtime_p->tcp_client.writev = tcp_client_writev;
+    runtime_p->tcp_client.is_writable = tcp_client_is_writable;
     runtime_p->tcp_client.read = tcp_client_read;
+    runtime_p->tcp_client.borrow = tcp_client_borrow;
+    runtime_p->tcp_client.release = tcp_client_release;
     runtime_p->tcp_server.init = tcp_server_init;
     runtime_p->tcp_server.add_client = tcp_server_add_client;
     runtime_p->tcp_server.start = tcp_server_start;
     runtime_p->tcp_server.stop = tcp_server_stop;
     runtime_p->tcp_server.client.write = tcp_server_client_write;
     runtime_p->tcp_server.client.read = tcp_server_client_read;
+    runtime_p->tcp_server.client.borrow = tcp_server_client_borrow;
+    runtime_p->tcp_server.client.release = tcp_server_client_release;
     runtime_p->tcp_server.client.disconnect = tcp_server_client_disconnect;
 
-    self_p->io.fd = eventfd(0, EFD_SEMAPHORE);
+    self_p->io.fd = eventfd(0, 0);
 
     if (self_p->io.fd == -1) {
         return (-1);
     }
 
+    self_p->async.fd = eventfd(0, 0);
+
+    if (self_p->async.fd == -1) {
+        return (-1);
+    }
+
     self_p->io.epoll_fd = epoll_create1(0);
 
     if (self_p->io.epoll_fd == -1) {
         return (-1);
     }
 
-    ml_timer_handler_init(&self_p->timer_handler);
-    ml_queue_init(&self_p->io.queue, 32);
-    ml_queue_set_on_put(&self_p->io.queue,
-                        (ml_queue_put_t)on_put_signal_event,
-                        &self_p->io.fd);
-    ml_timer_handler_timer_init(&self_p->timer_handler,
-                                &self_p->async.timer,
-                                &uid_timeout,
-                                &self_p->async.queue);
-    ml_queue_init(&self_p->async.queue, 32);
-    ml_worker_pool_init(&self_p->worker_pool, 4, 32);
+    if (async_runtime_timer_init(&self_p->timer) != 0) {
+        return (-1);
+    }
+
+    async_resolver_init(&self_p->resolver);
+    async_input_pool_init(&self_p->async.input_pool);
+
+    self_p->io.data_p = NULL;
+    async_message_queue_init(&self_p->io.queue);
+    async_message_slab_init(&self_p->io.slabs.connect_complete,
+                            sizeof(struct message_connect_complete_t));
+    async_message_slab_init(&self_p->io.slabs.accepted,
+                            sizeof(struct message_accepted_t));
+    async_message_slab_init(&self_p->io.slabs.socket,
+                            sizeof(struct message_socket_t));
+    async_message_slab_init(&self_p->io.slabs.data,
+                            sizeof(struct message_data_t));
+    async_message_queue_init(&self_p->async.queue);
+    async_message_slab_init(&self_p->async.slabs.connect,
+                            sizeof(struct message_connect_t));
+    async_message_slab_init(&self_p->async.slabs.connect_abort,
+                            sizeof(struct message_connect_abort_t));
+    async_message_slab_init(&self_p->async.slabs.listener,
+                            sizeof(struct message_listener_t));
+    async_message_slab_init(&self_p->async.slabs.socket,
+                            sizeof(struct message_socket_t));
+    async_message_slab_init(&self_p->async.slabs.data,
+                            sizeof(struct message_data_t));
+
+    if (async_calls_init(&self_p->async.calls,
+                         CALL_THREADSAFE_RING_LENGTH,
+                         (async_calls_wakeup_t)call_wakeup,
+                         self_p) != 0) {
+        return (-1);
+    }
+
     runtime_p->obj_p = self_p;
 
     return (0);
 }
 
+void async_runtime_linux_get_statistics(
+    struct async_runtime_t *runtime_p,
+    struct async_runtime_linux_statistics_t *statistics_p)
+{
+    struct async_runtime_linux_t *self_p;
+    struct async_slab_statistics_t slabs;
+
+    self_p = runtime_p->obj_p;
+    memset(&slabs, 0, sizeof(slabs));
+    async_slab_add_statistics(&self_p->io.slabs.connect_complete, &slabs);
+    async_slab_add_statistics(&self_p->io.slabs.accepted, &slabs);
+    async_slab_add_statistics(&self_p->io.slabs.socket, &slabs);
+    async_slab_add_statistics(&self_p->io.slabs.data, &slabs);
+    async_slab_add_statistics(&self_p->async.slabs.connect, &slabs);
+    async_slab_add_statistics(&self_p->async.slabs.connect_abort, &slabs);
+    async_slab_add_statistics(&self_p->async.slabs.listener, &slabs);
+    async_slab_add_statistics(&self_p->async.slabs.socket, &slabs);
+    async_slab_add_statistics(&self_p->async.slabs.data, &slabs);
+    async_slab_add_statistics(&self_p->async.calls.jobs, &slabs);
+    statistics_p->messages.allocations = slabs.allocations;
+    statistics_p->messages.misses = slabs.misses;
+    statistics_p->messages.capacity = slabs.capacity;
+    statistics_p->messages.used = slabs.used;
+}
+
 struct async_runtime_t *async_runtime_linux_create()
 {
     struct async_runtime_linux_t *self_p;
@@ -820,3 +1932,13 @@ struct async_runtime_t *async_runtime_linux_create()
 
     return (&self_p->runtime);
 }
+
+struct async_resolver_t *async_runtime_linux_get_resolver(
+    struct async_runtime_t *runtime_p)
+{
+    struct async_runtime_linux_t *self_p;
+
+    self_p = runtime_p->obj_p;
+
+    return (&self_p->resolver);
+}
@@ -0,0 +1,1262 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+/*
+ * A single threaded Linux runtime. I/O, timers and callbacks are all
+ * handled in the thread calling async_run_forever(), so there is no
+ * message passing between threads. Only threadsafe calls and worker
+ * pool completions are passed from other threads, through a lock-free
+ * ring and an eventfd.
+ */
+
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include "async.h"
+#include "async/runtimes/linux.h"
+#include "async/utils/linux.h"
+#include "internal.h"
+
+/* Maximum number of queued threadsafe calls. A power of two. */
+#define CALL_THREADSAFE_RING_LENGTH                     1024
+
+/* Maximum number of events handled per epoll_wait() call. */
+#define EPOLL_EVENTS_MAX                                32
+
+/* Maximum number of connections accepted per listener event. */
+#define ACCEPT_MAX                                      64
+
+struct async_runtime_linux_st_t;
+
+typedef void (*epoll_func_t)(struct async_runtime_linux_st_t *self_p,
+                             void *arg_p,
+                             uint32_t events);
+
+struct epoll_handler_t {
+    epoll_func_t func;
+    void *arg_p;
+};
+
+struct async_runtime_linux_st_t {
+    struct async_runtime_t runtime;
+    int epoll_fd;
+    struct async_runtime_timer_t timer;
+    struct epoll_handler_t timer_handler;
+    int event_fd;
+    struct epoll_handler_t event_handler;
+    struct async_calls_t calls;
+    struct async_resolver_t resolver;
+    struct async_input_pool_t input_pool;
+    /* The CPU the runtime is pinned to, or -1. */
+    int cpu;
+    struct async_t *async_p;
+};
+
+struct connection_t;
+
+typedef void (*connection_func_t)(struct connection_t *self_p);
+
+typedef void (*connection_input_t)(void *owner_p);
+
+/**
+ * A socket shared by TCP clients and TCP server clients.
+ */
+struct connection_t {
+    struct async_runtime_linux_st_t *runtime_p;
+    void *owner_p;
+    int sockfd;
+    /* Closed by the remote end or by an error, but not yet
+       reported. */
+    bool closed;
+    /* Closed by a failed write, reported by a later call. */
+    bool failed;
+    struct epoll_handler_t handler;
+    /* Written data waiting for the socket to become writable. */
+    struct async_output_t output;
+    /* Received data not yet consumed by on_input(). */
+    struct async_input_t input;
+    const size_t *low_watermark_p;
+    const size_t *high_watermark_p;
+    connection_input_t on_input;
+    /* Called when closed by the remote end or by an error. */
+    connection_func_t on_closed;
+    /* Called when drained to the low watermark, if set. */
+    connection_func_t on_writable;
+};
+
+struct tcp_client_t {
+    struct connection_t connection;
+    async_tcp_client_connected_t on_connected;
+    async_tcp_client_disconnected_t on_disconnected;
+    /* Resolving or connecting. */
+    bool connecting;
+    unsigned int connect_id;
+    struct async_timer_t connect_timer;
+    /* Used instead of the connection handler while connecting. */
+    struct epoll_handler_t connect_handler;
+    /* Addresses of the host, connected to in order until one
+       succeeds. */
+    struct async_resolver_result_t result;
+    int address_index;
+};
+
+struct tcp_server_t {
+    struct async_runtime_linux_st_t *runtime_p;
+    struct async_tcp_server_t *server_p;
+    struct sockaddr_in addr;
+    int listener;
+    struct epoll_handler_t handler;
+    async_tcp_server_client_connected_t on_connected;
+    async_tcp_server_client_disconnected_t on_disconnected;
+    async_tcp_server_client_input_t on_input;
+};
+
+struct tcp_server_client_t {
+    struct connection_t connection;
+};
+
+/* Server clients have no configurable output watermarks. */
+static const size_t server_client_low_watermark =
+    ASYNC_TCP_CLIENT_OUTPUT_LOW_WATERMARK;
+static const size_t server_client_high_watermark =
+    ASYNC_TCP_CLIENT_OUTPUT_HIGH_WATERMARK;
+
+static void epoll_add(struct async_runtime_linux_st_t *self_p,
+                      int fd,
+                      uint32_t events,
+                      struct epoll_handler_t *handler_p)
+{
+    struct epoll_event event;
+
+    event.events = events;
+    event.data.ptr = handler_p;
+
+    if (epoll_ctl(self_p->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        async_utils_linux_fatal_perror("epoll_ctl");
+    }
+}
+
+static void epoll_mod(struct async_runtime_linux_st_t *self_p,
+                      int fd,
+                      uint32_t events,
+                      struct epoll_handler_t *handler_p)
+{
+    struct epoll_event event;
+
+    event.events = events;
+    event.data.ptr = handler_p;
+
+    if (epoll_ctl(self_p->epoll_fd, EPOLL_CTL_MOD, fd, &event) == -1) {
+        async_utils_linux_fatal_perror("epoll_ctl");
+    }
+}
+
+static void handle_connection(struct async_runtime_linux_st_t *self_p,
+                              struct connection_t *connection_p,
+                              uint32_t events);
+
+static void connection_init(struct connection_t *self_p,
+                            struct async_runtime_linux_st_t *runtime_p,
+                            void *owner_p,
+                            connection_input_t on_input,
+                            connection_func_t on_closed,
+                            connection_func_t on_writable,
+                            const size_t *low_watermark_p,
+                            const size_t *high_watermark_p)
+{
+    self_p->runtime_p = runtime_p;
+    self_p->owner_p = owner_p;
+    self_p->sockfd = -1;
+    self_p->closed = false;
+    self_p->failed = false;
+    self_p->handler.func = (epoll_func_t)handle_connection;
+    self_p->handler.arg_p = self_p;
+    async_output_init(&self_p->output);
+    async_input_init(&self_p->input, &runtime_p->input_pool);
+    self_p->low_watermark_p = low_watermark_p;
+    self_p->high_watermark_p = high_watermark_p;
+    self_p->on_input = on_input;
+    self_p->on_closed = on_closed;
+    self_p->on_writable = on_writable;
+}
+
+/**
+ * Start receiving on given connected socket.
+ */
+static void connection_start(struct connection_t *self_p, int sockfd)
+{
+    self_p->sockfd = sockfd;
+    self_p->closed = false;
+    self_p->failed = false;
+    epoll_add(self_p->runtime_p, sockfd, EPOLLIN, &self_p->handler);
+}
+
+static void connection_close(struct connection_t *self_p)
+{
+    self_p->failed = false;
+    async_output_clear(&self_p->output);
+    async_input_clear(&self_p->input);
+
+    if (self_p->sockfd == -1) {
+        return;
+    }
+
+    epoll_ctl(self_p->runtime_p->epoll_fd, EPOLL_CTL_DEL, self_p->sockfd, NULL);
+    close(self_p->sockfd);
+    self_p->sockfd = -1;
+}
+
+/**
+ * Closed by the remote end or by an error.
+ */
+static void connection_closed(struct connection_t *self_p)
+{
+    self_p->closed = true;
+    connection_close(self_p);
+    self_p->on_closed(self_p);
+}
+
+static void on_connection_write_failed(struct connection_t *self_p,
+                                       void *arg_p)
+{
+    (void)arg_p;
+
+    /* Disconnected or connected again since. */
+    if (!self_p->failed) {
+        return;
+    }
+
+    self_p->failed = false;
+    self_p->on_closed(self_p);
+}
+
+/**
+ * Write queued data once the socket is writable. Returns false if
+ * closed.
+ */
+static bool handle_connection_writable(struct connection_t *self_p)
+{
+    if (async_output_flush(&self_p->output, self_p->sockfd) != 0) {
+        connection_closed(self_p);
+
+        return (false);
+    }
+
+    if (async_output_is_empty(&self_p->output)) {
+        epoll_mod(self_p->runtime_p,
+                  self_p->sockfd,
+                  EPOLLIN,
+                  &self_p->handler);
+    }
+
+    if (async_output_update(&self_p->output,
+                            *self_p->low_watermark_p,
+                            *self_p->high_watermark_p)) {
+        if (self_p->on_writable != NULL) {
+            self_p->on_writable(self_p);
+        }
+    }
+
+    return (self_p->sockfd != -1);
+}
+
+static void handle_connection(struct async_runtime_linux_st_t *self_p,
+                              struct connection_t *connection_p,
+                              uint32_t events)
+{
+    size_t consumed;
+
+    (void)self_p;
+
+    /* Closed by an earlier event in the same batch. */
+    if (connection_p->sockfd == -1) {
+        return;
+    }
+
+    if ((events & EPOLLOUT) && !async_output_is_empty(&connection_p->output)) {
+        if (!handle_connection_writable(connection_p)) {
+            return;
+        }
+    }
+
+    if ((events & ~EPOLLOUT) == 0) {
+        return;
+    }
+
+    async_input_set_readable(&connection_p->input);
+
+    /* Call again while received data is consumed, as the socket may
+       be drained. */
+    do {
+        consumed = connection_p->input.consumed;
+        connection_p->on_input(connection_p->owner_p);
+    } while (async_input_is_progressing(&connection_p->input, consumed));
+
+    if (connection_p->closed && (connection_p->sockfd != -1)) {
+        connection_closed(connection_p);
+    }
+}
+
+/**
+ * Data that cannot be written immediately is queued and written once
+ * the socket is writable. A failed write is reported by a later call
+ * to on_closed().
+ */
+static void connection_writev(struct connection_t *self_p,
+                              const struct async_iovec_t *iov_p,
+                              int length)
+{
+    bool was_empty;
+
+    if (self_p->closed || (self_p->sockfd == -1)) {
+        return;
+    }
+
+    was_empty = async_output_is_empty(&self_p->output);
+
+    if (async_output_writev(&self_p->output,
+                            self_p->sockfd,
+                            iov_p,
+                            length) != 0) {
+        self_p->closed = true;
+        connection_close(self_p);
+        self_p->failed = true;
+        async_call(self_p->runtime_p->async_p,
+                   (async_func_t)on_connection_write_failed,
+                   self_p,
+                   NULL);
+
+        return;
+    }
+
+    if (was_empty && !async_output_is_empty(&self_p->output)) {
+        epoll_mod(self_p->runtime_p,
+                  self_p->sockfd,
+                  EPOLLIN | EPOLLOUT,
+                  &self_p->handler);
+    }
+
+    async_output_update(&self_p->output,
+                        *self_p->low_watermark_p,
+                        *self_p->high_watermark_p);
+}
+
+static void connection_write(struct connection_t *self_p,
+                             const void *buf_p,
+                             size_t size)
+{
+    struct async_iovec_t iov;
+
+    iov.buf_p = buf_p;
+    iov.size = size;
+    connection_writev(self_p, &iov, 1);
+}
+
+static size_t connection_input_result(struct connection_t *self_p,
+                                      ssize_t res)
+{
+    if (res == 0) {
+        self_p->closed = true;
+    } else if (res == -1) {
+        if (errno != EAGAIN) {
+            self_p->closed = true;
+        }
+
+        res = 0;
+    }
+
+    return (res);
+}
+
+static size_t connection_read(struct connection_t *self_p,
+                              void *buf_p,
+                              size_t size)
+{
+    if (self_p->closed) {
+        return (0);
+    }
+
+    return (connection_input_result(self_p,
+                                    async_input_read(&self_p->input,
+                                                     self_p->sockfd,
+                                                     buf_p,
+                                                     size)));
+}
+
+static size_t connection_borrow(struct connection_t *self_p,
+                                const uint8_t **buf_pp)
+{
+    if (self_p->closed) {
+        return (0);
+    }
+
+    return (connection_input_result(self_p,
+                                    async_input_borrow(&self_p->input,
+                                                       self_p->sockfd,
+                                                       buf_pp)));
+}
+
+static void connection_release(struct connection_t *self_p, size_t size)
+{
+    async_input_release(&self_p->input, size);
+}
+
+static struct tcp_client_t *tcp_client(struct async_tcp_client_t *self_p)
+{
+    return ((struct tcp_client_t *)(self_p->obj_p));
+}
+
+static struct async_runtime_linux_st_t *tcp_client_runtime(
+    struct async_tcp_client_t *self_p)
+{
+    return ((struct async_runtime_linux_st_t *)(
+                self_p->async_p->runtime_p->obj_p));
+}
+
+static void tcp_client_close(struct async_tcp_client_t *self_p)
+{
+    struct tcp_client_t *rself_p;
+
+    rself_p = tcp_client(self_p);
+    rself_p->connecting = false;
+    async_timer_stop(&rself_p->connect_timer);
+    connection_close(&rself_p->connection);
+}
+
+static void tcp_client_on_closed(struct connection_t *self_p)
+{
+    struct async_tcp_client_t *tcp_p;
+
+    tcp_p = self_p->owner_p;
+    tcp_client(tcp_p)->on_disconnected(tcp_p);
+}
+
+static void tcp_client_on_writable(struct connection_t *self_p)
+{
+    struct async_tcp_client_t *tcp_p;
+
+    tcp_p = self_p->owner_p;
+    tcp_p->output.on_writable(tcp_p);
+}
+
+static void tcp_client_start_connect_timer(struct async_tcp_client_t *self_p)
+{
+    struct tcp_client_t *rself_p;
+
+    rself_p = tcp_client(self_p);
+
+    if (self_p->connect_timeout > 0) {
+        async_timer_set_initial(&rself_p->connect_timer,
+                                self_p->connect_timeout);
+        async_timer_start(&rself_p->connect_timer);
+    }
+}
+
+/**
+ * Start connecting to the next address of the host without blocking.
+ * Completion is signalled by the socket becoming writable. Returns
+ * false if there are no more addresses.
+ */
+static bool tcp_client_connect_next(struct async_tcp_client_t *self_p)
+{
+    struct tcp_client_t *rself_p;
+    const struct async_resolver_address_t *address_p;
+    int sockfd;
+
+    rself_p = tcp_client(self_p);
+
+    while (rself_p->address_index < rself_p->result.length) {
+        address_p = &rself_p->result.addresses[rself_p->address_index];
+        rself_p->address_index++;
+        sockfd = socket(address_p->addr.ss_family,
+                        SOCK_STREAM | SOCK_NONBLOCK,
+                        0);
+
+        if (sockfd == -1) {
+            continue;
+        }
+
+        if ((connect(sockfd,
+                     (struct sockaddr *)&address_p->addr,
+                     address_p->size) == 0)
+            || (errno == EINPROGRESS)) {
+            rself_p->connection.sockfd = sockfd;
+            epoll_add(tcp_client_runtime(self_p),
+                      sockfd,
+                      EPOLLOUT,
+                      &rself_p->connect_handler);
+
+            return (true);
+        }
+
+        close(sockfd);
+    }
+
+    return (false);
+}
+
+static void on_tcp_client_connect_failed(struct async_tcp_client_t *self_p,
+                                         void *arg_p)
+{
+    (void)arg_p;
+
+    tcp_client(self_p)->on_connected(self_p, -1);
+}
+
+/**
+ * Try the next address, if any, before giving up.
+ */
+static void on_tcp_client_connect_timeout(struct async_tcp_client_t *self_p)
+{
+    if (!tcp_client(self_p)->connecting) {
+        return;
+    }
+
+    connection_close(&tcp_client(self_p)->connection);
+
+    if (tcp_client_connect_next(self_p)) {
+        tcp_client_start_connect_timer(self_p);
+
+        return;
+    }
+
+    tcp_client_close(self_p);
+    tcp_client(self_p)->on_connected(self_p, -1);
+}
+
+static void handle_tcp_client_connected(struct async_runtime_linux_st_t *self_p,
+                                        struct async_tcp_client_t *tcp_p,
+                                        uint32_t events)
+{
+    struct tcp_client_t *rself_p;
+    struct connection_t *connection_p;
+    int error;
+    socklen_t size;
+
+    (void)events;
+
+    rself_p = tcp_client(tcp_p);
+    connection_p = &rself_p->connection;
+
+    /* Closed by an earlier event in the same batch. */
+    if (!rself_p->connecting || (connection_p->sockfd == -1)) {
+        return;
+    }
+
+    size = sizeof(error);
+
+    if (getsockopt(connection_p->sockfd,
+                   SOL_SOCKET,
+                   SO_ERROR,
+                   &error,
+                   &size) == -1) {
+        error = errno;
+    }
+
+    if (error != 0) {
+        /* Try the next address, if any. */
+        connection_close(connection_p);
+
+        if (tcp_client_connect_next(tcp_p)) {
+            tcp_client_start_connect_timer(tcp_p);
+        } else {
+            tcp_client_close(tcp_p);
+            rself_p->on_connected(tcp_p, -1);
+        }
+    } else {
+        rself_p->connecting = false;
+        async_timer_stop(&rself_p->connect_timer);
+        epoll_mod(self_p,
+                  connection_p->sockfd,
+                  EPOLLIN,
+                  &connection_p->handler);
+        rself_p->on_connected(tcp_p, 0);
+    }
+}
+
+static void server_client_list_remove(
+    struct async_tcp_server_client_t **list_pp,
+    struct async_tcp_server_client_t *client_p)
+{
+    if (client_p->prev_p != NULL) {
+        client_p->prev_p->next_p = client_p->next_p;
+    } else {
+        *list_pp = client_p->next_p;
+    }
+
+    if (client_p->next_p != NULL) {
+        client_p->next_p->prev_p = client_p->prev_p;
+    }
+
+    client_p->next_p = NULL;
+    client_p->prev_p = NULL;
+}
+
+static void server_client_list_push(struct async_tcp_server_client_t **list_pp,
+                                    struct async_tcp_server_client_t *client_p)
+{
+    client_p->prev_p = NULL;
+    client_p->next_p = *list_pp;
+
+    if (*list_pp != NULL) {
+        (*list_pp)->prev_p = client_p;
+    }
+
+    *list_pp = client_p;
+}
+
+static struct tcp_server_t *tcp_server(struct async_tcp_server_t *self_p)
+{
+    return ((struct tcp_server_t *)(self_p->obj_p));
+}
+
+static struct connection_t *tcp_server_client(
+    struct async_tcp_server_client_t *self_p)
+{
+    return ((struct connection_t *)(self_p->obj_p));
+}
+
+static void tcp_server_client_on_closed(struct connection_t *self_p)
+{
+    struct async_tcp_server_client_t *client_p;
+    struct async_tcp_server_t *server_p;
+
+    client_p = self_p->owner_p;
+    server_p = client_p->server_p;
+    server_client_list_remove(&server_p->clients.used_p, client_p);
+    server_client_list_push(&server_p->clients.free_p, client_p);
+    tcp_server(server_p)->on_disconnected(client_p);
+}
+
+/**
+ * Accept up to ACCEPT_MAX pending connections and assign them to free
+ * clients. Remaining connections are accepted in the next iteration,
+ * as the listener is still readable.
+ */
+static void handle_tcp_server(struct async_runtime_linux_st_t *self_p,
+                              struct async_tcp_server_t *server_p,
+                              uint32_t events)
+{
+    struct tcp_server_t *rself_p;
+    struct async_tcp_server_client_t *client_p;
+    int sockfd;
+    int i;
+
+    (void)self_p;
+    (void)events;
+
+    rself_p = tcp_server(server_p);
+
+    for (i = 0; (i < ACCEPT_MAX) && (rself_p->listener != -1); i++) {
+        sockfd = accept4(rself_p->listener,
+                         NULL,
+                         NULL,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (sockfd == -1) {
+            if ((errno == ECONNABORTED) || (errno == EINTR)) {
+                continue;
+            }
+
+            break;
+        }
+
+        client_p = server_p->clients.free_p;
+
+        if (client_p == NULL) {
+            close(sockfd);
+            continue;
+        }
+
+        server_client_list_remove(&server_p->clients.free_p, client_p);
+        server_client_list_push(&server_p->clients.used_p, client_p);
+        connection_start(tcp_server_client(client_p), sockfd);
+        rself_p->on_connected(client_p);
+    }
+}
+
+static void handle_timer(struct async_runtime_linux_st_t *self_p,
+                         void *arg_p,
+                         uint32_t events)
+{
+    (void)arg_p;
+    (void)events;
+
+    /* Expired timers are handled by async_runtime_timer_advance(). */
+    async_runtime_timer_read(&self_p->timer);
+}
+
+static void handle_event(struct async_runtime_linux_st_t *self_p,
+                         void *arg_p,
+                         uint32_t events)
+{
+    uint64_t value;
+    ssize_t res;
+
+    (void)arg_p;
+    (void)events;
+
+    res = read(self_p->event_fd, &value, sizeof(value));
+
+    if (res != (ssize_t)sizeof(value)) {
+        async_utils_linux_fatal_perror("event read");
+    }
+
+    async_calls_process(&self_p->calls);
+}
+
+static void set_async(struct async_runtime_linux_st_t *self_p,
+                      struct async_t *async_p)
+{
+    self_p->async_p = async_p;
+}
+
+static void call_wakeup(struct async_runtime_linux_st_t *self_p)
+{
+    uint64_t value;
+    ssize_t size;
+
+    value = 1;
+    size = write(self_p->event_fd, &value, sizeof(value));
+    (void)size;
+}
+
+static void call_threadsafe(struct async_runtime_linux_st_t *self_p,
+                            async_func_t func,
+                            void *obj_p,
+                            void *arg_p)
+{
+    async_calls_call_threadsafe(&self_p->calls, func, obj_p, arg_p);
+}
+
+static int call_worker_pool(struct async_runtime_linux_st_t *self_p,
+                            async_func_t entry,
+                            void *obj_p,
+                            void *arg_p,
+                            async_func_t on_complete)
+{
+    return (async_calls_call_worker_pool(&self_p->calls,
+                                         self_p->async_p,
+                                         entry,
+                                         obj_p,
+                                         arg_p,
+                                         on_complete));
+}
+
+static void run_forever(struct async_runtime_linux_st_t *self_p)
+{
+    struct epoll_event events[EPOLL_EVENTS_MAX];
+    struct epoll_handler_t *handler_p;
+    int timeout;
+    int nfds;
+    int i;
+
+    async_process(self_p->async_p);
+    async_runtime_timer_start(&self_p->timer, self_p->async_p);
+
+    while (true) {
+        if (async_has_pending_calls(self_p->async_p)) {
+            timeout = 0;
+        } else {
+            timeout = -1;
+        }
+
+        nfds = epoll_wait(self_p->epoll_fd,
+                          &events[0],
+                          EPOLL_EVENTS_MAX,
+                          timeout);
+
+        if (nfds == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            async_utils_linux_fatal_perror("epoll_wait");
+        }
+
+        async_runtime_timer_advance(&self_p->timer, self_p->async_p);
+
+        for (i = 0; i < nfds; i++) {
+            handler_p = events[i].data.ptr;
+            handler_p->func(self_p, handler_p->arg_p, events[i].events);
+        }
+
+        async_process(self_p->async_p);
+        async_runtime_timer_update(&self_p->timer, self_p->async_p);
+    }
+}
+
+static void tcp_client_init(struct async_tcp_client_t *self_p,
+                            async_tcp_client_connected_t on_connected,
+                            async_tcp_client_disconnected_t on_disconnected,
+                            async_tcp_client_input_t on_input)
+{
+    struct tcp_client_t *rself_p;
+
+    rself_p = malloc(sizeof(*rself_p));
+
+    if (rself_p == NULL) {
+        async_utils_linux_fatal_perror("tcp client malloc");
+    }
+
+    connection_init(&rself_p->connection,
+                    tcp_client_runtime(self_p),
+                    self_p,
+                    (connection_input_t)on_input,
+                    tcp_client_on_closed,
+                    tcp_client_on_writable,
+                    &self_p->output.low_watermark,
+                    &self_p->output.high_watermark);
+    rself_p->on_connected = on_connected;
+    rself_p->on_disconnected = on_disconnected;
+    rself_p->connecting = false;
+    rself_p->connect_id = 0;
+    rself_p->result.length = 0;
+    rself_p->address_index = 0;
+    async_timer_init(&rself_p->connect_timer,
+                     (async_timer_timeout_t)on_tcp_client_connect_timeout,
+                     self_p,
+                     0,
+                     0,
+                     self_p->async_p);
+    rself_p->connect_handler.func = (epoll_func_t)handle_tcp_client_connected;
+    rself_p->connect_handler.arg_p = self_p;
+    self_p->obj_p = rself_p;
+}
+
+/**
+ * Connect to the first address once resolved. The other addresses are
+ * tried in order if connecting fails.
+ */
+static void on_tcp_client_resolved(
+    struct async_tcp_client_t *self_p,
+    void *arg_p,
+    const struct async_resolver_result_t *result_p)
+{
+    struct tcp_client_t *rself_p;
+
+    rself_p = tcp_client(self_p);
+
+    /* Disconnected, timed out or connecting again while resolving. */
+    if (!rself_p->connecting
+        || ((unsigned int)(uintptr_t)arg_p != rself_p->connect_id)) {
+        return;
+    }
+
+    if (result_p != NULL) {
+        rself_p->result = *result_p;
+        rself_p->address_index = 0;
+
+        if (tcp_client_connect_next(self_p)) {
+            return;
+        }
+    }
+
+    tcp_client_close(self_p);
+    async_call(self_p->async_p,
+               (async_func_t)on_tcp_client_connect_failed,
+               self_p,
+               NULL);
+}
+
+/**
+ * Resolve given host and connect, unless the connect timer expires
+ * first.
+ */
+static void tcp_client_connect(struct async_tcp_client_t *self_p,
+                               const char *host_p,
+                               int port)
+{
+    struct tcp_client_t *rself_p;
+
+    rself_p = tcp_client(self_p);
+    tcp_client_close(self_p);
+    rself_p->connection.closed = false;
+    rself_p->connecting = true;
+    rself_p->connect_id++;
+    rself_p->result.length = 0;
+    rself_p->address_index = 0;
+    tcp_client_start_connect_timer(self_p);
+
+    async_resolver_get(&tcp_client_runtime(self_p)->resolver,
+                       self_p->async_p,
+                       host_p,
+                       port,
+                       (async_resolver_complete_t)on_tcp_client_resolved,
+                       self_p,
+                       (void *)(uintptr_t)rself_p->connect_id);
+}
+
+static void tcp_client_disconnect(struct async_tcp_client_t *self_p)
+{
+    tcp_client_close(self_p);
+}
+
+static void tcp_client_writev(struct async_tcp_client_t *self_p,
+                              const struct async_iovec_t *iov_p,
+                              int length)
+{
+    connection_writev(&tcp_client(self_p)->connection, iov_p, length);
+}
+
+static void tcp_client_write(struct async_tcp_client_t *self_p,
+                             const void *buf_p,
+                             size_t size)
+{
+    connection_write(&tcp_client(self_p)->connection, buf_p, size);
+}
+
+static bool tcp_client_is_writable(struct async_tcp_client_t *self_p)
+{
+    return (!tcp_client(self_p)->connection.output.blocked);
+}
+
+static size_t tcp_client_read(struct async_tcp_client_t *self_p,
+                              void *buf_p,
+                              size_t size)
+{
+    return (connection_read(&tcp_client(self_p)->connection, buf_p, size));
+}
+
+static size_t tcp_client_borrow(struct async_tcp_client_t *self_p,
+                                const uint8_t **buf_pp)
+{
+    return (connection_borrow(&tcp_client(self_p)->connection, buf_pp));
+}
+
+static void tcp_client_release(struct async_tcp_client_t *self_p, size_t size)
+{
+    connection_release(&tcp_client(self_p)->connection, size);
+}
+
+static void tcp_server_init(struct async_tcp_server_t *self_p,
+                            const char *host_p,
+                            int port,
+                            async_tcp_server_client_connected_t on_connected,
+                            async_tcp_server_client_disconnected_t on_disconnected,
+                            async_tcp_server_client_input_t on_input)
+{
+    struct tcp_server_t *rself_p;
+
+    rself_p = malloc(sizeof(*rself_p));
+
+    if (rself_p == NULL) {
+        async_utils_linux_fatal_perror("tcp server malloc");
+    }
+
+    rself_p->runtime_p = self_p->async_p->runtime_p->obj_p;
+    rself_p->server_p = self_p;
+    memset(&rself_p->addr, 0, sizeof(rself_p->addr));
+    rself_p->addr.sin_family = AF_INET;
+    rself_p->addr.sin_port = htons(port);
+
+    if (inet_aton(host_p, &rself_p->addr.sin_addr) == 0) {
+        rself_p->addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    }
+
+    rself_p->listener = -1;
+    rself_p->handler.func = (epoll_func_t)handle_tcp_server;
+    rself_p->handler.arg_p = self_p;
+    rself_p->on_connected = on_connected;
+    rself_p->on_disconnected = on_disconnected;
+    rself_p->on_input = on_input;
+    self_p->clients.used_p = NULL;
+    self_p->clients.free_p = NULL;
+    self_p->obj_p = rself_p;
+}
+
+static void tcp_server_add_client(struct async_tcp_server_t *self_p,
+                                  struct async_tcp_server_client_t *client_p)
+{
+    struct tcp_server_client_t *rclient_p;
+
+    rclient_p = malloc(sizeof(*rclient_p));
+
+    if (rclient_p == NULL) {
+        async_utils_linux_fatal_perror("tcp server client malloc");
+    }
+
+    connection_init(&rclient_p->connection,
+                    tcp_server(self_p)->runtime_p,
+                    client_p,
+                    (connection_input_t)tcp_server(self_p)->on_input,
+                    tcp_server_client_on_closed,
+                    NULL,
+                    &server_client_low_watermark,
+                    &server_client_high_watermark);
+    client_p->obj_p = rclient_p;
+    server_client_list_push(&self_p->clients.free_p, client_p);
+}
+
+static int tcp_server_start(struct async_tcp_server_t *self_p)
+{
+    struct tcp_server_t *rself_p;
+    int listener;
+    int yes;
+
+    rself_p = tcp_server(self_p);
+
+    if (rself_p->listener != -1) {
+        return (-1);
+    }
+
+    listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (listener == -1) {
+        return (-1);
+    }
+
+    yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    if ((self_p->reuse_port
+         && (setsockopt(listener,
+                        SOL_SOCKET,
+                        SO_REUSEPORT,
+                        &yes,
+                        sizeof(yes)) != 0))
+        || (bind(listener,
+                 (struct sockaddr *)&rself_p->addr,
+                 sizeof(rself_p->addr)) != 0)
+        || (listen(listener, self_p->backlog) != 0)) {
+        close(listener);
+
+        return (-1);
+    }
+
+    /* Prefer this listener for connections handled by the kernel on
+       the same CPU, among listeners on the same port. */
+    if (rself_p->runtime_p->cpu != -1) {
+        setsockopt(listener,
+                   SOL_SOCKET,
+                   SO_INCOMING_CPU,
+                   &rself_p->runtime_p->cpu,
+                   sizeof(rself_p->runtime_p->cpu));
+    }
+
+    rself_p->listener = listener;
+    epoll_add(rself_p->runtime_p, listener, EPOLLIN, &rself_p->handler);
+
+    return (0);
+}
+
+static void tcp_server_client_disconnect(struct async_tcp_server_client_t *self_p)
+{
+    struct connection_t *connection_p;
+    struct async_tcp_server_t *server_p;
+
+    connection_p = tcp_server_client(self_p);
+
+    /* Not connected, unless a failed write is not yet reported. */
+    if ((connection_p->sockfd == -1) && !connection_p->failed) {
+        return;
+    }
+
+    server_p = self_p->server_p;
+    server_client_list_remove(&server_p->clients.used_p, self_p);
+    server_client_list_push(&server_p->clients.free_p, self_p);
+    connection_close(connection_p);
+}
+
+static void tcp_server_stop(struct async_tcp_server_t *self_p)
+{
+    struct tcp_server_t *rself_p;
+
+    rself_p = tcp_server(self_p);
+
+    if (rself_p->listener == -1) {
+        return;
+    }
+
+    epoll_ctl(rself_p->runtime_p->epoll_fd,
+              EPOLL_CTL_DEL,
+              rself_p->listener,
+              NULL);
+    close(rself_p->listener);
+    rself_p->listener = -1;
+
+    while (self_p->clients.used_p != NULL) {
+        tcp_server_client_disconnect(self_p->clients.used_p);
+    }
+}
+
+static void tcp_server_client_write(struct async_tcp_server_client_t *self_p,
+                                    const void *buf_p,
+                                    size_t size)
+{
+    connection_write(tcp_server_client(self_p), buf_p, size);
+}
+
+static size_t tcp_server_client_read(struct async_tcp_server_client_t *self_p,
+                                     void *buf_p,
+                                     size_t size)
+{
+    return (connection_read(tcp_server_client(self_p), buf_p, size));
+}
+
+static size_t tcp_server_client_borrow(struct async_tcp_server_client_t *self_p,
+                                       const uint8_t **buf_pp)
+{
+    return (connection_borrow(tcp_server_client(self_p), buf_pp));
+}
+
+static void tcp_server_client_release(struct async_tcp_server_client_t *self_p,
+                                      size_t size)
+{
+    connection_release(tcp_server_client(self_p), size);
+}
+
+static int init(struct async_runtime_linux_st_t *self_p)
+{
+    struct async_runtime_t *runtime_p;
+
+    runtime_p = &self_p->runtime;
+    runtime_p->set_async = (async_runtime_set_async_t)set_async;
+    runtime_p->call_threadsafe = (async_runtime_call_threadsafe_t)call_threadsafe;
+    runtime_p->call_worker_pool = (async_runtime_call_worker_pool_t)call_worker_pool;
+    runtime_p->run_forever = (async_runtime_run_forever_t)run_forever;
+    runtime_p->tcp_client.init = tcp_client_init;
+    runtime_p->tcp_client.connect = tcp_client_connect;
+    runtime_p->tcp_client.disconnect = tcp_client_disconnect;
+    runtime_p->tcp_client.write = tcp_client_write;
+    runtime_p->tcp_client.writev = tcp_client_writev;
+    runtime_p->tcp_client.is_writable = tcp_client_is_writable;
+    runtime_p->tcp_client.read = tcp_client_read;
+    runtime_p->tcp_client.borrow = tcp_client_borrow;
+    runtime_p->tcp_client.release = tcp_client_release;
+    runtime_p->tcp_server.init = tcp_server_init;
+    runtime_p->tcp_server.add_client = tcp_server_add_client;
+    runtime_p->tcp_server.start = tcp_server_start;
+    runtime_p->tcp_server.stop = tcp_server_stop;
+    runtime_p->tcp_server.client.write = tcp_server_client_write;
+    runtime_p->tcp_server.client.read = tcp_server_client_read;
+    runtime_p->tcp_server.client.borrow = tcp_server_client_borrow;
+    runtime_p->tcp_server.client.release = tcp_server_client_release;
+    runtime_p->tcp_server.client.disconnect = tcp_server_client_disconnect;
+
+    self_p->epoll_fd = epoll_create1(0);
+
+    if (self_p->epoll_fd == -1) {
+        return (-1);
+    }
+
+    if (async_runtime_timer_init(&self_p->timer) != 0) {
+        close(self_p->epoll_fd);
+
+        return (-1);
+    }
+
+    self_p->timer_handler.func = handle_timer;
+    self_p->timer_handler.arg_p = NULL;
+    epoll_add(self_p, self_p->timer.fd, EPOLLIN, &self_p->timer_handler);
+    self_p->event_fd = eventfd(0, EFD_NONBLOCK);
+
+    if (self_p->event_fd == -1) {
+        close(self_p->timer.fd);
+        close(self_p->epoll_fd);
+
+        return (-1);
+    }
+
+    self_p->event_handler.func = handle_event;
+    self_p->event_handler.arg_p = NULL;
+    epoll_add(self_p, self_p->event_fd, EPOLLIN, &self_p->event_handler);
+
+    if (async_calls_init(&self_p->calls,
+                         CALL_THREADSAFE_RING_LENGTH,
+                         (async_calls_wakeup_t)call_wakeup,
+                         self_p) != 0) {
+        close(self_p->event_fd);
+        close(self_p->timer.fd);
+        close(self_p->epoll_fd);
+
+        return (-1);
+    }
+
+    async_resolver_init(&self_p->resolver);
+    async_input_pool_init(&self_p->input_pool);
+    self_p->cpu = -1;
+    runtime_p->obj_p = self_p;
+
+    return (0);
+}
+
+struct async_runtime_t *async_runtime_linux_st_create()
+{
+    struct async_runtime_linux_st_t *self_p;
+    int res;
+
+    self_p = malloc(sizeof(*self_p));
+
+    if (self_p == NULL) {
+        return (NULL);
+    }
+
+    res = init(self_p);
+
+    if (res != 0) {
+        free(self_p);
+
+        return (NULL);
+    }
+
+    return (&self_p->runtime);
+}
+
+void async_runtime_linux_st_destroy(struct async_runtime_t *runtime_p)
+{
+    struct async_runtime_linux_st_t *self_p;
+
+    self_p = runtime_p->obj_p;
+    async_calls_destroy(&self_p->calls);
+    close(self_p->event_fd);
+    close(self_p->timer.fd);
+    close(self_p->epoll_fd);
+    free(self_p);
+}
+
+void async_runtime_linux_st_set_cpu(struct async_runtime_t *runtime_p, int cpu)
+{
+    ((struct async_runtime_linux_st_t *)(runtime_p->obj_p))->cpu = cpu;
+}
+
+struct async_resolver_t *async_runtime_linux_st_get_resolver(
+    struct async_runtime_t *runtime_p)
+{
+    struct async_runtime_linux_st_t *self_p;
+
+    self_p = runtime_p->obj_p;
+
+    return (&self_p->resolver);
+}
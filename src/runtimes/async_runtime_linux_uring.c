@@ -0,0 +1,1721 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+/*
+ * A single threaded Linux runtime built on io_uring. All sockets are
+ * serviced by operations submitted in batches, one io_uring_enter()
+ * call per loop iteration, which also waits for the earliest timer
+ * deadline. Accept and receive are multishot operations, receiving
+ * into a ring of provided buffers shared by all connections.
+ */
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "async.h"
+#include "async/runtimes/linux.h"
+#include "async/utils/linux.h"
+#include "internal.h"
+
+/* Maximum number of queued threadsafe calls. A power of two. */
+#define CALL_THREADSAFE_RING_LENGTH                     1024
+
+/* Number of submission and completion queue entries. */
+#define SQ_ENTRIES                                      256
+#define CQ_ENTRIES                                      4096
+
+/* Receive buffers shared by all connections. A power of two. */
+#define RECV_BUFFERS                                    256
+#define RECV_BUFFER_SIZE                                4096
+#define RECV_BUFFER_GROUP                               0
+
+/* Operation kinds, stored in the low bits of the user data. */
+#define OP_EVENT                                        0
+#define OP_CONNECT                                      1
+#define OP_RECV                                         2
+#define OP_SEND                                         3
+#define OP_CANCEL                                       4
+#define OP_ACCEPT                                       5
+#define OP_ACCEPT_CANCEL                                6
+#define OP_CONNECT_TIMEOUT                              7
+#define OP_MASK                                         7
+
+struct async_runtime_linux_uring_t;
+struct connection_t;
+
+typedef void (*connection_func_t)(struct connection_t *self_p);
+
+typedef void (*connection_input_t)(void *owner_p);
+
+struct recv_buffer_t {
+    /* Next received buffer of the same connection, or -1. */
+    int next;
+    size_t size;
+    size_t offset;
+};
+
+struct output_t {
+    uint8_t *buf_p;
+    size_t size;
+    size_t capacity;
+};
+
+/**
+ * A socket shared by TCP clients and TCP server clients. Once closed,
+ * the socket is not released until all its submitted operations have
+ * completed.
+ */
+struct connection_t {
+    struct async_runtime_linux_uring_t *runtime_p;
+    void *owner_p;
+    int sockfd;
+    /* Number of submitted operations not yet completed. */
+    int pending;
+    bool connected;
+    bool closing;
+    struct {
+        int head;
+        int tail;
+        /* Total number of consumed bytes. */
+        size_t consumed;
+    } input;
+    /* Written data waiting for the send in progress. */
+    struct output_t output;
+    struct output_t sending;
+    size_t sent;
+    bool flush_queued;
+    struct connection_t *flush_next_p;
+    bool starved;
+    struct connection_t *starved_next_p;
+    connection_input_t on_input;
+    /* Called when closed by the remote end or by an error. */
+    connection_func_t on_closed;
+    /* Called when the socket has been released. */
+    connection_func_t on_released;
+    /* Called when a send completed, if set. */
+    connection_func_t on_sent;
+};
+
+struct async_runtime_linux_uring_t {
+    struct async_runtime_t runtime;
+    int ring_fd;
+    bool enabled;
+    struct {
+        unsigned *head_p;
+        unsigned *tail_p;
+        unsigned mask;
+        unsigned entries;
+        unsigned tail;
+        struct io_uring_sqe *sqes_p;
+    } sq;
+    struct {
+        unsigned *head_p;
+        unsigned *tail_p;
+        unsigned mask;
+        struct io_uring_cqe *cqes_p;
+    } cq;
+    struct {
+        struct io_uring_buf_ring *ring_p;
+        uint8_t *bufs_p;
+        struct recv_buffer_t buffers[RECV_BUFFERS];
+        uint16_t tail;
+        int used;
+    } recv;
+    struct connection_t *flush_p;
+    struct connection_t *starved_p;
+    struct async_runtime_timer_t timer;
+    int event_fd;
+    uint64_t event_value;
+    struct async_calls_t calls;
+    struct async_resolver_t resolver;
+    struct async_t *async_p;
+};
+
+struct tcp_client_t {
+    struct connection_t connection;
+    async_tcp_client_connected_t on_connected;
+    async_tcp_client_disconnected_t on_disconnected;
+    /* Addresses of the host, connected to in order until one
+       succeeds. */
+    struct async_resolver_result_t result;
+    int address_index;
+    struct __kernel_timespec connect_timeout;
+    unsigned int connect_id;
+    bool resolving;
+    /* Connect once the previous socket has been released. */
+    bool connect_pending;
+    /* Above the high watermark and not yet drained to the low. */
+    bool blocked;
+};
+
+struct tcp_server_t {
+    struct async_runtime_linux_uring_t *runtime_p;
+    struct async_tcp_server_t *server_p;
+    struct sockaddr_in addr;
+    int listener;
+    int pending;
+    bool stopping;
+    async_tcp_server_client_connected_t on_connected;
+    async_tcp_server_client_disconnected_t on_disconnected;
+    async_tcp_server_client_input_t on_input;
+};
+
+struct tcp_server_client_t {
+    struct connection_t connection;
+};
+
+static uint64_t user_data(void *obj_p, int op)
+{
+    return ((uint64_t)(uintptr_t)obj_p | (uint64_t)op);
+}
+
+static int ring_setup(unsigned entries, struct io_uring_params *params_p)
+{
+    return ((int)syscall(__NR_io_uring_setup, entries, params_p));
+}
+
+static int ring_enter(struct async_runtime_linux_uring_t *self_p,
+                      unsigned to_submit,
+                      unsigned min_complete,
+                      unsigned flags,
+                      void *arg_p,
+                      size_t size)
+{
+    return ((int)syscall(__NR_io_uring_enter,
+                         self_p->ring_fd,
+                         to_submit,
+                         min_complete,
+                         flags,
+                         arg_p,
+                         size));
+}
+
+static int ring_register(struct async_runtime_linux_uring_t *self_p,
+                         unsigned opcode,
+                         void *arg_p,
+                         unsigned nr_args)
+{
+    return ((int)syscall(__NR_io_uring_register,
+                         self_p->ring_fd,
+                         opcode,
+                         arg_p,
+                         nr_args));
+}
+
+/**
+ * The ring is created disabled, and enabled by the thread that first
+ * submits operations, which then is the only thread allowed to do so.
+ */
+static void ring_enable(struct async_runtime_linux_uring_t *self_p)
+{
+    if (self_p->enabled) {
+        return;
+    }
+
+    if (ring_register(self_p, IORING_REGISTER_ENABLE_RINGS, NULL, 0) != 0) {
+        async_utils_linux_fatal_perror("io_uring enable");
+    }
+
+    self_p->enabled = true;
+}
+
+static unsigned sq_pending(struct async_runtime_linux_uring_t *self_p)
+{
+    return (self_p->sq.tail - __atomic_load_n(self_p->sq.head_p,
+                                              __ATOMIC_ACQUIRE));
+}
+
+/**
+ * Submit all prepared operations without waiting for completions.
+ */
+static void submit(struct async_runtime_linux_uring_t *self_p)
+{
+    int res;
+
+    ring_enable(self_p);
+    __atomic_store_n(self_p->sq.tail_p, self_p->sq.tail, __ATOMIC_RELEASE);
+
+    while (sq_pending(self_p) > 0) {
+        res = ring_enter(self_p, sq_pending(self_p), 0, 0, NULL, 0);
+
+        if ((res == -1) && (errno != EINTR) && (errno != EBUSY)) {
+            async_utils_linux_fatal_perror("io_uring_enter");
+        }
+    }
+}
+
+/**
+ * Submit all prepared operations and wait for at least one completion
+ * or the timer deadline.
+ */
+static void submit_and_wait(struct async_runtime_linux_uring_t *self_p)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec timeout;
+    struct timespec remaining;
+    unsigned min_complete;
+    int res;
+
+    ring_enable(self_p);
+    __atomic_store_n(self_p->sq.tail_p, self_p->sq.tail, __ATOMIC_RELEASE);
+    memset(&arg, 0, sizeof(arg));
+
+    if (async_runtime_timer_remaining(&self_p->timer, &remaining)) {
+        timeout.tv_sec = remaining.tv_sec;
+        timeout.tv_nsec = remaining.tv_nsec;
+        arg.ts = (uint64_t)(uintptr_t)&timeout;
+    }
+
+    if ((*self_p->cq.head_p != __atomic_load_n(self_p->cq.tail_p,
+                                                __ATOMIC_ACQUIRE))
+        || async_has_pending_calls(self_p->async_p)) {
+        min_complete = 0;
+    } else {
+        min_complete = 1;
+    }
+
+    res = ring_enter(self_p,
+                     sq_pending(self_p),
+                     min_complete,
+                     IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                     &arg,
+                     sizeof(arg));
+
+    if (res == -1) {
+        if ((errno != EINTR) && (errno != ETIME) && (errno != EBUSY)) {
+            async_utils_linux_fatal_perror("io_uring_enter");
+        }
+    }
+}
+
+/**
+ * Make room for given number of submission queue entries, so that
+ * linked operations are submitted together.
+ */
+static void sqe_reserve(struct async_runtime_linux_uring_t *self_p,
+                        unsigned count)
+{
+    if (sq_pending(self_p) + count > self_p->sq.entries) {
+        submit(self_p);
+    }
+}
+
+/**
+ * Get a zeroed submission queue entry. Submits prepared operations if
+ * the queue is full.
+ */
+static struct io_uring_sqe *sqe_get(struct async_runtime_linux_uring_t *self_p)
+{
+    struct io_uring_sqe *sqe_p;
+
+    sqe_reserve(self_p, 1);
+
+    sqe_p = &self_p->sq.sqes_p[self_p->sq.tail & self_p->sq.mask];
+    memset(sqe_p, 0, sizeof(*sqe_p));
+    self_p->sq.tail++;
+
+    return (sqe_p);
+}
+
+static void prep_event_read(struct async_runtime_linux_uring_t *self_p)
+{
+    struct io_uring_sqe *sqe_p;
+
+    sqe_p = sqe_get(self_p);
+    sqe_p->opcode = IORING_OP_READ;
+    sqe_p->fd = self_p->event_fd;
+    sqe_p->addr = (uint64_t)(uintptr_t)&self_p->event_value;
+    sqe_p->len = sizeof(self_p->event_value);
+    sqe_p->off = (uint64_t)-1;
+    sqe_p->user_data = user_data(self_p, OP_EVENT);
+}
+
+static void prep_recv(struct connection_t *self_p)
+{
+    struct io_uring_sqe *sqe_p;
+
+    sqe_p = sqe_get(self_p->runtime_p);
+    sqe_p->opcode = IORING_OP_RECV;
+    sqe_p->fd = self_p->sockfd;
+    sqe_p->ioprio = IORING_RECV_MULTISHOT;
+    sqe_p->flags = IOSQE_BUFFER_SELECT;
+    sqe_p->buf_group = RECV_BUFFER_GROUP;
+    sqe_p->user_data = user_data(self_p, OP_RECV);
+    self_p->pending++;
+}
+
+static void prep_send(struct connection_t *self_p)
+{
+    struct io_uring_sqe *sqe_p;
+
+    sqe_p = sqe_get(self_p->runtime_p);
+    sqe_p->opcode = IORING_OP_SEND;
+    sqe_p->fd = self_p->sockfd;
+    sqe_p->addr = (uint64_t)(uintptr_t)&self_p->sending.buf_p[self_p->sent];
+    sqe_p->len = (self_p->sending.size - self_p->sent);
+    sqe_p->msg_flags = MSG_NOSIGNAL;
+    sqe_p->user_data = user_data(self_p, OP_SEND);
+    self_p->pending++;
+}
+
+static void prep_cancel(struct async_runtime_linux_uring_t *self_p,
+                        int fd,
+                        uint64_t data)
+{
+    struct io_uring_sqe *sqe_p;
+
+    sqe_p = sqe_get(self_p);
+    sqe_p->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe_p->fd = fd;
+    sqe_p->cancel_flags = (IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL);
+    sqe_p->user_data = data;
+}
+
+/**
+ * Give given buffer back to the kernel.
+ */
+static void recv_buffer_put(struct async_runtime_linux_uring_t *self_p,
+                            int index)
+{
+    struct io_uring_buf *buf_p;
+
+    buf_p = &self_p->recv.ring_p->bufs[self_p->recv.tail & (RECV_BUFFERS - 1)];
+    buf_p->addr = (uint64_t)(uintptr_t)&self_p->recv.bufs_p[
+        index * RECV_BUFFER_SIZE];
+    buf_p->len = RECV_BUFFER_SIZE;
+    buf_p->bid = index;
+    self_p->recv.tail++;
+    __atomic_store_n(&self_p->recv.ring_p->tail,
+                     self_p->recv.tail,
+                     __ATOMIC_RELEASE);
+    self_p->recv.used--;
+}
+
+static void connection_init(struct connection_t *self_p,
+                            struct async_runtime_linux_uring_t *runtime_p,
+                            void *owner_p,
+                            connection_input_t on_input,
+                            connection_func_t on_closed,
+                            connection_func_t on_released)
+{
+    memset(self_p, 0, sizeof(*self_p));
+    self_p->runtime_p = runtime_p;
+    self_p->owner_p = owner_p;
+    self_p->sockfd = -1;
+    self_p->input.head = -1;
+    self_p->input.tail = -1;
+    self_p->input.consumed = 0;
+    self_p->on_input = on_input;
+    self_p->on_closed = on_closed;
+    self_p->on_released = on_released;
+}
+
+static void connection_flush_queue(struct connection_t *self_p)
+{
+    if (self_p->flush_queued) {
+        return;
+    }
+
+    self_p->flush_queued = true;
+    self_p->flush_next_p = self_p->runtime_p->flush_p;
+    self_p->runtime_p->flush_p = self_p;
+}
+
+/**
+ * Start sending written data, unless a send is already in progress.
+ */
+static void connection_flush(struct connection_t *self_p)
+{
+    struct output_t output;
+
+    if (!self_p->connected
+        || self_p->closing
+        || (self_p->sending.size > 0)
+        || (self_p->output.size == 0)) {
+        return;
+    }
+
+    output = self_p->sending;
+    self_p->sending = self_p->output;
+    self_p->output = output;
+    self_p->output.size = 0;
+    self_p->sent = 0;
+    prep_send(self_p);
+}
+
+static void connection_start(struct connection_t *self_p)
+{
+    self_p->connected = true;
+
+    /* A starved connection receives once buffers are available. */
+    if (!self_p->starved) {
+        prep_recv(self_p);
+    }
+
+    connection_flush_queue(self_p);
+}
+
+static void connection_release(struct connection_t *self_p)
+{
+    close(self_p->sockfd);
+    self_p->sockfd = -1;
+    self_p->closing = false;
+    self_p->sending.size = 0;
+    self_p->on_released(self_p);
+}
+
+/**
+ * Close the socket once all submitted operations have completed.
+ */
+static void connection_close(struct connection_t *self_p)
+{
+    struct async_runtime_linux_uring_t *runtime_p;
+    int index;
+
+    if ((self_p->sockfd == -1) || self_p->closing) {
+        return;
+    }
+
+    runtime_p = self_p->runtime_p;
+    self_p->connected = false;
+    self_p->closing = true;
+    self_p->output.size = 0;
+
+    while (self_p->input.head != -1) {
+        index = self_p->input.head;
+        self_p->input.head = runtime_p->recv.buffers[index].next;
+        recv_buffer_put(runtime_p, index);
+    }
+
+    self_p->input.tail = -1;
+
+    if (self_p->pending == 0) {
+        connection_release(self_p);
+    } else {
+        prep_cancel(runtime_p,
+                    self_p->sockfd,
+                    user_data(self_p, OP_CANCEL));
+        self_p->pending++;
+    }
+}
+
+/**
+ * Released after on_closed, as a server client would otherwise be
+ * put in the free list before removed from the used list.
+ */
+static void connection_closed(struct connection_t *self_p)
+{
+    self_p->pending++;
+    connection_close(self_p);
+    self_p->on_closed(self_p);
+    self_p->pending--;
+
+    if (self_p->closing && (self_p->pending == 0)) {
+        connection_release(self_p);
+    }
+}
+
+static void connection_write(struct connection_t *self_p,
+                             const void *buf_p,
+                             size_t size)
+{
+    struct output_t *output_p;
+    size_t capacity;
+
+    if ((self_p->sockfd == -1) || self_p->closing) {
+        return;
+    }
+
+    output_p = &self_p->output;
+
+    if (output_p->size + size > output_p->capacity) {
+        capacity = (2 * output_p->capacity);
+
+        if (capacity < output_p->size + size) {
+            capacity = (output_p->size + size);
+        }
+
+        output_p->buf_p = realloc(output_p->buf_p, capacity);
+
+        if (output_p->buf_p == NULL) {
+            async_utils_linux_fatal_perror("output realloc");
+        }
+
+        output_p->capacity = capacity;
+    }
+
+    memcpy(&output_p->buf_p[output_p->size], buf_p, size);
+    output_p->size += size;
+    connection_flush_queue(self_p);
+}
+
+/**
+ * Borrow the unconsumed data of the first received buffer.
+ */
+static size_t connection_input_borrow(struct connection_t *self_p,
+                                      const uint8_t **buf_pp)
+{
+    struct async_runtime_linux_uring_t *runtime_p;
+    struct recv_buffer_t *buffer_p;
+    int index;
+
+    index = self_p->input.head;
+
+    if (index == -1) {
+        return (0);
+    }
+
+    runtime_p = self_p->runtime_p;
+    buffer_p = &runtime_p->recv.buffers[index];
+    *buf_pp = &runtime_p->recv.bufs_p[index * RECV_BUFFER_SIZE
+                                      + buffer_p->offset];
+
+    return (buffer_p->size - buffer_p->offset);
+}
+
+/**
+ * Consume given number of borrowed bytes, and give the buffer back
+ * to the kernel once all of it has been consumed.
+ */
+static void connection_input_release(struct connection_t *self_p, size_t size)
+{
+    struct async_runtime_linux_uring_t *runtime_p;
+    struct recv_buffer_t *buffer_p;
+    int index;
+
+    index = self_p->input.head;
+
+    if (index == -1) {
+        return;
+    }
+
+    runtime_p = self_p->runtime_p;
+    buffer_p = &runtime_p->recv.buffers[index];
+
+    if (size > (buffer_p->size - buffer_p->offset)) {
+        size = (buffer_p->size - buffer_p->offset);
+    }
+
+    buffer_p->offset += size;
+    self_p->input.consumed += size;
+
+    if (buffer_p->offset == buffer_p->size) {
+        self_p->input.head = buffer_p->next;
+
+        if (self_p->input.head == -1) {
+            self_p->input.tail = -1;
+        }
+
+        recv_buffer_put(runtime_p, index);
+    }
+}
+
+static size_t connection_read(struct connection_t *self_p,
+                              void *buf_p,
+                              size_t size)
+{
+    const uint8_t *chunk_p;
+    size_t left;
+    size_t chunk;
+
+    left = size;
+
+    while (left > 0) {
+        chunk = connection_input_borrow(self_p, &chunk_p);
+
+        if (chunk == 0) {
+            break;
+        }
+
+        if (chunk > left) {
+            chunk = left;
+        }
+
+        memcpy(buf_p, chunk_p, chunk);
+        connection_input_release(self_p, chunk);
+        buf_p = ((uint8_t *)buf_p + chunk);
+        left -= chunk;
+    }
+
+    return (size - left);
+}
+
+static void connection_append_input(struct connection_t *self_p,
+                                    int index,
+                                    size_t size)
+{
+    struct recv_buffer_t *buffers_p;
+
+    buffers_p = &self_p->runtime_p->recv.buffers[0];
+    buffers_p[index].next = -1;
+    buffers_p[index].size = size;
+    buffers_p[index].offset = 0;
+
+    if (self_p->input.tail == -1) {
+        self_p->input.head = index;
+    } else {
+        buffers_p[self_p->input.tail].next = index;
+    }
+
+    self_p->input.tail = index;
+}
+
+static void handle_recv(struct connection_t *self_p, int res, uint32_t flags)
+{
+    int index;
+    size_t consumed;
+
+    if (flags & IORING_CQE_F_BUFFER) {
+        index = (flags >> IORING_CQE_BUFFER_SHIFT);
+        self_p->runtime_p->recv.used++;
+
+        if (self_p->closing) {
+            recv_buffer_put(self_p->runtime_p, index);
+        } else {
+            connection_append_input(self_p, index, res);
+        }
+    }
+
+    if (self_p->closing) {
+        return;
+    }
+
+    if (res > 0) {
+        /* Call again while received data is consumed, as no more
+           may be received. */
+        do {
+            consumed = self_p->input.consumed;
+            self_p->on_input(self_p->owner_p);
+        } while (!self_p->closing
+                 && (self_p->input.head != -1)
+                 && (self_p->input.consumed != consumed));
+
+        if (!(flags & IORING_CQE_F_MORE) && !self_p->closing) {
+            prep_recv(self_p);
+        }
+    } else if (res == -ENOBUFS) {
+        /* Received again once buffers are given back. */
+        if (!self_p->starved) {
+            self_p->starved = true;
+            self_p->starved_next_p = self_p->runtime_p->starved_p;
+            self_p->runtime_p->starved_p = self_p;
+        }
+    } else {
+        connection_closed(self_p);
+    }
+}
+
+static void handle_send(struct connection_t *self_p, int res)
+{
+    if (self_p->closing) {
+        return;
+    }
+
+    if (res < 0) {
+        connection_closed(self_p);
+
+        return;
+    }
+
+    self_p->sent += res;
+
+    if (self_p->sent < self_p->sending.size) {
+        prep_send(self_p);
+    } else {
+        self_p->sending.size = 0;
+        self_p->sent = 0;
+        connection_flush(self_p);
+    }
+
+    if (self_p->on_sent != NULL) {
+        self_p->on_sent(self_p);
+    }
+}
+
+/**
+ * Number of written bytes not yet sent.
+ */
+static size_t connection_output_size(struct connection_t *self_p)
+{
+    return (self_p->output.size + self_p->sending.size - self_p->sent);
+}
+
+static struct tcp_client_t *tcp_client(struct async_tcp_client_t *self_p)
+{
+    return ((struct tcp_client_t *)(self_p->obj_p));
+}
+
+static void on_tcp_client_connect_failed(struct async_tcp_client_t *self_p,
+                                         void *arg_p)
+{
+    (void)arg_p;
+
+    tcp_client(self_p)->on_connected(self_p, -1);
+}
+
+/**
+ * Connect to the current address of the host, or the first following
+ * address a socket can be created for.
+ */
+static void tcp_client_start_connect(struct async_tcp_client_t *self_p)
+{
+    struct tcp_client_t *rself_p;
+    struct async_runtime_linux_uring_t *runtime_p;
+    struct async_resolver_address_t *address_p;
+    struct io_uring_sqe *sqe_p;
+    int sockfd;
+
+    rself_p = tcp_client(self_p);
+
+    while (true) {
+        address_p = &rself_p->result.addresses[rself_p->address_index];
+        sockfd = socket(address_p->addr.ss_family, SOCK_STREAM, 0);
+
+        if (sockfd != -1) {
+            break;
+        }
+
+        rself_p->address_index++;
+
+        if (rself_p->address_index == rself_p->result.length) {
+            async_call(self_p->async_p,
+                       (async_func_t)on_tcp_client_connect_failed,
+                       self_p,
+                       NULL);
+
+            return;
+        }
+    }
+
+    rself_p->connection.sockfd = sockfd;
+    runtime_p = rself_p->connection.runtime_p;
+    sqe_reserve(runtime_p, 2);
+    sqe_p = sqe_get(runtime_p);
+    sqe_p->opcode = IORING_OP_CONNECT;
+    sqe_p->fd = sockfd;
+    sqe_p->addr = (uint64_t)(uintptr_t)&address_p->addr;
+    sqe_p->off = address_p->size;
+    sqe_p->user_data = user_data(&rself_p->connection, OP_CONNECT);
+    rself_p->connection.pending++;
+
+    if (self_p->connect_timeout == 0) {
+        return;
+    }
+
+    /* The connect is cancelled if not completed in time. */
+    sqe_p->flags = IOSQE_IO_LINK;
+    rself_p->connect_timeout.tv_sec = (self_p->connect_timeout / 1000);
+    rself_p->connect_timeout.tv_nsec =
+        ((self_p->connect_timeout % 1000) * 1000000);
+    sqe_p = sqe_get(runtime_p);
+    sqe_p->opcode = IORING_OP_LINK_TIMEOUT;
+    sqe_p->fd = -1;
+    sqe_p->addr = (uint64_t)(uintptr_t)&rself_p->connect_timeout;
+    sqe_p->len = 1;
+    sqe_p->user_data = user_data(&rself_p->connection, OP_CONNECT_TIMEOUT);
+    rself_p->connection.pending++;
+}
+
+/**
+ * A failed or timed out connect is retried with the next address of
+ * the host, if any, once the socket has been released.
+ */
+static void handle_connect(struct connection_t *self_p, int res)
+{
+    struct async_tcp_client_t *tcp_p;
+    struct tcp_client_t *rself_p;
+
+    if (self_p->closing) {
+        return;
+    }
+
+    tcp_p = self_p->owner_p;
+    rself_p = tcp_client(tcp_p);
+
+    if (res != 0) {
+        if (rself_p->address_index + 1 < rself_p->result.length) {
+            rself_p->address_index++;
+            rself_p->connect_pending = true;
+            connection_close(self_p);
+        } else {
+            connection_close(self_p);
+            rself_p->on_connected(tcp_p, -1);
+        }
+    } else {
+        connection_start(self_p);
+        tcp_client(tcp_p)->on_connected(tcp_p, 0);
+    }
+}
+
+static void handle_connection(struct connection_t *self_p,
+                              int op,
+                              int res,
+                              uint32_t flags)
+{
+    if (!(flags & IORING_CQE_F_MORE)) {
+        self_p->pending--;
+    }
+
+    switch (op) {
+
+    case OP_CONNECT:
+        handle_connect(self_p, res);
+        break;
+
+    case OP_RECV:
+        handle_recv(self_p, res, flags);
+        break;
+
+    case OP_SEND:
+        handle_send(self_p, res);
+        break;
+
+    default:
+        break;
+    }
+
+    if (self_p->closing && (self_p->pending == 0)) {
+        connection_release(self_p);
+    }
+}
+
+static void server_client_list_remove(
+    struct async_tcp_server_client_t **list_pp,
+    struct async_tcp_server_client_t *client_p)
+{
+    if (client_p->prev_p != NULL) {
+        client_p->prev_p->next_p = client_p->next_p;
+    } else {
+        *list_pp = client_p->next_p;
+    }
+
+    if (client_p->next_p != NULL) {
+        client_p->next_p->prev_p = client_p->prev_p;
+    }
+
+    client_p->next_p = NULL;
+    client_p->prev_p = NULL;
+}
+
+static void server_client_list_push(struct async_tcp_server_client_t **list_pp,
+                                    struct async_tcp_server_client_t *client_p)
+{
+    client_p->prev_p = NULL;
+    client_p->next_p = *list_pp;
+
+    if (*list_pp != NULL) {
+        (*list_pp)->prev_p = client_p;
+    }
+
+    *list_pp = client_p;
+}
+
+static struct tcp_server_t *tcp_server(struct async_tcp_server_t *self_p)
+{
+    return ((struct tcp_server_t *)(self_p->obj_p));
+}
+
+static struct connection_t *tcp_server_client(
+    struct async_tcp_server_client_t *self_p)
+{
+    return ((struct connection_t *)(self_p->obj_p));
+}
+
+static void prep_accept(struct tcp_server_t *self_p)
+{
+    struct io_uring_sqe *sqe_p;
+
+    sqe_p = sqe_get(self_p->runtime_p);
+    sqe_p->opcode = IORING_OP_ACCEPT;
+    sqe_p->fd = self_p->listener;
+    sqe_p->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe_p->accept_flags = SOCK_CLOEXEC;
+    sqe_p->user_data = user_data(self_p, OP_ACCEPT);
+    self_p->pending++;
+}
+
+static void handle_accept(struct tcp_server_t *self_p, int res, uint32_t flags)
+{
+    struct async_tcp_server_t *server_p;
+    struct async_tcp_server_client_t *client_p;
+
+    if (!(flags & IORING_CQE_F_MORE)) {
+        self_p->pending--;
+    }
+
+    server_p = self_p->server_p;
+
+    if (res >= 0) {
+        client_p = server_p->clients.free_p;
+
+        if (self_p->stopping || (client_p == NULL)) {
+            close(res);
+        } else {
+            server_client_list_remove(&server_p->clients.free_p, client_p);
+            server_client_list_push(&server_p->clients.used_p, client_p);
+            tcp_server_client(client_p)->sockfd = res;
+            connection_start(tcp_server_client(client_p));
+            self_p->on_connected(client_p);
+        }
+    }
+
+    if (self_p->stopping) {
+        if (self_p->pending == 0) {
+            close(self_p->listener);
+            self_p->listener = -1;
+            self_p->stopping = false;
+        }
+    } else if (!(flags & IORING_CQE_F_MORE)) {
+        prep_accept(self_p);
+    }
+}
+
+static void handle_event(struct async_runtime_linux_uring_t *self_p)
+{
+    async_calls_process(&self_p->calls);
+    prep_event_read(self_p);
+}
+
+static void handle_completion(struct async_runtime_linux_uring_t *self_p,
+                              uint64_t data,
+                              int res,
+                              uint32_t flags)
+{
+    void *obj_p;
+    int op;
+
+    obj_p = (void *)(uintptr_t)(data & ~(uint64_t)OP_MASK);
+    op = (int)(data & OP_MASK);
+
+    switch (op) {
+
+    case OP_EVENT:
+        handle_event(self_p);
+        break;
+
+    case OP_ACCEPT:
+    case OP_ACCEPT_CANCEL:
+        handle_accept(obj_p, (op == OP_ACCEPT) ? res : -ECANCELED, flags);
+        break;
+
+    default:
+        handle_connection(obj_p, op, res, flags);
+        break;
+    }
+}
+
+/**
+ * Start sends and receives queued by callbacks.
+ */
+static void prepare(struct async_runtime_linux_uring_t *self_p)
+{
+    struct connection_t *connection_p;
+
+    while (self_p->flush_p != NULL) {
+        connection_p = self_p->flush_p;
+        self_p->flush_p = connection_p->flush_next_p;
+        connection_p->flush_queued = false;
+        connection_flush(connection_p);
+    }
+
+    while ((self_p->starved_p != NULL)
+           && (self_p->recv.used < RECV_BUFFERS)) {
+        connection_p = self_p->starved_p;
+        self_p->starved_p = connection_p->starved_next_p;
+        connection_p->starved = false;
+
+        if (connection_p->connected) {
+            prep_recv(connection_p);
+        }
+    }
+}
+
+static void process_completions(struct async_runtime_linux_uring_t *self_p)
+{
+    struct io_uring_cqe *cqe_p;
+    unsigned head;
+    unsigned tail;
+    uint64_t data;
+    int res;
+    uint32_t flags;
+
+    head = *self_p->cq.head_p;
+    tail = __atomic_load_n(self_p->cq.tail_p, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        cqe_p = &self_p->cq.cqes_p[head & self_p->cq.mask];
+        data = cqe_p->user_data;
+        res = cqe_p->res;
+        flags = cqe_p->flags;
+        head++;
+        __atomic_store_n(self_p->cq.head_p, head, __ATOMIC_RELEASE);
+        handle_completion(self_p, data, res, flags);
+    }
+}
+
+static void set_async(struct async_runtime_linux_uring_t *self_p,
+                      struct async_t *async_p)
+{
+    self_p->async_p = async_p;
+}
+
+static void call_wakeup(struct async_runtime_linux_uring_t *self_p)
+{
+    uint64_t value;
+    ssize_t size;
+
+    value = 1;
+    size = write(self_p->event_fd, &value, sizeof(value));
+    (void)size;
+}
+
+static void call_threadsafe(struct async_runtime_linux_uring_t *self_p,
+                            async_func_t func,
+                            void *obj_p,
+                            void *arg_p)
+{
+    async_calls_call_threadsafe(&self_p->calls, func, obj_p, arg_p);
+}
+
+static int call_worker_pool(struct async_runtime_linux_uring_t *self_p,
+                            async_func_t entry,
+                            void *obj_p,
+                            void *arg_p,
+                            async_func_t on_complete)
+{
+    return (async_calls_call_worker_pool(&self_p->calls,
+                                         self_p->async_p,
+                                         entry,
+                                         obj_p,
+                                         arg_p,
+                                         on_complete));
+}
+
+static void run_forever(struct async_runtime_linux_uring_t *self_p)
+{
+    prep_event_read(self_p);
+    async_process(self_p->async_p);
+    async_runtime_timer_start(&self_p->timer, self_p->async_p);
+
+    while (true) {
+        prepare(self_p);
+        submit_and_wait(self_p);
+        async_runtime_timer_advance(&self_p->timer, self_p->async_p);
+        process_completions(self_p);
+        async_process(self_p->async_p);
+        async_runtime_timer_update(&self_p->timer, self_p->async_p);
+    }
+}
+
+static void tcp_client_on_closed(struct connection_t *self_p)
+{
+    struct async_tcp_client_t *tcp_p;
+
+    tcp_p = self_p->owner_p;
+    tcp_client(tcp_p)->blocked = false;
+    tcp_client(tcp_p)->on_disconnected(tcp_p);
+}
+
+static void tcp_client_on_sent(struct connection_t *self_p)
+{
+    struct async_tcp_client_t *tcp_p;
+
+    tcp_p = self_p->owner_p;
+
+    if (tcp_client(tcp_p)->blocked
+        && (connection_output_size(self_p) <= tcp_p->output.low_watermark)) {
+        tcp_client(tcp_p)->blocked = false;
+        tcp_p->output.on_writable(tcp_p);
+    }
+}
+
+static void tcp_client_on_released(struct connection_t *self_p)
+{
+    struct async_tcp_client_t *tcp_p;
+
+    tcp_p = self_p->owner_p;
+
+    if (tcp_client(tcp_p)->connect_pending) {
+        tcp_client(tcp_p)->connect_pending = false;
+        tcp_client_start_connect(tcp_p);
+    }
+}
+
+static void tcp_client_init(struct async_tcp_client_t *self_p,
+                            async_tcp_client_connected_t on_connected,
+                            async_tcp_client_disconnected_t on_disconnected,
+                            async_tcp_client_input_t on_input)
+{
+    struct tcp_client_t *rself_p;
+
+    rself_p = malloc(sizeof(*rself_p));
+
+    if (rself_p == NULL) {
+        async_utils_linux_fatal_perror("tcp client malloc");
+    }
+
+    connection_init(&rself_p->connection,
+                    self_p->async_p->runtime_p->obj_p,
+                    self_p,
+                    (connection_input_t)on_input,
+                    tcp_client_on_closed,
+                    tcp_client_on_released);
+    rself_p->connection.on_sent = tcp_client_on_sent;
+    rself_p->on_connected = on_connected;
+    rself_p->on_disconnected = on_disconnected;
+    rself_p->connect_id = 0;
+    rself_p->result.length = 0;
+    rself_p->address_index = 0;
+    rself_p->resolving = false;
+    rself_p->connect_pending = false;
+    rself_p->blocked = false;
+    self_p->obj_p = rself_p;
+}
+
+/**
+ * Connect to the first address once resolved. The other addresses are
+ * tried in order if connecting fails. The connect timeout does not
+ * include the resolution, and applies to each address.
+ */
+static void on_tcp_client_resolved(
+    struct async_tcp_client_t *self_p,
+    void *arg_p,
+    const struct async_resolver_result_t *result_p)
+{
+    struct tcp_client_t *rself_p;
+
+    rself_p = tcp_client(self_p);
+
+    /* Disconnected or connecting again while resolving. */
+    if (!rself_p->resolving
+        || ((unsigned int)(uintptr_t)arg_p != rself_p->connect_id)) {
+        return;
+    }
+
+    rself_p->resolving = false;
+
+    if (result_p == NULL) {
+        async_call(self_p->async_p,
+                   (async_func_t)on_tcp_client_connect_failed,
+                   self_p,
+                   NULL);
+
+        return;
+    }
+
+    rself_p->result = *result_p;
+    rself_p->address_index = 0;
+
+    if (rself_p->connection.sockfd != -1) {
+        rself_p->connect_pending = true;
+    } else {
+        tcp_client_start_connect(self_p);
+    }
+}
+
+static void tcp_client_connect(struct async_tcp_client_t *self_p,
+                               const char *host_p,
+                               int port)
+{
+    struct tcp_client_t *rself_p;
+
+    rself_p = tcp_client(self_p);
+    connection_close(&rself_p->connection);
+    rself_p->connect_pending = false;
+    rself_p->blocked = false;
+    rself_p->resolving = true;
+    rself_p->connect_id++;
+    async_resolver_get(&rself_p->connection.runtime_p->resolver,
+                       self_p->async_p,
+                       host_p,
+                       port,
+                       (async_resolver_complete_t)on_tcp_client_resolved,
+                       self_p,
+                       (void *)(uintptr_t)rself_p->connect_id);
+}
+
+static void tcp_client_disconnect(struct async_tcp_client_t *self_p)
+{
+    tcp_client(self_p)->resolving = false;
+    tcp_client(self_p)->connect_pending = false;
+    tcp_client(self_p)->blocked = false;
+    connection_close(&tcp_client(self_p)->connection);
+}
+
+/**
+ * Written data is always copied to the output buffer, as sends
+ * complete after this function has returned.
+ */
+static void tcp_client_writev(struct async_tcp_client_t *self_p,
+                              const struct async_iovec_t *iov_p,
+                              int length)
+{
+    struct tcp_client_t *rself_p;
+    int i;
+
+    rself_p = tcp_client(self_p);
+
+    for (i = 0; i < length; i++) {
+        connection_write(&rself_p->connection, iov_p[i].buf_p, iov_p[i].size);
+    }
+
+    if (connection_output_size(&rself_p->connection)
+        > self_p->output.high_watermark) {
+        rself_p->blocked = true;
+    }
+}
+
+static void tcp_client_write(struct async_tcp_client_t *self_p,
+                             const void *buf_p,
+                             size_t size)
+{
+    struct async_iovec_t iov;
+
+    iov.buf_p = buf_p;
+    iov.size = size;
+    tcp_client_writev(self_p, &iov, 1);
+}
+
+static bool tcp_client_is_writable(struct async_tcp_client_t *self_p)
+{
+    return (!tcp_client(self_p)->blocked);
+}
+
+static size_t tcp_client_read(struct async_tcp_client_t *self_p,
+                              void *buf_p,
+                              size_t size)
+{
+    return (connection_read(&tcp_client(self_p)->connection, buf_p, size));
+}
+
+static size_t tcp_client_borrow(struct async_tcp_client_t *self_p,
+                                const uint8_t **buf_pp)
+{
+    return (connection_input_borrow(&tcp_client(self_p)->connection, buf_pp));
+}
+
+static void tcp_client_release(struct async_tcp_client_t *self_p, size_t size)
+{
+    connection_input_release(&tcp_client(self_p)->connection, size);
+}
+
+static void tcp_server_client_on_closed(struct connection_t *self_p)
+{
+    struct async_tcp_server_client_t *client_p;
+    struct async_tcp_server_t *server_p;
+
+    client_p = self_p->owner_p;
+    server_p = client_p->server_p;
+    server_client_list_remove(&server_p->clients.used_p, client_p);
+    tcp_server(server_p)->on_disconnected(client_p);
+}
+
+static void tcp_server_client_on_released(struct connection_t *self_p)
+{
+    struct async_tcp_server_client_t *client_p;
+
+    client_p = self_p->owner_p;
+    server_client_list_push(&client_p->server_p->clients.free_p, client_p);
+}
+
+static void tcp_server_init(struct async_tcp_server_t *self_p,
+                            const char *host_p,
+                            int port,
+                            async_tcp_server_client_connected_t on_connected,
+                            async_tcp_server_client_disconnected_t on_disconnected,
+                            async_tcp_server_client_input_t on_input)
+{
+    struct tcp_server_t *rself_p;
+
+    rself_p = malloc(sizeof(*rself_p));
+
+    if (rself_p == NULL) {
+        async_utils_linux_fatal_perror("tcp server malloc");
+    }
+
+    rself_p->runtime_p = self_p->async_p->runtime_p->obj_p;
+    rself_p->server_p = self_p;
+    memset(&rself_p->addr, 0, sizeof(rself_p->addr));
+    rself_p->addr.sin_family = AF_INET;
+    rself_p->addr.sin_port = htons(port);
+
+    if (inet_aton(host_p, &rself_p->addr.sin_addr) == 0) {
+        rself_p->addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    }
+
+    rself_p->listener = -1;
+    rself_p->pending = 0;
+    rself_p->stopping = false;
+    rself_p->on_connected = on_connected;
+    rself_p->on_disconnected = on_disconnected;
+    rself_p->on_input = on_input;
+    self_p->clients.used_p = NULL;
+    self_p->clients.free_p = NULL;
+    self_p->obj_p = rself_p;
+}
+
+static void tcp_server_add_client(struct async_tcp_server_t *self_p,
+                                  struct async_tcp_server_client_t *client_p)
+{
+    struct tcp_server_client_t *rclient_p;
+
+    rclient_p = malloc(sizeof(*rclient_p));
+
+    if (rclient_p == NULL) {
+        async_utils_linux_fatal_perror("tcp server client malloc");
+    }
+
+    connection_init(&rclient_p->connection,
+                    tcp_server(self_p)->runtime_p,
+                    client_p,
+                    (connection_input_t)tcp_server(self_p)->on_input,
+                    tcp_server_client_on_closed,
+                    tcp_server_client_on_released);
+    client_p->obj_p = rclient_p;
+    server_client_list_push(&self_p->clients.free_p, client_p);
+}
+
+static int tcp_server_start(struct async_tcp_server_t *self_p)
+{
+    struct tcp_server_t *rself_p;
+    int listener;
+    int yes;
+
+    rself_p = tcp_server(self_p);
+
+    if (rself_p->listener != -1) {
+        return (-1);
+    }
+
+    listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (listener == -1) {
+        return (-1);
+    }
+
+    yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    if ((self_p->reuse_port
+         && (setsockopt(listener,
+                        SOL_SOCKET,
+                        SO_REUSEPORT,
+                        &yes,
+                        sizeof(yes)) != 0))
+        || (bind(listener,
+                 (struct sockaddr *)&rself_p->addr,
+                 sizeof(rself_p->addr)) != 0)
+        || (listen(listener, self_p->backlog) != 0)) {
+        close(listener);
+
+        return (-1);
+    }
+
+    rself_p->listener = listener;
+    prep_accept(rself_p);
+
+    return (0);
+}
+
+static void tcp_server_client_disconnect(struct async_tcp_server_client_t *self_p)
+{
+    struct connection_t *connection_p;
+
+    connection_p = tcp_server_client(self_p);
+
+    if ((connection_p->sockfd == -1) || connection_p->closing) {
+        return;
+    }
+
+    server_client_list_remove(&self_p->server_p->clients.used_p, self_p);
+    connection_close(connection_p);
+}
+
+static void tcp_server_stop(struct async_tcp_server_t *self_p)
+{
+    struct tcp_server_t *rself_p;
+
+    rself_p = tcp_server(self_p);
+
+    if ((rself_p->listener == -1) || rself_p->stopping) {
+        return;
+    }
+
+    rself_p->stopping = true;
+    prep_cancel(rself_p->runtime_p,
+                rself_p->listener,
+                user_data(rself_p, OP_ACCEPT_CANCEL));
+    rself_p->pending++;
+
+    while (self_p->clients.used_p != NULL) {
+        tcp_server_client_disconnect(self_p->clients.used_p);
+    }
+}
+
+static void tcp_server_client_write(struct async_tcp_server_client_t *self_p,
+                                    const void *buf_p,
+                                    size_t size)
+{
+    connection_write(tcp_server_client(self_p), buf_p, size);
+}
+
+static size_t tcp_server_client_read(struct async_tcp_server_client_t *self_p,
+                                     void *buf_p,
+                                     size_t size)
+{
+    return (connection_read(tcp_server_client(self_p), buf_p, size));
+}
+
+static size_t tcp_server_client_borrow(struct async_tcp_server_client_t *self_p,
+                                       const uint8_t **buf_pp)
+{
+    return (connection_input_borrow(tcp_server_client(self_p), buf_pp));
+}
+
+static void tcp_server_client_release(struct async_tcp_server_client_t *self_p,
+                                      size_t size)
+{
+    connection_input_release(tcp_server_client(self_p), size);
+}
+
+static int ring_init(struct async_runtime_linux_uring_t *self_p)
+{
+    struct io_uring_params params;
+    uint8_t *ring_p;
+    size_t sq_size;
+    size_t cq_size;
+    unsigned *array_p;
+    unsigned i;
+
+    memset(&params, 0, sizeof(params));
+    params.flags = (IORING_SETUP_CQSIZE
+                    | IORING_SETUP_SUBMIT_ALL
+                    | IORING_SETUP_R_DISABLED
+                    | IORING_SETUP_SINGLE_ISSUER
+                    | IORING_SETUP_DEFER_TASKRUN);
+    params.cq_entries = CQ_ENTRIES;
+    self_p->ring_fd = ring_setup(SQ_ENTRIES, &params);
+
+    if (self_p->ring_fd == -1) {
+        return (-1);
+    }
+
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)
+        || !(params.features & IORING_FEAT_NODROP)
+        || !(params.features & IORING_FEAT_EXT_ARG)) {
+        return (-1);
+    }
+
+    sq_size = (params.sq_off.array + params.sq_entries * sizeof(unsigned));
+    cq_size = (params.cq_off.cqes
+               + params.cq_entries * sizeof(struct io_uring_cqe));
+
+    if (cq_size > sq_size) {
+        sq_size = cq_size;
+    }
+
+    ring_p = mmap(NULL,
+                  sq_size,
+                  PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE,
+                  self_p->ring_fd,
+                  IORING_OFF_SQ_RING);
+
+    if (ring_p == MAP_FAILED) {
+        return (-1);
+    }
+
+    self_p->sq.sqes_p = mmap(NULL,
+                             params.sq_entries * sizeof(struct io_uring_sqe),
+                             PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE,
+                             self_p->ring_fd,
+                             IORING_OFF_SQES);
+
+    if (self_p->sq.sqes_p == MAP_FAILED) {
+        return (-1);
+    }
+
+    self_p->enabled = false;
+    self_p->sq.head_p = (unsigned *)&ring_p[params.sq_off.head];
+    self_p->sq.tail_p = (unsigned *)&ring_p[params.sq_off.tail];
+    self_p->sq.mask = *(unsigned *)&ring_p[params.sq_off.ring_mask];
+    self_p->sq.entries = params.sq_entries;
+    self_p->sq.tail = *self_p->sq.tail_p;
+    self_p->cq.head_p = (unsigned *)&ring_p[params.cq_off.head];
+    self_p->cq.tail_p = (unsigned *)&ring_p[params.cq_off.tail];
+    self_p->cq.mask = *(unsigned *)&ring_p[params.cq_off.ring_mask];
+    self_p->cq.cqes_p = (struct io_uring_cqe *)&ring_p[params.cq_off.cqes];
+
+    /* Entries are always submitted in order. */
+    array_p = (unsigned *)&ring_p[params.sq_off.array];
+
+    for (i = 0; i < params.sq_entries; i++) {
+        array_p[i] = i;
+    }
+
+    return (0);
+}
+
+static int recv_init(struct async_runtime_linux_uring_t *self_p)
+{
+    struct io_uring_buf_reg reg;
+    int i;
+
+    self_p->recv.ring_p = mmap(NULL,
+                               RECV_BUFFERS * sizeof(struct io_uring_buf),
+                               PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS,
+                               -1,
+                               0);
+
+    if (self_p->recv.ring_p == MAP_FAILED) {
+        return (-1);
+    }
+
+    self_p->recv.bufs_p = malloc(RECV_BUFFERS * RECV_BUFFER_SIZE);
+
+    if (self_p->recv.bufs_p == NULL) {
+        return (-1);
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)self_p->recv.ring_p;
+    reg.ring_entries = RECV_BUFFERS;
+    reg.bgid = RECV_BUFFER_GROUP;
+
+    if (ring_register(self_p, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        return (-1);
+    }
+
+    self_p->recv.tail = 0;
+    self_p->recv.used = RECV_BUFFERS;
+
+    for (i = 0; i < RECV_BUFFERS; i++) {
+        recv_buffer_put(self_p, i);
+    }
+
+    return (0);
+}
+
+static int init(struct async_runtime_linux_uring_t *self_p)
+{
+    struct async_runtime_t *runtime_p;
+
+    runtime_p = &self_p->runtime;
+    runtime_p->set_async = (async_runtime_set_async_t)set_async;
+    runtime_p->call_threadsafe = (async_runtime_call_threadsafe_t)call_threadsafe;
+    runtime_p->call_worker_pool = (async_runtime_call_worker_pool_t)call_worker_pool;
+    runtime_p->run_forever = (async_runtime_run_forever_t)run_forever;
+    runtime_p->tcp_client.init = tcp_client_init;
+    runtime_p->tcp_client.connect = tcp_client_connect;
+    runtime_p->tcp_client.disconnect = tcp_client_disconnect;
+    runtime_p->tcp_client.write = tcp_client_write;
+    runtime_p->tcp_client.writev = tcp_client_writev;
+    runtime_p->tcp_client.is_writable = tcp_client_is_writable;
+    runtime_p->tcp_client.read = tcp_client_read;
+    runtime_p->tcp_client.borrow = tcp_client_borrow;
+    runtime_p->tcp_client.release = tcp_client_release;
+    runtime_p->tcp_server.init = tcp_server_init;
+    runtime_p->tcp_server.add_client = tcp_server_add_client;
+    runtime_p->tcp_server.start = tcp_server_start;
+    runtime_p->tcp_server.stop = tcp_server_stop;
+    runtime_p->tcp_server.client.write = tcp_server_client_write;
+    runtime_p->tcp_server.client.read = tcp_server_client_read;
+    runtime_p->tcp_server.client.borrow = tcp_server_client_borrow;
+    runtime_p->tcp_server.client.release = tcp_server_client_release;
+    runtime_p->tcp_server.client.disconnect = tcp_server_client_disconnect;
+
+    if (ring_init(self_p) != 0) {
+        return (-1);
+    }
+
+    if (recv_init(self_p) != 0) {
+        return (-1);
+    }
+
+    self_p->flush_p = NULL;
+    self_p->starved_p = NULL;
+    async_runtime_timer_init_without_fd(&self_p->timer);
+    self_p->event_fd = eventfd(0, 0);
+
+    if (self_p->event_fd == -1) {
+        return (-1);
+    }
+
+    if (async_calls_init(&self_p->calls,
+                         CALL_THREADSAFE_RING_LENGTH,
+                         (async_calls_wakeup_t)call_wakeup,
+                         self_p) != 0) {
+        return (-1);
+    }
+
+    async_resolver_init(&self_p->resolver);
+    runtime_p->obj_p = self_p;
+
+    return (0);
+}
+
+struct async_runtime_t *async_runtime_linux_uring_create()
+{
+    struct async_runtime_linux_uring_t *self_p;
+    int res;
+
+    self_p = malloc(sizeof(*self_p));
+
+    if (self_p == NULL) {
+        return (NULL);
+    }
+
+    res = init(self_p);
+
+    if (res != 0) {
+        free(self_p);
+
+        return (NULL);
+    }
+
+    return (&self_p->runtime);
+}
+
+struct async_resolver_t *async_runtime_linux_uring_get_resolver(
+    struct async_runtime_t *runtime_p)
+{
+    struct async_runtime_linux_uring_t *self_p;
+
+    self_p = runtime_p->obj_p;
+
+    return (&self_p->resolver);
+}
@@ -0,0 +1,165 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "async/utils/linux.h"
+#include "internal.h"
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec);
+}
+
+int async_runtime_timer_init(struct async_runtime_timer_t *self_p)
+{
+    self_p->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+
+    if (self_p->fd == -1) {
+        return (-1);
+    }
+
+    self_p->tick_start_ns = 0;
+    self_p->deadline_ns = 0;
+
+    return (0);
+}
+
+void async_runtime_timer_init_without_fd(struct async_runtime_timer_t *self_p)
+{
+    self_p->fd = -1;
+    self_p->tick_start_ns = 0;
+    self_p->deadline_ns = 0;
+}
+
+void async_runtime_timer_start(struct async_runtime_timer_t *self_p,
+                               struct async_t *async_p)
+{
+    self_p->tick_start_ns = now_ns();
+    self_p->deadline_ns = 0;
+    async_runtime_timer_update(self_p, async_p);
+}
+
+bool async_runtime_timer_read(struct async_runtime_timer_t *self_p)
+{
+    uint64_t value;
+    ssize_t res;
+
+    res = read(self_p->fd, &value, sizeof(value));
+
+    if (res != (ssize_t)sizeof(value)) {
+        /* The timer may have been re-armed since it expired. */
+        if (errno == EAGAIN) {
+            return (false);
+        }
+
+        async_utils_linux_fatal_perror("read timer");
+    }
+
+    return (true);
+}
+
+void async_runtime_timer_advance(struct async_runtime_timer_t *self_p,
+                                 struct async_t *async_p)
+{
+    uint64_t tick_ns;
+    uint64_t ticks;
+
+    tick_ns = ((uint64_t)async_p->tick_in_ms * 1000000);
+    ticks = ((now_ns() - self_p->tick_start_ns) / tick_ns);
+
+    if (ticks > 0) {
+        self_p->tick_start_ns += (ticks * tick_ns);
+        async_advance(async_p, (unsigned int)ticks);
+    }
+}
+
+void async_runtime_timer_update(struct async_runtime_timer_t *self_p,
+                                struct async_t *async_p)
+{
+    struct itimerspec timeout;
+    uint64_t deadline_ns;
+    int ms;
+
+    ms = async_next_timeout(async_p);
+
+    if (ms == -1) {
+        deadline_ns = 0;
+    } else {
+        deadline_ns = (self_p->tick_start_ns + (uint64_t)ms * 1000000);
+    }
+
+    if (deadline_ns == self_p->deadline_ns) {
+        return;
+    }
+
+    self_p->deadline_ns = deadline_ns;
+
+    if (self_p->fd == -1) {
+        return;
+    }
+
+    memset(&timeout, 0, sizeof(timeout));
+    timeout.it_value.tv_sec = (deadline_ns / 1000000000);
+    timeout.it_value.tv_nsec = (deadline_ns % 1000000000);
+
+    if (timerfd_settime(self_p->fd, TFD_TIMER_ABSTIME, &timeout, NULL) == -1) {
+        async_utils_linux_fatal_perror("timerfd_settime");
+    }
+}
+
+bool async_runtime_timer_remaining(struct async_runtime_timer_t *self_p,
+                                   struct timespec *remaining_p)
+{
+    uint64_t now;
+    uint64_t remaining_ns;
+
+    if (self_p->deadline_ns == 0) {
+        return (false);
+    }
+
+    now = now_ns();
+
+    if (now < self_p->deadline_ns) {
+        remaining_ns = (self_p->deadline_ns - now);
+    } else {
+        remaining_ns = 0;
+    }
+
+    remaining_p->tv_sec = (remaining_ns / 1000000000);
+    remaining_p->tv_nsec = (remaining_ns % 1000000000);
+
+    return (true);
+}
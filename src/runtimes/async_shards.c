@@ -0,0 +1,359 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+/*
+ * Shards are async objects with single threaded runtimes, each run by
+ * its own thread pinned to a CPU. Calls between shards are passed in
+ * lock-free single-producer single-consumer rings, one per pair of
+ * shards, created by the sending shard on first use. The receiving
+ * shard is woken up by a threadsafe call once per batch of calls.
+ */
+
+#include <sched.h>
+#include <stdio.h>
+#include "async.h"
+#include "async/runtimes/linux.h"
+#include "async/utils/linux.h"
+#include "internal.h"
+
+struct shard_t {
+    /* First, as async objects are converted to shards. */
+    struct async_t async;
+    struct async_shards_t *shards_p;
+    int index;
+    int cpu;
+    /* Rings from other shards, indexed by the sending shard. */
+    _Atomic(struct async_spsc_ring_t *) *rings_pp;
+    _Alignas(64) atomic_bool wakeup_pending;
+};
+
+struct async_shards_t {
+    int number_of_shards;
+    struct shard_t *shards_p;
+};
+
+/* The shard run by the current thread, if any. */
+static __thread struct shard_t *current_shard_p = NULL;
+
+static void shard_drain(struct shard_t *self_p, void *arg_p);
+
+static struct shard_t *shard(struct async_t *async_p)
+{
+    return ((struct shard_t *)async_p);
+}
+
+/**
+ * Call all calls from all other shards, but at most one lap of each
+ * ring, or a fast sender would keep the shard here forever.
+ */
+static void shard_drain(struct shard_t *self_p, void *arg_p)
+{
+    struct async_spsc_ring_t *ring_p;
+    async_func_t func;
+    void *obj_p;
+    void *call_arg_p;
+    bool more;
+    size_t count;
+    int i;
+
+    (void)arg_p;
+
+    /* Calls put after this wakes up the shard again. */
+    atomic_exchange(&self_p->wakeup_pending, false);
+    more = false;
+
+    for (i = 0; i < self_p->shards_p->number_of_shards; i++) {
+        ring_p = atomic_load_explicit(&self_p->rings_pp[i],
+                                      memory_order_acquire);
+
+        if (ring_p == NULL) {
+            continue;
+        }
+
+        for (count = 0; count <= ring_p->mask; count++) {
+            func = async_spsc_ring_get(ring_p, &obj_p, &call_arg_p);
+
+            if (func == NULL) {
+                break;
+            }
+
+            func(obj_p, call_arg_p);
+        }
+
+        if (count > ring_p->mask) {
+            more = true;
+        }
+    }
+
+    if (more) {
+        async_call(&self_p->async, (async_func_t)shard_drain, self_p, NULL);
+    }
+}
+
+static struct async_spsc_ring_t *shard_ring_get(struct shard_t *self_p,
+                                                struct shard_t *from_p)
+{
+    struct async_spsc_ring_t *ring_p;
+
+    ring_p = atomic_load_explicit(&self_p->rings_pp[from_p->index],
+                                  memory_order_relaxed);
+
+    if (ring_p != NULL) {
+        return (ring_p);
+    }
+
+    ring_p = malloc(sizeof(*ring_p));
+
+    if (ring_p == NULL) {
+        return (NULL);
+    }
+
+    if (async_spsc_ring_init(ring_p, ASYNC_SHARDS_RING_LENGTH) != 0) {
+        free(ring_p);
+
+        return (NULL);
+    }
+
+    atomic_store_explicit(&self_p->rings_pp[from_p->index],
+                          ring_p,
+                          memory_order_release);
+
+    return (ring_p);
+}
+
+static void *shard_main(struct shard_t *self_p)
+{
+    cpu_set_t cpus;
+    char name[16];
+
+    CPU_ZERO(&cpus);
+    CPU_SET(self_p->cpu, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    snprintf(&name[0], sizeof(name), "async_shard_%d", self_p->index);
+    pthread_setname_np(pthread_self(), &name[0]);
+    current_shard_p = self_p;
+    async_run_forever(&self_p->async);
+
+    return (NULL);
+}
+
+static int shard_init(struct shard_t *self_p,
+                      struct async_shards_t *shards_p,
+                      int index,
+                      int cpu)
+{
+    struct async_runtime_t *runtime_p;
+
+    self_p->rings_pp = calloc(shards_p->number_of_shards,
+                              sizeof(*self_p->rings_pp));
+
+    if (self_p->rings_pp == NULL) {
+        return (-1);
+    }
+
+    runtime_p = async_runtime_linux_st_create();
+
+    if (runtime_p == NULL) {
+        free(self_p->rings_pp);
+
+        return (-1);
+    }
+
+    async_init(&self_p->async);
+    async_set_runtime(&self_p->async, runtime_p);
+    async_runtime_linux_st_set_cpu(runtime_p, cpu);
+    self_p->shards_p = shards_p;
+    self_p->index = index;
+    self_p->cpu = cpu;
+    atomic_init(&self_p->wakeup_pending, false);
+
+    return (0);
+}
+
+static void shard_destroy(struct shard_t *self_p)
+{
+    async_runtime_linux_st_destroy(self_p->async.runtime_p);
+    async_destroy(&self_p->async);
+    free(self_p->rings_pp);
+}
+
+struct async_shards_t *async_shards_create(int number_of_shards)
+{
+    struct async_shards_t *self_p;
+    cpu_set_t allowed;
+    int cpus[CPU_SETSIZE];
+    int number_of_cpus;
+    int i;
+
+    CPU_ZERO(&allowed);
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return (NULL);
+    }
+
+    number_of_cpus = 0;
+
+    for (i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET(i, &allowed)) {
+            cpus[number_of_cpus] = i;
+            number_of_cpus++;
+        }
+    }
+
+    if (number_of_shards <= 0) {
+        number_of_shards = number_of_cpus;
+    }
+
+    self_p = malloc(sizeof(*self_p));
+
+    if (self_p == NULL) {
+        return (NULL);
+    }
+
+    self_p->shards_p = calloc(number_of_shards, sizeof(*self_p->shards_p));
+
+    if (self_p->shards_p == NULL) {
+        free(self_p);
+
+        return (NULL);
+    }
+
+    self_p->number_of_shards = number_of_shards;
+
+    for (i = 0; i < number_of_shards; i++) {
+        if (shard_init(&self_p->shards_p[i],
+                       self_p,
+                       i,
+                       cpus[i % number_of_cpus]) != 0) {
+            while (i > 0) {
+                i--;
+                shard_destroy(&self_p->shards_p[i]);
+            }
+
+            free(self_p->shards_p);
+            free(self_p);
+
+            return (NULL);
+        }
+    }
+
+    return (self_p);
+}
+
+int async_shards_get_number_of_shards(struct async_shards_t *self_p)
+{
+    return (self_p->number_of_shards);
+}
+
+struct async_t *async_shards_get(struct async_shards_t *self_p, int index)
+{
+    return (&self_p->shards_p[index].async);
+}
+
+struct async_t *async_shards_get_for_key(struct async_shards_t *self_p,
+                                         const void *key_p,
+                                         size_t size)
+{
+    const uint8_t *buf_p;
+    uint32_t hash;
+    size_t i;
+
+    /* FNV-1a. */
+    buf_p = key_p;
+    hash = 2166136261u;
+
+    for (i = 0; i < size; i++) {
+        hash ^= buf_p[i];
+        hash *= 16777619u;
+    }
+
+    return (async_shards_get(self_p, hash % self_p->number_of_shards));
+}
+
+void async_shards_run_forever(struct async_shards_t *self_p)
+{
+    pthread_t pthread;
+    int i;
+
+    for (i = 1; i < self_p->number_of_shards; i++) {
+        if (pthread_create(&pthread,
+                           NULL,
+                           (void *(*)(void *))shard_main,
+                           &self_p->shards_p[i]) != 0) {
+            async_utils_linux_fatal_perror("pthread_create");
+        }
+    }
+
+    shard_main(&self_p->shards_p[0]);
+}
+
+int async_call_on(struct async_t *shard_p,
+                  async_func_t func,
+                  void *obj_p,
+                  void *arg_p)
+{
+    struct shard_t *to_p;
+    struct shard_t *from_p;
+    struct async_spsc_ring_t *ring_p;
+    int res;
+
+    to_p = shard(shard_p);
+    from_p = current_shard_p;
+
+    if (from_p == to_p) {
+        return (async_call(shard_p, func, obj_p, arg_p));
+    }
+
+    if ((from_p == NULL) || (from_p->shards_p != to_p->shards_p)) {
+        async_call_threadsafe(shard_p, func, obj_p, arg_p);
+
+        return (0);
+    }
+
+    ring_p = shard_ring_get(to_p, from_p);
+
+    if (ring_p == NULL) {
+        return (-ASYNC_ERROR_QUEUE_FULL);
+    }
+
+    res = async_spsc_ring_put(ring_p, func, obj_p, arg_p);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    /* Only the first call in a batch wakes up the shard. */
+    if (!atomic_exchange(&to_p->wakeup_pending, true)) {
+        async_call_threadsafe(shard_p,
+                              (async_func_t)shard_drain,
+                              to_p,
+                              NULL);
+    }
+
+    return (0);
+}
@@ -0,0 +1,227 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+#include <stdalign.h>
+#include <stddef.h>
+#include "async/utils/linux.h"
+#include "internal.h"
+
+static void counter_increment(atomic_size_t *counter_p, size_t value)
+{
+    /* Only written by one thread, so no need for a locked add. */
+    atomic_store_explicit(counter_p,
+                          atomic_load_explicit(counter_p,
+                                               memory_order_relaxed) + value,
+                          memory_order_relaxed);
+}
+
+static void allocate_slab(struct async_slab_t *self_p)
+{
+    uint8_t *buf_p;
+    struct async_slab_object_t *object_p;
+    size_t i;
+
+    buf_p = malloc(self_p->size * ASYNC_SLAB_LENGTH);
+
+    if (buf_p == NULL) {
+        async_utils_linux_fatal_perror("slab malloc");
+    }
+
+    for (i = 0; i < ASYNC_SLAB_LENGTH; i++) {
+        object_p = (struct async_slab_object_t *)&buf_p[i * self_p->size];
+        object_p->next_p = self_p->free_p;
+        self_p->free_p = object_p;
+    }
+
+    counter_increment(&self_p->misses, 1);
+    counter_increment(&self_p->capacity, ASYNC_SLAB_LENGTH);
+}
+
+void async_slab_init(struct async_slab_t *self_p, size_t size)
+{
+    size_t align;
+
+    align = alignof(max_align_t);
+
+    if (size < sizeof(struct async_slab_object_t)) {
+        size = sizeof(struct async_slab_object_t);
+    }
+
+    self_p->size = ((size + align - 1) & ~(align - 1));
+    self_p->free_p = NULL;
+    atomic_init(&self_p->allocations, 0);
+    atomic_init(&self_p->misses, 0);
+    atomic_init(&self_p->capacity, 0);
+    atomic_init(&self_p->freed_p, NULL);
+    atomic_init(&self_p->frees, 0);
+}
+
+void *async_slab_alloc(struct async_slab_t *self_p)
+{
+    struct async_slab_object_t *object_p;
+
+    if (self_p->free_p == NULL) {
+        self_p->free_p = atomic_exchange_explicit(&self_p->freed_p,
+                                                  NULL,
+                                                  memory_order_acquire);
+
+        if (self_p->free_p == NULL) {
+            allocate_slab(self_p);
+        }
+    }
+
+    object_p = self_p->free_p;
+    self_p->free_p = object_p->next_p;
+    counter_increment(&self_p->allocations, 1);
+
+    return (object_p);
+}
+
+void async_slab_free(struct async_slab_t *self_p, void *object_p)
+{
+    struct async_slab_object_t *freed_p;
+    struct async_slab_object_t *head_p;
+
+    freed_p = object_p;
+    head_p = atomic_load_explicit(&self_p->freed_p, memory_order_relaxed);
+
+    /* Objects are only pushed, and the allocating thread takes all of
+       them, so there is no ABA problem. */
+    do {
+        freed_p->next_p = head_p;
+    } while (!atomic_compare_exchange_weak_explicit(&self_p->freed_p,
+                                                    &head_p,
+                                                    freed_p,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+
+    atomic_fetch_add_explicit(&self_p->frees, 1, memory_order_relaxed);
+}
+
+void async_slab_add_statistics(struct async_slab_t *self_p,
+                               struct async_slab_statistics_t *statistics_p)
+{
+    size_t allocations;
+    size_t frees;
+
+    allocations = atomic_load_explicit(&self_p->allocations,
+                                       memory_order_relaxed);
+    frees = atomic_load_explicit(&self_p->frees, memory_order_relaxed);
+    statistics_p->allocations += allocations;
+    statistics_p->misses += atomic_load_explicit(&self_p->misses,
+                                                 memory_order_relaxed);
+    statistics_p->capacity += atomic_load_explicit(&self_p->capacity,
+                                                   memory_order_relaxed);
+
+    if (allocations > frees) {
+        statistics_p->used += (allocations - frees);
+    }
+}
+
+void async_message_slab_init(struct async_slab_t *slab_p, size_t size)
+{
+    async_slab_init(slab_p, sizeof(struct async_message_t) + size);
+}
+
+void *async_message_alloc(struct async_slab_t *slab_p, int type)
+{
+    struct async_message_t *message_p;
+
+    message_p = async_slab_alloc(slab_p);
+    message_p->slab_p = slab_p;
+    message_p->type = type;
+
+    return (&message_p[1]);
+}
+
+void async_message_free(void *message_p)
+{
+    struct async_message_t *header_p;
+
+    header_p = &((struct async_message_t *)message_p)[-1];
+    async_slab_free(header_p->slab_p, header_p);
+}
+
+void async_message_queue_init(struct async_message_queue_t *self_p)
+{
+    atomic_init(&self_p->head_p, NULL);
+    self_p->taken_p = NULL;
+}
+
+bool async_message_queue_put(struct async_message_queue_t *self_p,
+                             void *message_p)
+{
+    struct async_message_t *header_p;
+    struct async_message_t *head_p;
+
+    header_p = &((struct async_message_t *)message_p)[-1];
+    head_p = atomic_load_explicit(&self_p->head_p, memory_order_relaxed);
+
+    /* The message may be taken by the consumer as soon as put, so
+       only the local copy of the head is used afterwards. */
+    do {
+        header_p->next_p = head_p;
+    } while (!atomic_compare_exchange_weak_explicit(&self_p->head_p,
+                                                    &head_p,
+                                                    header_p,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+
+    return (head_p == NULL);
+}
+
+void *async_message_queue_get(struct async_message_queue_t *self_p,
+                              int *type_p)
+{
+    struct async_message_t *header_p;
+    struct async_message_t *next_p;
+
+    if (self_p->taken_p == NULL) {
+        header_p = atomic_exchange_explicit(&self_p->head_p,
+                                            NULL,
+                                            memory_order_acquire);
+
+        /* Newest first in the stack. */
+        while (header_p != NULL) {
+            next_p = header_p->next_p;
+            header_p->next_p = self_p->taken_p;
+            self_p->taken_p = header_p;
+            header_p = next_p;
+        }
+
+        if (self_p->taken_p == NULL) {
+            return (NULL);
+        }
+    }
+
+    header_p = self_p->taken_p;
+    self_p->taken_p = header_p->next_p;
+    *type_p = header_p->type;
+
+    return (&header_p[1]);
+}
@@ -0,0 +1,111 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+#include "internal.h"
+
+int async_spsc_ring_init(struct async_spsc_ring_t *self_p, size_t length)
+{
+    if ((length == 0) || ((length & (length - 1)) != 0)) {
+        return (-1);
+    }
+
+    self_p->elems_p = malloc(sizeof(*self_p->elems_p) * length);
+
+    if (self_p->elems_p == NULL) {
+        return (-1);
+    }
+
+    self_p->mask = (length - 1);
+    atomic_init(&self_p->write_pos, 0);
+    self_p->read_pos_cache = 0;
+    atomic_init(&self_p->read_pos, 0);
+    self_p->write_pos_cache = 0;
+
+    return (0);
+}
+
+void async_spsc_ring_destroy(struct async_spsc_ring_t *self_p)
+{
+    free(self_p->elems_p);
+}
+
+int async_spsc_ring_put(struct async_spsc_ring_t *self_p,
+                        async_func_t func,
+                        void *obj_p,
+                        void *arg_p)
+{
+    struct async_spsc_ring_elem_t *elem_p;
+    size_t pos;
+
+    pos = atomic_load_explicit(&self_p->write_pos, memory_order_relaxed);
+
+    if ((pos - self_p->read_pos_cache) > self_p->mask) {
+        self_p->read_pos_cache = atomic_load_explicit(&self_p->read_pos,
+                                                      memory_order_acquire);
+
+        if ((pos - self_p->read_pos_cache) > self_p->mask) {
+            return (-ASYNC_ERROR_QUEUE_FULL);
+        }
+    }
+
+    elem_p = &self_p->elems_p[pos & self_p->mask];
+    elem_p->func = func;
+    elem_p->obj_p = obj_p;
+    elem_p->arg_p = arg_p;
+    atomic_store_explicit(&self_p->write_pos, pos + 1, memory_order_release);
+
+    return (0);
+}
+
+async_func_t async_spsc_ring_get(struct async_spsc_ring_t *self_p,
+                                 void **obj_pp,
+                                 void **arg_pp)
+{
+    struct async_spsc_ring_elem_t *elem_p;
+    async_func_t func;
+    size_t pos;
+
+    pos = atomic_load_explicit(&self_p->read_pos, memory_order_relaxed);
+
+    if (pos == self_p->write_pos_cache) {
+        self_p->write_pos_cache = atomic_load_explicit(&self_p->write_pos,
+                                                       memory_order_acquire);
+
+        if (pos == self_p->write_pos_cache) {
+            return (NULL);
+        }
+    }
+
+    elem_p = &self_p->elems_p[pos & self_p->mask];
+    func = elem_p->func;
+    *obj_pp = elem_p->obj_p;
+    *arg_pp = elem_p->arg_p;
+    atomic_store_explicit(&self_p->read_pos, pos + 1, memory_order_release);
+
+    return (func);
+}
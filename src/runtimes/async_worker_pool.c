@@ -0,0 +1,304 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include "internal.h"
+
+static int queue_init(struct async_worker_pool_queue_t *self_p, size_t length)
+{
+    size_t i;
+
+    self_p->elems_p = malloc(sizeof(*self_p->elems_p) * length);
+
+    if (self_p->elems_p == NULL) {
+        return (-1);
+    }
+
+    for (i = 0; i < length; i++) {
+        atomic_init(&self_p->elems_p[i].sequence, i);
+    }
+
+    self_p->mask = (length - 1);
+    atomic_init(&self_p->read_pos, 0);
+    self_p->write_pos = 0;
+
+    return (0);
+}
+
+static void queue_destroy(struct async_worker_pool_queue_t *self_p)
+{
+    free(self_p->elems_p);
+}
+
+static bool queue_put(struct async_worker_pool_queue_t *self_p,
+                      async_worker_pool_entry_t entry,
+                      void *arg_p)
+{
+    struct async_worker_pool_elem_t *elem_p;
+
+    elem_p = &self_p->elems_p[self_p->write_pos & self_p->mask];
+
+    /* Not yet taken in the previous lap. */
+    if (atomic_load_explicit(&elem_p->sequence, memory_order_acquire)
+        != self_p->write_pos) {
+        return (false);
+    }
+
+    elem_p->entry = entry;
+    elem_p->arg_p = arg_p;
+    atomic_store_explicit(&elem_p->sequence,
+                          self_p->write_pos + 1,
+                          memory_order_release);
+    self_p->write_pos++;
+
+    return (true);
+}
+
+static bool queue_take(struct async_worker_pool_queue_t *self_p,
+                       async_worker_pool_entry_t *entry_p,
+                       void **arg_pp)
+{
+    struct async_worker_pool_elem_t *elem_p;
+    size_t pos;
+    size_t sequence;
+    intptr_t diff;
+
+    pos = atomic_load_explicit(&self_p->read_pos, memory_order_relaxed);
+
+    while (true) {
+        elem_p = &self_p->elems_p[pos & self_p->mask];
+        sequence = atomic_load_explicit(&elem_p->sequence,
+                                        memory_order_acquire);
+        diff = ((intptr_t)sequence - (intptr_t)(pos + 1));
+
+        if (diff == 0) {
+            /* Ready. Take it unless another worker did first. */
+            if (atomic_compare_exchange_weak_explicit(&self_p->read_pos,
+                                                      &pos,
+                                                      pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return (false);
+        } else {
+            pos = atomic_load_explicit(&self_p->read_pos,
+                                       memory_order_relaxed);
+        }
+    }
+
+    *entry_p = elem_p->entry;
+    *arg_pp = elem_p->arg_p;
+    atomic_store_explicit(&elem_p->sequence,
+                          pos + self_p->mask + 1,
+                          memory_order_release);
+
+    return (true);
+}
+
+/**
+ * Take a job from the own queue, or steal one from the others. There
+ * is always at least one queued job once the semaphore is taken.
+ */
+static void worker_take(struct async_worker_pool_worker_t *self_p,
+                        async_worker_pool_entry_t *entry_p,
+                        void **arg_pp)
+{
+    struct async_worker_pool_t *pool_p;
+    int index;
+
+    pool_p = self_p->pool_p;
+
+    if (queue_take(&self_p->queue, entry_p, arg_pp)) {
+        return;
+    }
+
+    index = self_p->index;
+
+    while (true) {
+        index = ((index + 1) % pool_p->number_of_workers);
+
+        if (queue_take(&pool_p->workers_p[index].queue, entry_p, arg_pp)) {
+            break;
+        }
+    }
+
+    atomic_fetch_add_explicit(&pool_p->steals, 1, memory_order_relaxed);
+}
+
+static void *worker_main(struct async_worker_pool_worker_t *self_p)
+{
+    async_worker_pool_entry_t entry;
+    void *arg_p;
+
+    pthread_setname_np(pthread_self(), "async_worker");
+
+    while (true) {
+        while (sem_wait(&self_p->pool_p->jobs) != 0) {
+            if (errno != EINTR) {
+                return (NULL);
+            }
+        }
+
+        worker_take(self_p, &entry, &arg_p);
+        entry(arg_p);
+    }
+
+    return (NULL);
+}
+
+static size_t round_up_to_power_of_two(int value)
+{
+    size_t length;
+
+    length = 1;
+
+    while (length < (size_t)value) {
+        length *= 2;
+    }
+
+    return (length);
+}
+
+/**
+ * Destroy the semaphore and the first given number of queues, and
+ * free the workers, as if never started.
+ */
+static void destroy(struct async_worker_pool_t *self_p, int number_of_queues)
+{
+    int i;
+
+    for (i = 0; i < number_of_queues; i++) {
+        queue_destroy(&self_p->workers_p[i].queue);
+    }
+
+    sem_destroy(&self_p->jobs);
+    free(self_p->workers_p);
+    self_p->workers_p = NULL;
+    self_p->number_of_workers = 0;
+}
+
+void async_worker_pool_init(struct async_worker_pool_t *self_p)
+{
+    self_p->number_of_workers = 0;
+    self_p->workers_p = NULL;
+    self_p->next = 0;
+    atomic_init(&self_p->steals, 0);
+}
+
+int async_worker_pool_start(struct async_worker_pool_t *self_p,
+                            int number_of_workers,
+                            int queue_length)
+{
+    struct async_worker_pool_worker_t *worker_p;
+    size_t length;
+    int i;
+
+    if (self_p->workers_p != NULL) {
+        return (0);
+    }
+
+    if (number_of_workers <= 0) {
+        number_of_workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+        if (number_of_workers <= 0) {
+            number_of_workers = 1;
+        }
+    }
+
+    length = round_up_to_power_of_two(queue_length);
+    self_p->workers_p = malloc(sizeof(*self_p->workers_p) * number_of_workers);
+
+    if (self_p->workers_p == NULL) {
+        return (-1);
+    }
+
+    if (sem_init(&self_p->jobs, 0, 0) != 0) {
+        free(self_p->workers_p);
+        self_p->workers_p = NULL;
+
+        return (-1);
+    }
+
+    for (i = 0; i < number_of_workers; i++) {
+        worker_p = &self_p->workers_p[i];
+        worker_p->pool_p = self_p;
+        worker_p->index = i;
+
+        if (queue_init(&worker_p->queue, length) != 0) {
+            destroy(self_p, i);
+
+            return (-1);
+        }
+    }
+
+    self_p->number_of_workers = number_of_workers;
+
+    for (i = 0; i < number_of_workers; i++) {
+        worker_p = &self_p->workers_p[i];
+
+        if (pthread_create(&worker_p->pthread,
+                           NULL,
+                           (void *(*)(void *))worker_main,
+                           worker_p) != 0) {
+            /* Jobs in the queues of missing workers are stolen. */
+            if (i > 0) {
+                break;
+            }
+
+            destroy(self_p, number_of_workers);
+
+            return (-1);
+        }
+    }
+
+    return (0);
+}
+
+int async_worker_pool_spawn(struct async_worker_pool_t *self_p,
+                            async_worker_pool_entry_t entry,
+                            void *arg_p)
+{
+    int i;
+    int index;
+
+    for (i = 0; i < self_p->number_of_workers; i++) {
+        index = ((self_p->next + i) % self_p->number_of_workers);
+
+        if (queue_put(&self_p->workers_p[index].queue, entry, arg_p)) {
+            self_p->next = ((index + 1) % self_p->number_of_workers);
+            sem_post(&self_p->jobs);
+
+            return (0);
+        }
+    }
+
+    return (-ASYNC_ERROR_QUEUE_FULL);
+}
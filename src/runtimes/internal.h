@@ -0,0 +1,720 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019, Erik Moqvist
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * This file is part of the Async project.
+ */
+
+#ifndef ASYNC_RUNTIMES_INTERNAL_H
+#define ASYNC_RUNTIMES_INTERNAL_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/socket.h>
+#include "async/core.h"
+
+/* Resolver configuration. Results are cached for a fixed time, as
+   getaddrinfo() does not give the time to live of DNS records. */
+#ifndef ASYNC_RESOLVER_CACHE_LENGTH
+#    define ASYNC_RESOLVER_CACHE_LENGTH                 32
+#endif
+
+#ifndef ASYNC_RESOLVER_TTL_MS
+#    define ASYNC_RESOLVER_TTL_MS                       60000
+#endif
+
+/* Maximum number of queued calls from one shard to another. A power
+   of two. */
+#ifndef ASYNC_SHARDS_RING_LENGTH
+#    define ASYNC_SHARDS_RING_LENGTH                    1024
+#endif
+
+#define ASYNC_RESOLVER_ADDRESSES_MAX                    4
+#define ASYNC_RESOLVER_HOST_MAX                         256
+
+/* Minimum size of output queue chunks. */
+#ifndef ASYNC_OUTPUT_CHUNK_SIZE
+#    define ASYNC_OUTPUT_CHUNK_SIZE                     4096
+#endif
+
+/* Size of pooled receive buffers. */
+#ifndef ASYNC_INPUT_BUFFER_SIZE
+#    define ASYNC_INPUT_BUFFER_SIZE                     16384
+#endif
+
+/* Number of objects per slab. */
+#ifndef ASYNC_SLAB_LENGTH
+#    define ASYNC_SLAB_LENGTH                           64
+#endif
+
+struct async_mpsc_ring_elem_t {
+    atomic_size_t sequence;
+    async_func_t func;
+    void *obj_p;
+    void *arg_p;
+};
+
+/**
+ * A bounded lock-free multi-producer single-consumer ring of function
+ * calls. Each element has a sequence number telling if it is free
+ * for the producer or ready for the consumer in the current lap.
+ */
+struct async_mpsc_ring_t {
+    struct async_mpsc_ring_elem_t *elems_p;
+    size_t mask;
+    /* Producers and the consumer write to separate cache lines. */
+    _Alignas(64) atomic_size_t write_pos;
+    atomic_bool wakeup_pending;
+    _Alignas(64) size_t read_pos;
+};
+
+/**
+ * Initialize given ring with given length, which must be a power of
+ * two. Returns zero or negative error code.
+ */
+int async_mpsc_ring_init(struct async_mpsc_ring_t *self_p, size_t length);
+
+void async_mpsc_ring_destroy(struct async_mpsc_ring_t *self_p);
+
+/**
+ * Put given function call in given ring. May be called from any
+ * thread. Returns zero if the call was added, and the consumer has
+ * already been woken up, one if the call was added and the caller
+ * must wake up the consumer, or -ASYNC_ERROR_QUEUE_FULL if the ring
+ * is full.
+ */
+int async_mpsc_ring_put(struct async_mpsc_ring_t *self_p,
+                        async_func_t func,
+                        void *obj_p,
+                        void *arg_p);
+
+/**
+ * Get the oldest function call from given ring, or NULL if empty. May
+ * only be called from the consumer thread.
+ */
+async_func_t async_mpsc_ring_get(struct async_mpsc_ring_t *self_p,
+                                 void **obj_pp,
+                                 void **arg_pp);
+
+/**
+ * Must be called by the consumer when woken up, before getting calls
+ * from given ring. Calls put after this wakes up the consumer again.
+ */
+void async_mpsc_ring_woken_up(struct async_mpsc_ring_t *self_p);
+
+struct async_spsc_ring_elem_t {
+    async_func_t func;
+    void *obj_p;
+    void *arg_p;
+};
+
+/**
+ * A bounded lock-free single-producer single-consumer ring of
+ * function calls. Each side keeps a cached copy of the other side's
+ * position, so the shared positions are only read when the cached
+ * copy says the ring is full or empty.
+ */
+struct async_spsc_ring_t {
+    struct async_spsc_ring_elem_t *elems_p;
+    size_t mask;
+    /* The producer and the consumer write to separate cache
+       lines. */
+    _Alignas(64) atomic_size_t write_pos;
+    size_t read_pos_cache;
+    _Alignas(64) atomic_size_t read_pos;
+    size_t write_pos_cache;
+};
+
+/**
+ * Initialize given ring with given length, which must be a power of
+ * two. Returns zero or negative error code.
+ */
+int async_spsc_ring_init(struct async_spsc_ring_t *self_p, size_t length);
+
+void async_spsc_ring_destroy(struct async_spsc_ring_t *self_p);
+
+/**
+ * Put given function call in given ring. May only be called from the
+ * producer thread. Returns zero or -ASYNC_ERROR_QUEUE_FULL if the
+ * ring is full.
+ */
+int async_spsc_ring_put(struct async_spsc_ring_t *self_p,
+                        async_func_t func,
+                        void *obj_p,
+                        void *arg_p);
+
+/**
+ * Get the oldest function call from given ring, or NULL if empty. May
+ * only be called from the consumer thread.
+ */
+async_func_t async_spsc_ring_get(struct async_spsc_ring_t *self_p,
+                                 void **obj_pp,
+                                 void **arg_pp);
+
+typedef void (*async_worker_pool_entry_t)(void *arg_p);
+
+struct async_worker_pool_elem_t {
+    atomic_size_t sequence;
+    async_worker_pool_entry_t entry;
+    void *arg_p;
+};
+
+/**
+ * A bounded ring of jobs of one worker. Only the async thread puts
+ * jobs, while its worker and idle workers stealing from it take
+ * jobs.
+ */
+struct async_worker_pool_queue_t {
+    struct async_worker_pool_elem_t *elems_p;
+    size_t mask;
+    _Alignas(64) atomic_size_t read_pos;
+    _Alignas(64) size_t write_pos;
+};
+
+struct async_worker_pool_worker_t {
+    struct async_worker_pool_t *pool_p;
+    int index;
+    pthread_t pthread;
+    struct async_worker_pool_queue_t queue;
+};
+
+/**
+ * Worker threads with one job queue each. Jobs are put in the queues
+ * round-robin, and a worker steals from the other queues when its
+ * own is empty. The semaphore counts queued jobs, so idle workers
+ * sleep without polling.
+ */
+struct async_worker_pool_t {
+    int number_of_workers;
+    struct async_worker_pool_worker_t *workers_p;
+    /* Queue to put the next job in. */
+    int next;
+    sem_t jobs;
+    atomic_size_t steals;
+};
+
+void async_worker_pool_init(struct async_worker_pool_t *self_p);
+
+/**
+ * Start given number of workers, or one per online CPU if zero, each
+ * with a queue of given length, rounded up to a power of two. Does
+ * nothing if already started. Returns zero or negative error code.
+ */
+int async_worker_pool_start(struct async_worker_pool_t *self_p,
+                            int number_of_workers,
+                            int queue_length);
+
+/**
+ * Call given function in a worker. Must only be called from one
+ * thread. Returns zero or -ASYNC_ERROR_QUEUE_FULL if all queues are
+ * full.
+ */
+int async_worker_pool_spawn(struct async_worker_pool_t *self_p,
+                            async_worker_pool_entry_t entry,
+                            void *arg_p);
+
+/**
+ * A one-shot timer file descriptor armed for the earliest timer
+ * deadline of an async object, for tickless runtimes.
+ */
+struct async_runtime_timer_t {
+    int fd;
+    /* Monotonic time the current tick started. */
+    uint64_t tick_start_ns;
+    /* Armed deadline, or zero if disarmed. */
+    uint64_t deadline_ns;
+};
+
+/**
+ * Create the timer file descriptor. Returns zero or negative error
+ * code.
+ */
+int async_runtime_timer_init(struct async_runtime_timer_t *self_p);
+
+/**
+ * Initialize given timer without a file descriptor, for runtimes that
+ * wait for the deadline by other means.
+ */
+void async_runtime_timer_init_without_fd(struct async_runtime_timer_t *self_p);
+
+/**
+ * Start the async time now and arm the timer.
+ */
+void async_runtime_timer_start(struct async_runtime_timer_t *self_p,
+                               struct async_t *async_p);
+
+/**
+ * Read the timer file descriptor once readable. Returns true if the
+ * timer expired.
+ */
+bool async_runtime_timer_read(struct async_runtime_timer_t *self_p);
+
+/**
+ * Advance the async time to now. Call before handling any event, so
+ * timers started by the handler are relative to the current tick.
+ */
+void async_runtime_timer_advance(struct async_runtime_timer_t *self_p,
+                                 struct async_t *async_p);
+
+/**
+ * Arm the timer for the earliest deadline, or disarm it if no timer is
+ * running. Call after handling events. The timer file descriptor is
+ * only touched when the deadline changes.
+ */
+void async_runtime_timer_update(struct async_runtime_timer_t *self_p,
+                                struct async_t *async_p);
+
+/**
+ * Get the time left until the armed deadline, zero if already passed.
+ * Returns false if the timer is disarmed.
+ */
+bool async_runtime_timer_remaining(struct async_runtime_timer_t *self_p,
+                                   struct timespec *remaining_p);
+
+struct async_resolver_address_t {
+    struct sockaddr_storage addr;
+    socklen_t size;
+};
+
+/**
+ * IPv4 and IPv6 addresses of a host, in the order returned by
+ * getaddrinfo().
+ */
+struct async_resolver_result_t {
+    int length;
+    struct async_resolver_address_t addresses[ASYNC_RESOLVER_ADDRESSES_MAX];
+};
+
+/**
+ * Resolve given host to at least one address, or return -1. Called in
+ * the worker pool.
+ */
+typedef int (*async_resolver_resolve_t)(const char *host_p,
+                                        struct async_resolver_result_t *result_p);
+
+/**
+ * Called in the async thread once resolved, with a NULL result on
+ * failure.
+ */
+typedef void (*async_resolver_complete_t)(
+    void *obj_p,
+    void *arg_p,
+    const struct async_resolver_result_t *result_p);
+
+struct async_resolver_cache_entry_t {
+    char host[ASYNC_RESOLVER_HOST_MAX];
+    uint64_t expiry_ns;
+    uint64_t last_used;
+    struct async_resolver_result_t result;
+};
+
+/**
+ * Resolves host names in the worker pool, and caches the results for
+ * ASYNC_RESOLVER_TTL_MS. Numeric addresses are parsed without using
+ * the worker pool or the cache. Only used in the async thread.
+ */
+struct async_resolver_t {
+    async_resolver_resolve_t resolve;
+    unsigned int ttl_ms;
+    uint64_t counter;
+    int length;
+    struct async_resolver_cache_entry_t entries[ASYNC_RESOLVER_CACHE_LENGTH];
+};
+
+void async_resolver_init(struct async_resolver_t *self_p);
+
+/**
+ * Replace the getaddrinfo() based resolve function, for example with a
+ * stub in tests.
+ */
+void async_resolver_set_resolve(struct async_resolver_t *self_p,
+                                async_resolver_resolve_t resolve);
+
+/**
+ * Resolve given host using getaddrinfo(). Blocks. The port of all
+ * addresses is zero.
+ */
+int async_resolver_resolve(const char *host_p,
+                           struct async_resolver_result_t *result_p);
+
+/**
+ * Returns true and the result with given port if given host is
+ * numeric or cached and not yet expired.
+ */
+bool async_resolver_lookup(struct async_resolver_t *self_p,
+                           const char *host_p,
+                           int port,
+                           struct async_resolver_result_t *result_p);
+
+/**
+ * Add given result to the cache, replacing an expired or the least
+ * recently used entry if full.
+ */
+void async_resolver_insert(struct async_resolver_t *self_p,
+                           const char *host_p,
+                           const struct async_resolver_result_t *result_p);
+
+/**
+ * Resolve given host and call on_complete. Called immediately if
+ * found by async_resolver_lookup(), otherwise once resolved in the
+ * worker pool of given async object.
+ */
+void async_resolver_get(struct async_resolver_t *self_p,
+                        struct async_t *async_p,
+                        const char *host_p,
+                        int port,
+                        async_resolver_complete_t on_complete,
+                        void *obj_p,
+                        void *arg_p);
+
+struct async_output_chunk_t {
+    struct async_output_chunk_t *next_p;
+    /* First byte not yet written to the socket. */
+    size_t offset;
+    size_t size;
+    size_t capacity;
+    uint8_t buf[];
+};
+
+/**
+ * A queue of chained buffers with data not yet written to a
+ * non-blocking socket.
+ */
+struct async_output_t {
+    struct async_output_chunk_t *head_p;
+    struct async_output_chunk_t *tail_p;
+    /* A spare chunk, to avoid allocating one each time blocked. */
+    struct async_output_chunk_t *free_p;
+    size_t size;
+    /* Above the high watermark and not yet drained to the low. */
+    bool blocked;
+};
+
+void async_output_init(struct async_output_t *self_p);
+
+/**
+ * Discard all queued data.
+ */
+void async_output_clear(struct async_output_t *self_p);
+
+/**
+ * Write given buffers to given socket, and queue what the socket did
+ * not accept. Everything is queued if data is already queued. Returns
+ * zero or -1 on socket error.
+ */
+int async_output_writev(struct async_output_t *self_p,
+                        int sockfd,
+                        const struct async_iovec_t *iov_p,
+                        int length);
+
+/**
+ * Write queued data to given socket until empty or the socket is not
+ * writable. Returns zero or -1 on socket error.
+ */
+int async_output_flush(struct async_output_t *self_p, int sockfd);
+
+bool async_output_is_empty(struct async_output_t *self_p);
+
+/**
+ * Update the blocked state after a write or flush. Returns true if
+ * the queue just drained to the low watermark.
+ */
+bool async_output_update(struct async_output_t *self_p,
+                         size_t low_watermark,
+                         size_t high_watermark);
+
+struct async_input_buffer_t {
+    struct async_input_buffer_t *next_p;
+    uint8_t buf[ASYNC_INPUT_BUFFER_SIZE];
+};
+
+/**
+ * Receive buffers shared by all sockets of a runtime. Only used by
+ * the thread calling on_input.
+ */
+struct async_input_pool_t {
+    struct async_input_buffer_t *free_p;
+};
+
+/**
+ * Received data not yet consumed. A buffer is taken from the pool
+ * when reading from the socket, and given back once all its data
+ * has been consumed.
+ */
+struct async_input_t {
+    struct async_input_pool_t *pool_p;
+    struct async_input_buffer_t *buffer_p;
+    size_t offset;
+    size_t size;
+    /* The socket may have data not yet read. */
+    bool readable;
+    /* End of stream received. */
+    bool end;
+    /* Total number of consumed bytes. */
+    size_t consumed;
+};
+
+void async_input_pool_init(struct async_input_pool_t *self_p);
+
+void async_input_init(struct async_input_t *self_p,
+                      struct async_input_pool_t *pool_p);
+
+/**
+ * Discard all received data.
+ */
+void async_input_clear(struct async_input_t *self_p);
+
+/**
+ * The socket has data to read. Called before on_input.
+ */
+void async_input_set_readable(struct async_input_t *self_p);
+
+/**
+ * Read up to size bytes, copying from received data. Large reads go
+ * directly to given buffer if no data is buffered. Returns as
+ * read(), with EAGAIN once the socket has been read once since it
+ * became readable.
+ */
+ssize_t async_input_read(struct async_input_t *self_p,
+                         int sockfd,
+                         void *buf_p,
+                         size_t size);
+
+/**
+ * Borrow received data, reading from the socket first if readable.
+ * Returns as read().
+ */
+ssize_t async_input_borrow(struct async_input_t *self_p,
+                           int sockfd,
+                           const uint8_t **buf_pp);
+
+void async_input_release(struct async_input_t *self_p, size_t size);
+
+/**
+ * Returns true if data is left and more has been consumed than
+ * given number of bytes, that is, on_input should be called again.
+ */
+bool async_input_is_progressing(struct async_input_t *self_p, size_t consumed);
+
+struct async_slab_object_t {
+    struct async_slab_object_t *next_p;
+};
+
+/**
+ * Fixed size objects allocated ASYNC_SLAB_LENGTH at a time, and never
+ * given back to malloc. Objects are allocated by one thread, and may
+ * be freed by any thread. Freed objects are pushed on a lock-free
+ * stack, which the allocating thread takes all of at once when its
+ * own free list is empty.
+ */
+struct async_slab_t {
+    size_t size;
+    /* Only used by the allocating thread. */
+    struct async_slab_object_t *free_p;
+    atomic_size_t allocations;
+    atomic_size_t misses;
+    atomic_size_t capacity;
+    /* Written by freeing threads. */
+    _Alignas(64) _Atomic(struct async_slab_object_t *) freed_p;
+    atomic_size_t frees;
+};
+
+/**
+ * Slab usage. Only approximate while objects are allocated and freed.
+ */
+struct async_slab_statistics_t {
+    /* Number of allocations. */
+    size_t allocations;
+    /* Number of allocations that had to allocate a slab. */
+    size_t misses;
+    /* Number of objects in all slabs. */
+    size_t capacity;
+    /* Number of allocated objects not yet freed. */
+    size_t used;
+};
+
+/**
+ * Initialize given slab with objects of given size.
+ */
+void async_slab_init(struct async_slab_t *self_p, size_t size);
+
+/**
+ * Allocate an object. Must only be called by one thread.
+ */
+void *async_slab_alloc(struct async_slab_t *self_p);
+
+/**
+ * Free given object. May be called from any thread.
+ */
+void async_slab_free(struct async_slab_t *self_p, void *object_p);
+
+/**
+ * Add the statistics of given slab to given statistics.
+ */
+void async_slab_add_statistics(struct async_slab_t *self_p,
+                               struct async_slab_statistics_t *statistics_p);
+
+/**
+ * A message passed between threads, followed by its payload.
+ */
+struct async_message_t {
+    struct async_message_t *next_p;
+    struct async_slab_t *slab_p;
+    int type;
+};
+
+/**
+ * An unbounded lock-free multi-producer single-consumer queue of
+ * messages. Producers push on a stack, and the consumer takes all of
+ * it at once, reversed to the order the messages were put in.
+ */
+struct async_message_queue_t {
+    _Atomic(struct async_message_t *) head_p;
+    /* Only used by the consumer. */
+    _Alignas(64) struct async_message_t *taken_p;
+};
+
+/**
+ * Initialize given slab for messages with payloads of given size.
+ */
+void async_message_slab_init(struct async_slab_t *slab_p, size_t size);
+
+/**
+ * Allocate a message of given type from given message slab. Returns
+ * the payload.
+ */
+void *async_message_alloc(struct async_slab_t *slab_p, int type);
+
+/**
+ * Free given payload, and its message, to the slab it was allocated
+ * from. May be called from any thread.
+ */
+void async_message_free(void *message_p);
+
+void async_message_queue_init(struct async_message_queue_t *self_p);
+
+/**
+ * Put given payload in given queue. May be called from any thread.
+ * Returns true if the queue was empty, that is, the caller must wake
+ * up the consumer.
+ */
+bool async_message_queue_put(struct async_message_queue_t *self_p,
+                             void *message_p);
+
+/**
+ * Get the oldest payload and its type from given queue, or NULL if
+ * empty. May only be called from the consumer thread.
+ */
+void *async_message_queue_get(struct async_message_queue_t *self_p,
+                              int *type_p);
+
+/**
+ * Wake up the async thread of the runtime given when the calls were
+ * initialized.
+ */
+typedef void (*async_calls_wakeup_t)(void *obj_p);
+
+/**
+ * Threadsafe calls and worker pool jobs of a runtime. Functions are
+ * put in a ring by any thread and called by the async thread, which
+ * is woken up by the runtime specific wakeup function once per batch.
+ */
+struct async_calls_t {
+    struct async_mpsc_ring_t ring;
+    struct async_worker_pool_t worker_pool;
+    /* Jobs are allocated and freed by the async thread. */
+    struct async_slab_t jobs;
+    async_calls_wakeup_t wakeup;
+    void *obj_p;
+};
+
+/**
+ * Initialize given calls with a ring of given length, a power of
+ * two. Returns zero or negative error code.
+ */
+int async_calls_init(struct async_calls_t *self_p,
+                     size_t length,
+                     async_calls_wakeup_t wakeup,
+                     void *obj_p);
+
+void async_calls_destroy(struct async_calls_t *self_p);
+
+/**
+ * Call given function in the async thread. May be called from any
+ * thread. Waits for room if the ring is full.
+ */
+void async_calls_call_threadsafe(struct async_calls_t *self_p,
+                                 async_func_t func,
+                                 void *obj_p,
+                                 void *arg_p);
+
+/**
+ * Call given function in a worker, and then given complete function
+ * in the async thread. The worker pool is started on first use as
+ * configured in given async object. Returns zero or negative error
+ * code.
+ */
+int async_calls_call_worker_pool(struct async_calls_t *self_p,
+                                 struct async_t *async_p,
+                                 async_func_t entry,
+                                 void *obj_p,
+                                 void *arg_p,
+                                 async_func_t on_complete);
+
+/**
+ * Call all functions in the ring. Called by the async thread when
+ * woken up.
+ */
+void async_calls_process(struct async_calls_t *self_p);
+
+/**
+ * Destroy given single threaded runtime, created by
+ * async_runtime_linux_st_create(). It must not have been started.
+ */
+void async_runtime_linux_st_destroy(struct async_runtime_t *runtime_p);
+
+/**
+ * Set the CPU given single threaded runtime is pinned to. TCP servers
+ * started after this prefer connections handled by the kernel on
+ * that CPU.
+ */
+void async_runtime_linux_st_set_cpu(struct async_runtime_t *runtime_p,
+                                    int cpu);
+
+/**
+ * Get the host name resolver of given runtime, for example to replace
+ * its resolve function in tests.
+ */
+struct async_resolver_t *async_runtime_linux_get_resolver(
+    struct async_runtime_t *runtime_p);
+
+struct async_resolver_t *async_runtime_linux_st_get_resolver(
+    struct async_runtime_t *runtime_p);
+
+struct async_resolver_t *async_runtime_linux_uring_get_resolver(
+    struct async_runtime_t *runtime_p);
+
+#endif
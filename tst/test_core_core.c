@@ -1,3 +1,4 @@
+#include <unistd.h>
 #include "nala.h"
 #include "async.h"
 
@@ -44,11 +45,14 @@ TEST(call_twice)
     async_destroy(&async);
 }
 
+#if defined(ASYNC_FUNC_QUEUE_FIXED)
+
 TEST(call_queue_full)
 {
     struct async_t async;
     int arg;
     int i;
+    struct async_call_queue_statistics_t statistics;
 
     async_init(&async);
     arg = 0;
@@ -59,11 +63,348 @@ TEST(call_queue_full)
 
     ASSERT_EQ(async_call(&async, (async_func_t)increment, NULL, &arg),
               -ASYNC_ERROR_QUEUE_FULL);
+    async_get_call_queue_statistics(&async, &statistics);
+    ASSERT_EQ(statistics.number_of_drops, 1u);
     async_process(&async);
     ASSERT_EQ(arg, 32);
     async_destroy(&async);
 }
 
+#else
+
+TEST(call_queue_grows)
+{
+    struct async_t async;
+    int arg;
+    int i;
+    int j;
+    struct async_call_queue_statistics_t statistics;
+
+    async_init(&async);
+    arg = 0;
+
+    /* Both within and across segments, and reusing pooled ones. */
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 1000; j++) {
+            ASSERT_EQ(async_call(&async,
+                                 (async_func_t)increment,
+                                 NULL,
+                                 &arg), 0);
+        }
+
+        async_get_call_queue_statistics(&async, &statistics);
+        ASSERT_EQ(statistics.length, 1000);
+        async_process(&async);
+        ASSERT_EQ(arg, 1000 * (i + 1));
+    }
+
+    async_get_call_queue_statistics(&async, &statistics);
+    ASSERT_EQ(statistics.length, 0);
+    ASSERT_EQ(statistics.max_length, 1000);
+    ASSERT_EQ(statistics.number_of_overflows, 0u);
+    ASSERT_EQ(statistics.number_of_drops, 0u);
+    async_destroy(&async);
+}
+
+TEST(call_queue_soft_max)
+{
+    struct async_t async;
+    int arg;
+    int i;
+    struct async_call_queue_statistics_t statistics;
+
+    async_init(&async);
+    async_set_call_queue_soft_max(&async, 32);
+    arg = 0;
+
+    /* Calls above the soft max are queued and counted. */
+    for (i = 0; i < 40; i++) {
+        ASSERT_EQ(async_call(&async, (async_func_t)increment, NULL, &arg), 0);
+    }
+
+    async_get_call_queue_statistics(&async, &statistics);
+    ASSERT_EQ(statistics.length, 40);
+    ASSERT_EQ(statistics.number_of_overflows, 8u);
+    async_process(&async);
+    ASSERT_EQ(arg, 40);
+    async_destroy(&async);
+}
+
+#endif
+
+static void call_again(struct async_t *async_p, int *arg_p)
+{
+    (*arg_p)++;
+
+    if (*arg_p < 100) {
+        ASSERT_EQ(async_call(async_p,
+                             (async_func_t)call_again,
+                             async_p,
+                             arg_p), 0);
+    }
+}
+
+TEST(call_from_called_function)
+{
+    struct async_t async;
+    int arg;
+
+    async_init(&async);
+    arg = 0;
+    ASSERT_EQ(async_call(&async, (async_func_t)call_again, &async, &arg),
+              0);
+    async_process(&async);
+    ASSERT_EQ(arg, 100);
+    async_destroy(&async);
+}
+
+static void call_forever(struct async_t *async_p, int *arg_p)
+{
+    (*arg_p)++;
+    ASSERT_EQ(async_call(async_p, (async_func_t)call_forever, async_p, arg_p),
+              0);
+}
+
+TEST(process_budget_calls)
+{
+    struct async_t async;
+    int arg;
+
+    async_init(&async);
+    async_set_process_budget(&async, 10, 0);
+    arg = 0;
+    ASSERT_EQ(async_call(&async, (async_func_t)call_forever, &async, &arg),
+              0);
+
+    /* Calls left when the budget is used up are made in the next
+       process. */
+    async_process(&async);
+    ASSERT_EQ(arg, 10);
+    ASSERT(async_has_pending_calls(&async));
+    async_process(&async);
+    ASSERT_EQ(arg, 20);
+    ASSERT(async_has_pending_calls(&async));
+    async_destroy(&async);
+}
+
+static void sleep_forever(struct async_t *async_p, int *arg_p)
+{
+    (*arg_p)++;
+    usleep(2000);
+    ASSERT_EQ(async_call(async_p, (async_func_t)sleep_forever, async_p, arg_p),
+              0);
+}
+
+TEST(process_budget_time)
+{
+    struct async_t async;
+    int arg;
+
+    async_init(&async);
+    async_set_process_budget(&async, 0, 1000);
+    arg = 0;
+    ASSERT_EQ(async_call(&async, (async_func_t)sleep_forever, &async, &arg),
+              0);
+
+    /* Each call takes longer than the budget. */
+    async_process(&async);
+    ASSERT_EQ(arg, 1);
+    async_process(&async);
+    ASSERT_EQ(arg, 2);
+    async_destroy(&async);
+}
+
+struct order_t {
+    struct async_t *async_p;
+    char calls[32];
+    int length;
+};
+
+static void order_append(struct order_t *self_p, char *name_p)
+{
+    self_p->calls[self_p->length++] = *name_p;
+    self_p->calls[self_p->length] = '\0';
+}
+
+static void order_append_and_call_high(struct order_t *self_p,
+                                       char *name_p)
+{
+    order_append(self_p, name_p);
+    ASSERT_EQ(async_call_with_priority(self_p->async_p,
+                                       ASYNC_PRIORITY_HIGH,
+                                       (async_func_t)order_append,
+                                       self_p,
+                                       "h"), 0);
+}
+
+TEST(call_with_priority)
+{
+    struct async_t async;
+    struct order_t order;
+
+    async_init(&async);
+    order.length = 0;
+    ASSERT_EQ(async_call_with_priority(&async,
+                                       ASYNC_PRIORITY_IDLE,
+                                       (async_func_t)order_append,
+                                       &order,
+                                       "i"), 0);
+    ASSERT_EQ(async_call(&async, (async_func_t)order_append, &order, "n"), 0);
+    ASSERT_EQ(async_call_with_priority(&async,
+                                       ASYNC_PRIORITY_NORMAL,
+                                       (async_func_t)order_append,
+                                       &order,
+                                       "N"), 0);
+    ASSERT_EQ(async_call_with_priority(&async,
+                                       ASYNC_PRIORITY_HIGH,
+                                       (async_func_t)order_append,
+                                       &order,
+                                       "h"), 0);
+    ASSERT(async_has_pending_calls(&async));
+    async_process(&async);
+    ASSERT_EQ(&order.calls[0], "hnNi");
+    ASSERT(!async_has_pending_calls(&async));
+    async_destroy(&async);
+}
+
+TEST(call_with_invalid_priority)
+{
+    struct async_t async;
+    struct order_t order;
+
+    async_init(&async);
+    order.length = 0;
+    ASSERT_EQ(async_call_with_priority(&async,
+                                       ASYNC_PRIORITY_HIGH - 1,
+                                       (async_func_t)order_append,
+                                       &order,
+                                       "h"), -ASYNC_ERROR_INVALID_ARGUMENT);
+    ASSERT_EQ(async_call_with_priority(&async,
+                                       ASYNC_PRIORITY_IDLE + 1,
+                                       (async_func_t)order_append,
+                                       &order,
+                                       "i"), -ASYNC_ERROR_INVALID_ARGUMENT);
+    ASSERT_EQ(async_call_with_priority(&async,
+                                       ASYNC_PRIORITY_MAX,
+                                       (async_func_t)order_append,
+                                       &order,
+                                       "i"), -ASYNC_ERROR_INVALID_ARGUMENT);
+    ASSERT(!async_has_pending_calls(&async));
+    async_destroy(&async);
+}
+
+TEST(call_high_priority_between_normal_batches)
+{
+    struct async_t async;
+    struct order_t order;
+    int i;
+
+    async_init(&async);
+    order.async_p = &async;
+    order.length = 0;
+
+    /* The high priority call queued by the first normal call is made
+       after the first batch of normal calls. */
+    ASSERT_EQ(async_call(&async,
+                         (async_func_t)order_append_and_call_high,
+                         &order,
+                         "n"), 0);
+
+    for (i = 0; i < 11; i++) {
+        ASSERT_EQ(async_call(&async,
+                             (async_func_t)order_append,
+                             &order,
+                             "n"), 0);
+    }
+
+    async_process(&async);
+    ASSERT_EQ(ASYNC_FUNC_QUEUE_NORMAL_BATCH, 8);
+    ASSERT_EQ(&order.calls[0], "nnnnnnnnhnnnn");
+    async_destroy(&async);
+}
+
+static void idle_call_again(struct async_t *async_p, int *arg_p)
+{
+    (*arg_p)++;
+    ASSERT_EQ(async_call_with_priority(async_p,
+                                       ASYNC_PRIORITY_IDLE,
+                                       (async_func_t)idle_call_again,
+                                       async_p,
+                                       arg_p), 0);
+}
+
+TEST(call_idle_priority_again)
+{
+    struct async_t async;
+    int arg;
+
+    async_init(&async);
+    arg = 0;
+
+    /* Idle calls queued by idle calls are made in the next
+       process. */
+    ASSERT_EQ(async_call_with_priority(&async,
+                                       ASYNC_PRIORITY_IDLE,
+                                       (async_func_t)idle_call_again,
+                                       &async,
+                                       &arg), 0);
+    async_process(&async);
+    ASSERT_EQ(arg, 1);
+    ASSERT(async_has_pending_calls(&async));
+    async_process(&async);
+    ASSERT_EQ(arg, 2);
+    ASSERT(async_has_pending_calls(&async));
+    async_destroy(&async);
+}
+
+#if defined(ASYNC_FUNC_QUEUE_FIXED)
+
+TEST(call_with_priority_queue_full)
+{
+    struct async_t async;
+    int arg;
+    int i;
+
+    async_init(&async);
+    arg = 0;
+
+    /* Each priority has its own queue. */
+    for (i = 0; i < 32; i++) {
+        ASSERT_EQ(async_call(&async, (async_func_t)increment, NULL, &arg), 0);
+    }
+
+    for (i = 0; i < 8; i++) {
+        ASSERT_EQ(async_call_with_priority(&async,
+                                           ASYNC_PRIORITY_HIGH,
+                                           (async_func_t)increment,
+                                           NULL,
+                                           &arg), 0);
+        ASSERT_EQ(async_call_with_priority(&async,
+                                           ASYNC_PRIORITY_IDLE,
+                                           (async_func_t)increment,
+                                           NULL,
+                                           &arg), 0);
+    }
+
+    ASSERT_EQ(async_call_with_priority(&async,
+                                       ASYNC_PRIORITY_HIGH,
+                                       (async_func_t)increment,
+                                       NULL,
+                                       &arg),
+              -ASYNC_ERROR_QUEUE_FULL);
+    ASSERT_EQ(async_call_with_priority(&async,
+                                       ASYNC_PRIORITY_IDLE,
+                                       (async_func_t)increment,
+                                       NULL,
+                                       &arg),
+              -ASYNC_ERROR_QUEUE_FULL);
+    async_process(&async);
+    ASSERT_EQ(arg, 48);
+    async_destroy(&async);
+}
+
+#endif
+
 static int log_print_object;
 
 static void log_stdout(void *log_object_p,
@@ -0,0 +1,226 @@
+#include "nala.h"
+#include "async.h"
+#include "utils.h"
+
+struct reader_t {
+    struct async_coroutine_t coroutine;
+    int available;
+    int number_of_reads;
+    int number_of_timeouts;
+    int number_of_yields;
+    int number_of_sleeps;
+};
+
+static void reader_main(struct async_coroutine_t *self_p)
+{
+    struct reader_t *reader_p;
+
+    reader_p = self_p->obj_p;
+
+    ASYNC_COROUTINE_BEGIN(self_p);
+
+    while (reader_p->number_of_reads < 2) {
+        ASYNC_COROUTINE_AWAIT(self_p, reader_p->available > 0);
+        reader_p->available--;
+        reader_p->number_of_reads++;
+    }
+
+    ASYNC_COROUTINE_END(self_p);
+}
+
+TEST(await)
+{
+    struct async_t async;
+    struct reader_t reader;
+
+    async_init(&async);
+    reader.available = 0;
+    reader.number_of_reads = 0;
+    async_coroutine_init(&reader.coroutine, reader_main, &reader, &async);
+
+    /* Not started. */
+    async_coroutine_resume(&reader.coroutine);
+    ASSERT(async_coroutine_is_done(&reader.coroutine));
+
+    /* Started in a later call. */
+    ASSERT_EQ(async_coroutine_start(&reader.coroutine), 0);
+    ASSERT(!async_coroutine_is_done(&reader.coroutine));
+    async_process(&async);
+    ASSERT_EQ(reader.number_of_reads, 0);
+
+    /* Resumed without the condition being true. */
+    async_coroutine_resume(&reader.coroutine);
+    ASSERT_EQ(reader.number_of_reads, 0);
+
+    /* Resumed with data available. */
+    reader.available = 1;
+    async_coroutine_resume(&reader.coroutine);
+    ASSERT_EQ(reader.number_of_reads, 1);
+    ASSERT(!async_coroutine_is_done(&reader.coroutine));
+
+    /* Available data is read without waiting. */
+    reader.available = 2;
+    async_coroutine_resume(&reader.coroutine);
+    ASSERT_EQ(reader.number_of_reads, 2);
+    ASSERT_EQ(reader.available, 1);
+    ASSERT(async_coroutine_is_done(&reader.coroutine));
+
+    /* Not resumed once done. */
+    async_coroutine_resume(&reader.coroutine);
+    ASSERT_EQ(reader.number_of_reads, 2);
+
+    async_destroy(&async);
+}
+
+static void timeout_reader_main(struct async_coroutine_t *self_p)
+{
+    struct reader_t *reader_p;
+
+    reader_p = self_p->obj_p;
+
+    ASYNC_COROUTINE_BEGIN(self_p);
+
+    while (true) {
+        ASYNC_COROUTINE_AWAIT_TIMEOUT(self_p, reader_p->available > 0, 200);
+
+        if (self_p->res == -ASYNC_ERROR_TIMEOUT) {
+            reader_p->number_of_timeouts++;
+        } else {
+            ASSERT_EQ(self_p->res, 0);
+            reader_p->available--;
+            reader_p->number_of_reads++;
+        }
+    }
+
+    ASYNC_COROUTINE_END(self_p);
+}
+
+TEST(await_timeout)
+{
+    struct async_t async;
+    struct reader_t reader;
+
+    async_init(&async);
+    reader.available = 0;
+    reader.number_of_reads = 0;
+    reader.number_of_timeouts = 0;
+    async_coroutine_init(&reader.coroutine,
+                         timeout_reader_main,
+                         &reader,
+                         &async);
+    ASSERT_EQ(async_coroutine_start(&reader.coroutine), 0);
+    async_process(&async);
+
+    /* Data available before the timeout. */
+    async_tick(&async);
+    async_process(&async);
+    reader.available = 1;
+    async_coroutine_resume(&reader.coroutine);
+    ASSERT_EQ(reader.number_of_reads, 1);
+    ASSERT_EQ(reader.number_of_timeouts, 0);
+
+    /* The timer was restarted by the next wait. */
+    async_tick(&async);
+    async_tick(&async);
+    async_process(&async);
+    ASSERT_EQ(reader.number_of_timeouts, 0);
+    async_tick(&async);
+    async_process(&async);
+    ASSERT_EQ(reader.number_of_timeouts, 1);
+    ASSERT_EQ(reader.number_of_reads, 1);
+
+    /* Data available after the timer expired, but before the timeout
+       is handled. The timeout is ignored. */
+    async_tick(&async);
+    async_tick(&async);
+    async_tick(&async);
+    reader.available = 1;
+    async_coroutine_resume(&reader.coroutine);
+    ASSERT_EQ(reader.number_of_reads, 2);
+    async_process(&async);
+    ASSERT_EQ(reader.number_of_timeouts, 1);
+
+    /* Stopped while waiting. */
+    async_coroutine_stop(&reader.coroutine);
+    ASSERT(async_coroutine_is_done(&reader.coroutine));
+    async_tick(&async);
+    async_tick(&async);
+    async_tick(&async);
+    async_process(&async);
+    ASSERT_EQ(reader.number_of_timeouts, 1);
+
+    async_destroy(&async);
+}
+
+static void yield_main(struct async_coroutine_t *self_p)
+{
+    struct reader_t *reader_p;
+
+    reader_p = self_p->obj_p;
+
+    ASYNC_COROUTINE_BEGIN(self_p);
+
+    while (reader_p->number_of_yields < 3) {
+        reader_p->number_of_yields++;
+        ASYNC_COROUTINE_YIELD(self_p);
+    }
+
+    ASYNC_COROUTINE_SLEEP(self_p, 0);
+    reader_p->number_of_sleeps++;
+
+    ASYNC_COROUTINE_END(self_p);
+}
+
+static void on_yield_call(int *value_p, void *arg_p)
+{
+    (void)arg_p;
+
+    (*value_p)++;
+}
+
+TEST(yield_and_sleep)
+{
+    struct async_t async;
+    struct reader_t reader;
+    int value;
+
+    async_init(&async);
+    async_set_process_budget(&async, 1, 0);
+    reader.number_of_yields = 0;
+    reader.number_of_sleeps = 0;
+    value = 0;
+    async_coroutine_init(&reader.coroutine, yield_main, &reader, &async);
+    ASSERT_EQ(async_coroutine_start(&reader.coroutine), 0);
+    ASSERT_EQ(async_call(&async, (async_func_t)on_yield_call, &value, NULL), 0);
+
+    /* Calls queued before a yield are made before the coroutine
+       continues. */
+    async_process(&async);
+    ASSERT_EQ(reader.number_of_yields, 1);
+    ASSERT_EQ(value, 0);
+    async_process(&async);
+    ASSERT_EQ(value, 1);
+    ASSERT_EQ(reader.number_of_yields, 1);
+    async_process(&async);
+    ASSERT_EQ(reader.number_of_yields, 2);
+    async_process(&async);
+    ASSERT_EQ(reader.number_of_yields, 3);
+    async_process(&async);
+    ASSERT(!async_has_pending_calls(&async));
+
+    /* Sleeping, even if resumed. */
+    async_coroutine_resume(&reader.coroutine);
+    ASSERT_EQ(reader.number_of_sleeps, 0);
+    async_tick(&async);
+    async_process(&async);
+    ASSERT_EQ(reader.number_of_sleeps, 1);
+    ASSERT(async_coroutine_is_done(&reader.coroutine));
+
+    /* Restarted. */
+    reader.number_of_yields = 0;
+    ASSERT_EQ(async_coroutine_start(&reader.coroutine), 0);
+    async_process(&async);
+    ASSERT_EQ(reader.number_of_yields, 1);
+
+    async_destroy(&async);
+}
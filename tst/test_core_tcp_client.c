@@ -24,10 +24,64 @@ TEST(call_all_functions)
     runtime_test_tcp_client_read_mock_once(5, 6);
     ASSERT_EQ(async_tcp_client_read(&tcp, NULL, 5), 6u);
 
+    runtime_test_tcp_client_borrow_mock_once(7);
+    ASSERT_EQ(async_tcp_client_borrow(&tcp, NULL), 7u);
+
+    runtime_test_tcp_client_release_mock_once(4);
+    async_tcp_client_release(&tcp, 4);
+
     runtime_test_tcp_client_disconnect_mock_once();
     async_tcp_client_disconnect(&tcp);
 }
 
+TEST(connect_timeout)
+{
+    struct async_t async;
+    struct async_tcp_client_t tcp;
+
+    async_init(&async);
+
+    runtime_test_set_async_mock();
+    async_set_runtime(&async, runtime_test_create());
+
+    runtime_test_tcp_client_init_mock_once();
+    async_tcp_client_init(&tcp, NULL, NULL, NULL, &async);
+    ASSERT_EQ(tcp.connect_timeout,
+              (unsigned int)ASYNC_TCP_CLIENT_CONNECT_TIMEOUT);
+
+    async_tcp_client_set_connect_timeout(&tcp, 500);
+    ASSERT_EQ(tcp.connect_timeout, 500u);
+}
+
+TEST(output_watermarks)
+{
+    struct async_t async;
+    struct async_tcp_client_t tcp;
+
+    async_init(&async);
+
+    runtime_test_set_async_mock();
+    async_set_runtime(&async, runtime_test_create());
+
+    runtime_test_tcp_client_init_mock_once();
+    async_tcp_client_init(&tcp, NULL, NULL, NULL, &async);
+    ASSERT_EQ(tcp.output.low_watermark,
+              (size_t)ASYNC_TCP_CLIENT_OUTPUT_LOW_WATERMARK);
+    ASSERT_EQ(tcp.output.high_watermark,
+              (size_t)ASYNC_TCP_CLIENT_OUTPUT_HIGH_WATERMARK);
+
+    async_tcp_client_set_output_watermarks(&tcp, 100, 1000);
+    ASSERT_EQ(tcp.output.low_watermark, (size_t)100);
+    ASSERT_EQ(tcp.output.high_watermark, (size_t)1000);
+
+    runtime_test_tcp_client_is_writable_mock_once(false);
+    ASSERT(!async_tcp_client_is_writable(&tcp));
+
+    /* The default callback does nothing. */
+    async_tcp_client_set_on_writable(&tcp, NULL);
+    tcp.output.on_writable(&tcp);
+}
+
 TEST(call_default_callbacks)
 {
     struct async_t async;
@@ -50,8 +104,9 @@ TEST(call_default_callbacks)
 
     /* Call the callbacks. */
     params_p->on_connected(&tcp, 0);
-    runtime_test_tcp_client_read_mock_once(32, 30);
-    runtime_test_tcp_client_read_mock_once(32, 0);
+    runtime_test_tcp_client_borrow_mock_once(30);
+    runtime_test_tcp_client_release_mock_once(30);
+    runtime_test_tcp_client_borrow_mock_once(0);
     params_p->on_input(&tcp);
     params_p->on_disconnected(&tcp);
 }
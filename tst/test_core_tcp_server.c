@@ -28,6 +28,12 @@ TEST(call_all_functions)
     runtime_test_tcp_server_client_read_mock_once(5, 6);
     ASSERT_EQ(async_tcp_server_client_read(&client, NULL, 5), 6u);
 
+    runtime_test_tcp_server_client_borrow_mock_once(7);
+    ASSERT_EQ(async_tcp_server_client_borrow(&client, NULL), 7u);
+
+    runtime_test_tcp_server_client_release_mock_once(4);
+    async_tcp_server_client_release(&client, 4);
+
     runtime_test_tcp_server_client_disconnect_mock_once();
     async_tcp_server_client_disconnect(&client);
 
@@ -35,6 +41,29 @@ TEST(call_all_functions)
     async_tcp_server_stop(&server);
 }
 
+TEST(listen_options)
+{
+    struct async_t async;
+    struct async_tcp_server_t server;
+
+    async_init(&async);
+
+    runtime_test_set_async_mock();
+    async_set_runtime(&async, runtime_test_create());
+
+    runtime_test_tcp_server_init_mock_once("127.0.0.1", 4446);
+    async_tcp_server_init(&server, "127.0.0.1", 4446, NULL, NULL, NULL, &async);
+
+    ASSERT_EQ(server.backlog, ASYNC_TCP_SERVER_BACKLOG);
+    ASSERT(!server.reuse_port);
+
+    async_tcp_server_set_backlog(&server, 10);
+    ASSERT_EQ(server.backlog, 10);
+
+    async_tcp_server_set_reuse_port(&server, true);
+    ASSERT(server.reuse_port);
+}
+
 TEST(call_default_callbacks)
 {
     struct async_t async;
@@ -61,8 +90,9 @@ TEST(call_default_callbacks)
 
     /* Call the callbacks. */
     params_p->on_connected(&client);
-    runtime_test_tcp_server_client_read_mock_once(32, 30);
-    runtime_test_tcp_server_client_read_mock_once(32, 0);
+    runtime_test_tcp_server_client_borrow_mock_once(30);
+    runtime_test_tcp_server_client_release_mock_once(30);
+    runtime_test_tcp_server_client_borrow_mock_once(0);
     params_p->on_input(&client);
     params_p->on_disconnected(&client);
 }
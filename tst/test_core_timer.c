@@ -498,3 +498,310 @@ TEST(stop_multiple_timers)
     ASSERT_EQ(counters[8].value, 0);
     ASSERT_EQ(counters[9].value, 1);
 }
+
+static void tick_many(struct async_t *async_p, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        async_tick(async_p);
+    }
+}
+
+TEST(long_timeouts)
+{
+    unsigned int timeouts[9] = {
+        62, 63, 64, 4094, 4095, 4096, 262143, 262144, 300000
+    };
+    struct counter_t counters[9];
+    unsigned int ticks;
+    int i;
+    struct async_t async;
+
+    async_init(&async);
+    async_set_tick_in_ms(&async, 1);
+
+    for (i = 0; i < 9; i++) {
+        counters[i].value = 0;
+        async_timer_init(&counters[i].timer,
+                         (async_timer_timeout_t)on_timeout,
+                         &counters[i],
+                         timeouts[i],
+                         0,
+                         &async);
+        async_timer_start(&counters[i].timer);
+    }
+
+    /* Each timer expires one tick after its timeout, and not a tick
+       earlier, even if cascaded from higher levels of the wheel. */
+    ticks = 0;
+
+    for (i = 0; i < 9; i++) {
+        tick_many(&async, timeouts[i] - ticks);
+        ticks = timeouts[i];
+        async_process(&async);
+        ASSERT_EQ(counters[i].value, 0);
+        async_tick(&async);
+        ticks++;
+        async_process(&async);
+        ASSERT_EQ(counters[i].value, 1);
+    }
+
+    async_destroy(&async);
+}
+
+TEST(tick_counter_wrap_around)
+{
+    struct async_t async;
+    struct counter_t counters[2];
+
+    async_init(&async);
+    async_set_tick_in_ms(&async, 1);
+    async.running_timers.tick = 0xfffffff0;
+    counters[0].value = 0;
+    async_timer_init(&counters[0].timer,
+                     (async_timer_timeout_t)on_timeout,
+                     &counters[0],
+                     99,
+                     0,
+                     &async);
+    async_timer_start(&counters[0].timer);
+    counters[1].value = 0;
+    async_timer_init(&counters[1].timer,
+                     (async_timer_timeout_t)on_timeout,
+                     &counters[1],
+                     9,
+                     10,
+                     &async);
+    async_timer_start(&counters[1].timer);
+
+    /* The periodic timer expires every 10 ticks. */
+    tick_many(&async, 99);
+    async_process(&async);
+    ASSERT_EQ(counters[0].value, 0);
+    ASSERT_EQ(counters[1].value, 9);
+    async_tick(&async);
+    async_process(&async);
+    ASSERT_EQ(counters[0].value, 1);
+    ASSERT_EQ(counters[1].value, 10);
+
+    async_destroy(&async);
+}
+
+TEST(stop_cascaded_timer)
+{
+    struct async_t async;
+    struct counter_t counter;
+
+    async_init(&async);
+    async_set_tick_in_ms(&async, 1);
+    counter.value = 0;
+    async_timer_init(&counter.timer,
+                     (async_timer_timeout_t)on_timeout,
+                     &counter,
+                     5000,
+                     0,
+                     &async);
+    async_timer_start(&counter.timer);
+
+    /* Stop after the timer has been moved to a lower level. */
+    tick_many(&async, 4500);
+    async_timer_stop(&counter.timer);
+    tick_many(&async, 1000);
+    async_process(&async);
+    ASSERT_EQ(counter.value, 0);
+
+    /* Stopping again is a noop. */
+    async_timer_stop(&counter.timer);
+
+    async_destroy(&async);
+}
+
+TEST(next_timeout)
+{
+    struct async_t async;
+    struct counter_t counters[2];
+
+    async_init(&async);
+    ASSERT_EQ(async_next_timeout(&async), -1);
+
+    /* 250 ms is rounded up to three ticks, plus the current tick. */
+    counters[0].value = 0;
+    async_timer_init(&counters[0].timer,
+                     (async_timer_timeout_t)on_timeout,
+                     &counters[0],
+                     250,
+                     0,
+                     &async);
+    async_timer_start(&counters[0].timer);
+    ASSERT_EQ(async_next_timeout(&async), 400);
+    async_tick(&async);
+    ASSERT_EQ(async_next_timeout(&async), 300);
+
+    /* A timer in a higher level gives the time it is cascaded. */
+    counters[1].value = 0;
+    async_timer_init(&counters[1].timer,
+                     (async_timer_timeout_t)on_timeout,
+                     &counters[1],
+                     10000,
+                     0,
+                     &async);
+    async_timer_start(&counters[1].timer);
+    async_timer_stop(&counters[0].timer);
+    ASSERT_EQ(async_next_timeout(&async), 6300);
+    async_advance(&async, 63);
+    ASSERT_EQ(async_next_timeout(&async), 3800);
+
+    async_timer_stop(&counters[1].timer);
+    ASSERT_EQ(async_next_timeout(&async), -1);
+
+    async_destroy(&async);
+}
+
+TEST(advance)
+{
+    struct async_t async;
+    struct counter_t counters[3];
+
+    async_init(&async);
+    async_set_tick_in_ms(&async, 1);
+    counters[0].value = 0;
+    async_timer_init(&counters[0].timer,
+                     (async_timer_timeout_t)on_timeout,
+                     &counters[0],
+                     299999,
+                     0,
+                     &async);
+    async_timer_start(&counters[0].timer);
+    counters[1].value = 0;
+    async_timer_init(&counters[1].timer,
+                     (async_timer_timeout_t)on_timeout,
+                     &counters[1],
+                     49999,
+                     50000,
+                     &async);
+    async_timer_start(&counters[1].timer);
+    counters[2].value = 0;
+    async_timer_init(&counters[2].timer,
+                     (async_timer_timeout_t)on_timeout,
+                     &counters[2],
+                     7,
+                     0,
+                     &async);
+    async_timer_start(&counters[2].timer);
+
+    /* Expiring timers are not skipped. */
+    async_advance(&async, 299999);
+    async_process(&async);
+    ASSERT_EQ(counters[0].value, 0);
+    ASSERT_EQ(counters[1].value, 5);
+    ASSERT_EQ(counters[2].value, 1);
+    async_advance(&async, 1);
+    async_process(&async);
+    ASSERT_EQ(counters[0].value, 1);
+    ASSERT_EQ(counters[1].value, 6);
+
+    /* Time is advanced with no timers running. */
+    async_timer_stop(&counters[1].timer);
+    async_advance(&async, 1000000);
+    ASSERT_EQ(async.running_timers.tick, 1300000u);
+    async_timer_start(&counters[2].timer);
+    async_advance(&async, 7);
+    async_process(&async);
+    ASSERT_EQ(counters[2].value, 1);
+    async_advance(&async, 1);
+    async_process(&async);
+    ASSERT_EQ(counters[2].value, 2);
+
+    async_destroy(&async);
+}
+
+TEST(is_running)
+{
+    struct async_t async;
+    struct counter_t counters[2];
+
+    async_init(&async);
+    counters[0].value = 0;
+    async_timer_init(&counters[0].timer,
+                     (async_timer_timeout_t)on_timeout,
+                     &counters[0],
+                     100,
+                     0,
+                     &async);
+    counters[1].value = 0;
+    async_timer_init(&counters[1].timer,
+                     (async_timer_timeout_t)on_timeout,
+                     &counters[1],
+                     100,
+                     100,
+                     &async);
+    ASSERT(!async_timer_is_running(&counters[0].timer));
+
+    /* Stopping a timer that is not running is a noop. */
+    async_timer_stop(&counters[0].timer);
+    ASSERT(!async_timer_is_running(&counters[0].timer));
+
+    async_timer_start(&counters[0].timer);
+    async_timer_start(&counters[1].timer);
+    ASSERT(async_timer_is_running(&counters[0].timer));
+    ASSERT(async_timer_is_running(&counters[1].timer));
+    async_tick(&async);
+    async_tick(&async);
+    async_process(&async);
+    ASSERT_EQ(counters[0].value, 1);
+    ASSERT_EQ(counters[1].value, 1);
+    ASSERT(!async_timer_is_running(&counters[0].timer));
+    ASSERT(async_timer_is_running(&counters[1].timer));
+    async_timer_stop(&counters[1].timer);
+    ASSERT(!async_timer_is_running(&counters[1].timer));
+
+    async_destroy(&async);
+}
+
+TEST(restart_running_timer)
+{
+    struct async_t async;
+    struct counter_t counters[2];
+    int i;
+
+    async_init(&async);
+    counters[0].value = 0;
+    async_timer_init(&counters[0].timer,
+                     (async_timer_timeout_t)on_timeout,
+                     &counters[0],
+                     200,
+                     0,
+                     &async);
+    counters[1].value = 0;
+    async_timer_init(&counters[1].timer,
+                     (async_timer_timeout_t)on_timeout,
+                     &counters[1],
+                     400,
+                     0,
+                     &async);
+    async_timer_start(&counters[1].timer);
+
+    /* Restarting many times within a tick keeps the expiry. */
+    for (i = 0; i < 10; i++) {
+        async_timer_start(&counters[0].timer);
+    }
+
+    async_tick(&async);
+
+    /* Restarting in the next tick postpones the expiry. */
+    async_timer_start(&counters[0].timer);
+    async_tick(&async);
+    async_tick(&async);
+    async_process(&async);
+    ASSERT_EQ(counters[0].value, 0);
+    async_tick(&async);
+    async_process(&async);
+    ASSERT_EQ(counters[0].value, 1);
+    ASSERT_EQ(counters[1].value, 0);
+    async_tick(&async);
+    async_process(&async);
+    ASSERT_EQ(counters[1].value, 1);
+
+    async_destroy(&async);
+}
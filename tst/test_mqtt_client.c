@@ -1,3 +1,4 @@
+#include <string.h>
 #include "nala.h"
 #include "async.h"
 #include "async/modules/mqtt_client.h"
@@ -22,6 +23,43 @@ static void save_tcp_callbacks(struct async_tcp_client_t *self_p,
     tcp_on_input = on_input;
 }
 
+static const uint8_t *writev_buf_p;
+static size_t writev_size;
+
+static void check_writev(struct async_tcp_client_t *self_p,
+                         const struct async_iovec_t *iov_p,
+                         int length)
+{
+    size_t offset;
+    int i;
+
+    (void)self_p;
+
+    offset = 0;
+
+    for (i = 0; i < length; i++) {
+        ASSERT(offset + iov_p[i].size <= writev_size);
+        ASSERT(memcmp(iov_p[i].buf_p,
+                      &writev_buf_p[offset],
+                      iov_p[i].size) == 0);
+        offset += iov_p[i].size;
+    }
+
+    ASSERT_EQ(offset, writev_size);
+}
+
+/**
+ * Expect given data to be written in one call to
+ * async_tcp_client_writev().
+ */
+static void mock_prepare_writev(const uint8_t *buf_p, size_t size)
+{
+    writev_buf_p = buf_p;
+    writev_size = size;
+    async_tcp_client_writev_mock_ignore_in_once();
+    async_tcp_client_writev_mock_set_callback(check_writev);
+}
+
 static void on_connected(void *obj_p)
 {
     mqtt_on_connected(obj_p);
@@ -40,11 +78,26 @@ static void on_publish(void *obj_p,
     mqtt_on_publish(obj_p, topic_p, buf_p, size);
 }
 
+static void on_publish_chunk(void *obj_p,
+                             const char *topic_p,
+                             const uint8_t *buf_p,
+                             size_t size,
+                             size_t offset,
+                             size_t total_size)
+{
+    mqtt_on_publish_chunk(obj_p, topic_p, buf_p, size, offset, total_size);
+}
+
 static void on_subscribe_complete(void *obj_p, uint16_t transaction_id)
 {
     mqtt_on_subscribe_complete(obj_p, transaction_id);
 }
 
+static void on_publish_complete(void *obj_p, uint16_t packet_identifier)
+{
+    mqtt_on_publish_complete(obj_p, packet_identifier);
+}
+
 static void assert_init(struct async_t *async_p,
                         struct async_mqtt_client_t *client_p)
 {
@@ -76,47 +129,39 @@ static void assert_start_and_on_tcp_connected(
     tcp_on_connected(tcp_p, 0);
 }
 
-static void input_packet(uint8_t *buf_p,
-                         size_t length_size,
-                         size_t size)
+/**
+ * Expect a read of what fits in the receive buffer, with given number
+ * of bytes already in it, and give it given data.
+ */
+static void mock_prepare_read(uint8_t *buf_p, size_t size, size_t buffered)
 {
-    /* Fixed header. */
-    async_tcp_client_read_mock_once(1, 1);
-    async_tcp_client_read_mock_set_buf_p_out(&buf_p[0], 1);
-    tcp_on_input(tcp_p);
-
-    if (length_size == 1) {
-        async_tcp_client_read_mock_once(1, 1);
-        async_tcp_client_read_mock_set_buf_p_out(&buf_p[1], 1);
-        tcp_on_input(tcp_p);
-    } else if (length_size == 2) {
-        async_tcp_client_read_mock_once(1, 1);
-        async_tcp_client_read_mock_set_buf_p_out(&buf_p[1], 1);
-        tcp_on_input(tcp_p);
-        async_tcp_client_read_mock_once(1, 1);
-        async_tcp_client_read_mock_set_buf_p_out(&buf_p[2], 1);
-        tcp_on_input(tcp_p);
-    } else {
-        FAIL("Bad length.");
-    }
-
-    /* Data. */
-    size -= (length_size + 1);
+    async_tcp_client_read_mock_once(
+        ASYNC_MQTT_CLIENT_INPUT_BUFFER_SIZE - buffered,
+        size);
 
     if (size > 0) {
-        async_tcp_client_read_mock_once(size, size);
-        async_tcp_client_read_mock_set_buf_p_out(&buf_p[length_size + 1], size);
-        tcp_on_input(tcp_p);
+        async_tcp_client_read_mock_set_buf_p_out(buf_p, size);
     }
 }
 
+/**
+ * Input given data in one read. Reading continues until nothing is
+ * read.
+ */
+static void input_packet(uint8_t *buf_p, size_t size)
+{
+    mock_prepare_read(buf_p, size, 0);
+    mock_prepare_read(NULL, 0, 0);
+    tcp_on_input(tcp_p);
+}
+
 static void input_packet_suback(uint16_t transaction_id)
 {
     uint8_t suback[] = {
         0x90, 0x04, 0x00, transaction_id, 0x00, 0x00
     };
 
-    input_packet(&suback[0], 1, sizeof(suback));
+    input_packet(&suback[0], sizeof(suback));
 }
 
 static void input_packet_publish(void)
@@ -126,7 +171,7 @@ static void input_packet_publish(void)
         0x00, 0x56, 0x78
     };
 
-    input_packet(&publish[0], 1, sizeof(publish));
+    input_packet(&publish[0], sizeof(publish));
 }
 
 static void input_packet_pingresp(void)
@@ -135,23 +180,22 @@ static void input_packet_pingresp(void)
         0xd0, 0x00
     };
 
-    input_packet(&pingresp[0], 1, sizeof(pingresp));
+    input_packet(&pingresp[0], sizeof(pingresp));
 }
 
-static void assert_on_connected(uint8_t *connack_p,
-                                size_t length_size,
-                                size_t size)
+static void assert_on_connected(uint8_t *connack_p, size_t size)
 {
     mqtt_on_connected_mock_once();
-    input_packet(connack_p, length_size, size);
+    input_packet(connack_p, size);
 }
 
 static void assert_start_until_connected(struct async_mqtt_client_t *client_p)
 {
     uint8_t connect[] = {
-        0x10, 0x18, 0x00, 0x04, 0x4d, 0x51, 0x54, 0x54, 0x05, 0x02,
-        0x00, 0x1e, 0x00, 0x00, 0x0b, 0x61, 0x73, 0x79, 0x6e, 0x63,
-        0x2d, 0x31, 0x32, 0x33, 0x34, 0x35
+        0x10, 0x1e, 0x00, 0x04, 0x4d, 0x51, 0x54, 0x54, 0x05, 0x02,
+        0x00, 0x1e, 0x06, 0x21, 0x00, 0x10, 0x22, 0x00, 0x01, 0x00,
+        0x0b, 0x61, 0x73, 0x79, 0x6e, 0x63, 0x2d, 0x31, 0x32, 0x33,
+        0x34, 0x35
     };
     uint8_t connack[] = {
         0x20, 0x0b, 0x00, 0x00, 0x08, 0x24, 0x00, 0x25, 0x00, 0x28,
@@ -161,7 +205,7 @@ static void assert_start_until_connected(struct async_mqtt_client_t *client_p)
     assert_start_and_on_tcp_connected(client_p,
                                       &connect[0],
                                       sizeof(connect));
-    assert_on_connected(&connack[0], 1, sizeof(connack));
+    assert_on_connected(&connack[0], sizeof(connack));
 }
 
 static void assert_until_connected(struct async_t *async_p,
@@ -202,13 +246,12 @@ static void mock_prepare_subscribe_default(void)
 
 static void mock_prepare_publish_default(void)
 {
-    uint8_t publish[] = {
+    static const uint8_t publish[] = {
         0x30, 0x0b, 0x00, 0x06, 'f', 'o', 'o', 'b', 'a', 'r',
         0x00, 0x12, 0x34
     };
 
-    async_tcp_client_write_mock_once(sizeof(publish));
-    async_tcp_client_write_mock_set_buf_p_in(&publish[0], sizeof(publish));
+    mock_prepare_writev(&publish[0], sizeof(publish));
 }
 
 static void mock_prepare_pingreq(void)
@@ -221,6 +264,15 @@ static void mock_prepare_pingreq(void)
     async_tcp_client_write_mock_set_buf_p_in(&pingreq[0], sizeof(pingreq));
 }
 
+static void tick_many(struct async_t *async_p, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        async_tick(async_p);
+    }
+}
+
 TEST(init_start_stop)
 {
     struct async_t async;
@@ -238,10 +290,11 @@ TEST(connect_will)
     uint8_t will_message[] = { 'b', 'a', 'r' };
     /* Connect with will topic 'foo' and message 'bar'. */
     uint8_t connect[] = {
-        0x10, 0x23, 0x00, 0x04, 0x4d, 0x51, 0x54, 0x54, 0x05, 0x06,
-        0x00, 0x1e, 0x00, 0x00, 0x0b, 0x61, 0x73, 0x79, 0x6e, 0x63,
-        0x2d, 0x31, 0x32, 0x33, 0x34, 0x35, 0x00, 0x00, 0x03, 0x66,
-        0x6f, 0x6f, 0x00, 0x03, 0x62, 0x61, 0x72
+        0x10, 0x29, 0x00, 0x04, 0x4d, 0x51, 0x54, 0x54, 0x05, 0x06,
+        0x00, 0x1e, 0x06, 0x21, 0x00, 0x10, 0x22, 0x00, 0x01, 0x00,
+        0x0b, 0x61, 0x73, 0x79, 0x6e, 0x63, 0x2d, 0x31, 0x32, 0x33,
+        0x34, 0x35, 0x00, 0x00, 0x03, 0x66, 0x6f, 0x6f, 0x00, 0x03,
+        0x62, 0x61, 0x72
     };
     uint8_t connack[] = {
         0x20, 0x0b, 0x00, 0x00, 0x08, 0x24, 0x00, 0x25, 0x00, 0x28,
@@ -256,7 +309,7 @@ TEST(connect_will)
     assert_start_and_on_tcp_connected(&client,
                                       &connect[0],
                                       sizeof(connect));
-    assert_on_connected(&connack[0], 1, sizeof(connack));
+    assert_on_connected(&connack[0], sizeof(connack));
     assert_stop(&client);
 }
 
@@ -301,7 +354,147 @@ TEST(subscribe_error_short_suback)
     ASSERT_EQ(async_mqtt_client_subscribe(&client, "ttt"), transaction_id);
 
     /* Short SUBACK. */
-    input_packet(&suback[0], 1, sizeof(suback));
+    input_packet(&suback[0], sizeof(suback));
+    assert_stop(&client);
+}
+
+TEST(subscribe_with_qos)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t subscribe[] = {
+        0x80, 0x09, 0x00, 0x01, 0x00, 0x00, 0x03, 0x74, 0x74, 0x74,
+        0x02
+    };
+
+    assert_until_connected(&async, &client);
+
+    /* The requested QoS is given in the subscription options. */
+    async_tcp_client_write_mock_once(sizeof(subscribe));
+    async_tcp_client_write_mock_set_buf_p_in(&subscribe[0], sizeof(subscribe));
+    ASSERT_EQ(async_mqtt_client_subscribe_with_qos(&client, "ttt", 2), 1);
+
+    /* Invalid QoS. */
+    ASSERT_EQ(async_mqtt_client_subscribe_with_qos(&client, "ttt", -1),
+              -ASYNC_ERROR_INVALID_ARGUMENT);
+    ASSERT_EQ(async_mqtt_client_subscribe_with_qos(&client, "ttt", 3),
+              -ASYNC_ERROR_INVALID_ARGUMENT);
+    assert_stop(&client);
+}
+
+static void on_publish_count(int *count_p,
+                             const char *topic_p,
+                             const uint8_t *buf_p,
+                             size_t size)
+{
+    ASSERT_EQ(topic_p, "bar/foo");
+    ASSERT_EQ(size, 2);
+    ASSERT_EQ(buf_p[0], 0x56);
+    ASSERT_EQ(buf_p[1], 0x78);
+    (*count_p)++;
+}
+
+static void mock_prepare_subscribe(const char *filter_p,
+                                   uint16_t transaction_id)
+{
+    static uint8_t subscribe[16];
+    size_t size;
+
+    size = strlen(filter_p);
+    subscribe[0] = 0x80;
+    subscribe[1] = (size + 6);
+    subscribe[2] = 0x00;
+    subscribe[3] = transaction_id;
+    subscribe[4] = 0x00;
+    subscribe[5] = 0x00;
+    subscribe[6] = size;
+    memcpy(&subscribe[7], filter_p, size);
+    subscribe[7 + size] = 0x00;
+    async_tcp_client_write_mock_once(size + 8);
+    async_tcp_client_write_mock_set_buf_p_in(&subscribe[0], size + 8);
+}
+
+TEST(subscribe_with_handler)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    int single_level_count;
+    int multi_level_count;
+    uint8_t publish_bar_foo[] = {
+        0x30, 0x0c, 0x00, 0x07, 'b', 'a', 'r', '/', 'f', 'o',
+        'o', 0x00, 0x56, 0x78
+    };
+    uint8_t message[] = { 0x56, 0x78 };
+
+    single_level_count = 0;
+    multi_level_count = 0;
+    assert_init(&async, &client);
+    assert_start_until_connected(&client);
+
+    mock_prepare_subscribe("+/foo", 1);
+    ASSERT_EQ(async_mqtt_client_subscribe_with_handler(
+                  &client,
+                  "+/foo",
+                  (async_mqtt_client_on_publish_t)on_publish_count,
+                  &single_level_count), 1);
+    mock_prepare_subscribe("bar/#", 2);
+    ASSERT_EQ(async_mqtt_client_subscribe_with_handler(
+                  &client,
+                  "bar/#",
+                  (async_mqtt_client_on_publish_t)on_publish_count,
+                  &multi_level_count), 2);
+
+    /* Malformed filters are not subscribed to. */
+    ASSERT_EQ(async_mqtt_client_subscribe_with_handler(
+                  &client,
+                  "bar/#/foo",
+                  (async_mqtt_client_on_publish_t)on_publish_count,
+                  &multi_level_count), -ASYNC_ERROR_INVALID_ARGUMENT);
+    ASSERT_EQ(async_mqtt_client_subscribe_with_handler(
+                  &client,
+                  "bar+",
+                  (async_mqtt_client_on_publish_t)on_publish_count,
+                  &multi_level_count), -ASYNC_ERROR_INVALID_ARGUMENT);
+
+    /* Both filters match. */
+    input_packet(&publish_bar_foo[0], sizeof(publish_bar_foo));
+    ASSERT_EQ(single_level_count, 1);
+    ASSERT_EQ(multi_level_count, 1);
+
+    /* No filter matches, so on_publish() is called. */
+    mqtt_on_publish_mock_once("barfoo", 2);
+    mqtt_on_publish_mock_set_buf_p_in(&message[0], sizeof(message));
+    input_packet_publish();
+    ASSERT_EQ(single_level_count, 1);
+    ASSERT_EQ(multi_level_count, 1);
+
+    assert_stop(&client);
+}
+
+TEST(subscribe_with_handler_router_full)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    struct async_mqtt_client_router_level_t levels[4];
+    int count;
+
+    assert_init(&async, &client);
+    async_mqtt_client_set_router_buffer(&client, &levels[0], 4);
+    assert_start_until_connected(&client);
+
+    /* Three of four levels may be used. */
+    mock_prepare_subscribe("a/b/c", 1);
+    ASSERT_EQ(async_mqtt_client_subscribe_with_handler(
+                  &client,
+                  "a/b/c",
+                  (async_mqtt_client_on_publish_t)on_publish_count,
+                  &count), 1);
+    ASSERT_EQ(async_mqtt_client_subscribe_with_handler(
+                  &client,
+                  "d",
+                  (async_mqtt_client_on_publish_t)on_publish_count,
+                  &count), -ASYNC_ERROR_QUEUE_FULL);
+
     assert_stop(&client);
 }
 
@@ -376,8 +569,7 @@ TEST(publish_200_bytes)
 
     assert_init(&async, &client);
     assert_start_until_connected(&client);
-    async_tcp_client_write_mock_once(sizeof(publish));
-    async_tcp_client_write_mock_set_buf_p_in(&publish[0], sizeof(publish));
+    mock_prepare_writev(&publish[0], sizeof(publish));
     async_mqtt_client_publish(&client,
                               "foobar",
                               &message,
@@ -385,190 +577,1190 @@ TEST(publish_200_bytes)
     assert_stop(&client);
 }
 
-TEST(receive_publish)
+TEST(publish_1000_bytes)
 {
     struct async_t async;
     struct async_mqtt_client_t client;
-    uint8_t message[] = { 0x56, 0x78 };
+    uint8_t publish[1013];
+    uint8_t message[1000];
+    size_t i;
 
-    assert_until_connected(&async, &client);
-    mqtt_on_publish_mock_once("barfoo", 2);
-    mqtt_on_publish_mock_set_buf_p_in(&message[0], sizeof(message));
-    input_packet_publish();
+    for (i = 0; i < sizeof(message); i++) {
+        message[i] = i;
+    }
+
+    /* Remaining length 1009 in two bytes, topic, no properties and
+       the message. */
+    publish[0] = 0x30;
+    publish[1] = 0xf1;
+    publish[2] = 0x07;
+    publish[3] = 0x00;
+    publish[4] = 0x06;
+    memcpy(&publish[5], "foobar", 6);
+    publish[11] = 0x00;
+    memcpy(&publish[12], &message[0], sizeof(message));
+
+    assert_init(&async, &client);
+    assert_start_until_connected(&client);
+    mock_prepare_writev(&publish[0], 12 + sizeof(message));
+    async_mqtt_client_publish(&client,
+                              "foobar",
+                              &message,
+                              sizeof(message));
     assert_stop(&client);
 }
 
-TEST(receive_publish_200_bytes)
+TEST(publish_qos_1)
 {
     struct async_t async;
     struct async_mqtt_client_t client;
-    uint8_t publish[] = {
-        0x30, 0xd1, 0x01, 0x00, 0x06, 0x62, 0x61, 0x72, 0x66, 0x6f,
-        0x6f, 0x00,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89
-    };
     uint8_t message[] = {
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
-        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89
+         0x12, 0x34
+    };
+    static const uint8_t publish_1[] = {
+        0x32, 0x0a, 0x00, 0x03, 'f', 'o', 'o', 0x80, 0x00, 0x00,
+        0x12, 0x34
+    };
+    static const uint8_t publish_2[] = {
+        0x32, 0x0a, 0x00, 0x03, 'f', 'o', 'o', 0x80, 0x20, 0x00,
+        0x12, 0x34
+    };
+    uint8_t puback[] = {
+        0x40, 0x02, 0x80, 0x00
     };
 
-    assert_until_connected(&async, &client);
-    mqtt_on_publish_mock_once("barfoo", 200);
-    mqtt_on_publish_mock_set_buf_p_in(&message[0], sizeof(message));
-    input_packet(&publish[0], 2, sizeof(publish));
+    assert_init(&async, &client);
+    async_mqtt_client_set_on_publish_complete(&client, on_publish_complete);
+    assert_start_until_connected(&client);
+    mock_prepare_writev(&publish_1[0], sizeof(publish_1));
+    ASSERT_EQ(async_mqtt_client_publish_with_qos(&client,
+                                                 "foo",
+                                                 &message[0],
+                                                 sizeof(message),
+                                                 1),
+              0x8000);
+    mqtt_on_publish_complete_mock_once(0x8000);
+    input_packet(&puback[0], sizeof(puback));
+
+    /* Not completed again. */
+    input_packet(&puback[0], sizeof(puback));
+
+    /* The next message gets a new packet identifier. */
+    mock_prepare_writev(&publish_2[0], sizeof(publish_2));
+    ASSERT_EQ(async_mqtt_client_publish_with_qos(&client,
+                                                 "foo",
+                                                 &message[0],
+                                                 sizeof(message),
+                                                 1),
+              0x8020);
     assert_stop(&client);
 }
 
-TEST(receive_publish_no_data)
+TEST(publish_qos_2)
 {
     struct async_t async;
     struct async_mqtt_client_t client;
-    uint8_t publish[] = {
-        0x30, 0x09, 0x00, 0x06, 'b', 'a', 'r', 'f', 'o', 'o',
-        0x00
+    uint8_t message[] = {
+         0x12, 0x34
+    };
+    static const uint8_t publish[] = {
+        0x34, 0x0a, 0x00, 0x03, 'f', 'o', 'o', 0x80, 0x00, 0x00,
+        0x12, 0x34
+    };
+    uint8_t pubrec[] = {
+        0x50, 0x02, 0x80, 0x00
+    };
+    uint8_t pubrel[] = {
+        0x62, 0x02, 0x80, 0x00
+    };
+    uint8_t pubrec_unknown[] = {
+        0x50, 0x02, 0x80, 0x05
+    };
+    uint8_t pubrel_unknown[] = {
+        0x62, 0x03, 0x80, 0x05, 0x92
+    };
+    uint8_t pubcomp[] = {
+        0x70, 0x02, 0x80, 0x00
     };
 
-    assert_until_connected(&async, &client);
-    mqtt_on_publish_mock_once("barfoo", 0);
-    input_packet(&publish[0], 1, sizeof(publish));
+    assert_init(&async, &client);
+    async_mqtt_client_set_on_publish_complete(&client, on_publish_complete);
+    assert_start_until_connected(&client);
+    mock_prepare_writev(&publish[0], sizeof(publish));
+    ASSERT_EQ(async_mqtt_client_publish_with_qos(&client,
+                                                 "foo",
+                                                 &message[0],
+                                                 sizeof(message),
+                                                 2),
+              0x8000);
+
+    /* Released once received by the broker. */
+    async_tcp_client_write_mock_once(sizeof(pubrel));
+    async_tcp_client_write_mock_set_buf_p_in(&pubrel[0], sizeof(pubrel));
+    input_packet(&pubrec[0], sizeof(pubrec));
+
+    /* Unknown packet identifier. */
+    async_tcp_client_write_mock_once(sizeof(pubrel_unknown));
+    async_tcp_client_write_mock_set_buf_p_in(&pubrel_unknown[0],
+                                             sizeof(pubrel_unknown));
+    input_packet(&pubrec_unknown[0], sizeof(pubrec_unknown));
+
+    /* Completed. */
+    mqtt_on_publish_complete_mock_once(0x8000);
+    input_packet(&pubcomp[0], sizeof(pubcomp));
     assert_stop(&client);
 }
 
-TEST(receive_publish_error_short_message_no_props)
+TEST(publish_with_invalid_qos)
 {
     struct async_t async;
     struct async_mqtt_client_t client;
-    uint8_t publish[] = {
-        0x30, 0x08, 0x00, 0x06, 'b', 'a', 'r', 'f', 'o', 'o'
+    uint8_t message[] = {
+         0x12, 0x34
     };
 
     assert_until_connected(&async, &client);
-    input_packet(&publish[0], 1, sizeof(publish));
+    ASSERT_EQ(async_mqtt_client_publish_with_qos(&client,
+                                                 "foo",
+                                                 &message[0],
+                                                 sizeof(message),
+                                                 -1),
+              -ASYNC_ERROR_INVALID_ARGUMENT);
+    ASSERT_EQ(async_mqtt_client_publish_with_qos(&client,
+                                                 "foo",
+                                                 &message[0],
+                                                 sizeof(message),
+                                                 3),
+              -ASYNC_ERROR_INVALID_ARGUMENT);
     assert_stop(&client);
 }
 
-static void tick_many(struct async_t *async_p, int count)
+TEST(set_in_flight_buffer)
 {
-    int i;
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    struct async_mqtt_client_in_flight_message_t messages[2];
 
-    for (i = 0; i < count; i++) {
-        async_tick(async_p);
-    }
+    assert_init(&async, &client);
+    ASSERT_EQ(async_mqtt_client_set_in_flight_buffer(&client, &messages[0], 0),
+              -ASYNC_ERROR_INVALID_ARGUMENT);
+    ASSERT_EQ(async_mqtt_client_set_in_flight_buffer(&client,
+                                                     &messages[0],
+                                                     32769),
+              -ASYNC_ERROR_INVALID_ARGUMENT);
+    ASSERT_EQ(async_mqtt_client_set_in_flight_buffer(&client, &messages[0], 2),
+              0);
 }
 
-TEST(ping)
+TEST(publish_qos_1_resent_after_reconnect)
 {
     struct async_t async;
     struct async_mqtt_client_t client;
+    uint8_t message[] = {
+         0x12, 0x34
+    };
+    uint8_t connect[] = {
+        0x10, 0x1e, 0x00, 0x04, 0x4d, 0x51, 0x54, 0x54, 0x05, 0x02,
+        0x00, 0x1e, 0x06, 0x21, 0x00, 0x10, 0x22, 0x00, 0x01, 0x00,
+        0x0b, 0x61, 0x73, 0x79, 0x6e, 0x63, 0x2d, 0x31, 0x32, 0x33,
+        0x34, 0x35
+    };
+    uint8_t connack[] = {
+        0x20, 0x03, 0x00, 0x00, 0x00
+    };
+    static const uint8_t publish[] = {
+        0x32, 0x0a, 0x00, 0x03, 'f', 'o', 'o', 0x80, 0x00, 0x00,
+        0x12, 0x34
+    };
+    uint8_t puback[] = {
+        0x40, 0x02, 0x80, 0x00
+    };
 
-    assert_until_connected(&async, &client);
-
-    /* First ping-pong. */
-    mock_prepare_pingreq();
-    tick_many(&async, 101);
-    async_process(&async);
-    input_packet_pingresp();
+    assert_init(&async, &client);
+    async_mqtt_client_set_on_publish_complete(&client, on_publish_complete);
+    assert_start_until_connected(&client);
+    mock_prepare_writev(&publish[0], sizeof(publish));
+    async_mqtt_client_publish_with_qos(&client,
+                                       "foo",
+                                       &message[0],
+                                       sizeof(message),
+                                       1);
+    mqtt_on_disconnected_mock_once();
+    tcp_on_disconnected(tcp_p);
 
-    /* Second ping-pong. */
-    mock_prepare_pingreq();
-    tick_many(&async, 101);
+    /* Sent again as a new message, as there is no session. */
+    async_tcp_client_connect_mock_once("foo", 1883);
+    tick_many(&async, 11);
     async_process(&async);
-    input_packet_pingresp();
+    async_tcp_client_write_mock_once(sizeof(connect));
+    async_tcp_client_write_mock_set_buf_p_in(&connect[0], sizeof(connect));
+    tcp_on_connected(tcp_p, 0);
+    async_tcp_client_write_mock_once(sizeof(publish));
+    async_tcp_client_write_mock_set_buf_p_in(&publish[0], sizeof(publish));
+    assert_on_connected(&connack[0], sizeof(connack));
 
+    mqtt_on_publish_complete_mock_once(0x8000);
+    input_packet(&puback[0], sizeof(puback));
     assert_stop(&client);
 }
 
-TEST(reconnect_after_tcp_disconnect)
+TEST(publish_resent_in_session_after_reconnect)
 {
     struct async_t async;
     struct async_mqtt_client_t client;
+    uint8_t message[] = {
+         0x12, 0x34
+    };
     uint8_t connect[] = {
-        0x10, 0x18, 0x00, 0x04, 0x4d, 0x51, 0x54, 0x54, 0x05, 0x02,
-        0x00, 0x1e, 0x00, 0x00, 0x0b, 0x61, 0x73, 0x79, 0x6e, 0x63,
-        0x2d, 0x31, 0x32, 0x33, 0x34, 0x35
+        0x10, 0x23, 0x00, 0x04, 0x4d, 0x51, 0x54, 0x54, 0x05, 0x00,
+        0x00, 0x1e, 0x0b, 0x11, 0x00, 0x00, 0x00, 0x3c, 0x21, 0x00,
+        0x10, 0x22, 0x00, 0x01, 0x00, 0x0b, 0x61, 0x73, 0x79, 0x6e,
+        0x63, 0x2d, 0x31, 0x32, 0x33, 0x34, 0x35
     };
     uint8_t connack[] = {
-        0x20, 0x0b, 0x00, 0x00, 0x08, 0x24, 0x00, 0x25, 0x00, 0x28,
-        0x00, 0x2a, 0x00
+        0x20, 0x03, 0x01, 0x00, 0x00
+    };
+    static const uint8_t publish_1[] = {
+        0x34, 0x0a, 0x00, 0x03, 'f', 'o', 'o', 0x80, 0x00, 0x00,
+        0x12, 0x34
+    };
+    static const uint8_t publish_2[] = {
+        0x32, 0x0a, 0x00, 0x03, 'f', 'o', 'o', 0x80, 0x01, 0x00,
+        0x12, 0x34
+    };
+    uint8_t pubrel_and_publish_2_dup[] = {
+        0x62, 0x02, 0x80, 0x00, 0x3a, 0x0a, 0x00, 0x03, 'f', 'o',
+        'o', 0x80, 0x01, 0x00, 0x12, 0x34
+    };
+    uint8_t pubrec[] = {
+        0x50, 0x02, 0x80, 0x00
+    };
+    uint8_t pubrel[] = {
+        0x62, 0x02, 0x80, 0x00
+    };
+    uint8_t pubcomp[] = {
+        0x70, 0x02, 0x80, 0x00
+    };
+    uint8_t puback[] = {
+        0x40, 0x02, 0x80, 0x01
     };
-    int i;
 
-    assert_until_connected(&async, &client);
+    /* The session is kept for 60 seconds. */
+    assert_init(&async, &client);
+    async_mqtt_client_set_on_publish_complete(&client, on_publish_complete);
+    async_mqtt_client_set_session_expiry_interval(&client, 60);
+    assert_start_and_on_tcp_connected(&client, &connect[0], sizeof(connect));
+    assert_on_connected(&connack[0], sizeof(connack));
+
+    /* A released QoS 2 message and an unacknowledged QoS 1
+       message. */
+    mock_prepare_writev(&publish_1[0], sizeof(publish_1));
+    async_mqtt_client_publish_with_qos(&client,
+                                       "foo",
+                                       &message[0],
+                                       sizeof(message),
+                                       2);
+    async_tcp_client_write_mock_once(sizeof(pubrel));
+    async_tcp_client_write_mock_set_buf_p_in(&pubrel[0], sizeof(pubrel));
+    input_packet(&pubrec[0], sizeof(pubrec));
+    mock_prepare_writev(&publish_2[0], sizeof(publish_2));
+    async_mqtt_client_publish_with_qos(&client,
+                                       "foo",
+                                       &message[0],
+                                       sizeof(message),
+                                       1);
     mqtt_on_disconnected_mock_once();
     tcp_on_disconnected(tcp_p);
 
-    /* Reconnects every 1 seconds, make it fail until first ping
-       should have been sent (10 seconds, wait 15 to be sure). */
-    for (i = 1; i < 16; i++) {
-        async_tcp_client_connect_mock_once("foo", 1883);
-        tick_many(&async, 11);
-        async_process(&async);
-        tcp_on_connected(tcp_p, -1);
-    }
-
-    /* Reconnects after 1 second, make it successful. */
+    /* The session is present, so the release and the duplicate
+       message are sent in order, in one write. */
     async_tcp_client_connect_mock_once("foo", 1883);
     tick_many(&async, 11);
     async_process(&async);
     async_tcp_client_write_mock_once(sizeof(connect));
     async_tcp_client_write_mock_set_buf_p_in(&connect[0], sizeof(connect));
     tcp_on_connected(tcp_p, 0);
-    assert_on_connected(&connack[0], 1, sizeof(connack));
-
-    /* ping-pong after 10 seconds. */
-    mock_prepare_pingreq();
-    tick_many(&async, 101);
-    async_process(&async);
-    input_packet_pingresp();
-
+    async_tcp_client_write_mock_once(sizeof(pubrel_and_publish_2_dup));
+    async_tcp_client_write_mock_set_buf_p_in(
+        &pubrel_and_publish_2_dup[0],
+        sizeof(pubrel_and_publish_2_dup));
+    assert_on_connected(&connack[0], sizeof(connack));
+
+    mqtt_on_publish_complete_mock_once(0x8000);
+    input_packet(&pubcomp[0], sizeof(pubcomp));
+    mqtt_on_publish_complete_mock_once(0x8001);
+    input_packet(&puback[0], sizeof(puback));
     assert_stop(&client);
 }
 
-TEST(reconnect_after_unsuccessful_connack)
+TEST(publish_in_flight_limits)
 {
     struct async_t async;
     struct async_mqtt_client_t client;
-    uint8_t connect[] = {
-        0x10, 0x18, 0x00, 0x04, 0x4d, 0x51, 0x54, 0x54, 0x05, 0x02,
-        0x00, 0x1e, 0x00, 0x00, 0x0b, 0x61, 0x73, 0x79, 0x6e, 0x63,
-        0x2d, 0x31, 0x32, 0x33, 0x34, 0x35
+    uint8_t message[] = {
+         0x12, 0x34
+    };
+    uint8_t connack[] = {
+        0x20, 0x06, 0x00, 0x00, 0x03, 0x21, 0x00, 0x01
+    };
+    uint8_t connect[] = {
+        0x10, 0x1e, 0x00, 0x04, 0x4d, 0x51, 0x54, 0x54, 0x05, 0x02,
+        0x00, 0x1e, 0x06, 0x21, 0x00, 0x10, 0x22, 0x00, 0x01, 0x00,
+        0x0b, 0x61, 0x73, 0x79, 0x6e, 0x63, 0x2d, 0x31, 0x32, 0x33,
+        0x34, 0x35
+    };
+    static const uint8_t publish_1[] = {
+        0x32, 0x0a, 0x00, 0x03, 'f', 'o', 'o', 0x80, 0x00, 0x00,
+        0x12, 0x34
+    };
+    uint8_t publish_2[] = {
+        0x32, 0x0a, 0x00, 0x03, 'f', 'o', 'o', 0x80, 0x01, 0x00,
+        0x12, 0x34
+    };
+    uint8_t puback[] = {
+        0x40, 0x02, 0x80, 0x00
+    };
+    int i;
+
+    /* The broker's Receive Maximum is 1. */
+    assert_init(&async, &client);
+    async_mqtt_client_set_on_publish_complete(&client, on_publish_complete);
+    assert_start_and_on_tcp_connected(&client, &connect[0], sizeof(connect));
+    assert_on_connected(&connack[0], sizeof(connack));
+    mock_prepare_writev(&publish_1[0], sizeof(publish_1));
+
+    for (i = 0; i < ASYNC_MQTT_CLIENT_IN_FLIGHT_MAX; i++) {
+        ASSERT_EQ(async_mqtt_client_publish_with_qos(&client,
+                                                     "foo",
+                                                     &message[0],
+                                                     sizeof(message),
+                                                     1),
+                  0x8000 + i);
+    }
+
+    ASSERT_EQ(async_mqtt_client_publish_with_qos(&client,
+                                                 "foo",
+                                                 &message[0],
+                                                 sizeof(message),
+                                                 1),
+              -ASYNC_ERROR_QUEUE_FULL);
+
+    /* The next message is sent once the first is acknowledged. */
+    async_tcp_client_write_mock_once(sizeof(publish_2));
+    async_tcp_client_write_mock_set_buf_p_in(&publish_2[0], sizeof(publish_2));
+    mqtt_on_publish_complete_mock_once(0x8000);
+    input_packet(&puback[0], sizeof(puback));
+    assert_stop(&client);
+}
+
+TEST(publish_topic_alias)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    struct async_mqtt_client_statistics_t statistics;
+    uint8_t connect[] = {
+        0x10, 0x1e, 0x00, 0x04, 0x4d, 0x51, 0x54, 0x54, 0x05, 0x02,
+        0x00, 0x1e, 0x06, 0x21, 0x00, 0x10, 0x22, 0x00, 0x01, 0x00,
+        0x0b, 0x61, 0x73, 0x79, 0x6e, 0x63, 0x2d, 0x31, 0x32, 0x33,
+        0x34, 0x35
+    };
+    /* Topic Alias Maximum 1. */
+    uint8_t connack[] = {
+        0x20, 0x06, 0x00, 0x00, 0x03, 0x22, 0x00, 0x01
+    };
+    static const uint8_t publish_foo[] = {
+        0x30, 0x0b, 0x00, 0x03, 'f', 'o', 'o', 0x03, 0x23, 0x00,
+        0x01, 0x12, 0x34
+    };
+    static const uint8_t publish_alias[] = {
+        0x30, 0x08, 0x00, 0x00, 0x03, 0x23, 0x00, 0x01, 0x12, 0x34
+    };
+    static const uint8_t publish_bar[] = {
+        0x30, 0x0b, 0x00, 0x03, 'b', 'a', 'r', 0x03, 0x23, 0x00,
+        0x01, 0x12, 0x34
+    };
+    uint8_t message[] = {
+        0x12, 0x34
+    };
+
+    assert_init(&async, &client);
+    assert_start_and_on_tcp_connected(&client, &connect[0], sizeof(connect));
+    assert_on_connected(&connack[0], sizeof(connack));
+
+    /* The topic is sent with the alias the first time. */
+    mock_prepare_writev(&publish_foo[0], sizeof(publish_foo));
+    async_mqtt_client_publish(&client, "foo", &message, sizeof(message));
+
+    /* Only the alias the second time. */
+    mock_prepare_writev(&publish_alias[0], sizeof(publish_alias));
+    async_mqtt_client_publish(&client, "foo", &message, sizeof(message));
+
+    /* The least recently used alias is reassigned. */
+    mock_prepare_writev(&publish_bar[0], sizeof(publish_bar));
+    async_mqtt_client_publish(&client, "bar", &message, sizeof(message));
+
+    async_mqtt_client_get_statistics(&client, &statistics);
+    ASSERT_EQ(statistics.sent.bytes,
+              sizeof(connect)
+              + sizeof(publish_foo)
+              + sizeof(publish_alias)
+              + sizeof(publish_bar));
+    ASSERT_EQ(statistics.sent.topic_alias_bytes, 3);
+    ASSERT_EQ(statistics.received.bytes, sizeof(connack));
+
+    assert_stop(&client);
+}
+
+TEST(receive_publish)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t message[] = { 0x56, 0x78 };
+
+    assert_until_connected(&async, &client);
+    mqtt_on_publish_mock_once("barfoo", 2);
+    mqtt_on_publish_mock_set_buf_p_in(&message[0], sizeof(message));
+    input_packet_publish();
+    assert_stop(&client);
+}
+
+TEST(receive_publish_topic_alias)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    struct async_mqtt_client_statistics_t statistics;
+    /* Maximum Packet Size 64 and Topic Alias Maximum 16, as any topic
+       fits in the topic storage of an alias. */
+    uint8_t connect[] = {
+        0x10, 0x23, 0x00, 0x04, 0x4d, 0x51, 0x54, 0x54, 0x05, 0x02,
+        0x00, 0x1e, 0x0b, 0x27, 0x00, 0x00, 0x00, 0x40, 0x21, 0x00,
+        0x10, 0x22, 0x00, 0x10, 0x00, 0x0b, 0x61, 0x73, 0x79, 0x6e,
+        0x63, 0x2d, 0x31, 0x32, 0x33, 0x34, 0x35
+    };
+    uint8_t connack[] = {
+        0x20, 0x03, 0x00, 0x00, 0x00
+    };
+    uint8_t publish_foo[] = {
+        0x30, 0x0b, 0x00, 0x03, 'f', 'o', 'o', 0x03, 0x23, 0x00,
+        0x01, 0x56, 0x78
+    };
+    uint8_t publish_alias[] = {
+        0x30, 0x08, 0x00, 0x00, 0x03, 0x23, 0x00, 0x01, 0x56, 0x78
+    };
+    uint8_t publish_unknown_alias[] = {
+        0x30, 0x08, 0x00, 0x00, 0x03, 0x23, 0x00, 0x02, 0x56, 0x78
+    };
+    uint8_t disconnect[] = {
+        0xe0, 0x02, 0x94, 0x00
+    };
+    uint8_t message[] = { 0x56, 0x78 };
+
+    assert_init(&async, &client);
+    async_mqtt_client_set_maximum_packet_size(&client, 64);
+    assert_start_and_on_tcp_connected(&client, &connect[0], sizeof(connect));
+    assert_on_connected(&connack[0], sizeof(connack));
+
+    /* The topic with its alias. */
+    mqtt_on_publish_mock_once("foo", 2);
+    mqtt_on_publish_mock_set_buf_p_in(&message[0], sizeof(message));
+    input_packet(&publish_foo[0], sizeof(publish_foo));
+
+    /* Only the alias. */
+    mqtt_on_publish_mock_once("foo", 2);
+    mqtt_on_publish_mock_set_buf_p_in(&message[0], sizeof(message));
+    input_packet(&publish_alias[0], sizeof(publish_alias));
+
+    async_mqtt_client_get_statistics(&client, &statistics);
+    ASSERT_EQ(statistics.received.topic_alias_bytes, 3);
+
+    /* Disconnected on an unknown alias. */
+    async_tcp_client_write_mock_once(sizeof(disconnect));
+    async_tcp_client_write_mock_set_buf_p_in(&disconnect[0], sizeof(disconnect));
+    mqtt_on_disconnected_mock_once();
+    async_tcp_client_disconnect_mock_once();
+    async_tcp_client_disconnect_mock_set_self_p_in_pointer(tcp_p);
+    mock_prepare_read(&publish_unknown_alias[0],
+                      sizeof(publish_unknown_alias),
+                      0);
+    tcp_on_input(tcp_p);
+}
+
+TEST(receive_publish_long_topic_alias)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    char topic_alias_buf[ASYNC_MQTT_CLIENT_TOPIC_ALIAS_MAX * 256];
+    char topic[201];
+    /* Maximum Packet Size 256 and Topic Alias Maximum 16. */
+    uint8_t connect[] = {
+        0x10, 0x23, 0x00, 0x04, 0x4d, 0x51, 0x54, 0x54, 0x05, 0x02,
+        0x00, 0x1e, 0x0b, 0x27, 0x00, 0x00, 0x01, 0x00, 0x21, 0x00,
+        0x10, 0x22, 0x00, 0x10, 0x00, 0x0b, 0x61, 0x73, 0x79, 0x6e,
+        0x63, 0x2d, 0x31, 0x32, 0x33, 0x34, 0x35
+    };
+    uint8_t connack[] = {
+        0x20, 0x03, 0x00, 0x00, 0x00
+    };
+    uint8_t publish_topic[211] = {
+        0x30, 0xd0, 0x01, 0x00, 0xc8
+    };
+    uint8_t publish_alias[] = {
+        0x30, 0x08, 0x00, 0x00, 0x03, 0x23, 0x00, 0x01, 0x56, 0x78
+    };
+    uint8_t message[] = { 0x56, 0x78 };
+    int i;
+
+    for (i = 0; i < 200; i++) {
+        topic[i] = ('a' + (i % 26));
+        publish_topic[5 + i] = topic[i];
+    }
+
+    topic[200] = '\0';
+    publish_topic[205] = 0x03;
+    publish_topic[206] = 0x23;
+    publish_topic[207] = 0x00;
+    publish_topic[208] = 0x01;
+    publish_topic[209] = 0x56;
+    publish_topic[210] = 0x78;
+
+    /* Topics of received aliases are stored in a buffer large enough
+       for any topic. */
+    assert_init(&async, &client);
+    async_mqtt_client_set_topic_alias_buffer(&client,
+                                             &topic_alias_buf[0],
+                                             sizeof(topic_alias_buf));
+    async_mqtt_client_set_maximum_packet_size(&client, 256);
+    assert_start_and_on_tcp_connected(&client, &connect[0], sizeof(connect));
+    assert_on_connected(&connack[0], sizeof(connack));
+
+    /* The long topic with its alias. */
+    mqtt_on_publish_mock_once(&topic[0], 2);
+    mqtt_on_publish_mock_set_buf_p_in(&message[0], sizeof(message));
+    input_packet(&publish_topic[0], sizeof(publish_topic));
+
+    /* Only the alias. */
+    mqtt_on_publish_mock_once(&topic[0], 2);
+    mqtt_on_publish_mock_set_buf_p_in(&message[0], sizeof(message));
+    input_packet(&publish_alias[0], sizeof(publish_alias));
+    assert_stop(&client);
+}
+
+TEST(receive_publish_topic_alias_with_defaults)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t publish_foo[] = {
+        0x30, 0x0b, 0x00, 0x03, 'f', 'o', 'o', 0x03, 0x23, 0x00,
+        0x01, 0x56, 0x78
+    };
+    uint8_t publish_alias[] = {
+        0x30, 0x08, 0x00, 0x00, 0x03, 0x23, 0x00, 0x01, 0x56, 0x78
+    };
+    uint8_t publish_bar[] = {
+        0x30, 0x0b, 0x00, 0x03, 'b', 'a', 'r', 0x03, 0x23, 0x00,
+        0x02, 0x56, 0x78
+    };
+    uint8_t disconnect[] = {
+        0xe0, 0x02, 0x94, 0x00
+    };
+    uint8_t message[] = { 0x56, 0x78 };
+
+    /* Topic Alias Maximum 1 is sent by default, as the default topic
+       storage has room for one topic filling the receive buffer. */
+    assert_until_connected(&async, &client);
+
+    mqtt_on_publish_mock_once("foo", 2);
+    mqtt_on_publish_mock_set_buf_p_in(&message[0], sizeof(message));
+    input_packet(&publish_foo[0], sizeof(publish_foo));
+
+    mqtt_on_publish_mock_once("foo", 2);
+    mqtt_on_publish_mock_set_buf_p_in(&message[0], sizeof(message));
+    input_packet(&publish_alias[0], sizeof(publish_alias));
+
+    /* Disconnected on an alias above the maximum. */
+    async_tcp_client_write_mock_once(sizeof(disconnect));
+    async_tcp_client_write_mock_set_buf_p_in(&disconnect[0], sizeof(disconnect));
+    mqtt_on_disconnected_mock_once();
+    async_tcp_client_disconnect_mock_once();
+    async_tcp_client_disconnect_mock_set_self_p_in_pointer(tcp_p);
+    mock_prepare_read(&publish_bar[0], sizeof(publish_bar), 0);
+    tcp_on_input(tcp_p);
+}
+
+TEST(receive_publish_200_bytes)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t publish[] = {
+        0x30, 0xd1, 0x01, 0x00, 0x06, 0x62, 0x61, 0x72, 0x66, 0x6f,
+        0x6f, 0x00,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89
+    };
+    uint8_t message[] = {
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0x01, 0x23, 0x45, 0x67, 0x89
+    };
+
+    assert_until_connected(&async, &client);
+    mqtt_on_publish_mock_once("barfoo", 200);
+    mqtt_on_publish_mock_set_buf_p_in(&message[0], sizeof(message));
+    input_packet(&publish[0], sizeof(publish));
+    assert_stop(&client);
+}
+
+TEST(receive_publish_no_data)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t publish[] = {
+        0x30, 0x09, 0x00, 0x06, 'b', 'a', 'r', 'f', 'o', 'o',
+        0x00
+    };
+
+    assert_until_connected(&async, &client);
+    mqtt_on_publish_mock_once("barfoo", 0);
+    input_packet(&publish[0], sizeof(publish));
+    assert_stop(&client);
+}
+
+TEST(receive_publish_error_short_message_no_props)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t publish[] = {
+        0x30, 0x08, 0x00, 0x06, 'b', 'a', 'r', 'f', 'o', 'o'
+    };
+
+    assert_until_connected(&async, &client);
+    input_packet(&publish[0], sizeof(publish));
+    assert_stop(&client);
+}
+
+TEST(receive_publish_qos_1)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t publish[] = {
+        0x32, 0x0a, 0x00, 0x03, 'f', 'o', 'o', 0x00, 0x05, 0x00,
+        0x56, 0x78
+    };
+    uint8_t puback[] = {
+        0x40, 0x02, 0x00, 0x05
+    };
+    uint8_t message[] = { 0x56, 0x78 };
+
+    assert_until_connected(&async, &client);
+
+    /* Acknowledged once passed to the application. */
+    mqtt_on_publish_mock_once("foo", 2);
+    mqtt_on_publish_mock_set_buf_p_in(&message[0], sizeof(message));
+    async_tcp_client_write_mock_once(sizeof(puback));
+    async_tcp_client_write_mock_set_buf_p_in(&puback[0], sizeof(puback));
+    input_packet(&publish[0], sizeof(publish));
+    assert_stop(&client);
+}
+
+TEST(receive_publish_qos_2)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t publish[] = {
+        0x34, 0x0a, 0x00, 0x03, 'f', 'o', 'o', 0x00, 0x05, 0x00,
+        0x56, 0x78
+    };
+    uint8_t publish_dup[] = {
+        0x3c, 0x0a, 0x00, 0x03, 'f', 'o', 'o', 0x00, 0x05, 0x00,
+        0x56, 0x78
+    };
+    uint8_t pubrec[] = {
+        0x50, 0x02, 0x00, 0x05
+    };
+    uint8_t pubrel[] = {
+        0x62, 0x02, 0x00, 0x05
+    };
+    uint8_t pubcomp[] = {
+        0x70, 0x02, 0x00, 0x05
+    };
+    uint8_t pubcomp_unknown[] = {
+        0x70, 0x03, 0x00, 0x05, 0x92
+    };
+    uint8_t message[] = { 0x56, 0x78 };
+
+    assert_until_connected(&async, &client);
+
+    /* Received. */
+    mqtt_on_publish_mock_once("foo", 2);
+    mqtt_on_publish_mock_set_buf_p_in(&message[0], sizeof(message));
+    async_tcp_client_write_mock_once(sizeof(pubrec));
+    async_tcp_client_write_mock_set_buf_p_in(&pubrec[0], sizeof(pubrec));
+    input_packet(&publish[0], sizeof(publish));
+
+    /* Resent by the broker, but not passed to the application
+       again. */
+    async_tcp_client_write_mock_once(sizeof(pubrec));
+    async_tcp_client_write_mock_set_buf_p_in(&pubrec[0], sizeof(pubrec));
+    input_packet(&publish_dup[0], sizeof(publish_dup));
+
+    /* Released. */
+    async_tcp_client_write_mock_once(sizeof(pubcomp));
+    async_tcp_client_write_mock_set_buf_p_in(&pubcomp[0], sizeof(pubcomp));
+    input_packet(&pubrel[0], sizeof(pubrel));
+
+    /* Unknown packet identifier. */
+    async_tcp_client_write_mock_once(sizeof(pubcomp_unknown));
+    async_tcp_client_write_mock_set_buf_p_in(&pubcomp_unknown[0],
+                                             sizeof(pubcomp_unknown));
+    input_packet(&pubrel[0], sizeof(pubrel));
+
+    /* The packet identifier may be reused once released. */
+    mqtt_on_publish_mock_once("foo", 2);
+    mqtt_on_publish_mock_set_buf_p_in(&message[0], sizeof(message));
+    async_tcp_client_write_mock_once(sizeof(pubrec));
+    async_tcp_client_write_mock_set_buf_p_in(&pubrec[0], sizeof(pubrec));
+    input_packet(&publish[0], sizeof(publish));
+    assert_stop(&client);
+}
+
+TEST(receive_publish_qos_2_receive_maximum_exceeded)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t publish[] = {
+        0x34, 0x0a, 0x00, 0x03, 'f', 'o', 'o', 0x00, 0x00, 0x00,
+        0x56, 0x78
+    };
+    uint8_t pubrec[] = {
+        0x50, 0x02, 0x00, 0x00
+    };
+    uint8_t disconnect[] = {
+        0xe0, 0x02, 0x93, 0x00
+    };
+    uint8_t message[] = { 0x56, 0x78 };
+    int i;
+
+    assert_until_connected(&async, &client);
+
+    /* Up to the Receive Maximum of unreleased messages. */
+    for (i = 1; i <= ASYNC_MQTT_CLIENT_RECEIVE_MAX; i++) {
+        publish[8] = i;
+        pubrec[3] = i;
+        mqtt_on_publish_mock_once("foo", 2);
+        mqtt_on_publish_mock_set_buf_p_in(&message[0], sizeof(message));
+        async_tcp_client_write_mock_once(sizeof(pubrec));
+        async_tcp_client_write_mock_set_buf_p_in(&pubrec[0], sizeof(pubrec));
+        input_packet(&publish[0], sizeof(publish));
+    }
+
+    /* Disconnected on one more. */
+    publish[8] = i;
+    async_tcp_client_write_mock_once(sizeof(disconnect));
+    async_tcp_client_write_mock_set_buf_p_in(&disconnect[0], sizeof(disconnect));
+    mqtt_on_disconnected_mock_once();
+    async_tcp_client_disconnect_mock_once();
+    async_tcp_client_disconnect_mock_set_self_p_in_pointer(tcp_p);
+    mock_prepare_read(&publish[0], sizeof(publish), 0);
+    tcp_on_input(tcp_p);
+}
+
+TEST(receive_many_packets_in_one_read)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t packets[] = {
+        /* SUBACK. */
+        0x90, 0x04, 0x00, 0x01, 0x00, 0x00,
+        /* PUBLISH. */
+        0x30, 0x0b, 0x00, 0x06, 'b', 'a', 'r', 'f', 'o', 'o',
+        0x00, 0x56, 0x78,
+        /* PINGRESP. */
+        0xd0, 0x00,
+        /* PUBLISH. */
+        0x30, 0x0a, 0x00, 0x06, 'b', 'a', 'r', 'f', 'o', 'o',
+        0x00, 0x9a
+    };
+    uint8_t message_1[] = { 0x56, 0x78 };
+    uint8_t message_2[] = { 0x9a };
+
+    assert_init(&async, &client);
+    async_mqtt_client_set_on_subscribe_complete(&client, on_subscribe_complete);
+    assert_start_until_connected(&client);
+    mqtt_on_subscribe_complete_mock_once(1);
+    mqtt_on_publish_mock_once("barfoo", 2);
+    mqtt_on_publish_mock_set_buf_p_in(&message_1[0], sizeof(message_1));
+    mqtt_on_publish_mock_once("barfoo", 1);
+    mqtt_on_publish_mock_set_buf_p_in(&message_2[0], sizeof(message_2));
+    input_packet(&packets[0], sizeof(packets));
+    assert_stop(&client);
+}
+
+TEST(receive_publish_split_over_input_events)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t publish[] = {
+        0x30, 0x0b, 0x00, 0x06, 'b', 'a', 'r', 'f', 'o', 'o',
+        0x00, 0x56, 0x78
+    };
+    uint8_t message[] = { 0x56, 0x78 };
+
+    assert_until_connected(&async, &client);
+
+    /* Fixed header type. */
+    mock_prepare_read(&publish[0], 1, 0);
+    mock_prepare_read(NULL, 0, 1);
+    tcp_on_input(tcp_p);
+
+    /* Remaining length and the topic length. */
+    mock_prepare_read(&publish[1], 3, 1);
+    mock_prepare_read(NULL, 0, 4);
+    tcp_on_input(tcp_p);
+
+    /* The rest. */
+    mqtt_on_publish_mock_once("barfoo", 2);
+    mqtt_on_publish_mock_set_buf_p_in(&message[0], sizeof(message));
+    mock_prepare_read(&publish[4], sizeof(publish) - 4, 4);
+    mock_prepare_read(NULL, 0, 0);
+    tcp_on_input(tcp_p);
+
+    assert_stop(&client);
+}
+
+TEST(receive_too_large_publish_is_discarded)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t publish[ASYNC_MQTT_CLIENT_INPUT_BUFFER_SIZE + 16];
+    uint8_t message[] = { 0x56, 0x78 };
+    size_t size;
+
+    /* A PUBLISH not fitting in the receive buffer, followed by a
+       small PUBLISH. */
+    size = (ASYNC_MQTT_CLIENT_INPUT_BUFFER_SIZE + 16 - 13 - 3);
+    memset(&publish[0], 0, sizeof(publish));
+    publish[0] = 0x30;
+    publish[1] = (0x80 | (size & 0x7f));
+    publish[2] = (size >> 7);
+    memcpy(&publish[sizeof(publish) - 13],
+           "\x30\x0b\x00\x06" "barfoo" "\x00\x56\x78",
+           13);
+
+    assert_until_connected(&async, &client);
+    mqtt_on_publish_mock_once("barfoo", 2);
+    mqtt_on_publish_mock_set_buf_p_in(&message[0], sizeof(message));
+    mock_prepare_read(&publish[0], ASYNC_MQTT_CLIENT_INPUT_BUFFER_SIZE, 0);
+    mock_prepare_read(&publish[ASYNC_MQTT_CLIENT_INPUT_BUFFER_SIZE], 16, 0);
+    mock_prepare_read(NULL, 0, 0);
+    tcp_on_input(tcp_p);
+    assert_stop(&client);
+}
+
+TEST(receive_too_large_publish_topic_alias)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t publish[ASYNC_MQTT_CLIENT_INPUT_BUFFER_SIZE + 16];
+    uint8_t message[] = { 0x56, 0x78 };
+    size_t size;
+
+    /* A PUBLISH with topic 'foo' and alias 1 not fitting in the
+       receive buffer, followed by a small PUBLISH with only the
+       alias. */
+    size = (ASYNC_MQTT_CLIENT_INPUT_BUFFER_SIZE + 16 - 10 - 3);
+    memset(&publish[0], 0, sizeof(publish));
+    publish[0] = 0x30;
+    publish[1] = (0x80 | (size & 0x7f));
+    publish[2] = (size >> 7);
+    memcpy(&publish[3], "\x00\x03" "foo" "\x03\x23\x00\x01", 9);
+    memcpy(&publish[sizeof(publish) - 10],
+           "\x30\x08\x00\x00\x03\x23\x00\x01\x56\x78",
+           10);
+
+    /* The large message is discarded, but its alias is stored. */
+    assert_until_connected(&async, &client);
+    mqtt_on_publish_mock_once("foo", 2);
+    mqtt_on_publish_mock_set_buf_p_in(&message[0], sizeof(message));
+    mock_prepare_read(&publish[0], ASYNC_MQTT_CLIENT_INPUT_BUFFER_SIZE, 0);
+    mock_prepare_read(&publish[ASYNC_MQTT_CLIENT_INPUT_BUFFER_SIZE], 16, 0);
+    mock_prepare_read(NULL, 0, 0);
+    tcp_on_input(tcp_p);
+    assert_stop(&client);
+}
+
+TEST(receive_publish_in_chunks)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t buf[24];
+    uint8_t connect[] = {
+        0x10, 0x1e, 0x00, 0x04, 0x4d, 0x51, 0x54, 0x54, 0x05, 0x02,
+        0x00, 0x1e, 0x06, 0x21, 0x00, 0x10, 0x22, 0x00, 0x10, 0x00,
+        0x0b, 0x61, 0x73, 0x79, 0x6e, 0x63, 0x2d, 0x31, 0x32, 0x33,
+        0x34, 0x35
+    };
+    uint8_t connack[] = {
+        0x20, 0x03, 0x00, 0x00, 0x00
+    };
+    uint8_t publish[34] = {
+        0x30, 0x20, 0x00, 0x03, 'f', 'o', 'o', 0x00
+    };
+    size_t i;
+
+    for (i = 8; i < sizeof(publish); i++) {
+        publish[i] = i;
+    }
+
+    /* A receive buffer too small for the PUBLISH. */
+    assert_init(&async, &client);
+    async_mqtt_client_set_input_buffer(&client, &buf[0], sizeof(buf));
+    async_mqtt_client_set_on_publish_chunk(&client, on_publish_chunk);
+    assert_start_and_on_tcp_connected(&client, &connect[0], sizeof(connect));
+    mqtt_on_connected_mock_once();
+    async_tcp_client_read_mock_once(sizeof(buf), sizeof(connack));
+    async_tcp_client_read_mock_set_buf_p_out(&connack[0], sizeof(connack));
+    async_tcp_client_read_mock_once(sizeof(buf), 0);
+    tcp_on_input(tcp_p);
+
+    /* The message is passed in two chunks, while the topic is kept
+       at the start of the receive buffer. */
+    mqtt_on_publish_chunk_mock_once("foo", 16, 0, 26);
+    mqtt_on_publish_chunk_mock_set_buf_p_in(&publish[8], 16);
+    mqtt_on_publish_chunk_mock_once("foo", 10, 16, 26);
+    mqtt_on_publish_chunk_mock_set_buf_p_in(&publish[24], 10);
+    async_tcp_client_read_mock_once(sizeof(buf), sizeof(buf));
+    async_tcp_client_read_mock_set_buf_p_out(&publish[0], sizeof(buf));
+    async_tcp_client_read_mock_once(sizeof(buf) - 4, 10);
+    async_tcp_client_read_mock_set_buf_p_out(&publish[24], 10);
+    async_tcp_client_read_mock_once(sizeof(buf), 0);
+    tcp_on_input(tcp_p);
+    assert_stop(&client);
+}
+
+TEST(receive_publish_qos_1_in_chunks)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t buf[24];
+    uint8_t connect[] = {
+        0x10, 0x1e, 0x00, 0x04, 0x4d, 0x51, 0x54, 0x54, 0x05, 0x02,
+        0x00, 0x1e, 0x06, 0x21, 0x00, 0x10, 0x22, 0x00, 0x10, 0x00,
+        0x0b, 0x61, 0x73, 0x79, 0x6e, 0x63, 0x2d, 0x31, 0x32, 0x33,
+        0x34, 0x35
+    };
+    uint8_t connack[] = {
+        0x20, 0x03, 0x00, 0x00, 0x00
+    };
+    uint8_t publish[36] = {
+        0x32, 0x22, 0x00, 0x03, 'f', 'o', 'o', 0x00, 0x05, 0x00
+    };
+    uint8_t puback[] = {
+        0x40, 0x02, 0x00, 0x05
+    };
+    size_t i;
+
+    for (i = 10; i < sizeof(publish); i++) {
+        publish[i] = i;
+    }
+
+    assert_init(&async, &client);
+    async_mqtt_client_set_input_buffer(&client, &buf[0], sizeof(buf));
+    async_mqtt_client_set_on_publish_chunk(&client, on_publish_chunk);
+    assert_start_and_on_tcp_connected(&client, &connect[0], sizeof(connect));
+    mqtt_on_connected_mock_once();
+    async_tcp_client_read_mock_once(sizeof(buf), sizeof(connack));
+    async_tcp_client_read_mock_set_buf_p_out(&connack[0], sizeof(connack));
+    async_tcp_client_read_mock_once(sizeof(buf), 0);
+    tcp_on_input(tcp_p);
+
+    /* Acknowledged once the last chunk is passed. */
+    mqtt_on_publish_chunk_mock_once("foo", 14, 0, 26);
+    mqtt_on_publish_chunk_mock_set_buf_p_in(&publish[10], 14);
+    mqtt_on_publish_chunk_mock_once("foo", 12, 14, 26);
+    mqtt_on_publish_chunk_mock_set_buf_p_in(&publish[24], 12);
+    async_tcp_client_read_mock_once(sizeof(buf), sizeof(buf));
+    async_tcp_client_read_mock_set_buf_p_out(&publish[0], sizeof(buf));
+    async_tcp_client_read_mock_once(sizeof(buf) - 4, 12);
+    async_tcp_client_read_mock_set_buf_p_out(&publish[24], 12);
+    async_tcp_client_write_mock_once(sizeof(puback));
+    async_tcp_client_write_mock_set_buf_p_in(&puback[0], sizeof(puback));
+    async_tcp_client_read_mock_once(sizeof(buf), 0);
+    tcp_on_input(tcp_p);
+    assert_stop(&client);
+}
+
+TEST(receive_larger_than_maximum_packet_size)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t connect[] = {
+        0x10, 0x23, 0x00, 0x04, 0x4d, 0x51, 0x54, 0x54, 0x05, 0x02,
+        0x00, 0x1e, 0x0b, 0x27, 0x00, 0x00, 0x00, 0x40, 0x21, 0x00,
+        0x10, 0x22, 0x00, 0x10, 0x00, 0x0b, 0x61, 0x73, 0x79, 0x6e,
+        0x63, 0x2d, 0x31, 0x32, 0x33, 0x34, 0x35
+    };
+    uint8_t connack[] = {
+        0x20, 0x03, 0x00, 0x00, 0x00
+    };
+    uint8_t publish[] = {
+        0x30, 0x3f, 0x00, 0x03, 'f', 'o', 'o', 0x00
+    };
+    uint8_t disconnect[] = {
+        0xe0, 0x02, 0x95, 0x00
+    };
+
+    /* The maximum packet size is sent to the broker. */
+    assert_init(&async, &client);
+    async_mqtt_client_set_maximum_packet_size(&client, 64);
+    assert_start_and_on_tcp_connected(&client, &connect[0], sizeof(connect));
+    assert_on_connected(&connack[0], sizeof(connack));
+
+    /* Disconnected on a 65 bytes packet, and not read again. */
+    async_tcp_client_write_mock_once(sizeof(disconnect));
+    async_tcp_client_write_mock_set_buf_p_in(&disconnect[0], sizeof(disconnect));
+    mqtt_on_disconnected_mock_once();
+    async_tcp_client_disconnect_mock_once();
+    async_tcp_client_disconnect_mock_set_self_p_in_pointer(tcp_p);
+    mock_prepare_read(&publish[0], sizeof(publish), 0);
+    tcp_on_input(tcp_p);
+}
+
+TEST(receive_malformed_remaining_length)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t publish[] = {
+        0x30, 0xff, 0xff, 0xff, 0xff, 0x01
+    };
+
+    assert_until_connected(&async, &client);
+
+    /* Disconnected, and not read again. */
+    mqtt_on_disconnected_mock_once();
+    async_tcp_client_disconnect_mock_once();
+    async_tcp_client_disconnect_mock_set_self_p_in_pointer(tcp_p);
+    mock_prepare_read(&publish[0], sizeof(publish), 0);
+    tcp_on_input(tcp_p);
+
+    /* Reconnects after 1 second. */
+    async_tcp_client_connect_mock_once("foo", 1883);
+    tick_many(&async, 11);
+    async_process(&async);
+}
+
+TEST(ping)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+
+    assert_until_connected(&async, &client);
+
+    /* First ping-pong. */
+    mock_prepare_pingreq();
+    tick_many(&async, 101);
+    async_process(&async);
+    input_packet_pingresp();
+
+    /* Second ping-pong. */
+    mock_prepare_pingreq();
+    tick_many(&async, 101);
+    async_process(&async);
+    input_packet_pingresp();
+
+    assert_stop(&client);
+}
+
+TEST(reconnect_after_tcp_disconnect)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t connect[] = {
+        0x10, 0x1e, 0x00, 0x04, 0x4d, 0x51, 0x54, 0x54, 0x05, 0x02,
+        0x00, 0x1e, 0x06, 0x21, 0x00, 0x10, 0x22, 0x00, 0x01, 0x00,
+        0x0b, 0x61, 0x73, 0x79, 0x6e, 0x63, 0x2d, 0x31, 0x32, 0x33,
+        0x34, 0x35
+    };
+    uint8_t connack[] = {
+        0x20, 0x0b, 0x00, 0x00, 0x08, 0x24, 0x00, 0x25, 0x00, 0x28,
+        0x00, 0x2a, 0x00
+    };
+    int i;
+
+    assert_until_connected(&async, &client);
+    mqtt_on_disconnected_mock_once();
+    tcp_on_disconnected(tcp_p);
+
+    /* Reconnects every 1 seconds, make it fail until first ping
+       should have been sent (10 seconds, wait 15 to be sure). */
+    for (i = 1; i < 16; i++) {
+        async_tcp_client_connect_mock_once("foo", 1883);
+        tick_many(&async, 11);
+        async_process(&async);
+        tcp_on_connected(tcp_p, -1);
+    }
+
+    /* Reconnects after 1 second, make it successful. */
+    async_tcp_client_connect_mock_once("foo", 1883);
+    tick_many(&async, 11);
+    async_process(&async);
+    async_tcp_client_write_mock_once(sizeof(connect));
+    async_tcp_client_write_mock_set_buf_p_in(&connect[0], sizeof(connect));
+    tcp_on_connected(tcp_p, 0);
+    assert_on_connected(&connack[0], sizeof(connack));
+
+    /* ping-pong after 10 seconds. */
+    mock_prepare_pingreq();
+    tick_many(&async, 101);
+    async_process(&async);
+    input_packet_pingresp();
+
+    assert_stop(&client);
+}
+
+TEST(reconnect_after_unsuccessful_connack)
+{
+    struct async_t async;
+    struct async_mqtt_client_t client;
+    uint8_t connect[] = {
+        0x10, 0x1e, 0x00, 0x04, 0x4d, 0x51, 0x54, 0x54, 0x05, 0x02,
+        0x00, 0x1e, 0x06, 0x21, 0x00, 0x10, 0x22, 0x00, 0x01, 0x00,
+        0x0b, 0x61, 0x73, 0x79, 0x6e, 0x63, 0x2d, 0x31, 0x32, 0x33,
+        0x34, 0x35
     };
     uint8_t connack[] = {
         0x20, 0x0b, 0x00, 0x05, 0x08, 0x24, 0x00, 0x25, 0x00, 0x28,
@@ -585,7 +1777,10 @@ TEST(reconnect_after_unsuccessful_connack)
     mqtt_on_connected_mock_none();
     async_tcp_client_disconnect_mock_once();
     async_tcp_client_disconnect_mock_set_self_p_in_pointer(tcp_p);
-    input_packet(&connack[0], 1, sizeof(connack));
+
+    /* Not read again once disconnected. */
+    mock_prepare_read(&connack[0], sizeof(connack), 0);
+    tcp_on_input(tcp_p);
 
     /* Reconnects after 1 second. */
     async_tcp_client_connect_mock_once("foo", 1883);
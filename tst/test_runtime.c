@@ -1,10 +1,27 @@
 #include <pthread.h>
+#include <semaphore.h>
 #include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include "nala.h"
 #include "async.h"
+#include "async/runtimes/linux.h"
+
+/* Run given test with the io_uring runtime, or skip it if io_uring
+   is not supported by the kernel. */
+static void run_linux_uring(void (*test)(struct async_runtime_t *runtime_p))
+{
+    struct async_runtime_t *runtime_p;
+
+    runtime_p = async_runtime_linux_uring_create();
+
+    if (runtime_p == NULL) {
+        return;
+    }
+
+    test(runtime_p);
+}
 
 static bool single_shot_timer_expired = false;
 static int periodic_timer_expiry_count = 0;
@@ -32,13 +49,13 @@ static void on_periodic_timer_expiry()
     check_timers_test_done();
 }
 
-TEST(timers)
+static void test_timers(struct async_runtime_t *runtime_p)
 {
     struct async_t async;
     struct async_timer_t timers[2];
 
     async_init(&async);
-    async_set_runtime(&async, async_runtime_create());
+    async_set_runtime(&async, runtime_p);
     async_timer_init(&timers[0],
                      on_single_shot_timer_expiry,
                      NULL,
@@ -56,6 +73,21 @@ TEST(timers)
     async_run_forever(&async);
 }
 
+TEST(timers)
+{
+    test_timers(async_runtime_create());
+}
+
+TEST(timers_linux_st)
+{
+    test_timers(async_runtime_linux_st_create());
+}
+
+TEST(timers_linux_uring)
+{
+    run_linux_uring(test_timers);
+}
+
 static void do_connect(struct async_tcp_client_t *tcp_p, void *arg_p)
 {
     (void)arg_p;
@@ -118,7 +150,8 @@ static void *tcp_client_server_initiated_close_server_main(void *arg_p)
     return (NULL);
 }
 
-TEST(tcp_client_server_initiated_close)
+static void test_tcp_client_server_initiated_close(
+    struct async_runtime_t *runtime_p)
 {
     struct async_t async;
     struct async_tcp_client_t tcp;
@@ -130,7 +163,7 @@ TEST(tcp_client_server_initiated_close)
                    NULL);
 
     async_init(&async);
-    async_set_runtime(&async, async_runtime_create());
+    async_set_runtime(&async, runtime_p);
     async_tcp_client_init(&tcp,
                           tcp_client_server_initiated_close_on_connected,
                           tcp_client_server_initiated_close_on_disconnected,
@@ -140,6 +173,21 @@ TEST(tcp_client_server_initiated_close)
     async_run_forever(&async);
 }
 
+TEST(tcp_client_server_initiated_close)
+{
+    test_tcp_client_server_initiated_close(async_runtime_create());
+}
+
+TEST(tcp_client_server_initiated_close_linux_st)
+{
+    test_tcp_client_server_initiated_close(async_runtime_linux_st_create());
+}
+
+TEST(tcp_client_server_initiated_close_linux_uring)
+{
+    run_linux_uring(test_tcp_client_server_initiated_close);
+}
+
 static void tcp_client_client_initiated_close_do_connect(
     struct async_tcp_client_t *tcp_p,
     void *arg_p)
@@ -187,7 +235,8 @@ static void *tcp_client_client_initiated_close_server_main(void *arg_p)
     return (NULL);
 }
 
-TEST(tcp_client_client_initiated_close)
+static void test_tcp_client_client_initiated_close(
+    struct async_runtime_t *runtime_p)
 {
     struct async_t async;
     struct async_tcp_client_t tcp;
@@ -199,7 +248,7 @@ TEST(tcp_client_client_initiated_close)
                    NULL);
 
     async_init(&async);
-    async_set_runtime(&async, async_runtime_create());
+    async_set_runtime(&async, runtime_p);
     async_tcp_client_init(&tcp,
                           tcp_client_client_initiated_close_on_connected,
                           NULL,
@@ -212,6 +261,21 @@ TEST(tcp_client_client_initiated_close)
     async_run_forever(&async);
 }
 
+TEST(tcp_client_client_initiated_close)
+{
+    test_tcp_client_client_initiated_close(async_runtime_create());
+}
+
+TEST(tcp_client_client_initiated_close_linux_st)
+{
+    test_tcp_client_client_initiated_close(async_runtime_linux_st_create());
+}
+
+TEST(tcp_client_client_initiated_close_linux_uring)
+{
+    run_linux_uring(test_tcp_client_client_initiated_close);
+}
+
 static void on_tcp_connected(struct async_tcp_client_t *tcp_p, int res)
 {
     ASSERT_NE(tcp_p, NULL);
@@ -219,13 +283,13 @@ static void on_tcp_connected(struct async_tcp_client_t *tcp_p, int res)
     exit(0);
 }
 
-TEST(tcp_client_connect_failure)
+static void test_tcp_client_connect_failure(struct async_runtime_t *runtime_p)
 {
     struct async_t async;
     struct async_tcp_client_t tcp;
 
     async_init(&async);
-    async_set_runtime(&async, async_runtime_create());
+    async_set_runtime(&async, runtime_p);
     async_tcp_client_init(&tcp,
                           on_tcp_connected,
                           NULL,
@@ -235,6 +299,352 @@ TEST(tcp_client_connect_failure)
     async_run_forever(&async);
 }
 
+TEST(tcp_client_connect_failure)
+{
+    test_tcp_client_connect_failure(async_runtime_create());
+}
+
+TEST(tcp_client_connect_failure_linux_st)
+{
+    test_tcp_client_connect_failure(async_runtime_linux_st_create());
+}
+
+TEST(tcp_client_connect_failure_linux_uring)
+{
+    run_linux_uring(test_tcp_client_connect_failure);
+}
+
+static int listener_create(int port, int backlog)
+{
+    int sock;
+    struct sockaddr_in addr;
+    int yes;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_aton("127.0.0.1", (struct in_addr *)&addr.sin_addr.s_addr);
+
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    yes = 1;
+    ASSERT_EQ(setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)), 0);
+    ASSERT_EQ(bind(sock, &addr, sizeof(addr)), 0);
+    ASSERT_EQ(listen(sock, backlog), 0);
+
+    return (sock);
+}
+
+static void tcp_client_connect_timeout_on_connected(
+    struct async_tcp_client_t *tcp_p, int res)
+{
+    (void)tcp_p;
+
+    ASSERT_EQ(res, -1);
+    exit(0);
+}
+
+static void test_tcp_client_connect_timeout(struct async_runtime_t *runtime_p)
+{
+    struct async_t async;
+    struct async_tcp_client_t tcp;
+    struct sockaddr_in addr;
+    int sock;
+    int i;
+
+    /* Connections are not accepted once the backlog is full, so
+       the connect below never completes. */
+    listener_create(9997, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(9997);
+    inet_aton("127.0.0.1", (struct in_addr *)&addr.sin_addr.s_addr);
+
+    for (i = 0; i < 4; i++) {
+        sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        connect(sock, &addr, sizeof(addr));
+    }
+
+    async_init(&async);
+    async_set_runtime(&async, runtime_p);
+    async_tcp_client_init(&tcp,
+                          tcp_client_connect_timeout_on_connected,
+                          NULL,
+                          NULL,
+                          &async);
+    async_tcp_client_set_connect_timeout(&tcp, 10);
+    async_tcp_client_connect(&tcp, "127.0.0.1", 9997);
+    async_run_forever(&async);
+}
+
+TEST(tcp_client_connect_timeout)
+{
+    test_tcp_client_connect_timeout(async_runtime_create());
+}
+
+TEST(tcp_client_connect_timeout_linux_st)
+{
+    test_tcp_client_connect_timeout(async_runtime_linux_st_create());
+}
+
+TEST(tcp_client_connect_timeout_linux_uring)
+{
+    run_linux_uring(test_tcp_client_connect_timeout);
+}
+
+static sem_t tcp_client_write_failed_connected;
+static sem_t tcp_client_write_failed_reset;
+
+static void tcp_client_write_failed_on_connected(
+    struct async_tcp_client_t *tcp_p, int res)
+{
+    ASSERT_EQ(res, 0);
+
+    /* Written after the connection was reset by the server. */
+    sem_post(&tcp_client_write_failed_connected);
+    sem_wait(&tcp_client_write_failed_reset);
+    async_tcp_client_write(tcp_p, "1", 1);
+}
+
+static void tcp_client_write_failed_on_disconnected(
+    struct async_tcp_client_t *tcp_p)
+{
+    (void)tcp_p;
+
+    exit(0);
+}
+
+static void *tcp_client_write_failed_server_main(void *arg_p)
+{
+    int sock;
+    struct linger linger;
+
+    sock = accept(*(int *)arg_p, NULL, 0);
+    sem_wait(&tcp_client_write_failed_connected);
+    linger.l_onoff = 1;
+    linger.l_linger = 0;
+    ASSERT_EQ(setsockopt(sock, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger)),
+              0);
+    ASSERT_EQ(close(sock), 0);
+    sem_post(&tcp_client_write_failed_reset);
+
+    return (NULL);
+}
+
+static void test_tcp_client_write_failed(struct async_runtime_t *runtime_p)
+{
+    struct async_t async;
+    struct async_tcp_client_t tcp;
+    pthread_t server_pthread;
+    int sock;
+
+    sem_init(&tcp_client_write_failed_connected, 0, 0);
+    sem_init(&tcp_client_write_failed_reset, 0, 0);
+    sock = listener_create(9996, 5);
+    pthread_create(&server_pthread,
+                   NULL,
+                   tcp_client_write_failed_server_main,
+                   &sock);
+
+    async_init(&async);
+    async_set_runtime(&async, runtime_p);
+    async_tcp_client_init(&tcp,
+                          tcp_client_write_failed_on_connected,
+                          tcp_client_write_failed_on_disconnected,
+                          NULL,
+                          &async);
+    async_tcp_client_connect(&tcp, "127.0.0.1", 9996);
+    async_run_forever(&async);
+}
+
+TEST(tcp_client_write_failed)
+{
+    test_tcp_client_write_failed(async_runtime_create());
+}
+
+TEST(tcp_client_write_failed_linux_st)
+{
+    test_tcp_client_write_failed(async_runtime_linux_st_create());
+}
+
+TEST(tcp_client_write_failed_linux_uring)
+{
+    run_linux_uring(test_tcp_client_write_failed);
+}
+
+static void tcp_server_on_client_input(
+    struct async_tcp_server_client_t *client_p)
+{
+    char ch;
+
+    while (async_tcp_server_client_read(client_p, &ch, 1) == 1) {
+        async_tcp_server_client_write(client_p, &ch, 1);
+    }
+}
+
+static void tcp_server_on_client_disconnected(
+    struct async_tcp_server_client_t *client_p)
+{
+    (void)client_p;
+
+    exit(0);
+}
+
+static void *tcp_server_client_main(void *arg_p)
+{
+    (void)arg_p;
+
+    int sock;
+    struct sockaddr_in addr;
+    char buf[3];
+    size_t size;
+    ssize_t res;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(9995);
+    inet_aton("127.0.0.1", (struct in_addr *)&addr.sin_addr.s_addr);
+
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_EQ(connect(sock, &addr, sizeof(addr)), 0);
+    ASSERT_EQ(write(sock, "123", 3), 3);
+    size = 0;
+
+    while (size < 3) {
+        res = read(sock, &buf[size], 3 - size);
+        ASSERT_GT(res, 0);
+        size += res;
+    }
+
+    ASSERT_EQ(memcmp(&buf[0], "123", 3), 0);
+    ASSERT_EQ(close(sock), 0);
+
+    return (NULL);
+}
+
+static void test_tcp_server(struct async_runtime_t *runtime_p)
+{
+    struct async_t async;
+    struct async_tcp_server_t server;
+    struct async_tcp_server_client_t client;
+    pthread_t client_pthread;
+
+    async_init(&async);
+    async_set_runtime(&async, runtime_p);
+    async_tcp_server_init(&server,
+                          "127.0.0.1",
+                          9995,
+                          NULL,
+                          tcp_server_on_client_disconnected,
+                          tcp_server_on_client_input,
+                          &async);
+    async_tcp_server_add_client(&server, &client);
+    ASSERT_EQ(async_tcp_server_start(&server), 0);
+    pthread_create(&client_pthread, NULL, tcp_server_client_main, NULL);
+    async_run_forever(&async);
+}
+
+TEST(tcp_server)
+{
+    test_tcp_server(async_runtime_create());
+}
+
+TEST(tcp_server_linux_st)
+{
+    test_tcp_server(async_runtime_linux_st_create());
+}
+
+TEST(tcp_server_linux_uring)
+{
+    run_linux_uring(test_tcp_server);
+}
+
+#define NUMBER_OF_CLIENTS 100
+
+/* All clients send at the same time, more than fits in one batch of
+   events. The echo is only received in later rounds if every socket
+   was re-armed. */
+static void *tcp_server_many_clients_client_main(void *arg_p)
+{
+    (void)arg_p;
+
+    int socks[NUMBER_OF_CLIENTS];
+    struct sockaddr_in addr;
+    int round;
+    int i;
+    char ch;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(9994);
+    inet_aton("127.0.0.1", (struct in_addr *)&addr.sin_addr.s_addr);
+
+    for (i = 0; i < NUMBER_OF_CLIENTS; i++) {
+        socks[i] = socket(AF_INET, SOCK_STREAM, 0);
+        ASSERT_EQ(connect(socks[i], &addr, sizeof(addr)), 0);
+    }
+
+    for (round = 0; round < 3; round++) {
+        for (i = 0; i < NUMBER_OF_CLIENTS; i++) {
+            ch = (char)i;
+            ASSERT_EQ(write(socks[i], &ch, 1), 1);
+        }
+
+        for (i = 0; i < NUMBER_OF_CLIENTS; i++) {
+            ASSERT_EQ(read(socks[i], &ch, 1), 1);
+            ASSERT_EQ(ch, (char)i);
+        }
+    }
+
+    exit(0);
+
+    return (NULL);
+}
+
+static void test_tcp_server_many_clients(struct async_runtime_t *runtime_p)
+{
+    struct async_t async;
+    struct async_tcp_server_t server;
+    struct async_tcp_server_client_t clients[NUMBER_OF_CLIENTS];
+    pthread_t client_pthread;
+    int i;
+
+    async_init(&async);
+    async_set_runtime(&async, runtime_p);
+    async_tcp_server_init(&server,
+                          "127.0.0.1",
+                          9994,
+                          NULL,
+                          NULL,
+                          tcp_server_on_client_input,
+                          &async);
+
+    for (i = 0; i < NUMBER_OF_CLIENTS; i++) {
+        async_tcp_server_add_client(&server, &clients[i]);
+    }
+
+    ASSERT_EQ(async_tcp_server_start(&server), 0);
+    pthread_create(&client_pthread,
+                   NULL,
+                   tcp_server_many_clients_client_main,
+                   NULL);
+    async_run_forever(&async);
+}
+
+TEST(tcp_server_many_clients)
+{
+    test_tcp_server_many_clients(async_runtime_create());
+}
+
+TEST(tcp_server_many_clients_linux_st)
+{
+    test_tcp_server_many_clients(async_runtime_linux_st_create());
+}
+
+TEST(tcp_server_many_clients_linux_uring)
+{
+    run_linux_uring(test_tcp_server_many_clients);
+}
+
 static bool hello_called = false;
 
 static void hello(void *obj_p, void *arg_p)
@@ -252,16 +662,157 @@ static void on_complete(void *obj_p, void *arg_p)
     exit(0);
 }
 
-TEST(call_worker_pool)
+static void test_call_worker_pool(struct async_runtime_t *runtime_p)
 {
     struct async_t async;
 
     async_init(&async);
-    async_set_runtime(&async, async_runtime_create());
+    async_set_runtime(&async, runtime_p);
     async_call_worker_pool(&async, hello, NULL, NULL, on_complete);
     async_run_forever(&async);
 }
 
+TEST(call_worker_pool)
+{
+    test_call_worker_pool(async_runtime_create());
+}
+
+TEST(call_worker_pool_linux_st)
+{
+    test_call_worker_pool(async_runtime_linux_st_create());
+}
+
+TEST(call_worker_pool_linux_uring)
+{
+    run_linux_uring(test_call_worker_pool);
+}
+
+static void job_entry(void *obj_p, void *arg_p)
+{
+    (void)obj_p;
+    (void)arg_p;
+}
+
+static int jobs_left = 100;
+
+static void on_job_complete(struct async_t *async_p, void *arg_p)
+{
+    (void)arg_p;
+
+    struct async_runtime_linux_statistics_t statistics;
+
+    jobs_left--;
+
+    if (jobs_left > 0) {
+        async_call_worker_pool(async_p,
+                               job_entry,
+                               async_p,
+                               NULL,
+                               (async_func_t)on_job_complete);
+
+        return;
+    }
+
+    /* All jobs but this one given back to the slab, which was only
+       allocated once. */
+    async_runtime_linux_get_statistics(async_p->runtime_p, &statistics);
+    ASSERT_EQ(statistics.messages.allocations, 100);
+    ASSERT_EQ(statistics.messages.misses, 1);
+    ASSERT_EQ(statistics.messages.capacity, 64);
+    ASSERT_EQ(statistics.messages.used, 1);
+    exit(0);
+}
+
+TEST(message_slabs)
+{
+    struct async_t async;
+
+    async_init(&async);
+    async_set_runtime(&async, async_runtime_linux_create());
+    async_call_worker_pool(&async,
+                           job_entry,
+                           &async,
+                           NULL,
+                           (async_func_t)on_job_complete);
+    async_run_forever(&async);
+}
+
+static sem_t blocked_jobs;
+static int blocked_jobs_left;
+
+static void blocked_job_entry(void *obj_p, void *arg_p)
+{
+    (void)obj_p;
+    (void)arg_p;
+
+    sem_wait(&blocked_jobs);
+}
+
+static void on_blocked_job_complete(void *obj_p, void *arg_p)
+{
+    (void)obj_p;
+    (void)arg_p;
+
+    blocked_jobs_left--;
+
+    if (blocked_jobs_left == 0) {
+        exit(0);
+    }
+}
+
+static void test_call_worker_pool_queue_full(struct async_runtime_t *runtime_p)
+{
+    struct async_t async;
+    int i;
+    int res;
+
+    sem_init(&blocked_jobs, 0, 0);
+    async_init(&async);
+    async_set_runtime(&async, runtime_p);
+    async_set_worker_pool_size(&async, 1, 2);
+    blocked_jobs_left = 0;
+
+    /* One job in the worker and two queued, at most. Submission fails
+       instead of blocking once the queue is full. */
+    for (i = 0; i < 4; i++) {
+        res = async_call_worker_pool(&async,
+                                     blocked_job_entry,
+                                     NULL,
+                                     NULL,
+                                     on_blocked_job_complete);
+
+        if (res != 0) {
+            break;
+        }
+
+        blocked_jobs_left++;
+    }
+
+    ASSERT_EQ(res, -ASYNC_ERROR_QUEUE_FULL);
+    ASSERT(blocked_jobs_left >= 2);
+
+    for (i = 0; i < blocked_jobs_left; i++) {
+        sem_post(&blocked_jobs);
+    }
+
+    async_run_forever(&async);
+}
+
+TEST(call_worker_pool_queue_full)
+{
+    test_call_worker_pool_queue_full(async_runtime_create());
+}
+
+TEST(call_worker_pool_queue_full_linux_st)
+{
+    test_call_worker_pool_queue_full(async_runtime_linux_st_create());
+}
+
+TEST(call_worker_pool_queue_full_linux_uring)
+{
+    run_linux_uring(test_call_worker_pool_queue_full);
+}
+
 static pthread_t threadsafe_caller_pthread;
 static int value = 3;
 
@@ -282,15 +833,256 @@ static void *threadsafe_caller(struct async_t *async_p)
     return (NULL);
 }
 
-TEST(call_threadsafe)
+static void test_call_threadsafe(struct async_runtime_t *runtime_p)
 {
     struct async_t async;
 
     async_init(&async);
-    async_set_runtime(&async, async_runtime_create());
+    async_set_runtime(&async, runtime_p);
     pthread_create(&threadsafe_caller_pthread,
                    NULL,
                    (void *(*)(void *))threadsafe_caller,
                    &async);
     async_run_forever(&async);
 }
+
+TEST(call_threadsafe)
+{
+    test_call_threadsafe(async_runtime_create());
+}
+
+TEST(call_threadsafe_linux_st)
+{
+    test_call_threadsafe(async_runtime_linux_st_create());
+}
+
+TEST(call_threadsafe_linux_uring)
+{
+    run_linux_uring(test_call_threadsafe);
+}
+
+static void idle_call_again(struct async_t *async_p, int *arg_p)
+{
+    (*arg_p)++;
+
+    if (*arg_p == 1000) {
+        exit(0);
+    }
+
+    ASSERT_EQ(async_call_with_priority(async_p,
+                                       ASYNC_PRIORITY_IDLE,
+                                       (async_func_t)idle_call_again,
+                                       async_p,
+                                       arg_p), 0);
+}
+
+static void test_call_idle_priority(struct async_runtime_t *runtime_p)
+{
+    struct async_t async;
+    int arg;
+
+    /* The runtime must not block while idle calls are queued. */
+    async_init(&async);
+    async_set_runtime(&async, runtime_p);
+    arg = 0;
+    ASSERT_EQ(async_call_with_priority(&async,
+                                       ASYNC_PRIORITY_IDLE,
+                                       (async_func_t)idle_call_again,
+                                       &async,
+                                       &arg), 0);
+    async_run_forever(&async);
+}
+
+TEST(call_idle_priority)
+{
+    test_call_idle_priority(async_runtime_create());
+}
+
+TEST(call_idle_priority_linux_st)
+{
+    test_call_idle_priority(async_runtime_linux_st_create());
+}
+
+TEST(call_idle_priority_linux_uring)
+{
+    run_linux_uring(test_call_idle_priority);
+}
+
+static void flood(struct async_t *async_p, void *arg_p)
+{
+    ASSERT_EQ(async_call(async_p, (async_func_t)flood, async_p, arg_p), 0);
+}
+
+static void on_flood_timeout(void *obj_p)
+{
+    (void)obj_p;
+
+    exit(0);
+}
+
+static void test_process_budget_fairness(struct async_runtime_t *runtime_p)
+{
+    struct async_t async;
+    struct async_timer_t timer;
+
+    /* The timer expires even if callbacks are queued forever. */
+    async_init(&async);
+    async_set_runtime(&async, runtime_p);
+    async_set_tick_in_ms(&async, 1);
+    async_timer_init(&timer, on_flood_timeout, NULL, 10, 0, &async);
+    async_timer_start(&timer);
+    ASSERT_EQ(async_call(&async, (async_func_t)flood, &async, NULL), 0);
+    async_run_forever(&async);
+}
+
+TEST(process_budget_fairness)
+{
+    test_process_budget_fairness(async_runtime_create());
+}
+
+TEST(process_budget_fairness_linux_st)
+{
+    test_process_budget_fairness(async_runtime_linux_st_create());
+}
+
+TEST(process_budget_fairness_linux_uring)
+{
+    run_linux_uring(test_process_budget_fairness);
+}
+
+struct coroutine_job_t {
+    struct async_coroutine_t coroutine;
+    pthread_t pthread;
+    int value;
+};
+
+static void coroutine_job_entry(struct async_coroutine_t *coroutine_p,
+                                int *value_p)
+{
+    struct coroutine_job_t *job_p;
+
+    job_p = coroutine_p->obj_p;
+    ASSERT(!pthread_equal(pthread_self(), job_p->pthread));
+    (*value_p)++;
+}
+
+static void coroutine_job_main(struct async_coroutine_t *self_p)
+{
+    struct coroutine_job_t *job_p;
+
+    job_p = self_p->obj_p;
+
+    ASYNC_COROUTINE_BEGIN(self_p);
+
+    job_p->pthread = pthread_self();
+
+    while (job_p->value < 3) {
+        ASYNC_COROUTINE_AWAIT_WORKER_POOL(self_p,
+                                          (async_func_t)coroutine_job_entry,
+                                          &job_p->value);
+        ASSERT_EQ(self_p->res, 0);
+        ASSERT(pthread_equal(pthread_self(), job_p->pthread));
+    }
+
+    ASYNC_COROUTINE_SLEEP(self_p, 10);
+    ASSERT_EQ(self_p->res, -ASYNC_ERROR_TIMEOUT);
+    exit(0);
+
+    ASYNC_COROUTINE_END(self_p);
+}
+
+static void test_coroutine_await_worker_pool(struct async_runtime_t *runtime_p)
+{
+    struct async_t async;
+    struct coroutine_job_t job;
+
+    async_init(&async);
+    async_set_runtime(&async, runtime_p);
+    job.value = 0;
+    async_coroutine_init(&job.coroutine, coroutine_job_main, &job, &async);
+    ASSERT_EQ(async_coroutine_start(&job.coroutine), 0);
+    async_run_forever(&async);
+}
+
+TEST(coroutine_await_worker_pool)
+{
+    test_coroutine_await_worker_pool(async_runtime_create());
+}
+
+TEST(coroutine_await_worker_pool_linux_st)
+{
+    test_coroutine_await_worker_pool(async_runtime_linux_st_create());
+}
+
+TEST(coroutine_await_worker_pool_linux_uring)
+{
+    run_linux_uring(test_coroutine_await_worker_pool);
+}
+
+static struct async_shards_t *shards_p;
+static pthread_t shards_pthreads[2];
+static int shards_pongs;
+
+static void shards_on_ping(void *obj_p, void *arg_p);
+
+/* Bursts of calls, all in the same ring. */
+static void shards_ping_burst(void)
+{
+    int i;
+
+    for (i = 0; i < 100; i++) {
+        ASSERT_EQ(async_call_on(async_shards_get(shards_p, 1),
+                                shards_on_ping,
+                                NULL,
+                                NULL), 0);
+    }
+}
+
+static void shards_on_pong(void *obj_p, void *arg_p)
+{
+    (void)obj_p;
+    (void)arg_p;
+
+    ASSERT(pthread_equal(pthread_self(), shards_pthreads[0]));
+    shards_pongs++;
+
+    if (shards_pongs == 10000) {
+        exit(0);
+    } else if ((shards_pongs % 100) == 0) {
+        shards_ping_burst();
+    }
+}
+
+static void shards_on_ping(void *obj_p, void *arg_p)
+{
+    (void)obj_p;
+    (void)arg_p;
+
+    shards_pthreads[1] = pthread_self();
+    ASSERT(!pthread_equal(shards_pthreads[0], shards_pthreads[1]));
+    ASSERT_EQ(async_call_on(async_shards_get(shards_p, 0),
+                            shards_on_pong,
+                            NULL,
+                            NULL), 0);
+}
+
+static void shards_start(void *obj_p, void *arg_p)
+{
+    (void)obj_p;
+    (void)arg_p;
+
+    shards_pthreads[0] = pthread_self();
+    shards_ping_burst();
+}
+
+TEST(shards_call_on)
+{
+    shards_p = async_shards_create(2);
+    ASSERT_NE(shards_p, NULL);
+    ASSERT_EQ(async_shards_get_number_of_shards(shards_p), 2);
+    ASSERT_EQ(async_call_on(async_shards_get(shards_p, 0),
+                            shards_start,
+                            NULL,
+                            NULL), 0);
+    async_shards_run_forever(shards_p);
+}
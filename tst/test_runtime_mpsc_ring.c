@@ -0,0 +1,188 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include "nala.h"
+#include "async.h"
+#include "internal.h"
+
+static void func_1(void *obj_p, void *arg_p)
+{
+    (void)obj_p;
+    (void)arg_p;
+}
+
+static void func_2(void *obj_p, void *arg_p)
+{
+    (void)obj_p;
+    (void)arg_p;
+}
+
+TEST(put_get_order)
+{
+    struct async_mpsc_ring_t ring;
+    void *obj_p;
+    void *arg_p;
+    int lap;
+
+    ASSERT_EQ(async_mpsc_ring_init(&ring, 3), -1);
+    ASSERT_EQ(async_mpsc_ring_init(&ring, 4), 0);
+    ASSERT_EQ(async_mpsc_ring_get(&ring, &obj_p, &arg_p), NULL);
+
+    /* Several laps to wrap the positions. */
+    for (lap = 0; lap < 3; lap++) {
+        async_mpsc_ring_woken_up(&ring);
+        ASSERT_GE(async_mpsc_ring_put(&ring, func_1, &ring, NULL), 0);
+        ASSERT_GE(async_mpsc_ring_put(&ring, func_2, NULL, &ring), 0);
+        ASSERT_GE(async_mpsc_ring_put(&ring, func_1, &lap, &lap), 0);
+        ASSERT_EQ(async_mpsc_ring_get(&ring, &obj_p, &arg_p), func_1);
+        ASSERT_EQ(obj_p, &ring);
+        ASSERT_EQ(arg_p, NULL);
+        ASSERT_EQ(async_mpsc_ring_get(&ring, &obj_p, &arg_p), func_2);
+        ASSERT_EQ(obj_p, NULL);
+        ASSERT_EQ(arg_p, &ring);
+        ASSERT_EQ(async_mpsc_ring_get(&ring, &obj_p, &arg_p), func_1);
+        ASSERT_EQ(obj_p, &lap);
+        ASSERT_EQ(arg_p, &lap);
+        ASSERT_EQ(async_mpsc_ring_get(&ring, &obj_p, &arg_p), NULL);
+    }
+
+    async_mpsc_ring_destroy(&ring);
+}
+
+TEST(put_full)
+{
+    struct async_mpsc_ring_t ring;
+    void *obj_p;
+    void *arg_p;
+    int i;
+
+    ASSERT_EQ(async_mpsc_ring_init(&ring, 4), 0);
+
+    for (i = 0; i < 4; i++) {
+        ASSERT_GE(async_mpsc_ring_put(&ring, func_1, NULL, NULL), 0);
+    }
+
+    ASSERT_EQ(async_mpsc_ring_put(&ring, func_1, NULL, NULL),
+              -ASYNC_ERROR_QUEUE_FULL);
+
+    /* Room for one more once one call is taken. */
+    ASSERT_EQ(async_mpsc_ring_get(&ring, &obj_p, &arg_p), func_1);
+    ASSERT_GE(async_mpsc_ring_put(&ring, func_2, NULL, NULL), 0);
+    ASSERT_EQ(async_mpsc_ring_put(&ring, func_2, NULL, NULL),
+              -ASYNC_ERROR_QUEUE_FULL);
+
+    for (i = 0; i < 3; i++) {
+        ASSERT_EQ(async_mpsc_ring_get(&ring, &obj_p, &arg_p), func_1);
+    }
+
+    ASSERT_EQ(async_mpsc_ring_get(&ring, &obj_p, &arg_p), func_2);
+    ASSERT_EQ(async_mpsc_ring_get(&ring, &obj_p, &arg_p), NULL);
+
+    async_mpsc_ring_destroy(&ring);
+}
+
+TEST(wake_up)
+{
+    struct async_mpsc_ring_t ring;
+    void *obj_p;
+    void *arg_p;
+
+    ASSERT_EQ(async_mpsc_ring_init(&ring, 8), 0);
+
+    /* Only the first call wakes up the consumer. */
+    ASSERT_EQ(async_mpsc_ring_put(&ring, func_1, NULL, NULL), 1);
+    ASSERT_EQ(async_mpsc_ring_put(&ring, func_1, NULL, NULL), 0);
+    ASSERT_EQ(async_mpsc_ring_get(&ring, &obj_p, &arg_p), func_1);
+    ASSERT_EQ(async_mpsc_ring_get(&ring, &obj_p, &arg_p), func_1);
+
+    /* Still not woken up, even though empty. */
+    ASSERT_EQ(async_mpsc_ring_put(&ring, func_1, NULL, NULL), 0);
+
+    /* Woken up. The next call wakes up the consumer again. */
+    async_mpsc_ring_woken_up(&ring);
+    ASSERT_EQ(async_mpsc_ring_put(&ring, func_2, NULL, NULL), 1);
+    ASSERT_EQ(async_mpsc_ring_put(&ring, func_2, NULL, NULL), 0);
+
+    /* A failed put does not wake up the consumer. */
+    ASSERT_EQ(async_mpsc_ring_put(&ring, func_2, NULL, NULL), 0);
+    ASSERT_EQ(async_mpsc_ring_put(&ring, func_2, NULL, NULL), 0);
+    ASSERT_EQ(async_mpsc_ring_put(&ring, func_2, NULL, NULL), 0);
+    ASSERT_EQ(async_mpsc_ring_put(&ring, func_2, NULL, NULL), 0);
+    ASSERT_EQ(async_mpsc_ring_put(&ring, func_2, NULL, NULL), 0);
+    async_mpsc_ring_woken_up(&ring);
+    ASSERT_EQ(async_mpsc_ring_put(&ring, func_2, NULL, NULL),
+              -ASYNC_ERROR_QUEUE_FULL);
+    ASSERT_EQ(async_mpsc_ring_get(&ring, &obj_p, &arg_p), func_1);
+    ASSERT_EQ(async_mpsc_ring_put(&ring, func_2, NULL, NULL), 1);
+
+    async_mpsc_ring_destroy(&ring);
+}
+
+#define NUMBER_OF_PRODUCERS 4
+#define NUMBER_OF_CALLS 100000
+
+static struct async_mpsc_ring_t stress_ring;
+
+/* Puts calls with the producer index and a sequence number. */
+static void *producer_main(void *arg_p)
+{
+    uintptr_t producer;
+    uintptr_t i;
+
+    producer = (uintptr_t)arg_p;
+
+    for (i = 0; i < NUMBER_OF_CALLS; i++) {
+        while (async_mpsc_ring_put(&stress_ring,
+                                   func_1,
+                                   (void *)producer,
+                                   (void *)i) < 0) {
+            sched_yield();
+        }
+    }
+
+    return (NULL);
+}
+
+TEST(stress_multiple_producers)
+{
+    pthread_t pthreads[NUMBER_OF_PRODUCERS];
+    uintptr_t next[NUMBER_OF_PRODUCERS];
+    uintptr_t producer;
+    void *obj_p;
+    void *arg_p;
+    int left;
+    int i;
+
+    ASSERT_EQ(async_mpsc_ring_init(&stress_ring, 64), 0);
+
+    for (i = 0; i < NUMBER_OF_PRODUCERS; i++) {
+        next[i] = 0;
+        pthread_create(&pthreads[i], NULL, producer_main, (void *)(uintptr_t)i);
+    }
+
+    /* Every call is received exactly once, and in order per
+       producer. */
+    left = (NUMBER_OF_PRODUCERS * NUMBER_OF_CALLS);
+
+    while (left > 0) {
+        if (async_mpsc_ring_get(&stress_ring, &obj_p, &arg_p) == NULL) {
+            sched_yield();
+
+            continue;
+        }
+
+        producer = (uintptr_t)obj_p;
+        ASSERT_LT(producer, NUMBER_OF_PRODUCERS);
+        ASSERT_EQ((uintptr_t)arg_p, next[producer]);
+        next[producer]++;
+        left--;
+    }
+
+    for (i = 0; i < NUMBER_OF_PRODUCERS; i++) {
+        pthread_join(pthreads[i], NULL);
+        ASSERT_EQ(next[i], NUMBER_OF_CALLS);
+    }
+
+    ASSERT_EQ(async_mpsc_ring_get(&stress_ring, &obj_p, &arg_p), NULL);
+    async_mpsc_ring_destroy(&stress_ring);
+}
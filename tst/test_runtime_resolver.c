@@ -0,0 +1,483 @@
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "nala.h"
+#include "async.h"
+#include "async/runtimes/linux.h"
+#include "internal.h"
+
+static int resolve_count = 0;
+
+static void add_address(struct async_resolver_result_t *result_p,
+                        const char *address_p)
+{
+    struct async_resolver_address_t *resolved_p;
+    struct sockaddr_in *addr_p;
+    struct sockaddr_in6 *addr6_p;
+
+    resolved_p = &result_p->addresses[result_p->length];
+    memset(resolved_p, 0, sizeof(*resolved_p));
+    addr_p = (struct sockaddr_in *)&resolved_p->addr;
+    addr6_p = (struct sockaddr_in6 *)&resolved_p->addr;
+
+    if (inet_pton(AF_INET, address_p, &addr_p->sin_addr) == 1) {
+        addr_p->sin_family = AF_INET;
+        resolved_p->size = sizeof(*addr_p);
+    } else {
+        ASSERT_EQ(inet_pton(AF_INET6, address_p, &addr6_p->sin6_addr), 1);
+        addr6_p->sin6_family = AF_INET6;
+        resolved_p->size = sizeof(*addr6_p);
+    }
+
+    result_p->length++;
+}
+
+/* Resolves like localhost, with IPv6 before IPv4. */
+static int resolve(const char *host_p,
+                   struct async_resolver_result_t *result_p)
+{
+    resolve_count++;
+    result_p->length = 0;
+
+    if (strcmp(host_p, "fail.test") == 0) {
+        return (-1);
+    } else if (strcmp(host_p, "blackhole.test") == 0) {
+        add_address(result_p, "127.0.0.2");
+    } else {
+        add_address(result_p, "::1");
+    }
+
+    add_address(result_p, "127.0.0.1");
+
+    return (0);
+}
+
+static int port_of(const struct async_resolver_address_t *address_p)
+{
+    if (address_p->addr.ss_family == AF_INET) {
+        return (ntohs(((struct sockaddr_in *)&address_p->addr)->sin_port));
+    } else {
+        return (ntohs(((struct sockaddr_in6 *)&address_p->addr)->sin6_port));
+    }
+}
+
+static void assert_localhost(const struct async_resolver_result_t *result_p,
+                             int port)
+{
+    ASSERT_NE(result_p, NULL);
+    ASSERT_EQ(result_p->length, 2);
+    ASSERT_EQ(result_p->addresses[0].addr.ss_family, AF_INET6);
+    ASSERT_EQ(result_p->addresses[0].size, sizeof(struct sockaddr_in6));
+    ASSERT_EQ(port_of(&result_p->addresses[0]), port);
+    ASSERT_EQ(result_p->addresses[1].addr.ss_family, AF_INET);
+    ASSERT_EQ(result_p->addresses[1].size, sizeof(struct sockaddr_in));
+    ASSERT_EQ(port_of(&result_p->addresses[1]), port);
+}
+
+static int numeric_completed;
+
+static void on_numeric_complete(void *obj_p,
+                                void *arg_p,
+                                const struct async_resolver_result_t *result_p)
+{
+    ASSERT_EQ(obj_p, NULL);
+    ASSERT_NE(result_p, NULL);
+    ASSERT_EQ(result_p->length, 1);
+    ASSERT_EQ(result_p->addresses[0].addr.ss_family,
+              (sa_family_t)(uintptr_t)arg_p);
+    ASSERT_EQ(port_of(&result_p->addresses[0]), 80);
+    numeric_completed++;
+}
+
+TEST(resolver_numeric)
+{
+    struct async_t async;
+    struct async_resolver_t resolver;
+
+    /* Completed immediately, without the worker pool or the cache. */
+    async_init(&async);
+    async_resolver_init(&resolver);
+    async_resolver_set_resolve(&resolver, resolve);
+    numeric_completed = 0;
+    async_resolver_get(&resolver,
+                       &async,
+                       "127.0.0.1",
+                       80,
+                       on_numeric_complete,
+                       NULL,
+                       (void *)(uintptr_t)AF_INET);
+    async_resolver_get(&resolver,
+                       &async,
+                       "::1",
+                       80,
+                       on_numeric_complete,
+                       NULL,
+                       (void *)(uintptr_t)AF_INET6);
+    ASSERT_EQ(numeric_completed, 2);
+    ASSERT_EQ(resolve_count, 0);
+    ASSERT_EQ(resolver.length, 0);
+}
+
+static struct async_resolver_t resolver;
+static struct async_t async;
+static bool completed;
+
+static void on_cache_hit_complete(
+    void *obj_p,
+    void *arg_p,
+    const struct async_resolver_result_t *result_p)
+{
+    (void)obj_p;
+    (void)arg_p;
+
+    assert_localhost(result_p, 81);
+    completed = true;
+}
+
+static void on_cache_miss_complete(
+    void *obj_p,
+    void *arg_p,
+    const struct async_resolver_result_t *result_p)
+{
+    (void)obj_p;
+    (void)arg_p;
+
+    /* Both addresses are cached. */
+    assert_localhost(result_p, 80);
+    ASSERT_EQ(resolve_count, 1);
+    completed = false;
+    async_resolver_get(&resolver,
+                       &async,
+                       "localhost.test",
+                       81,
+                       on_cache_hit_complete,
+                       NULL,
+                       NULL);
+    ASSERT(completed);
+    ASSERT_EQ(resolve_count, 1);
+    exit(0);
+}
+
+static void resolve_localhost(void *obj_p, void *arg_p)
+{
+    (void)obj_p;
+
+    async_resolver_get(&resolver,
+                       &async,
+                       "localhost.test",
+                       80,
+                       (async_resolver_complete_t)arg_p,
+                       NULL,
+                       NULL);
+}
+
+TEST(resolver_cache_hit)
+{
+    async_init(&async);
+    async_set_runtime(&async, async_runtime_create());
+    async_resolver_init(&resolver);
+    async_resolver_set_resolve(&resolver, resolve);
+    async_call(&async,
+               resolve_localhost,
+               NULL,
+               (void *)on_cache_miss_complete);
+    async_run_forever(&async);
+}
+
+static void on_expired_complete(void *obj_p,
+                                void *arg_p,
+                                const struct async_resolver_result_t *result_p)
+{
+    (void)obj_p;
+    (void)arg_p;
+
+    assert_localhost(result_p, 80);
+
+    if (resolve_count == 1) {
+        /* Resolved again once the entry has expired. */
+        usleep(2000);
+        resolve_localhost(NULL, (void *)on_expired_complete);
+    } else {
+        ASSERT_EQ(resolve_count, 2);
+        exit(0);
+    }
+}
+
+TEST(resolver_ttl_expiry)
+{
+    async_init(&async);
+    async_set_runtime(&async, async_runtime_create());
+    async_resolver_init(&resolver);
+    async_resolver_set_resolve(&resolver, resolve);
+    resolver.ttl_ms = 1;
+    async_call(&async,
+               resolve_localhost,
+               NULL,
+               (void *)on_expired_complete);
+    async_run_forever(&async);
+}
+
+TEST(resolver_lru_eviction)
+{
+    struct async_resolver_result_t result;
+    char host[16];
+    int i;
+
+    async_resolver_init(&resolver);
+    ASSERT_EQ(resolve("localhost.test", &result), 0);
+
+    for (i = 0; i < ASYNC_RESOLVER_CACHE_LENGTH; i++) {
+        sprintf(&host[0], "host-%d", i);
+        async_resolver_insert(&resolver, &host[0], &result);
+    }
+
+    ASSERT_EQ(resolver.length, ASYNC_RESOLVER_CACHE_LENGTH);
+
+    /* The least recently used entry, host-1, is replaced when full. */
+    ASSERT(async_resolver_lookup(&resolver, "host-0", 80, &result));
+    async_resolver_insert(&resolver, "host-new", &result);
+    ASSERT_EQ(resolver.length, ASYNC_RESOLVER_CACHE_LENGTH);
+    ASSERT(!async_resolver_lookup(&resolver, "host-1", 80, &result));
+    ASSERT(async_resolver_lookup(&resolver, "host-new", 80, &result));
+    assert_localhost(&result, 80);
+    ASSERT(async_resolver_lookup(&resolver, "host-0", 80, &result));
+
+    for (i = 2; i < ASYNC_RESOLVER_CACHE_LENGTH; i++) {
+        sprintf(&host[0], "host-%d", i);
+        ASSERT(async_resolver_lookup(&resolver, &host[0], 80, &result));
+    }
+}
+
+typedef void (*runtime_test_t)(struct async_runtime_t *runtime_p,
+                               struct async_resolver_t *resolver_p);
+
+static void run_linux(runtime_test_t test)
+{
+    struct async_runtime_t *runtime_p;
+
+    runtime_p = async_runtime_linux_create();
+    test(runtime_p, async_runtime_linux_get_resolver(runtime_p));
+}
+
+static void run_linux_st(runtime_test_t test)
+{
+    struct async_runtime_t *runtime_p;
+
+    runtime_p = async_runtime_linux_st_create();
+    test(runtime_p, async_runtime_linux_st_get_resolver(runtime_p));
+}
+
+/* Skipped if io_uring is not supported by the kernel. */
+static void run_linux_uring(runtime_test_t test)
+{
+    struct async_runtime_t *runtime_p;
+
+    runtime_p = async_runtime_linux_uring_create();
+
+    if (runtime_p == NULL) {
+        return;
+    }
+
+    test(runtime_p, async_runtime_linux_uring_get_resolver(runtime_p));
+}
+
+static void on_resolve_failure_connected(struct async_tcp_client_t *tcp_p,
+                                         int res)
+{
+    (void)tcp_p;
+
+    ASSERT_EQ(res, -1);
+    ASSERT_EQ(resolve_count, 1);
+    exit(0);
+}
+
+static void test_tcp_client_resolve_failure(struct async_runtime_t *runtime_p,
+                                            struct async_resolver_t *resolver_p)
+{
+    struct async_tcp_client_t tcp;
+
+    async_init(&async);
+    async_set_runtime(&async, runtime_p);
+    async_resolver_set_resolve(resolver_p, resolve);
+    async_tcp_client_init(&tcp,
+                          on_resolve_failure_connected,
+                          NULL,
+                          NULL,
+                          &async);
+    async_tcp_client_connect(&tcp, "fail.test", 9993);
+    async_run_forever(&async);
+}
+
+TEST(tcp_client_resolve_failure)
+{
+    run_linux(test_tcp_client_resolve_failure);
+}
+
+TEST(tcp_client_resolve_failure_linux_st)
+{
+    run_linux_st(test_tcp_client_resolve_failure);
+}
+
+TEST(tcp_client_resolve_failure_linux_uring)
+{
+    run_linux_uring(test_tcp_client_resolve_failure);
+}
+
+static bool in_connect;
+
+static void on_host_too_long_connected(struct async_tcp_client_t *tcp_p,
+                                       int res)
+{
+    (void)tcp_p;
+
+    ASSERT_EQ(res, -1);
+    ASSERT_EQ(in_connect, false);
+    exit(0);
+}
+
+/* Fails before resolving, but still reported by a later call. */
+static void test_tcp_client_host_too_long(struct async_runtime_t *runtime_p,
+                                          struct async_resolver_t *resolver_p)
+{
+    struct async_tcp_client_t tcp;
+    char host[ASYNC_RESOLVER_HOST_MAX + 1];
+
+    memset(&host[0], 'a', sizeof(host) - 1);
+    host[sizeof(host) - 1] = '\0';
+    async_init(&async);
+    async_set_runtime(&async, runtime_p);
+    async_resolver_set_resolve(resolver_p, resolve);
+    async_tcp_client_init(&tcp,
+                          on_host_too_long_connected,
+                          NULL,
+                          NULL,
+                          &async);
+    in_connect = true;
+    async_tcp_client_connect(&tcp, &host[0], 9993);
+    in_connect = false;
+    async_run_forever(&async);
+}
+
+TEST(tcp_client_host_too_long)
+{
+    run_linux(test_tcp_client_host_too_long);
+}
+
+TEST(tcp_client_host_too_long_linux_st)
+{
+    run_linux_st(test_tcp_client_host_too_long);
+}
+
+TEST(tcp_client_host_too_long_linux_uring)
+{
+    run_linux_uring(test_tcp_client_host_too_long);
+}
+
+static int listener_create(const char *address_p, int port, int backlog)
+{
+    int sock;
+    struct sockaddr_in addr;
+    int yes;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_aton(address_p, (struct in_addr *)&addr.sin_addr.s_addr);
+
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    yes = 1;
+    ASSERT_EQ(setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)), 0);
+    ASSERT_EQ(bind(sock, &addr, sizeof(addr)), 0);
+    ASSERT_EQ(listen(sock, backlog), 0);
+
+    return (sock);
+}
+
+static void on_fallback_connected(struct async_tcp_client_t *tcp_p, int res)
+{
+    (void)tcp_p;
+
+    ASSERT_EQ(res, 0);
+    exit(0);
+}
+
+static void test_tcp_client_address_fallback(
+    struct async_runtime_t *runtime_p,
+    struct async_resolver_t *resolver_p)
+{
+    struct async_tcp_client_t tcp;
+
+    /* Only listening on the IPv4 address, so connecting to the first,
+       IPv6, address fails. */
+    listener_create("127.0.0.1", 9992, 5);
+    async_init(&async);
+    async_set_runtime(&async, runtime_p);
+    async_resolver_set_resolve(resolver_p, resolve);
+    async_tcp_client_init(&tcp, on_fallback_connected, NULL, NULL, &async);
+    async_tcp_client_connect(&tcp, "localhost.test", 9992);
+    async_run_forever(&async);
+}
+
+TEST(tcp_client_address_fallback)
+{
+    run_linux(test_tcp_client_address_fallback);
+}
+
+TEST(tcp_client_address_fallback_linux_st)
+{
+    run_linux_st(test_tcp_client_address_fallback);
+}
+
+TEST(tcp_client_address_fallback_linux_uring)
+{
+    run_linux_uring(test_tcp_client_address_fallback);
+}
+
+static void test_tcp_client_address_fallback_timeout(
+    struct async_runtime_t *runtime_p,
+    struct async_resolver_t *resolver_p)
+{
+    struct async_tcp_client_t tcp;
+    struct sockaddr_in addr;
+    int sock;
+    int i;
+
+    /* Connections to the first address are not accepted once the
+       backlog is full, so connecting to it times out. */
+    listener_create("127.0.0.2", 9991, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(9991);
+    inet_aton("127.0.0.2", (struct in_addr *)&addr.sin_addr.s_addr);
+
+    for (i = 0; i < 4; i++) {
+        sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        connect(sock, &addr, sizeof(addr));
+    }
+
+    listener_create("127.0.0.1", 9991, 5);
+    async_init(&async);
+    async_set_runtime(&async, runtime_p);
+    async_resolver_set_resolve(resolver_p, resolve);
+    async_tcp_client_init(&tcp, on_fallback_connected, NULL, NULL, &async);
+    async_tcp_client_set_connect_timeout(&tcp, 50);
+    async_tcp_client_connect(&tcp, "blackhole.test", 9991);
+    async_run_forever(&async);
+}
+
+TEST(tcp_client_address_fallback_timeout)
+{
+    run_linux(test_tcp_client_address_fallback_timeout);
+}
+
+TEST(tcp_client_address_fallback_timeout_linux_st)
+{
+    run_linux_st(test_tcp_client_address_fallback_timeout);
+}
+
+TEST(tcp_client_address_fallback_timeout_linux_uring)
+{
+    run_linux_uring(test_tcp_client_address_fallback_timeout);
+}
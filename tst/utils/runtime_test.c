@@ -40,7 +40,11 @@ static struct async_runtime_t runtime = {
         .connect = runtime_test_tcp_client_connect,
         .disconnect = runtime_test_tcp_client_disconnect,
         .write = runtime_test_tcp_client_write,
-        .read = runtime_test_tcp_client_read
+        .writev = runtime_test_tcp_client_writev,
+        .is_writable = runtime_test_tcp_client_is_writable,
+        .read = runtime_test_tcp_client_read,
+        .borrow = runtime_test_tcp_client_borrow,
+        .release = runtime_test_tcp_client_release
     },
     .tcp_server = {
         .init = runtime_test_tcp_server_init,
@@ -50,6 +54,8 @@ static struct async_runtime_t runtime = {
         .client = {
             .write = runtime_test_tcp_server_client_write,
             .read = runtime_test_tcp_server_client_read,
+            .borrow = runtime_test_tcp_server_client_borrow,
+            .release = runtime_test_tcp_server_client_release,
             .disconnect = runtime_test_tcp_server_client_disconnect
         }
     }
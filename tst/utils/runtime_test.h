@@ -50,10 +50,22 @@ void runtime_test_tcp_client_write(struct async_tcp_client_t *self_p,
                                    const void *buf_p,
                                    size_t size);
 
+void runtime_test_tcp_client_writev(struct async_tcp_client_t *self_p,
+                                    const struct async_iovec_t *iov_p,
+                                    int length);
+
+bool runtime_test_tcp_client_is_writable(struct async_tcp_client_t *self_p);
+
 size_t runtime_test_tcp_client_read(struct async_tcp_client_t *self_p,
                                     void *buf_p,
                                     size_t size);
 
+size_t runtime_test_tcp_client_borrow(struct async_tcp_client_t *self_p,
+                                      const uint8_t **buf_pp);
+
+void runtime_test_tcp_client_release(struct async_tcp_client_t *self_p,
+                                     size_t size);
+
 struct async_runtime_t *runtime_test_create(void);
 
 void runtime_test_tcp_server_init(
@@ -79,6 +91,14 @@ size_t runtime_test_tcp_server_client_read(struct async_tcp_server_client_t *sel
                                            void *buf_p,
                                            size_t size);
 
+size_t runtime_test_tcp_server_client_borrow(
+    struct async_tcp_server_client_t *self_p,
+    const uint8_t **buf_pp);
+
+void runtime_test_tcp_server_client_release(
+    struct async_tcp_server_client_t *self_p,
+    size_t size);
+
 void runtime_test_tcp_server_client_disconnect(
     struct async_tcp_server_client_t *self_p);
 
@@ -88,6 +88,26 @@ void runtime_test_tcp_client_write(struct async_tcp_client_t *self_p,
     FAIL("This function must be mocked.");
 }
 
+void runtime_test_tcp_client_writev(struct async_tcp_client_t *self_p,
+                                    const struct async_iovec_t *iov_p,
+                                    int length)
+{
+    (void)self_p;
+    (void)iov_p;
+    (void)length;
+
+    FAIL("This function must be mocked.");
+}
+
+bool runtime_test_tcp_client_is_writable(struct async_tcp_client_t *self_p)
+{
+    (void)self_p;
+
+    FAIL("This function must be mocked.");
+
+    return (false);
+}
+
 size_t runtime_test_tcp_client_read(struct async_tcp_client_t *self_p,
                                     void *buf_p,
                                     size_t size)
@@ -101,6 +121,26 @@ size_t runtime_test_tcp_client_read(struct async_tcp_client_t *self_p,
     return (0);
 }
 
+size_t runtime_test_tcp_client_borrow(struct async_tcp_client_t *self_p,
+                                      const uint8_t **buf_pp)
+{
+    (void)self_p;
+    (void)buf_pp;
+
+    FAIL("This function must be mocked.");
+
+    return (0);
+}
+
+void runtime_test_tcp_client_release(struct async_tcp_client_t *self_p,
+                                     size_t size)
+{
+    (void)self_p;
+    (void)size;
+
+    FAIL("This function must be mocked.");
+}
+
 void runtime_test_tcp_server_init(
     struct async_tcp_server_t *self_p,
     const char *host_p,
@@ -168,6 +208,28 @@ size_t runtime_test_tcp_server_client_read(struct async_tcp_server_client_t *sel
     return (0);
 }
 
+size_t runtime_test_tcp_server_client_borrow(
+    struct async_tcp_server_client_t *self_p,
+    const uint8_t **buf_pp)
+{
+    (void)self_p;
+    (void)buf_pp;
+
+    FAIL("This function must be mocked.");
+
+    return (0);
+}
+
+void runtime_test_tcp_server_client_release(
+    struct async_tcp_server_client_t *self_p,
+    size_t size)
+{
+    (void)self_p;
+    (void)size;
+
+    FAIL("This function must be mocked.");
+}
+
 void runtime_test_tcp_server_client_disconnect(struct async_tcp_server_client_t *self_p)
 {
     (void)self_p;
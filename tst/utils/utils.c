@@ -75,3 +75,28 @@ void mqtt_on_publish(void *obj_p,
 
     FAIL("This function must be mocked.");
 }
+
+void mqtt_on_publish_complete(void *obj_p, uint16_t packet_identifier)
+{
+    (void)obj_p;
+    (void)packet_identifier;
+
+    FAIL("This function must be mocked.");
+}
+
+void mqtt_on_publish_chunk(void *obj_p,
+                           const char *topic_p,
+                           const uint8_t *buf_p,
+                           size_t size,
+                           size_t offset,
+                           size_t total_size)
+{
+    (void)obj_p;
+    (void)topic_p;
+    (void)buf_p;
+    (void)size;
+    (void)offset;
+    (void)total_size;
+
+    FAIL("This function must be mocked.");
+}
@@ -26,4 +26,13 @@ void mqtt_on_publish(void *obj_p,
                      const uint8_t *buf_p,
                      size_t size);
 
+void mqtt_on_publish_complete(void *obj_p, uint16_t packet_identifier);
+
+void mqtt_on_publish_chunk(void *obj_p,
+                           const char *topic_p,
+                           const uint8_t *buf_p,
+                           size_t size,
+                           size_t offset,
+                           size_t total_size);
+
 #endif